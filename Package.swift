@@ -63,7 +63,9 @@ let package = Package(
         ),
         .testTarget(
             name: "ComputeTests",
-            dependencies: ["Compute", .product(name: "Algorithms", package: "swift-algorithms")],
+            dependencies: [
+                "Compute", "ComputeTestsSupport", .product(name: "Algorithms", package: "swift-algorithms"),
+            ],
             swiftSettings: [.interoperabilityMode(.Cxx)],
             linkerSettings: [.linkedLibrary("swiftDemangle")]
         ),
@@ -72,7 +74,24 @@ let package = Package(
             dependencies: ["Utilities", "EquatableSupport"],
             cxxSettings: [.headerSearchPath("")]
         ),
+        .swiftRuntimeTarget(
+            name: "ComputeTestsSupport",
+            dependencies: ["ComputeCxx", "Utilities"],
+            cxxSettings: [.headerSearchPath("../ComputeCxx")]
+        ),
         .target(name: "EquatableSupport"),
+        .executableTarget(
+            name: "ComputeBenchmarks",
+            dependencies: ["Compute", "ComputeBenchmarksSupport"],
+            cxxSettings: [.headerSearchPath("../ComputeCxx")],
+            swiftSettings: [.interoperabilityMode(.Cxx)],
+            linkerSettings: [.linkedLibrary("swiftDemangle")]
+        ),
+        .swiftRuntimeTarget(
+            name: "ComputeBenchmarksSupport",
+            dependencies: ["ComputeCxx", "Utilities"],
+            cxxSettings: [.headerSearchPath("../ComputeCxx")]
+        ),
     ],
     cxxLanguageStandard: .cxx20
 )
@@ -44,7 +44,12 @@ public struct Attribute<Value> {
     }
 
     public func applying<Member>(offset: PointerOffset<Value, Member>) -> Attribute<Member> {
-        fatalError("not implemented")
+        let identifier = __AGGraphCreateOffsetAttribute(
+            identifier,
+            UInt32(offset.byteOffset),
+            UInt64(MemoryLayout<Member>.size)
+        )
+        return Attribute<Member>(identifier: identifier)
     }
 
     public func breadthFirstSearch(options: SearchOptions, _ predicate: (AnyAttribute) -> Bool) -> Bool {
@@ -160,7 +165,7 @@ public struct Attribute<Value> {
     }
 
     public subscript<Member>(dynamicMember keyPath: KeyPath<Value, Member>) -> Attribute<Member> {
-        fatalError("not implemented")
+        return Attribute<Member>(Focus(root: self, keyPath: keyPath))
     }
 
 }
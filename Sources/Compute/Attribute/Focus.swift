@@ -10,6 +10,30 @@ public struct Focus<Root, Value> {
 
 }
 
+extension Focus {
+
+    /// The offset of the value in the root's value if `keyPath` is a path of stored properties, in which case the
+    /// value can be read in place rather than computed.
+    public var offset: PointerOffset<Root, Value>? {
+        return MemoryLayout<Root>.offset(of: keyPath).map { PointerOffset(byteOffset: $0) }
+    }
+
+}
+
+extension Attribute {
+
+    /// Creates an offset attribute of `focus.root` when `focus.keyPath` is a path of stored properties, so the value
+    /// is never copied out of the root and is compared in place. Creates a rule attribute for any other key path.
+    public init<Root>(_ focus: Focus<Root, Value>) {
+        if let offset = focus.offset {
+            self = focus.root.applying(offset: offset)
+        } else {
+            self.init(focus, initialValue: nil)
+        }
+    }
+
+}
+
 extension Focus: Rule {
 
     public var value: Value {
@@ -10,8 +10,14 @@ extension Graph {
         fatalError("not implemented")
     }
 
+    /// Calls `body` with `deadline`, in mach absolute time units, as the graph's deadline. Interruptible updates made
+    /// meanwhile, such as `updateDirtyAttributes()`, stop between two attributes once it has passed and leave the rest
+    /// dirty for the next update.
     public func withDeadline<T>(_ deadline: UInt64, _ body: () -> T) -> T {
-        fatalError("not implemented")
+        let oldDeadline = self.deadline
+        self.deadline = deadline
+        defer { self.deadline = oldDeadline }
+        return body()
     }
 
     public func withoutUpdate<T>(_ body: () -> T) -> T {
@@ -22,8 +28,36 @@ extension Graph {
         fatalError("not implemented")
     }
 
+    /// Calls `do` with `body` as the main thread handler. When nodes are updated in parallel off the main thread,
+    /// rules that aren't thread-safe are run by passing them to `body`, which must run them on the main thread
+    /// before returning.
     public func withMainThreadHandler(_ body: (() -> Void) -> Void, do: () -> Void) {
-        fatalError("not implemented")
+        struct Context {
+            var handler: (() -> Void) -> Void
+            var body: () -> Void
+        }
+
+        withoutActuallyEscaping(body) { escapingHandler in
+            withoutActuallyEscaping(`do`) { escapingBody in
+                var context = Context(handler: escapingHandler, body: escapingBody)
+                withUnsafeMutablePointer(to: &context) { contextPointer in
+                    __AGGraphWithMainThreadHandler(
+                        self,
+                        { context in
+                            guard let context = context?.assumingMemoryBound(to: Context.self).pointee else {
+                                return
+                            }
+                            context.body()
+                        }, contextPointer,
+                        { thunk, thunkContext, context in
+                            guard let context = context?.assumingMemoryBound(to: Context.self).pointee else {
+                                return
+                            }
+                            context.handler { thunk(thunkContext) }
+                        }, contextPointer)
+                }
+            }
+        }
     }
 
 }
@@ -31,20 +65,35 @@ extension Graph {
 extension Graph {
 
     public static func startProfiling() {
-        fatalError("not implemented")
+        __AGGraphStartProfiling()
     }
 
     public static func stopProfiling() {
-        fatalError("not implemented")
+        __AGGraphStopProfiling()
     }
 
     public static func markProfile(name: UnsafePointer<Int8>) {
-        fatalError("not implemented")
-
+        __AGGraphMarkProfile(name)
     }
 
     public static func resetProfile() {
-        fatalError("not implemented")
+        __AGGraphResetProfile()
+    }
+
+    /// The updates and comparisons counted since profiling started, by attribute type, marked sections first.
+    public static var profileEntries: [ProfileEntry] {
+        var capacity = __AGGraphCopyProfileEntries(nil, 0)
+        while true {
+            let entries = [ProfileEntry](unsafeUninitializedCapacity: capacity) { buffer, initializedCount in
+                let count = __AGGraphCopyProfileEntries(buffer.baseAddress, capacity)
+                initializedCount = min(count, capacity)
+                capacity = count
+            }
+            // entries may have been added between the two calls
+            if entries.count == capacity {
+                return entries
+            }
+        }
     }
 
 }
@@ -52,11 +101,13 @@ extension Graph {
 extension Graph {
 
     public func addTraceEvent<T>(_ event: UnsafePointer<Int8>, value: T) {
-        fatalError("not implemented")
+        withUnsafePointer(to: value) { valuePointer in
+            __AGGraphAddTraceEvent(self, event, valuePointer, Metadata(T.self))
+        }
     }
 
     public func addTraceEvent<T>(_ event: UnsafePointer<Int8>, context: UnsafePointer<T>) {
-        fatalError("not implemented")
+        __AGGraphAddTraceEvent(self, event, context, Metadata(T.self))
     }
 
 }
@@ -68,11 +119,18 @@ extension Graph {
     }
 
     public func archiveJSON(name: String?) {
-        fatalError("not implemented")
+        __AGGraphArchiveJSON(self, name)
     }
 
     public func graphvizDescription(includeValues: Bool) -> String {
-        fatalError("not implemented")
+        var bytes: [UInt8] = []
+        withUnsafeMutablePointer(to: &bytes) { bytesPointer in
+            __AGGraphDescribe(self, .graphviz, includeValues ? .includeValues : [], { chunk, size, context in
+                let bytes = context!.assumingMemoryBound(to: [UInt8].self)
+                bytes.pointee.append(contentsOf: UnsafeRawBufferPointer(start: chunk, count: size))
+            }, bytesPointer)
+        }
+        return String(decoding: bytes, as: UTF8.self)
     }
 
     public static func printStack(maxFrames: Int) {
@@ -92,3 +150,20 @@ extension Graph: @retroactive Equatable {
     }
 
 }
+
+extension GraphMemoryStats: @retroactive CustomStringConvertible {
+
+    public var description: String {
+        return "\(node_count) node values, \(node_value_bytes) bytes"
+    }
+
+}
+
+extension DataTableStats: @retroactive CustomStringConvertible {
+
+    public var description: String {
+        return
+            "\(used_bytes) of \(region_bytes) bytes used in \(page_size)-byte pages, \(reusable_bytes) bytes reusable, \(page_cache_hits) page cache hits, \(page_cache_misses) misses"
+    }
+
+}
@@ -16,18 +16,69 @@ extension Subgraph {
 
 }
 
+extension Subgraph {
+
+    /// Runs `body`, then releases everything allocated in this subgraph's memory while it ran in one step. `body`
+    /// must not create attributes in this subgraph.
+    public func withScratchAllocations<T>(_ body: () throws -> T) rethrows -> T {
+        __AGSubgraphBeginScratchAllocations(self)
+        defer {
+            __AGSubgraphEndScratchAllocations(self)
+        }
+        return try body()
+    }
+
+}
+
+extension Subgraph {
+
+    /// Creates an attribute of the attribute type `typeID` for each of `bodies`, with one allocation in this
+    /// subgraph's memory for each page of nodes.
+    public func addAttributes<Body>(type typeID: UInt32, bodies: [Body]) -> [AnyAttribute] {
+        return bodies.withUnsafeBufferPointer { buffer in
+            [AnyAttribute](unsafeUninitializedCapacity: buffer.count) { attributes, initializedCount in
+                __AGSubgraphAddAttributes(
+                    self,
+                    typeID,
+                    UnsafeRawPointer(buffer.baseAddress),
+                    MemoryLayout<Body>.stride,
+                    UInt32(buffer.count),
+                    attributes.baseAddress
+                )
+                initializedCount = buffer.count
+            }
+        }
+    }
+
+}
+
 extension Subgraph {
 
     public func addTreeValue<Value>(_ attribute: Attribute<Value>, forKey key: UnsafePointer<Int8>, flags: UInt32) {
-        fatalError("not implemented")
+        __AGSubgraphAddTreeValue(self, attribute.identifier, Metadata(Value.self), key, flags)
     }
 
     public func beginTreeElement<Value>(value: Attribute<Value>, flags: UInt32) {
-        fatalError("not implemented")
+        __AGSubgraphBeginTreeElement(self, value.identifier, Metadata(Value.self), flags)
     }
 
     public func endTreeElement<Value>(value: Attribute<Value>) {
-        fatalError("not implemented")
+        __AGSubgraphEndTreeElement(self, value.identifier)
+    }
+
+    /// The root of the subgraph's attribute tree, the first element that began.
+    public var treeRoot: TreeElement? {
+        let root = __AGSubgraphGetTreeRoot(self)
+        return root.rawValue == 0 ? nil : root
+    }
+
+}
+
+extension SubgraphMemoryStats: @retroactive CustomStringConvertible {
+
+    public var description: String {
+        return
+            "\(page_count) pages, \(page_bytes) bytes, \(free_fragment_count) free fragments, \(free_fragment_bytes) free bytes, \(persistent_buffer_count) persistent buffers, \(persistent_bytes) persistent bytes"
     }
 
 }
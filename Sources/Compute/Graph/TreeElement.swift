@@ -1,35 +1,120 @@
 import ComputeCxx
 
-public struct TreeElement {}
-
 extension TreeElement {
 
+    fileprivate init?(_ element: TreeElement) {
+        guard element.rawValue != 0 else {
+            return nil
+        }
+        self = element
+    }
+
     public var value: AnyAttribute? {
-        fatalError("not implemented")
+        let value = __AGTreeElementGetValue(self)
+        return value == .nil ? nil : value
+    }
+
+    public var parent: TreeElement? {
+        return TreeElement(__AGTreeElementGetParent(self))
+    }
+
+    /// The attributes created while the element was open.
+    public var nodes: Nodes {
+        return Nodes(element: self)
+    }
+
+    public var children: Children {
+        return Children(next: TreeElement(__AGTreeElementGetFirstChild(self)))
+    }
+
+    public var values: Values {
+        return Values(next: TreeValue(__AGTreeElementGetFirstValue(self)))
+    }
+
+    /// Calls `body` with this element and each of its descendants in preorder. Faster than walking `children`
+    /// recursively, since the whole walk happens in one call.
+    public func forEachDescendant(_ body: (TreeElement) -> Void) {
+        withoutActuallyEscaping(body) { escapingBody in
+            var body = escapingBody
+            withUnsafeMutablePointer(to: &body) { bodyPointer in
+                __AGTreeElementForEachDescendant(
+                    self,
+                    { descendant, context in
+                        context?.assumingMemoryBound(to: ((TreeElement) -> Void).self).pointee(descendant)
+                    }, bodyPointer)
+            }
+        }
     }
 
 }
 
-struct Nodes: Sequence, IteratorProtocol {
+extension TreeValue {
 
-    public func next() -> AnyAttribute? {
-        fatalError("not implemented")
+    fileprivate init?(_ treeValue: TreeValue) {
+        guard treeValue.rawValue != 0 else {
+            return nil
+        }
+        self = treeValue
     }
 
 }
 
-struct Children: Sequence, IteratorProtocol {
+/// Iterates the nodes of a tree element in the order they were created.
+public struct Nodes: Sequence, IteratorProtocol {
+
+    private let element: TreeElement
+    private let count: UInt32
+    private var index: UInt32 = 0
+
+    fileprivate init(element: TreeElement) {
+        self.element = element
+        self.count = __AGTreeElementGetNodeCount(element)
+    }
+
+    public mutating func next() -> AnyAttribute? {
+        guard index < count else {
+            return nil
+        }
+        defer { index += 1 }
+        return __AGTreeElementGetNode(element, index)
+    }
+
+}
+
+/// Iterates the children of a tree element in the order they began.
+public struct Children: Sequence, IteratorProtocol {
+
+    fileprivate var nextElement: TreeElement?
+
+    fileprivate init(next: TreeElement?) {
+        self.nextElement = next
+    }
 
     public mutating func next() -> TreeElement? {
-        fatalError("not implemented")
+        guard let element = nextElement else {
+            return nil
+        }
+        nextElement = TreeElement(__AGTreeElementGetNextSibling(element))
+        return element
     }
 
 }
 
-struct Values: Sequence, IteratorProtocol {
+/// Iterates the values of a tree element in the order they were added.
+public struct Values: Sequence, IteratorProtocol {
+
+    fileprivate var nextValue: TreeValue?
+
+    fileprivate init(next: TreeValue?) {
+        self.nextValue = next
+    }
 
-    public func next() -> TreeElement? {
-        fatalError("not implemented")
+    public mutating func next() -> TreeValue? {
+        guard let treeValue = nextValue else {
+            return nil
+        }
+        nextValue = TreeValue(__AGTreeValueGetNext(treeValue))
+        return treeValue
     }
 
 }
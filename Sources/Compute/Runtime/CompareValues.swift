@@ -1,21 +1,42 @@
-public enum ComparisonMode {
+import ComputeCxx
 
+public enum ComparisonMode: UInt16 {
+    case `default` = 0
 }
 
 public struct ComparisonOptions {
-    
+
+    public var rawValue: UInt32
+
+    public init(rawValue: UInt32) {
+        self.rawValue = rawValue
+    }
+
     init(mode: ComparisonMode) {
-        fatalError("not implemented")
+        self.init(rawValue: UInt32(mode.rawValue))
     }
-    
+
 }
 
 func compareValues<Value>(_ lhs: Value, _ rhs: Value, mode: ComparisonMode) -> Bool {
-    fatalError("not implemented")
+    return compareValues(lhs, rhs, mode: ComparisonOptions(mode: mode))
 }
 
 func compareValues<Value>(_ lhs: Value, _ rhs: Value, mode: ComparisonOptions) -> Bool {
-    fatalError("not implemented")
+    return withUnsafePointer(to: lhs) { lhsPointer in
+        withUnsafePointer(to: rhs) { rhsPointer in
+            AGCompareValues(lhsPointer, rhsPointer, Metadata(Value.self), AGComparisonOptions(rawValue: mode.rawValue))
+        }
+    }
 }
 
+func hashValue<Value>(_ value: Value, mode: ComparisonMode) -> UInt64 {
+    return hashValue(value, mode: ComparisonOptions(mode: mode))
+}
 
+/// A hash of `value` that is the same for values `compareValues` finds equal with the same options.
+func hashValue<Value>(_ value: Value, mode: ComparisonOptions) -> UInt64 {
+    return withUnsafePointer(to: value) { valuePointer in
+        AGHashValue(valuePointer, Metadata(Value.self), AGComparisonOptions(rawValue: mode.rawValue))
+    }
+}
@@ -0,0 +1,425 @@
+import Compute
+import ComputeBenchmarksSupport
+import Foundation
+
+// Representative value types for layouts, comparisons and the shared caches.
+
+private struct Point {
+    var x: Double
+    var y: Double
+}
+
+private final class Box {
+    var value = 0
+}
+
+private struct Mixed {
+    var id: Int
+    var name: String
+    var origin: Point
+    var flags: UInt8
+    var box: Box
+    var tags: [String]
+}
+
+private enum Shape {
+    case empty
+    case point(Point)
+    case named(String, Point)
+    case nested(Mixed)
+}
+
+private struct Nested {
+    var first: Mixed
+    var second: Mixed?
+    var shape: Shape
+    var points: (Point, Point, Point, Point)
+}
+
+/// Tuple types whose layouts haven't been built yet, for measuring layouts built from cold. Each is a `String`
+/// followed by eight `Int`, `Double` or `Bool` elements, so there are 6561 of them before they repeat.
+private struct FreshTypes {
+    private var next = 0
+
+    mutating func make(_ count: Int) -> [Metadata] {
+        let elementTypes: [Any.Type] = [Int.self, Double.self, Bool.self]
+        return (0..<count).map { _ in
+            var elements: [Any.Type] = [String.self]
+            var digits = next
+            for _ in 0..<8 {
+                elements.append(elementTypes[digits % 3])
+                digits /= 3
+            }
+            next += 1
+            return Metadata(TupleType(elements).type)
+        }
+    }
+}
+
+extension Harness {
+
+    mutating func runAllocatorBenchmarks() {
+        for size in [16, 64, 256] {
+            measure("zone.alloc_bytes.\(size)", operations: 100_000) {
+                AGBenchmarkZoneAllocBytes(100_000, UInt32(size), false)
+            }
+            measure("zone.alloc_bytes.templated.\(size)", operations: 100_000) {
+                AGBenchmarkZoneAllocBytes(100_000, UInt32(size), true)
+            }
+            measure("zone.alloc_bytes_recycle.churn.\(size)", operations: 4 * 10_000) {
+                AGBenchmarkZoneRecycleChurn(10_000, UInt32(size))
+            }
+        }
+        for pages in [1, 4] {
+            measure("table.alloc_page.fragmented.\(pages)", operations: 10_000) {
+                AGBenchmarkTableAllocPagesFragmented(10_000, UInt32(pages))
+            }
+        }
+    }
+
+    mutating func runHashTableBenchmarks() {
+        let kinds: [(String, AGBenchmarkTableKind)] = [
+            ("untyped_table", .chained),
+            ("flat_table", .flat),
+        ]
+        let keySets: [(String, AGBenchmarkTableKeys)] = [
+            ("", .pointers),
+            (".strings", .strings),
+        ]
+        for count in [1_000, 100_000, 1_000_000] {
+            for (kindName, kind) in kinds {
+                for (keysName, keys) in keySets {
+                    let table = AGBenchmarkTableCreate(kind, keys, UInt32(count))
+                    measure("\(kindName).insert\(keysName).\(count)", operations: count) {
+                        AGBenchmarkTableInsert(table)
+                    }
+                    measure("\(kindName).lookup\(keysName).\(count)", operations: count) {
+                        AGBenchmarkTableLookup(table, UInt32(count))
+                    }
+                    AGBenchmarkTableDestroy(table)
+                }
+            }
+        }
+    }
+
+    mutating func runLayoutBenchmarks() {
+        let types: [(String, Any.Type)] = [
+            ("Int", Int.self),
+            ("String", String.self),
+            ("Point", Point.self),
+            ("Mixed", Mixed.self),
+            ("Shape", Shape.self),
+            ("Nested", Nested.self),
+        ]
+        for (name, type) in types {
+            measure("layout.make_layout.\(name)", operations: 100) {
+                AGBenchmarkMakeLayout(Metadata(type), 100)
+            }
+            measure("type.apply_fields.\(name)", operations: 10_000) {
+                AGBenchmarkTypeApplyFields(Metadata(type), 10_000)
+            }
+        }
+
+        // Large plain data, with and without padding between the fields
+        for pairs in [4, 16, 64, 256] {
+            measure("layout.make_layout.pod.\(pairs * 16)", operations: 100) {
+                AGBenchmarkMakeLayout(Metadata(TupleType(Array(repeating: Int.self, count: pairs * 2)).type), 100)
+            }
+            measure("layout.make_layout.padded.\(pairs * 16)", operations: 100) {
+                AGBenchmarkMakeLayout(Metadata(paddedTupleType(pairs: pairs).type), 100)
+            }
+        }
+    }
+
+    mutating func runPrefetchBenchmarks() {
+        var freshTypes = FreshTypes()
+        var types: [Metadata] = []
+        let count = 64
+        let priorities = [UInt32](repeating: 0, count: count)
+
+        measure("layout.prefetch.batch.\(count)", operations: count, setUp: { types = freshTypes.make(count) }) {
+            let group = DispatchGroup()
+            AGPrefetchCompareValuesBatch(types, priorities, count, [], group)
+            group.wait()
+            return UInt64(types.count)
+        }
+        measure("layout.prefetch.single.\(count)", operations: count, setUp: { types = freshTypes.make(count) }) {
+            var result: UInt64 = 0
+            for type in types {
+                result &+= UInt64(UInt(bitPattern: AGPrefetchCompareValues(type, [], 0)))
+            }
+            // Waits for the layouts queued one at a time, which the batch finds already in flight
+            let group = DispatchGroup()
+            AGPrefetchCompareValuesBatch(types, priorities, count, [], group)
+            group.wait()
+            return result
+        }
+
+        // The same layouts built one after another on this thread, the baseline for the background workers
+        measure("layout.fetch.synchronous.\(count)", operations: count, setUp: { types = freshTypes.make(count) }) {
+            var result: UInt64 = 0
+            for type in types {
+                result &+= UInt64(UInt(bitPattern: AGPrefetchCompareValues(type, [.fetchLayoutsSynchronously], 0)))
+            }
+            return result
+        }
+    }
+
+    /// A tuple of `pairs` pairs of an `Int32` and an `Int`, so that each pair has 4 bytes of padding in its middle.
+    private func paddedTupleType(pairs: Int) -> TupleType {
+        TupleType(Array(repeating: [Int32.self, Int.self] as [Any.Type], count: pairs).flatMap { $0 })
+    }
+
+    mutating func runComparisonBenchmarks() {
+        let options: AGComparisonOptions = [.fetchLayoutsSynchronously]
+
+        // Equal values of every size, so that each comparison looks at all the bytes
+        for count in [1, 4, 16, 64, 256, 1024] {
+            let type = Metadata(TupleType(Array(repeating: Int.self, count: count)).type)
+            let lhs = UnsafeMutableRawPointer.allocate(byteCount: count * 8, alignment: 8)
+            let rhs = UnsafeMutableRawPointer.allocate(byteCount: count * 8, alignment: 8)
+            lhs.initializeMemory(as: UInt8.self, repeating: 0x5a, count: count * 8)
+            rhs.initializeMemory(as: UInt8.self, repeating: 0x5a, count: count * 8)
+            measure("compare_values.bytes.\(count * 8)", operations: 10_000) {
+                var equal: UInt64 = 0
+                for _ in 0..<10_000 where AGCompareValues(lhs, rhs, type, options) {
+                    equal += 1
+                }
+                return equal
+            }
+            measure("hash_value.bytes.\(count * 8)", operations: 10_000) {
+                var hash: UInt64 = 0
+                for _ in 0..<10_000 {
+                    hash &+= AGHashValue(lhs, type, options)
+                }
+                return hash
+            }
+            lhs.deallocate()
+            rhs.deallocate()
+        }
+
+        // Equal values with padding, which the layout skips
+        for pairs in [4, 16, 64, 256] {
+            let type = Metadata(paddedTupleType(pairs: pairs).type)
+            let lhs = UnsafeMutableRawPointer.allocate(byteCount: pairs * 16, alignment: 8)
+            let rhs = UnsafeMutableRawPointer.allocate(byteCount: pairs * 16, alignment: 8)
+            lhs.initializeMemory(as: UInt8.self, repeating: 0x5a, count: pairs * 16)
+            rhs.initializeMemory(as: UInt8.self, repeating: 0x5a, count: pairs * 16)
+            measure("compare_values.padded.\(pairs * 16)", operations: 10_000) {
+                var equal: UInt64 = 0
+                for _ in 0..<10_000 where AGCompareValues(lhs, rhs, type, options) {
+                    equal += 1
+                }
+                return equal
+            }
+            lhs.deallocate()
+            rhs.deallocate()
+        }
+
+        // Buffers that differ at the start, in the middle or at the end, or not at all
+        for size in [16, 64, 256, 1024, 4096] {
+            let positions = [("first", 0), ("middle", size / 2), ("last", size - 1), ("equal", size)]
+            for (position, offset) in positions {
+                measure("compare_bytes.\(size).\(position)", operations: 10_000) {
+                    AGBenchmarkCompareBytes(UInt32(size), UInt32(offset), 10_000)
+                }
+            }
+        }
+
+        // Small bitwise types, which skip fetching their layout
+        compareSmallValuesBenchmark("Int", 42, 42, options: options)
+        compareSmallValuesBenchmark("Double", 4.2, 4.2, options: options)
+        compareSmallValuesBenchmark("Bool", true, true, options: options)
+        compareSmallValuesBenchmark("Point", Point(x: 1, y: 2), Point(x: 1, y: 2), options: options)
+
+        let mixed = Mixed(
+            id: 1, name: "a name long enough to be out of line", origin: Point(x: 1, y: 2), flags: 3, box: Box(),
+            tags: ["one", "two"])
+        compareValuesBenchmark("Mixed", mixed, mixed, options: options)
+        compareValuesBenchmark("Shape", Shape.nested(mixed), Shape.nested(mixed), options: options)
+        let points = (Point(x: 0, y: 0), Point(x: 1, y: 1), Point(x: 2, y: 2), Point(x: 3, y: 3))
+        let nested = Nested(first: mixed, second: mixed, shape: .named("shape", Point(x: 4, y: 5)), points: points)
+        compareValuesBenchmark("Nested", nested, nested, options: options)
+    }
+
+    /// Compares values the way `compareValues` does in Swift, taking pointers to both values for every comparison.
+    private mutating func compareSmallValuesBenchmark<Value>(
+        _ name: String,
+        _ lhs: Value,
+        _ rhs: Value,
+        options: AGComparisonOptions
+    ) {
+        let type = Metadata(Value.self)
+        measure("compare_values.small.\(name)", operations: 100_000) {
+            var equal: UInt64 = 0
+            for _ in 0..<100_000 {
+                let result = withUnsafePointer(to: lhs) { lhsPointer in
+                    withUnsafePointer(to: rhs) { rhsPointer in
+                        AGCompareValues(lhsPointer, rhsPointer, type, options)
+                    }
+                }
+                if result {
+                    equal += 1
+                }
+            }
+            return equal
+        }
+    }
+
+    private mutating func compareValuesBenchmark<Value>(
+        _ name: String,
+        _ lhs: Value,
+        _ rhs: Value,
+        options: AGComparisonOptions
+    ) {
+        withUnsafePointer(to: lhs) { lhsPointer in
+            withUnsafePointer(to: rhs) { rhsPointer in
+                let type = Metadata(Value.self)
+                measure("compare_values.\(name)", operations: 10_000) {
+                    var equal: UInt64 = 0
+                    for _ in 0..<10_000 where AGCompareValues(lhsPointer, rhsPointer, type, options) {
+                        equal += 1
+                    }
+                    return equal
+                }
+                measure("hash_value.\(name)", operations: 10_000) {
+                    var hash: UInt64 = 0
+                    for _ in 0..<10_000 {
+                        hash &+= AGHashValue(lhsPointer, type, options)
+                    }
+                    return hash
+                }
+                measure("compare_layout.interpreted.\(name)", operations: 10_000) {
+                    AGBenchmarkCompareLayout(type, lhsPointer, 10_000, false)
+                }
+                measure("compare_layout.compiled.\(name)", operations: 10_000) {
+                    AGBenchmarkCompareLayout(type, lhsPointer, 10_000, true)
+                }
+            }
+        }
+    }
+
+    mutating func runValueBenchmarks() {
+        let mixed = Mixed(
+            id: 1, name: "a name long enough to be out of line", origin: Point(x: 1, y: 2), flags: 3, box: Box(),
+            tags: ["one", "two"])
+        valueAssignBenchmark("Point", Point(x: 1, y: 2))
+        valueAssignBenchmark("String", "a name long enough to be out of line")
+        valueAssignBenchmark("Mixed", mixed)
+        valueAssignBenchmark("Shape", Shape.nested(mixed))
+    }
+
+    private mutating func valueAssignBenchmark<Value>(_ name: String, _ value: Value) {
+        withUnsafePointer(to: value) { pointer in
+            let type = Metadata(Value.self)
+            measure("value_assign.value_witnesses.\(name)", operations: 10_000) {
+                AGBenchmarkValueAssign(type, pointer, 10_000, false)
+            }
+            measure("value_assign.kernel.\(name)", operations: 10_000) {
+                AGBenchmarkValueAssign(type, pointer, 10_000, true)
+            }
+        }
+    }
+
+    mutating func runGraphBenchmarks() {
+        let mixed = Mixed(
+            id: 1, name: "a name long enough to be out of line", origin: Point(x: 1, y: 2), flags: 3, box: Box(),
+            tags: ["one", "two"])
+        subgraphBenchmark("Int", 42)
+        subgraphBenchmark("Point", Point(x: 1, y: 2))
+        subgraphBenchmark("String", "a name long enough to be out of line")
+        subgraphBenchmark("Mixed", mixed)
+
+        // Independent subgraphs, which parallel updates can hand to different workers
+        for (subgraphCount, count) in [(1, 8_000), (8, 1_000), (64, 125)] {
+            let graph = AGBenchmarkGraphCreate(Metadata(Int.self))
+            var value = 0
+            let subgraphs = (0..<subgraphCount).map { _ in AGBenchmarkSubgraphCreate(graph, &value, UInt32(count)) }
+            let markDirty = {
+                for subgraph in subgraphs {
+                    AGBenchmarkSubgraphMarkDirty(subgraph)
+                }
+            }
+            measure("graph.update.\(subgraphCount)x\(count)", operations: subgraphCount * count, setUp: markDirty) {
+                AGBenchmarkGraphUpdate(graph, false)
+            }
+            // The same with the deadline checked between attributes
+            measure(
+                "graph.update.deadline.\(subgraphCount)x\(count)", operations: subgraphCount * count,
+                setUp: markDirty
+            ) {
+                AGBenchmarkGraphUpdate(graph, true)
+            }
+            for subgraph in subgraphs {
+                AGBenchmarkSubgraphDestroy(subgraph)
+            }
+            AGBenchmarkGraphDestroy(graph)
+        }
+    }
+
+    private mutating func subgraphBenchmark<Value>(_ name: String, _ value: Value) {
+        let count = 10_000
+        withUnsafePointer(to: value) { pointer in
+            let graph = AGBenchmarkGraphCreate(Metadata(Value.self))
+            var subgraph: AGBenchmarkSubgraphRef?
+
+            // Values of at most 16 bytes are stored inline after the attribute's body, see AG_INLINE_VALUE_SIZE
+            measure(
+                "graph.create_subgraph.\(name)", operations: count,
+                setUp: {
+                    if let subgraph {
+                        AGBenchmarkSubgraphDestroy(subgraph)
+                    }
+                    subgraph = nil
+                }
+            ) {
+                subgraph = AGBenchmarkSubgraphCreate(graph, pointer, UInt32(count))
+                return UInt64(count)
+            }
+            if let subgraph {
+                AGBenchmarkSubgraphDestroy(subgraph)
+            }
+
+            subgraph = AGBenchmarkSubgraphCreate(graph, pointer, UInt32(count))
+            measure("graph.read_values.\(name)", operations: count * 10) {
+                AGBenchmarkSubgraphReadValues(subgraph!, 10)
+            }
+            AGBenchmarkSubgraphDestroy(subgraph!)
+
+            measure(
+                "graph.destroy_subgraph.\(name)", operations: count,
+                setUp: { subgraph = AGBenchmarkSubgraphCreate(graph, pointer, UInt32(count)) }
+            ) {
+                AGBenchmarkSubgraphDestroy(subgraph!)
+            }
+            AGBenchmarkGraphDestroy(graph)
+        }
+    }
+
+    mutating func runScalingBenchmarks() {
+        let processorCount = ProcessInfo.processInfo.activeProcessorCount
+        var threadCounts = Array(sequence(first: 1, next: { $0 * 2 }).prefix { $0 < processorCount })
+        threadCounts.append(processorCount)
+
+        let types: [Metadata] = [Int.self, String.self, Point.self, Mixed.self, Shape.self, Nested.self, Box.self].map {
+            Metadata($0)
+        }
+        let caches: [(String, AGBenchmarkSharedCache)] = [
+            ("table.pages", .tablePages),
+            ("table.large_pages", .tableLargePages),
+            ("layout_cache.fetch", .layouts),
+            ("type_cache.resolve", .typeNames),
+            ("type_signature_cache.lookup", .typeSignatures),
+            ("mpsc_queue.push", .queue),
+        ]
+        for (name, cache) in caches {
+            measureScaling("scaling.\(name)", threadCounts: threadCounts) { threads in
+                let result = types.withUnsafeBufferPointer { types in
+                    AGBenchmarkSharedCacheScaling(cache, types.baseAddress!, types.count, UInt32(threads), 100_000)
+                }
+                return (result.operations, result.elapsed_nanoseconds, result.p99_nanoseconds)
+            }
+        }
+    }
+
+}
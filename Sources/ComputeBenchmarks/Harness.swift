@@ -0,0 +1,123 @@
+import Foundation
+
+/// The measurements of one benchmark. Times are per operation, over the samples taken after a warm-up run.
+struct BenchmarkResult: Encodable {
+    var name: String
+    var operations: Int
+    var samples: Int
+    var minNanoseconds: Double
+    var medianNanoseconds: Double
+    var meanNanoseconds: Double
+}
+
+/// The throughput of one shared cache at one thread count.
+struct ScalingResult: Encodable {
+    var name: String
+    var threads: Int
+    var operationsPerSecond: Double
+    var p99Nanoseconds: Double
+
+    /// Throughput relative to the single-threaded throughput times the number of threads, 1 for perfect scaling.
+    var efficiency: Double
+
+    /// Whether throughput dropped from the previous, smaller thread count.
+    var cliff: Bool
+}
+
+struct Harness {
+
+    var filter: String?
+    var samples = 10
+    private(set) var results: [BenchmarkResult] = []
+    private(set) var scalingResults: [ScalingResult] = []
+
+    /// Folds in the kernels' results so that their work can't be optimized away.
+    private(set) var sink: UInt64 = 0
+
+    init(filter: String?, samples: Int) {
+        self.filter = filter
+        self.samples = samples
+    }
+
+    /// Times `body`, which performs `operations` operations per call. `setUp` runs before each call, untimed.
+    mutating func measure(
+        _ name: String,
+        operations: Int,
+        setUp: () -> Void = {},
+        _ body: () -> UInt64
+    ) {
+        if let filter, !name.contains(filter) {
+            return
+        }
+
+        setUp()
+        sink &+= body()
+
+        let clock = ContinuousClock()
+        var perOperation: [Double] = []
+        perOperation.reserveCapacity(samples)
+        for _ in 0..<samples {
+            setUp()
+            var result: UInt64 = 0
+            let elapsed = clock.measure {
+                result = body()
+            }
+            sink &+= result
+            perOperation.append(elapsed.nanoseconds / Double(operations))
+        }
+
+        perOperation.sort()
+        results.append(
+            BenchmarkResult(
+                name: name,
+                operations: operations,
+                samples: samples,
+                minNanoseconds: perOperation.first ?? 0,
+                medianNanoseconds: perOperation.isEmpty ? 0 : perOperation[perOperation.count / 2],
+                meanNanoseconds: perOperation.isEmpty ? 0 : perOperation.reduce(0, +) / Double(perOperation.count)
+            )
+        )
+    }
+
+    /// Runs `body` with each thread count and records how throughput scales. `body` returns the number of operations,
+    /// the wall time they took and the 99th percentile latency of one operation.
+    mutating func measureScaling(
+        _ name: String,
+        threadCounts: [Int],
+        _ body: (Int) -> (operations: UInt64, nanoseconds: UInt64, p99Nanoseconds: Double)
+    ) {
+        if let filter, !name.contains(filter) {
+            return
+        }
+
+        var baseline: Double?
+        var previous: Double?
+        for threads in threadCounts {
+            let (operations, nanoseconds, p99Nanoseconds) = body(threads)
+            let throughput = nanoseconds == 0 ? 0 : Double(operations) * 1e9 / Double(nanoseconds)
+            let singleThreaded = baseline ?? throughput
+            baseline = singleThreaded
+            scalingResults.append(
+                ScalingResult(
+                    name: name,
+                    threads: threads,
+                    operationsPerSecond: throughput,
+                    p99Nanoseconds: p99Nanoseconds,
+                    efficiency: singleThreaded == 0 ? 0 : throughput / (singleThreaded * Double(threads)),
+                    cliff: previous.map { throughput < $0 } ?? false
+                )
+            )
+            previous = throughput
+        }
+    }
+
+}
+
+extension Duration {
+
+    var nanoseconds: Double {
+        let (seconds, attoseconds) = components
+        return Double(seconds) * 1e9 + Double(attoseconds) / 1e9
+    }
+
+}
@@ -0,0 +1,82 @@
+import Compute
+import ComputeBenchmarksSupport
+import Foundation
+
+// Usage: swift run -c release ComputeBenchmarks [--filter <substring>] [--samples <count>] [--output <path>]
+//                                                [--layout-cache <path>]
+//
+// Runs the benchmarks whose names contain the filter and writes their results as JSON, to stdout unless an output
+// path is given. BENCHMARK_COMMIT, if set, is recorded with the results so they can be tracked per commit.
+//
+// With a layout cache, layouts are kept in the file between runs. The first run with a new file builds and records
+// them, and the layout.make_layout benchmarks of later runs measure loading them from the file instead.
+//
+// The graph.update benchmarks update in parallel when AG_UPDATE_WORKERS is set to more than one.
+
+struct Report: Encodable {
+    var commit: String?
+    var pageSize: Int
+    var layoutCache: Bool
+    var benchmarks: [BenchmarkResult]
+    var scaling: [ScalingResult]
+}
+
+var filter: String?
+var samples = 10
+var outputPath: String?
+var layoutCachePath: String?
+
+var arguments = CommandLine.arguments.dropFirst().makeIterator()
+while let argument = arguments.next() {
+    switch argument {
+    case "--filter":
+        filter = arguments.next()
+    case "--samples":
+        samples = arguments.next().flatMap { Int($0) } ?? samples
+    case "--output":
+        outputPath = arguments.next()
+    case "--layout-cache":
+        layoutCachePath = arguments.next()
+    default:
+        FileHandle.standardError.write("unknown argument: \(argument)\n".data(using: .utf8)!)
+        exit(1)
+    }
+}
+
+if let layoutCachePath {
+    _ = AGComparisonSetLayoutCachePath(layoutCachePath)
+}
+
+var harness = Harness(filter: filter, samples: max(samples, 1))
+harness.runAllocatorBenchmarks()
+harness.runHashTableBenchmarks()
+harness.runLayoutBenchmarks()
+harness.runPrefetchBenchmarks()
+harness.runComparisonBenchmarks()
+harness.runValueBenchmarks()
+harness.runGraphBenchmarks()
+harness.runScalingBenchmarks()
+
+if layoutCachePath != nil {
+    _ = AGComparisonSaveLayoutCache()
+}
+
+let report = Report(
+    commit: ProcessInfo.processInfo.environment["BENCHMARK_COMMIT"],
+    pageSize: Int(AGBenchmarkPageSize()),
+    layoutCache: layoutCachePath != nil,
+    benchmarks: harness.results,
+    scaling: harness.scalingResults
+)
+
+let encoder = JSONEncoder()
+encoder.keyEncodingStrategy = .convertToSnakeCase
+encoder.outputFormatting = [.prettyPrinted, .sortedKeys]
+let data = try encoder.encode(report)
+
+if let outputPath {
+    try data.write(to: URL(fileURLWithPath: outputPath))
+} else {
+    FileHandle.standardOutput.write(data)
+    FileHandle.standardOutput.write("\n".data(using: .utf8)!)
+}
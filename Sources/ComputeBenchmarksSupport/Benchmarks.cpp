@@ -0,0 +1,319 @@
+#include "ComputeBenchmarksSupport.h"
+
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Data/Table.h"
+#include "Data/Zone.h"
+#include "Layout/Compare.h"
+#include "Layout/LayoutDescriptor.h"
+#include "Layout/Program.h"
+#include "Layout/ValueKernel.h"
+#include "Swift/Metadata.h"
+#include "Utilities/FlatTable.h"
+#include "Utilities/HashTable.h"
+#include "Vector/Vector.h"
+
+struct AGBenchmarkTableStorage {
+    AGBenchmarkTableKind kind;
+    bool string_keys;
+    uint32_t count;
+
+    // `count` keys in the table followed by `count` keys that aren't
+    AG::vector<const void *, 0, uint32_t> keys;
+    std::unique_ptr<char[]> strings;
+
+    std::unique_ptr<util::UntypedTable> chained_table;
+    std::unique_ptr<util::UntypedFlatTable> flat_table;
+};
+
+namespace {
+
+const void *key_for(uint32_t index) { return reinterpret_cast<const void *>(uintptr_t(index) + 1); }
+
+constexpr size_t string_key_size = 32;
+
+bool string_equal(const void *lhs, const void *rhs) {
+    return strcmp(static_cast<const char *>(lhs), static_cast<const char *>(rhs)) == 0;
+}
+
+template <typename Table> std::unique_ptr<Table> make_table(bool string_keys);
+
+template <> std::unique_ptr<util::UntypedTable> make_table(bool string_keys) {
+    if (!string_keys) {
+        return std::make_unique<util::UntypedTable>();
+    }
+    return std::make_unique<util::UntypedTable>(reinterpret_cast<util::UntypedTable::hasher>(util::string_hash),
+                                                string_equal, nullptr, nullptr, nullptr);
+}
+
+template <> std::unique_ptr<util::UntypedFlatTable> make_table(bool string_keys) {
+    if (!string_keys) {
+        return std::make_unique<util::UntypedFlatTable>();
+    }
+    return std::make_unique<util::UntypedFlatTable>(
+        reinterpret_cast<util::UntypedFlatTable::hasher>(util::string_hash), string_equal, nullptr, nullptr);
+}
+
+template <typename Table> uint64_t insert_keys(Table &table, const void *const *keys, uint32_t count) {
+    for (uint32_t index = 0; index < count; index++) {
+        table.insert(keys[index], keys[index]);
+    }
+    return table.count();
+}
+
+/// Looks up `lookup_count` of the keys, alternating between the `count` keys in the table and those past them.
+template <typename Table>
+uint64_t lookup_keys(const Table &table, const void *const *keys, uint32_t count, uint32_t lookup_count) {
+    uint64_t result = 0;
+    for (uint32_t index = 0; index < lookup_count; index++) {
+        uint32_t key_index = uint32_t((index * 2654435761u) % count);
+        if (index % 2) {
+            key_index += count;
+        }
+        if (table.lookup(keys[key_index], nullptr)) {
+            result += 1;
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+#pragma mark - Allocator
+
+uint32_t AGBenchmarkPageSize() { return AG::data::page_size; }
+
+uint64_t AGBenchmarkZoneAllocBytes(uint32_t count, uint32_t size, bool templated) {
+    AG::data::table::ensure_shared();
+    AG::data::zone zone;
+
+    uint64_t result = 0;
+    if (templated) {
+        for (uint32_t index = 0; index < count; index++) {
+            result += zone.alloc_bytes<7>(size).offset();
+        }
+    } else {
+        for (uint32_t index = 0; index < count; index++) {
+            result += zone.alloc_bytes(size, 7).offset();
+        }
+    }
+    zone.clear();
+    return result;
+}
+
+uint64_t AGBenchmarkZoneRecycleChurn(uint32_t count, uint32_t size) {
+    AG::data::table::ensure_shared();
+    AG::data::zone zone;
+
+    // Interleaved buffers can never grow in place, so each step frees the old buffer and recycles a fragment freed by
+    // an earlier one
+    AG::vector<AG::data::ptr<void>, 0, uint32_t> buffers;
+    for (uint32_t index = 0; index < count; index++) {
+        buffers.push_back(zone.alloc_bytes_recycle(size, 7));
+    }
+    uint64_t result = 0;
+    for (uint32_t step = 0; step < 4; step++) {
+        uint32_t buffer_size = size + step * 8;
+        for (auto &buffer : buffers) {
+            zone.realloc_bytes(&buffer, buffer_size, buffer_size + 8, 7);
+            result += buffer.offset();
+        }
+    }
+    zone.clear();
+    return result;
+}
+
+uint64_t AGBenchmarkTableAllocPagesFragmented(uint32_t count, uint32_t num_pages) {
+    auto &table = AG::data::table::ensure_shared();
+    AG::data::zone zone; // owns the pages only nominally, they are never linked into it
+
+    AG::vector<AG::data::ptr<AG::data::page>, 0, uint32_t> pages;
+    for (uint32_t index = 0; index < 2 * count; index++) {
+        pages.push_back(table.alloc_page(&zone, AG::data::page_size));
+    }
+    AG::vector<AG::data::ptr<AG::data::page>, 0, uint32_t> kept;
+    for (uint32_t index = 0; index < pages.size(); index++) {
+        if (index % 2) {
+            table.dealloc_page(pages[index]);
+        } else {
+            kept.push_back(pages[index]);
+        }
+    }
+
+    uint64_t result = 0;
+    for (uint32_t index = 0; index < count; index++) {
+        auto page = table.alloc_page(&zone, num_pages * AG::data::page_size);
+        result += page.offset();
+        kept.push_back(page);
+    }
+
+    for (auto page : kept) {
+        table.dealloc_page(page);
+    }
+    return result;
+}
+
+#pragma mark - Hash tables
+
+AGBenchmarkTableRef AGBenchmarkTableCreate(AGBenchmarkTableKind kind, AGBenchmarkTableKeys keys, uint32_t count) {
+    auto table = new AGBenchmarkTableStorage();
+    table->kind = kind;
+    table->string_keys = keys == AGBenchmarkTableKeysStrings;
+    table->count = count;
+    if (table->string_keys) {
+        table->strings = std::make_unique<char[]>(size_t(2) * count * string_key_size);
+    }
+    for (uint32_t index = 0; index < 2 * count; index++) {
+        if (table->string_keys) {
+            char *key = &table->strings[size_t(index) * string_key_size];
+            snprintf(key, string_key_size, "benchmark.key.%u", index);
+            table->keys.push_back(key);
+        } else {
+            table->keys.push_back(key_for(index));
+        }
+    }
+
+    if (kind == AGBenchmarkTableKindFlat) {
+        table->flat_table = make_table<util::UntypedFlatTable>(table->string_keys);
+        insert_keys(*table->flat_table, table->keys.data(), count);
+    } else {
+        table->chained_table = make_table<util::UntypedTable>(table->string_keys);
+        insert_keys(*table->chained_table, table->keys.data(), count);
+    }
+    return table;
+}
+
+void AGBenchmarkTableDestroy(AGBenchmarkTableRef table) { delete table; }
+
+uint64_t AGBenchmarkTableInsert(AGBenchmarkTableRef table) {
+    if (table->kind == AGBenchmarkTableKindFlat) {
+        auto new_table = make_table<util::UntypedFlatTable>(table->string_keys);
+        return insert_keys(*new_table, table->keys.data(), table->count);
+    }
+    auto new_table = make_table<util::UntypedTable>(table->string_keys);
+    return insert_keys(*new_table, table->keys.data(), table->count);
+}
+
+uint64_t AGBenchmarkTableLookup(AGBenchmarkTableRef table, uint32_t count) {
+    if (table->kind == AGBenchmarkTableKindFlat) {
+        return lookup_keys(*table->flat_table, table->keys.data(), table->count, count);
+    }
+    return lookup_keys(*table->chained_table, table->keys.data(), table->count, count);
+}
+
+#pragma mark - Layouts
+
+uint64_t AGBenchmarkMakeLayout(AGTypeID type, uint32_t count) {
+    auto &metadata = *reinterpret_cast<const AG::swift::metadata *>(type);
+
+    uint64_t result = 0;
+    for (uint32_t index = 0; index < count; index++) {
+        auto layout = AG::LayoutDescriptor::make_layout(metadata, AG::LayoutDescriptor::ComparisonMode(0),
+                                                        AG::LayoutDescriptor::HeapMode::Option0);
+        result += uintptr_t(layout);
+    }
+    return result;
+}
+
+uint64_t AGBenchmarkTypeApplyFields(AGTypeID type, uint32_t count) {
+    uint64_t result = 0;
+    for (uint32_t index = 0; index < count; index++) {
+        AGTypeApplyFields(
+            type,
+            [](const char *field_name, size_t field_size, AGTypeID field_type, void *context) {
+                *static_cast<uint64_t *>(context) += field_size;
+            },
+            &result);
+    }
+    return result;
+}
+
+#pragma mark - Comparison
+
+uint64_t AGBenchmarkCompareBytes(uint32_t size, uint32_t mismatch_offset, uint32_t count) {
+    auto lhs = std::make_unique<unsigned char[]>(size);
+    auto rhs = std::make_unique<unsigned char[]>(size);
+    memset(lhs.get(), 0x5a, size);
+    memset(rhs.get(), 0x5a, size);
+    if (mismatch_offset < size) {
+        rhs[mismatch_offset] = 0xa5;
+    }
+
+    uint64_t result = 0;
+    for (uint32_t index = 0; index < count; index++) {
+        size_t failure_location = 0;
+        if (AG::LayoutDescriptor::compare_bytes(lhs.get(), rhs.get(), size, &failure_location)) {
+            result += 1;
+        } else {
+            result += failure_location;
+        }
+    }
+    return result;
+}
+
+uint64_t AGBenchmarkCompareLayout(AGTypeID type, const void *value, uint32_t count, bool compiled) {
+    auto &metadata = *reinterpret_cast<const AG::swift::metadata *>(type);
+    auto options = AG::LayoutDescriptor::ComparisonOptions(
+        AG::LayoutDescriptor::ComparisonOptions::FetchLayoutsSynchronously);
+    auto layout = AG::LayoutDescriptor::fetch(metadata, options, 0);
+    if (!layout || layout == AG::ValueLayoutEmpty) {
+        return 0;
+    }
+    auto layout_program = AG::LayoutDescriptor::program(layout);
+    if (compiled && (!layout_program || layout_program->extent() > metadata.vw_size())) {
+        return 0;
+    }
+
+    // A copy, since comparing a value with itself returns before looking at the layout
+    auto lhs = static_cast<const unsigned char *>(value);
+    auto rhs = static_cast<unsigned char *>(malloc(metadata.vw_size() + 1));
+    metadata.vw_initializeWithCopy(reinterpret_cast<AG::swift::opaque_value *>(rhs),
+                                   static_cast<AG::swift::opaque_value *>(const_cast<void *>(value)));
+
+    uint64_t result = 0;
+    for (uint32_t index = 0; index < count; index++) {
+        bool equal;
+        if (compiled) {
+            equal = layout_program->compare(lhs, rhs, options);
+        } else {
+            auto compare_object = AG::LayoutDescriptor::Compare();
+            equal = compare_object(layout, lhs, rhs, 0, metadata.vw_size(), options);
+        }
+        if (equal) {
+            result += 1;
+        }
+    }
+    metadata.vw_destroy(reinterpret_cast<AG::swift::opaque_value *>(rhs));
+    free(rhs);
+    return result;
+}
+
+#pragma mark - Values
+
+uint64_t AGBenchmarkValueAssign(AGTypeID type, const void *value, uint32_t count, bool use_kernel) {
+    auto &metadata = *reinterpret_cast<const AG::swift::metadata *>(type);
+    auto &kernel = AG::LayoutDescriptor::ValueKernel::fetch(metadata);
+    auto source = static_cast<AG::swift::opaque_value *>(const_cast<void *>(value));
+
+    // malloc's alignment is enough for any value in the benchmarks
+    auto dest = static_cast<AG::swift::opaque_value *>(malloc(metadata.vw_size() + 1));
+    metadata.vw_initializeWithCopy(dest, source);
+    for (uint32_t index = 0; index < count; index++) {
+        if (use_kernel) {
+            kernel.assign_with_copy(dest, value);
+        } else {
+            metadata.vw_assignWithCopy(dest, source);
+        }
+    }
+    uint64_t result = *reinterpret_cast<unsigned char *>(dest);
+    if (use_kernel) {
+        kernel.destroy(dest);
+    } else {
+        metadata.vw_destroy(dest);
+    }
+    free(dest);
+    return result;
+}
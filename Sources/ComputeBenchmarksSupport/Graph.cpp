@@ -0,0 +1,120 @@
+#include "ComputeBenchmarksSupport.h"
+
+#include "Attribute/AttributeID.h"
+#include "Attribute/AttributeType.h"
+#include "Attribute/Node/Node.h"
+#include "Graph/Graph.h"
+#include "Subgraph/Subgraph.h"
+#include "Swift/Metadata.h"
+
+namespace {
+
+/// The layout of an AttributeType, which is otherwise only ever created by Swift.
+struct BenchmarkAttributeType {
+    const AG::swift::metadata *self_metadata;
+    const AG::swift::metadata *value_metadata;
+    AG::AttributeType::UpdateFunction update;
+    const void *update_context;
+    AG::AttributeVTable *v_table;
+    uint8_t v_table_flags;
+    uint32_t attribute_offset;
+};
+
+static_assert(sizeof(BenchmarkAttributeType) == sizeof(AG::AttributeType));
+
+AG::AttributeVTable empty_v_table = {nullptr};
+
+/// Sets the value to a copy of the body, which leaves values made by AGBenchmarkSubgraphCreate unchanged.
+void update_benchmark_attribute(const void *context, void *body, AGAttribute attribute) {
+    auto attribute_id = AG::AttributeID::from_raw_value(attribute);
+    attribute_id.subgraph()->graph().set_value(attribute_id.to_node_ptr(), body);
+}
+
+} // namespace
+
+struct AGBenchmarkGraphStorage {
+    AG::Graph graph;
+    BenchmarkAttributeType type;
+    uint32_t type_id;
+
+    // Attributes marked dirty since the last update
+    uint64_t num_marked = 0;
+};
+
+struct AGBenchmarkSubgraphStorage {
+    AGBenchmarkGraphStorage *graph;
+    AG::Subgraph subgraph;
+
+    explicit AGBenchmarkSubgraphStorage(AGBenchmarkGraphStorage &graph) : graph(&graph), subgraph(graph.graph) {};
+};
+
+AGBenchmarkGraphRef AGBenchmarkGraphCreate(AGTypeID value_type) {
+    AG::data::table::ensure_shared();
+
+    auto metadata = reinterpret_cast<const AG::swift::metadata *>(value_type);
+    size_t alignment_mask = metadata->vw_alignment() - 1;
+
+    auto graph = new AGBenchmarkGraphStorage();
+    graph->type = {metadata,
+                   metadata,
+                   update_benchmark_attribute,
+                   nullptr,
+                   &empty_v_table,
+                   AG::AttributeVTable::Flags::ThreadSafe,
+                   uint32_t((sizeof(AG::Node) + alignment_mask) & ~alignment_mask)};
+    graph->type_id = graph->graph.add_attribute_type(reinterpret_cast<AG::AttributeType &>(graph->type));
+    return graph;
+}
+
+void AGBenchmarkGraphDestroy(AGBenchmarkGraphRef graph) { delete graph; }
+
+AGBenchmarkSubgraphRef AGBenchmarkSubgraphCreate(AGBenchmarkGraphRef graph, const void *value, uint32_t count) {
+    auto subgraph = new AGBenchmarkSubgraphStorage(*graph);
+    if (count == 0) {
+        return subgraph;
+    }
+
+    AG::vector<AG::data::ptr<AG::Node>, 0, uint32_t> nodes;
+    nodes.resize(count);
+    subgraph->subgraph.add_nodes(graph->type_id, value, 0, count, nodes.data());
+    for (uint32_t index = 0; index < count; index++) {
+        nodes[index]->set_value(graph->graph, value);
+        if (index > 0) {
+            graph->graph.add_input(nodes[index], AG::AttributeID(nodes[index - 1]), false);
+        }
+    }
+    return subgraph;
+}
+
+uint64_t AGBenchmarkSubgraphDestroy(AGBenchmarkSubgraphRef subgraph) {
+    uint64_t result = subgraph->subgraph.num_nodes();
+    subgraph->subgraph.destroy_nodes();
+    delete subgraph;
+    return result;
+}
+
+void AGBenchmarkSubgraphMarkDirty(AGBenchmarkSubgraphRef subgraph) {
+    for (AG::data::ptr<AG::Node> node : subgraph->subgraph.nodes()) {
+        subgraph->graph->graph.mark_dirty(node);
+    }
+    subgraph->graph->num_marked += subgraph->subgraph.num_nodes();
+}
+
+uint64_t AGBenchmarkGraphUpdate(AGBenchmarkGraphRef graph, bool deadline) {
+    uint64_t result = graph->num_marked;
+    graph->graph.set_deadline(deadline ? UINT64_MAX - 1 : UINT64_MAX);
+    graph->graph.update_dirty_nodes();
+    graph->graph.set_deadline(UINT64_MAX);
+    graph->num_marked = 0;
+    return result;
+}
+
+uint64_t AGBenchmarkSubgraphReadValues(AGBenchmarkSubgraphRef subgraph, uint32_t count) {
+    uint64_t result = 0;
+    for (uint32_t step = 0; step < count; step++) {
+        for (AG::data::ptr<AG::Node> node : subgraph->subgraph.nodes()) {
+            result += *static_cast<const unsigned char *>(node->direct_value().get());
+        }
+    }
+    return result;
+}
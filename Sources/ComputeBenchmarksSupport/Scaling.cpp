@@ -0,0 +1,205 @@
+#include "ComputeBenchmarksSupport.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <pthread.h>
+#include <time.h>
+#include <vector>
+
+#include "Data/Table.h"
+#include "Data/Zone.h"
+#include "Layout/LayoutDescriptor.h"
+#include "Swift/FieldTable.h"
+#include "Swift/Metadata.h"
+#include "Utilities/MPSCQueue.h"
+
+namespace {
+
+/// Operations are timed in batches of this many, single operations being shorter than the clock's resolution.
+constexpr uint32_t batch_size = 16;
+
+struct type_name {
+    const AG::swift::metadata *type;
+    const char *name;
+};
+
+struct Run {
+    AGBenchmarkSharedCache cache;
+    const AG::swift::metadata *const *types;
+    size_t type_count;
+    std::vector<type_name> names;
+    uint32_t operations_per_thread;
+    AG::data::zone *zone;
+    util::MPSCQueue<uint64_t> *queue;
+
+    std::atomic<uint32_t> ready = 0;
+    std::atomic<bool> start = false;
+    std::atomic<bool> finished = false;
+    uint64_t drained = 0;
+};
+
+struct Worker {
+    Run *run;
+    uint32_t index;
+    std::vector<uint64_t> batch_nanoseconds;
+    uint64_t result = 0;
+};
+
+uint64_t now() { return clock_gettime_nsec_np(CLOCK_UPTIME_RAW); }
+
+/// Performs operation number `step` of a worker, returning a value that depends on it.
+uint64_t perform(Run &run, uint32_t step) {
+    switch (run.cache) {
+    case AGBenchmarkSharedCacheTablePages:
+    case AGBenchmarkSharedCacheTableLargePages: {
+        auto &table = AG::data::table::shared();
+        uint32_t num_pages = run.cache == AGBenchmarkSharedCacheTablePages ? 1 : 4;
+        auto page = table.alloc_page(run.zone, num_pages * AG::data::page_size);
+        table.dealloc_page(page);
+        return page.offset();
+    }
+    case AGBenchmarkSharedCacheLayouts: {
+        auto &type = *run.types[step % run.type_count];
+        return uintptr_t(AG::LayoutDescriptor::fetch(
+            type, AG::LayoutDescriptor::ComparisonOptions::FetchLayoutsSynchronously, 0));
+    }
+    case AGBenchmarkSharedCacheTypeNames: {
+        if (run.names.empty()) {
+            return 0;
+        }
+        auto &name = run.names[step % run.names.size()];
+        return uintptr_t(name.type->mangled_type_name_ref_cached(name.name, nullptr));
+    }
+    case AGBenchmarkSharedCacheTypeSignatures:
+        return uintptr_t(run.types[step % run.type_count]->signature());
+    case AGBenchmarkSharedCacheQueue:
+        return run.queue->push(step);
+    }
+    return 0;
+}
+
+/// Drains the queue for as long as the workers push to it, as the one consumer an `MPSCQueue` allows.
+void *run_consumer(void *context) {
+    auto &run = *static_cast<Run *>(context);
+    auto consume = [&run](uint64_t &value) { run.drained += value; };
+    while (!run.finished.load(std::memory_order_acquire)) {
+        run.queue->drain(consume);
+    }
+    run.queue->drain(consume);
+    return nullptr;
+}
+
+void *run_worker(void *context) {
+    auto &worker = *static_cast<Worker *>(context);
+    auto &run = *worker.run;
+
+    uint32_t num_batches = (run.operations_per_thread + batch_size - 1) / batch_size;
+    worker.batch_nanoseconds.reserve(num_batches);
+
+    run.ready.fetch_add(1, std::memory_order_release);
+    while (!run.start.load(std::memory_order_acquire)) {
+    }
+
+    // Workers start at different types so that they don't all hit the same entry
+    uint32_t step = worker.index * 7;
+    for (uint32_t batch = 0; batch < num_batches; batch++) {
+        uint32_t count = std::min(batch_size, run.operations_per_thread - batch * batch_size);
+        uint64_t start = now();
+        for (uint32_t index = 0; index < count; index++) {
+            worker.result += perform(run, step++);
+        }
+        worker.batch_nanoseconds.push_back((now() - start) / count);
+    }
+    return nullptr;
+}
+
+} // namespace
+
+AGBenchmarkScalingResult AGBenchmarkSharedCacheScaling(AGBenchmarkSharedCache cache, const AGTypeID *types,
+                                                       size_t type_count, uint32_t thread_count,
+                                                       uint32_t operations_per_thread) {
+    AG::data::table::ensure_shared();
+    AG::data::zone zone; // owns the pages only nominally, they are never linked into it
+
+    Run run;
+    run.cache = cache;
+    run.types = reinterpret_cast<const AG::swift::metadata *const *>(types);
+    run.type_count = type_count;
+    run.operations_per_thread = operations_per_thread;
+    run.zone = &zone;
+    run.queue = nullptr;
+    if (type_count == 0 || thread_count == 0) {
+        return {0, 0, 0};
+    }
+
+    if (cache == AGBenchmarkSharedCacheTypeNames) {
+        for (size_t index = 0; index < type_count; index++) {
+            auto fields = run.types[index]->fields();
+            if (!fields) {
+                continue;
+            }
+            for (auto &field : *fields) {
+                if (field.record && field.record->MangledTypeName) {
+                    run.names.push_back({run.types[index], field.record->MangledTypeName.get()});
+                }
+            }
+        }
+    }
+
+    std::unique_ptr<util::MPSCQueue<uint64_t>> queue;
+    pthread_t consumer;
+    if (cache == AGBenchmarkSharedCacheQueue) {
+        queue = std::make_unique<util::MPSCQueue<uint64_t>>();
+        run.queue = queue.get();
+        pthread_create(&consumer, nullptr, run_consumer, &run);
+    }
+
+    // Warm up, so that every operation measured is a hit
+    uint32_t warm_up_count = uint32_t(std::max(type_count, run.names.size()));
+    for (uint32_t step = 0; step < warm_up_count; step++) {
+        perform(run, step);
+    }
+
+    std::vector<Worker> workers(thread_count);
+    std::vector<pthread_t> threads(thread_count);
+    for (uint32_t index = 0; index < thread_count; index++) {
+        workers[index].run = &run;
+        workers[index].index = index;
+        pthread_create(&threads[index], nullptr, run_worker, &workers[index]);
+    }
+    while (run.ready.load(std::memory_order_acquire) < thread_count) {
+    }
+
+    uint64_t start = now();
+    run.start.store(true, std::memory_order_release);
+    for (auto thread : threads) {
+        pthread_join(thread, nullptr);
+    }
+    uint64_t elapsed = now() - start;
+
+    if (run.queue) {
+        run.finished.store(true, std::memory_order_release);
+        pthread_join(consumer, nullptr);
+        result += run.drained;
+    }
+
+    std::vector<uint64_t> batch_nanoseconds;
+    uint64_t result = 0;
+    for (auto &worker : workers) {
+        batch_nanoseconds.insert(batch_nanoseconds.end(), worker.batch_nanoseconds.begin(),
+                                 worker.batch_nanoseconds.end());
+        result += worker.result;
+    }
+    double p99 = 0;
+    if (!batch_nanoseconds.empty()) {
+        auto p99_position = batch_nanoseconds.begin() + (batch_nanoseconds.size() * 99) / 100;
+        std::nth_element(batch_nanoseconds.begin(), p99_position, batch_nanoseconds.end());
+        p99 = double(*p99_position);
+    }
+
+    // The kernels' results are only there to keep the work from being optimized away
+    asm volatile("" : : "r"(result));
+
+    return {uint64_t(thread_count) * operations_per_thread, elapsed, p99};
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "Swift/AGType.h"
+
+CF_ASSUME_NONNULL_BEGIN
+
+CF_EXTERN_C_BEGIN
+
+// Kernels for the benchmarks in ComputeBenchmarks. Each runs its whole loop in one call so that the caller's timing
+// doesn't add per-operation overhead, and returns a value that depends on the work so it can't be optimized away.
+
+// Allocator
+
+/// The size of zone pages this build was configured with, see AG_PAGE_SIZE.
+uint32_t AGBenchmarkPageSize(void);
+
+/// Allocates `count` blocks of `size` bytes from a new zone, then clears the zone. `templated` selects
+/// `alloc_bytes<7>(size)`, with the alignment known at compile time, over `alloc_bytes(size, 7)`.
+uint64_t AGBenchmarkZoneAllocBytes(uint32_t count, uint32_t size, bool templated);
+
+/// Grows `count` buffers from `size` bytes one at a time with `zone::realloc_bytes`, round robin, so that every move
+/// frees a fragment for `alloc_bytes_recycle` to reuse.
+uint64_t AGBenchmarkZoneRecycleChurn(uint32_t count, uint32_t size);
+
+/// Allocates `count` table pages, each `num_pages` long, after releasing every other of `2 * count` single pages, so
+/// that the free pages are as fragmented as they can be.
+uint64_t AGBenchmarkTableAllocPagesFragmented(uint32_t count, uint32_t num_pages);
+
+// Hash tables
+
+typedef CF_ENUM(uint32_t, AGBenchmarkTableKind) {
+    /// `util::UntypedTable`, which chains entries in heap-allocated nodes.
+    AGBenchmarkTableKindChained,
+    /// `util::UntypedFlatTable`, which probes groups of control bytes.
+    AGBenchmarkTableKindFlat,
+};
+
+typedef CF_ENUM(uint32_t, AGBenchmarkTableKeys) {
+    /// The integers from 1, hashed and compared as pointers.
+    AGBenchmarkTableKeysPointers,
+    /// Distinct strings, hashed with `util::string_hash` and compared with `strcmp`.
+    AGBenchmarkTableKeysStrings,
+};
+
+typedef struct AGBenchmarkTableStorage *AGBenchmarkTableRef;
+
+/// A table of `kind` holding `count` keys, along with as many more keys that aren't in it.
+AGBenchmarkTableRef AGBenchmarkTableCreate(AGBenchmarkTableKind kind, AGBenchmarkTableKeys keys, uint32_t count);
+void AGBenchmarkTableDestroy(AGBenchmarkTableRef table);
+
+/// Inserts the keys of `table` into a new, empty table of the same kind.
+uint64_t AGBenchmarkTableInsert(AGBenchmarkTableRef table);
+
+/// Looks up `count` keys, half of them present, returning the number found.
+uint64_t AGBenchmarkTableLookup(AGBenchmarkTableRef table, uint32_t count);
+
+// Layouts
+
+/// Builds the layout of `type` `count` times with `LayoutDescriptor::make_layout`, bypassing the layout cache. Layouts
+/// are never freed, so this leaks each one.
+uint64_t AGBenchmarkMakeLayout(AGTypeID type, uint32_t count);
+
+/// Visits the fields of `type` `count` times with `AGTypeApplyFields`, returning the sum of their sizes.
+uint64_t AGBenchmarkTypeApplyFields(AGTypeID type, uint32_t count);
+
+// Comparison
+
+/// Compares two buffers of `size` bytes `count` times with `LayoutDescriptor::compare_bytes`. The buffers differ only
+/// in the byte at `mismatch_offset`, or are equal if it is `size` or more.
+uint64_t AGBenchmarkCompareBytes(uint32_t size, uint32_t mismatch_offset, uint32_t count);
+
+/// Compares `value` of `type` with a copy of itself `count` times, with the program compiled from the type's layout if
+/// `compiled` is set or by interpreting the layout otherwise. Returns 0 without comparing if the type has no layout,
+/// or if `compiled` is set and its layout has no program.
+uint64_t AGBenchmarkCompareLayout(AGTypeID type, const void *value, uint32_t count, bool compiled);
+
+// Values
+
+/// Assigns `value` of `type` over a copy of itself `count` times, with the type's `LayoutDescriptor::ValueKernel` if
+/// `use_kernel` is set or its value witnesses otherwise.
+uint64_t AGBenchmarkValueAssign(AGTypeID type, const void *value, uint32_t count, bool use_kernel);
+
+// Graphs
+
+typedef struct AGBenchmarkGraphStorage *AGBenchmarkGraphRef;
+typedef struct AGBenchmarkSubgraphStorage *AGBenchmarkSubgraphRef;
+
+/// Creates a graph with a single attribute type, whose body and value are both of `value_type`. Updating an attribute
+/// sets its value to a copy of its body. The type is marked thread safe, so that parallel updates may update its
+/// attributes on any worker.
+AGBenchmarkGraphRef AGBenchmarkGraphCreate(AGTypeID value_type);
+void AGBenchmarkGraphDestroy(AGBenchmarkGraphRef graph);
+
+/// Creates a subgraph of `count` attributes, each with its body and its value a copy of `value`. Every attribute but
+/// the first has the one created before it as its input.
+AGBenchmarkSubgraphRef AGBenchmarkSubgraphCreate(AGBenchmarkGraphRef graph, const void *value, uint32_t count);
+
+/// Destroys the subgraph's nodes, see `Subgraph::destroy_nodes`, then the subgraph itself. Returns the number of
+/// attributes destroyed.
+uint64_t AGBenchmarkSubgraphDestroy(AGBenchmarkSubgraphRef subgraph);
+
+/// Reads the first byte of the value of every attribute in the subgraph, `count` times over.
+uint64_t AGBenchmarkSubgraphReadValues(AGBenchmarkSubgraphRef subgraph, uint32_t count);
+
+/// Marks every attribute of the subgraph dirty, see `Graph::mark_dirty`.
+void AGBenchmarkSubgraphMarkDirty(AGBenchmarkSubgraphRef subgraph);
+
+/// Updates the attributes marked dirty with `Graph::update_dirty_nodes`, in parallel if AG_UPDATE_WORKERS allows it.
+/// Returns the number of attributes that were dirty. Each attribute compares its body with its value, which are equal,
+/// so this measures the update with as little work per attribute as there can be.
+///
+/// With `deadline` set the update has a deadline too far away to pass, so that it reads the time between attributes
+/// without ever being cut short.
+uint64_t AGBenchmarkGraphUpdate(AGBenchmarkGraphRef graph, bool deadline);
+
+// Scaling
+
+/// The shared caches and queues exercised by `AGBenchmarkSharedCacheScaling`.
+typedef CF_ENUM(uint32_t, AGBenchmarkSharedCache) {
+    /// `table::alloc_page` and `dealloc_page` of single pages, served by the per-thread page magazines.
+    AGBenchmarkSharedCacheTablePages,
+    /// The same with four page allocations, which always take the table's lock.
+    AGBenchmarkSharedCacheTableLargePages,
+    /// `LayoutDescriptor::fetch` of layouts already built, through `TypeDescriptorCache::shared_cache()`.
+    AGBenchmarkSharedCacheLayouts,
+    /// `metadata::mangled_type_name_ref_cached` of the types' field type names, through the shared `TypeCache`.
+    AGBenchmarkSharedCacheTypeNames,
+    /// `metadata::signature()`, through the shared `TypeSignatureCache`.
+    AGBenchmarkSharedCacheTypeSignatures,
+    /// `util::MPSCQueue::push` of integers, while one more thread drains the queue until every push is done.
+    AGBenchmarkSharedCacheQueue,
+};
+
+typedef struct AGBenchmarkScalingResult {
+    uint64_t operations;
+    uint64_t elapsed_nanoseconds;
+
+    /// The 99th percentile of the time per operation, measured over batches of operations since single operations
+    /// are shorter than the clock's resolution.
+    double p99_nanoseconds;
+} AGBenchmarkScalingResult;
+
+/// Runs `operations_per_thread` operations on `cache` from each of `thread_count` threads started at once, cycling
+/// through `types`. The caches are warmed up first, so only hits are measured.
+AGBenchmarkScalingResult AGBenchmarkSharedCacheScaling(AGBenchmarkSharedCache cache, const AGTypeID *types,
+                                                       size_t type_count, uint32_t thread_count,
+                                                       uint32_t operations_per_thread);
+
+CF_EXTERN_C_END
+
+CF_ASSUME_NONNULL_END
@@ -11,6 +11,9 @@ CF_EXTERN_C_BEGIN
 
 typedef uint32_t AGAttribute AG_SWIFT_STRUCT AG_SWIFT_NAME(AnyAttribute);
 
+/// The raw value of the nil attribute, see AG::AttributeID::Kind.
+static const AGAttribute AGAttributeNil AG_SWIFT_NAME(AnyAttribute.nil) = 0x2;
+
 CF_EXTERN_C_END
 
 CF_ASSUME_NONNULL_END
@@ -8,6 +8,7 @@
 #include "Node/Node.h"
 #include "OffsetAttributeID.h"
 #include "Subgraph/Subgraph.h"
+#include "Vector/Vector.h"
 
 namespace AG {
 
@@ -48,16 +49,28 @@ OffsetAttributeID AttributeID::resolve(TraversalOptions options) const {
 }
 
 OffsetAttributeID AttributeID::resolve_slow(TraversalOptions options) const {
+    // The immutable nodes visited since the last mutable node or expired source, with the offset accumulated before
+    // each of them, so that each can remember where the chain ends
+    vector<std::pair<const IndirectNode *, uint32_t>, 16, uint32_t> path;
+    uint32_t generation = IndirectNode::resolution_generation();
+
     AttributeID result = *this;
     uint32_t offset = 0;
+    if (result.is_indirect() && options & TraversalOptions::ReportIndirectionInOffset) {
+        offset = 1;
+    }
+
     while (result.is_indirect()) {
-        if (offset == 0 && options & TraversalOptions::ReportIndirectionInOffset) {
-            offset = 1;
-        }
+        const IndirectNode &indirect_node = result.to_indirect_node();
 
-        auto indirect_node = to_indirect_node();
+        if (auto resolution = indirect_node.resolution(generation)) {
+            offset += resolution->offset();
+            result = resolution->attribute();
+            break;
+        }
 
-        if (indirect_node.is_mutable()) {
+        bool is_mutable = indirect_node.is_mutable();
+        if (is_mutable) {
             if (options & TraversalOptions::SkipMutableReference) {
                 return OffsetAttributeID(result, offset);
             }
@@ -70,23 +83,36 @@ OffsetAttributeID AttributeID::resolve_slow(TraversalOptions options) const {
                         subgraph->graph().update_attribute(dependency, false);
                     }
                 }
+                // updating may have modified nodes or freed pages
+                generation = IndirectNode::resolution_generation();
             }
+
+            // resolving through a mutable node may need to update its dependency first, so chains leading to one
+            // aren't remembered
+            path.clear();
         }
 
-        if (options && TraversalOptions::EvaluateWeakReferences) {
-            if (indirect_node.source().expired()) {
+        if (indirect_node.source().expired()) {
+            if (options & TraversalOptions::EvaluateWeakReferences) {
                 if (options & TraversalOptions::AssertNotNil) {
                     precondition_failure("invalid indirect ref: %u", _value);
                 }
                 return OffsetAttributeID(AttributeID::make_nil());
             }
+            path.clear();
+        } else if (!is_mutable) {
+            path.push_back({&indirect_node, offset});
         }
 
         offset += indirect_node.offset();
         result = indirect_node.source().attribute();
     }
 
-    if (options & TraversalOptions::AssertNotNil && !is_direct()) {
+    for (auto &[node, previous_offset] : path) {
+        node->set_resolution(result, offset - previous_offset, generation);
+    }
+
+    if (options & TraversalOptions::AssertNotNil && !result.is_direct()) {
         precondition_failure("invalid attribute id: %u", _value);
     }
 
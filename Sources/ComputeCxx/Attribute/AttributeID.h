@@ -54,10 +54,13 @@ class AttributeID {
         EvaluateWeakReferences = 1 << 4,
     };
 
-    AttributeID(data::ptr<Node> node) : _value(node | Kind::Direct){};
-    AttributeID(data::ptr<IndirectNode> indirect_node) : _value(indirect_node | Kind::Indirect){};
+    AttributeID(data::ptr<Node> node) : _value(node.offset() | Kind::Direct){};
+    AttributeID(data::ptr<IndirectNode> indirect_node) : _value(indirect_node.offset() | Kind::Indirect){};
     static AttributeID make_nil() { return AttributeID(Kind::NilAttribute); };
 
+    uint32_t to_raw_value() const { return _value; };
+    static AttributeID from_raw_value(uint32_t value) { return AttributeID(value); };
+
     operator bool() const { return _value == 0; };
 
     Kind kind() const { return Kind(_value & KindMask); };
@@ -72,6 +75,11 @@ class AttributeID {
         return *data::ptr<Node>(_value & ~KindMask);
     };
 
+    data::ptr<Node> to_node_ptr() const {
+        assert(is_direct());
+        return data::ptr<Node>(_value & ~KindMask);
+    };
+
     const IndirectNode &to_indirect_node() const {
         assert(is_indirect());
         return *data::ptr<IndirectNode>(_value & ~KindMask);
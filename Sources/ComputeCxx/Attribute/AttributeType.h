@@ -1,7 +1,11 @@
 #pragma once
 
 #include <CoreFoundation/CFBase.h>
+#include <atomic>
+#include <optional>
 
+#include "AGAttribute.h"
+#include "Layout/LayoutDescriptor.h"
 #include "Swift/Metadata.h"
 
 CF_ASSUME_NONNULL_BEGIN
@@ -14,6 +18,14 @@ class AttributeVTable {
   public:
     enum Flags : uint8_t {
         HasDestroySelf = 1 << 2,
+
+        /// Writes to values of this type record which cache lines they change, so that comparing a new value only
+        /// looks at those lines.
+        TracksDirtyRanges = 1 << 3,
+
+        /// Rules of this type may run on any thread. Rules of other types only run on the main thread when the graph
+        /// updates nodes in parallel.
+        ThreadSafe = 1 << 4,
     };
 
     using Callback = void (*)(AttributeType *attribute_type, void *body);
@@ -21,11 +33,15 @@ class AttributeVTable {
 };
 
 class AttributeType {
+  public:
+    /// Recomputes the value of `attribute`, whose body is at `body`, and sets it with Graph::set_value.
+    using UpdateFunction = void (*)(const void *_Nullable context, void *body, AGAttribute attribute);
+
   private:
     swift::metadata *_self_metadata;
     swift::metadata *_value_metadata;
-    void *_field1;
-    void *_field2;
+    UpdateFunction _Nullable _update;
+    const void *_Nullable _update_context;
     AttributeVTable *_v_table;
     uint8_t _v_table_flags;
     uint32_t _attribute_offset;
@@ -37,6 +53,20 @@ class AttributeType {
     /// Returns the offset in bytes from a Node to the attribute body,
     /// aligned to the body's alignment.
     uint32_t attribute_offset() const { return _attribute_offset; };
+    uint8_t v_table_flags() const { return _v_table_flags; };
+
+    bool tracks_dirty_ranges() const { return _v_table_flags & AttributeVTable::Flags::TracksDirtyRanges; };
+    bool is_thread_safe() const { return _v_table_flags & AttributeVTable::Flags::ThreadSafe; };
+
+    /// Whether destroying a value or body has any effect. Trivial types, per their value witnesses, have nothing to
+    /// release.
+    bool value_needs_destroy() const { return !_value_metadata->getValueWitnesses()->isPOD(); };
+    bool self_needs_destroy() const {
+        return !_self_metadata->getValueWitnesses()->isPOD() || (_v_table_flags & AttributeVTable::Flags::HasDestroySelf);
+    };
+
+    bool has_update() const { return _update != nullptr; };
+    void update(void *body, AGAttribute attribute) const { _update(_update_context, body, attribute); };
 
     // V table methods
     void v_destroy_self(void *body) {
@@ -46,6 +76,82 @@ class AttributeType {
     }
 };
 
+/// The fields of an AttributeType that node operations read most, precomputed when the type is added to a graph.
+/// Records are packed two to a cache line in a table indexed by type id, see Graph::attribute_type_record.
+class alignas(32) AttributeTypeRecord {
+  public:
+    enum Traits : uint8_t {
+        ValueNeedsDestroy = 1 << 0,
+        SelfNeedsDestroy = 1 << 1,
+    };
+
+  private:
+    AttributeType *_type;
+    uint32_t _attribute_offset;
+    uint32_t _value_size;
+    uint32_t _self_size;
+    uint8_t _value_alignment_mask;
+    uint8_t _v_table_flags;
+    uint8_t _traits;
+
+    // The comparison strategy of the value's layout in the high byte's comparison mode, or 0 until a layout for that
+    // mode has been fetched. Layouts are built lazily, so this is filled in by the first comparison.
+    mutable std::atomic<uint16_t> _comparison_strategy;
+
+  public:
+    AttributeTypeRecord() : _type(nullptr), _comparison_strategy(0){};
+    explicit AttributeTypeRecord(AttributeType &type)
+        : _type(&type), _attribute_offset(type.attribute_offset()),
+          _value_size(uint32_t(type.value_metadata().vw_size())),
+          _self_size(uint32_t(type.self_metadata().vw_size())),
+          _value_alignment_mask(uint8_t(type.value_metadata().vw_alignment() - 1)), _v_table_flags(type.v_table_flags()),
+          _traits((type.value_needs_destroy() ? ValueNeedsDestroy : 0) |
+                  (type.self_needs_destroy() ? SelfNeedsDestroy : 0)),
+          _comparison_strategy(0){};
+
+    AttributeTypeRecord(const AttributeTypeRecord &other) { *this = other; };
+    AttributeTypeRecord &operator=(const AttributeTypeRecord &other) {
+        _type = other._type;
+        _attribute_offset = other._attribute_offset;
+        _value_size = other._value_size;
+        _self_size = other._self_size;
+        _value_alignment_mask = other._value_alignment_mask;
+        _v_table_flags = other._v_table_flags;
+        _traits = other._traits;
+        _comparison_strategy.store(other._comparison_strategy.load(std::memory_order_relaxed),
+                                   std::memory_order_relaxed);
+        return *this;
+    };
+
+    AttributeType &type() const { return *_type; };
+
+    uint32_t attribute_offset() const { return _attribute_offset; };
+    uint32_t value_size() const { return _value_size; };
+    uint32_t value_alignment_mask() const { return _value_alignment_mask; };
+    uint32_t self_size() const { return _self_size; };
+
+    bool tracks_dirty_ranges() const { return _v_table_flags & AttributeVTable::Flags::TracksDirtyRanges; };
+    bool is_thread_safe() const { return _v_table_flags & AttributeVTable::Flags::ThreadSafe; };
+    bool value_needs_destroy() const { return _traits & ValueNeedsDestroy; };
+    bool self_needs_destroy() const { return _traits & SelfNeedsDestroy; };
+
+    /// Returns the strategy for comparing values in `mode`, or `std::nullopt` if it isn't known yet.
+    std::optional<LayoutDescriptor::ComparisonStrategy>
+    comparison_strategy(LayoutDescriptor::ComparisonMode mode) const {
+        uint16_t value = _comparison_strategy.load(std::memory_order_relaxed);
+        if ((value & 0xff) == 0 || (value >> 8) != mode) {
+            return std::nullopt;
+        }
+        return LayoutDescriptor::ComparisonStrategy(value & 0xff);
+    };
+    void set_comparison_strategy(LayoutDescriptor::ComparisonMode mode,
+                                 LayoutDescriptor::ComparisonStrategy strategy) const {
+        _comparison_strategy.store(uint16_t(mode << 8) | uint16_t(strategy), std::memory_order_relaxed);
+    };
+};
+
+static_assert(sizeof(AttributeTypeRecord) == 32);
+
 } // namespace AG
 
 CF_ASSUME_NONNULL_END
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <bit>
+#include <stdint.h>
+
+#include "Data/Pointer.h"
+#include "Data/Zone.h"
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace AG {
+
+/// An edge from a node to one of its inputs, packed into 32 bits.
+///
+/// The edge holds the raw value of the input's AttributeID. Nodes and indirect nodes are allocated 8-byte aligned and
+/// inputs are never nil, so only the low bit of the attribute's kind is needed, leaving two bits for the edge's flags.
+class InputEdge {
+  public:
+    enum Flags : uint32_t {
+        /// The input changed since the node last read it.
+        Changed = 1 << 1,
+
+        /// The node depends on the input even when its rule doesn't read it.
+        AlwaysEnabled = 1 << 2,
+    };
+
+    static constexpr uint32_t FlagsMask = Changed | AlwaysEnabled;
+
+  private:
+    uint32_t _value;
+
+    explicit InputEdge(uint32_t value) : _value(value){};
+
+  public:
+    /// `attribute_value` must be the raw value of a direct or indirect attribute, see `can_store`.
+    InputEdge(uint32_t attribute_value, uint32_t flags) : _value(attribute_value | (flags & FlagsMask)){};
+
+    static bool can_store(uint32_t attribute_value) { return (attribute_value & FlagsMask) == 0; };
+
+    uint32_t attribute_value() const { return _value & ~FlagsMask; };
+
+    bool is_changed() const { return _value & Changed; };
+    InputEdge with_changed(bool value) const { return InputEdge((_value & ~Changed) | (value ? Changed : 0)); };
+
+    bool is_always_enabled() const { return _value & AlwaysEnabled; };
+
+    uint32_t to_raw_value() const { return _value; };
+    static InputEdge from_raw_value(uint32_t value) { return InputEdge(value); };
+};
+
+static_assert(sizeof(InputEdge) == 4);
+
+/// A list of 32-bit edges stored in zone memory.
+///
+/// A list with a single edge keeps it inline, in place of the pointer, since most nodes have exactly one input or one
+/// output. Longer lists live in a zone allocation with a capacity of the next power of two, grown in place where
+/// possible with `zone::realloc_bytes`. Edges are stored as raw values, `Edge` converts them with `to_raw_value` and
+/// `from_raw_value`.
+template <typename Edge> class EdgeList {
+  private:
+    uint32_t _size = 0;
+    uint32_t _storage = 0; // the edge itself while _size is 1, otherwise the offset of the edges
+
+    uint32_t *_Nullable edges() {
+        return _size == 1 ? &_storage : (_storage ? data::ptr<uint32_t>(_storage).get() : nullptr);
+    };
+    const uint32_t *_Nullable edges() const {
+        return _size == 1 ? &_storage : (_storage ? data::ptr<uint32_t>(_storage).get() : nullptr);
+    };
+
+    static uint32_t capacity_for(uint32_t size) { return size <= 1 ? size : std::bit_ceil(size); };
+
+  public:
+    uint32_t size() const { return _size; };
+    bool empty() const { return _size == 0; };
+
+    Edge operator[](uint32_t index) const { return Edge::from_raw_value(edges()[index]); };
+    void set(uint32_t index, Edge edge) { edges()[index] = edge.to_raw_value(); };
+
+    /// Reads an edge of a list that lives in a copy of the table's region, see `data::table::copy_region()`.
+    Edge get(uint32_t index, vm_address_t ptr_base) const {
+        if (_size == 1) {
+            return Edge::from_raw_value(_storage);
+        }
+        return Edge::from_raw_value(reinterpret_cast<const uint32_t *>(ptr_base + _storage)[index]);
+    };
+
+    /// Returns the index of the first edge equal to `edge`, or `size()` if there isn't one.
+    uint32_t find(Edge edge) const {
+        const uint32_t *list = edges();
+        for (uint32_t index = 0; index < _size; index++) {
+            if (list[index] == edge.to_raw_value()) {
+                return index;
+            }
+        }
+        return _size;
+    };
+
+    void push_back(data::zone &zone, Edge edge);
+
+    /// Removes the edge at `index`, keeping the order of the others.
+    void remove(uint32_t index);
+
+    /// Removes the edge at `index` by moving the last edge into its place.
+    void remove_unordered(uint32_t index);
+};
+
+template <typename Edge> void EdgeList<Edge>::push_back(data::zone &zone, Edge edge) {
+    uint32_t value = edge.to_raw_value();
+    if (_size == 0) {
+        _storage = value;
+        _size = 1;
+        return;
+    }
+
+    if (_size == 1) {
+        // move the inline edge out
+        uint32_t first = _storage;
+        data::ptr<uint32_t> buffer = zone.alloc_bytes_recycle(2 * sizeof(uint32_t), sizeof(uint32_t) - 1);
+        buffer.get()[0] = first;
+        _storage = buffer.offset();
+    } else if (_size == capacity_for(_size)) {
+        data::ptr<void> buffer = data::ptr<void>(_storage);
+        zone.realloc_bytes(&buffer, _size * sizeof(uint32_t), 2 * _size * sizeof(uint32_t), sizeof(uint32_t) - 1);
+        _storage = buffer.offset();
+    }
+
+    data::ptr<uint32_t>(_storage).get()[_size] = value;
+    _size += 1;
+}
+
+template <typename Edge> void EdgeList<Edge>::remove(uint32_t index) {
+    uint32_t *list = edges();
+    for (uint32_t i = index + 1; i < _size; i++) {
+        list[i - 1] = list[i];
+    }
+    _size -= 1;
+
+    // the buffer is left to the zone, a single edge goes back inline
+    if (_size == 1) {
+        _storage = list[0];
+    } else if (_size == 0) {
+        _storage = 0;
+    }
+}
+
+template <typename Edge> void EdgeList<Edge>::remove_unordered(uint32_t index) {
+    uint32_t *list = edges();
+    list[index] = list[_size - 1];
+    _size -= 1;
+
+    if (_size == 1) {
+        _storage = list[0];
+    } else if (_size == 0) {
+        _storage = 0;
+    }
+}
+
+} // namespace AG
+
+CF_ASSUME_NONNULL_END
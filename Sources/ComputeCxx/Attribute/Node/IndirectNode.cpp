@@ -2,8 +2,12 @@
 
 #include <cassert>
 
+#include "Data/Table.h"
+
 namespace AG {
 
+std::atomic<uint32_t> IndirectNode::_num_modifications = 0;
+
 const MutableIndirectNode &IndirectNode::to_mutable() const {
     assert(is_mutable());
     return static_cast<const MutableIndirectNode &>(*this);
@@ -12,6 +16,18 @@ const MutableIndirectNode &IndirectNode::to_mutable() const {
 void IndirectNode::modify(WeakAttributeID source, size_t size) {
     _source = source;
     _info.size = uint32_t(size);
+
+    // invalidates every remembered resolution, including those of chains leading to this node
+    _num_modifications.fetch_add(1, std::memory_order_release);
+}
+
+#pragma mark - Resolution cache
+
+uint32_t IndirectNode::resolution_generation() {
+    uint32_t generation =
+        _num_modifications.load(std::memory_order_acquire) + data::table::shared().page_generation();
+    // zero is the generation of nodes that never resolved
+    return generation != 0 ? generation : 1;
 }
 
 } // namespace AG
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <CoreFoundation/CFBase.h>
+#include <atomic>
 
 #include "Attribute/AttributeID.h"
+#include "Attribute/OffsetAttributeID.h"
 #include "Attribute/WeakAttributeID.h"
 
 CF_ASSUME_NONNULL_BEGIN
@@ -25,7 +27,21 @@ class IndirectNode {
     WeakAttributeID _source;
     Info _info;
 
+    // Where the chain of indirections starting at this node ends, remembered by AttributeID::resolve_slow. Only valid
+    // while resolution_generation() returns _resolution_generation.
+    mutable AttributeID _resolved_attribute = AttributeID::make_nil();
+    mutable uint32_t _resolved_offset = 0;
+    mutable uint32_t _resolution_generation = 0;
+
+    static std::atomic<uint32_t> _num_modifications;
+
   public:
+    /// The largest offset an indirect node can store.
+    static constexpr uint32_t max_offset = (1 << 30) - 1;
+
+    IndirectNode(WeakAttributeID source, bool traverses_graph_contexts, uint32_t offset, std::optional<size_t> size)
+        : _source(source), _info({0, traverses_graph_contexts, offset, size ? uint32_t(*size) : InvalidSize}){};
+
     bool is_mutable() const { return _info.is_mutable; };
     const MutableIndirectNode &to_mutable() const;
 
@@ -37,8 +53,31 @@ class IndirectNode {
     };
 
     const WeakAttributeID &source() const { return _source; };
-    
+
     void modify(WeakAttributeID source, size_t size);
+
+    // Resolution cache
+
+    /// Changes whenever an indirect node is modified or a page is deallocated, either of which may change where a
+    /// chain of indirections ends. Never zero.
+    static uint32_t resolution_generation();
+
+    /// The attribute at the end of the chain starting at this node and the sum of the offsets along it, if it was
+    /// remembered during `generation`.
+    std::optional<OffsetAttributeID> resolution(uint32_t generation) const {
+        if (_resolution_generation != generation) {
+            return std::nullopt;
+        }
+        return OffsetAttributeID(_resolved_attribute, _resolved_offset);
+    };
+
+    /// Remembers the end of the chain starting at this node. The chain mustn't contain mutable nodes or expired
+    /// sources, which can change without the generation changing.
+    void set_resolution(AttributeID attribute, uint32_t offset, uint32_t generation) const {
+        _resolved_attribute = attribute;
+        _resolved_offset = offset;
+        _resolution_generation = generation;
+    };
 };
 
 class MutableIndirectNode : public IndirectNode {
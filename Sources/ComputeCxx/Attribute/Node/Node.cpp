@@ -1,13 +1,65 @@
 #include "Node.h"
 
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Attribute/AttributeID.h"
 #include "Attribute/AttributeType.h"
+#include "Data/Page.h"
 #include "Data/Pointer.h"
 #include "Data/Zone.h"
 #include "Graph/Graph.h"
+#include "Graph/Profiler.h"
+#include "Layout/LayoutDescriptor.h"
+#include "Layout/ValueKernel.h"
+#include "Trace/Trace.h"
 #include "Swift/Metadata.h"
 
 namespace AG {
 
+namespace {
+
+/// Values that track dirty ranges are followed by their bitmap, starting at the first word boundary after the value.
+size_t dirty_bitmap_offset(size_t value_size) { return (value_size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1); }
+
+size_t dirty_bitmap_word_count(const AttributeType &type) {
+    size_t size = type.value_metadata().vw_size();
+    if (!type.tracks_dirty_ranges() || size <= LayoutDescriptor::DirtyRanges::line_size) {
+        return 0;
+    }
+    return LayoutDescriptor::DirtyRanges::word_count(size);
+}
+
+data::ptr<Node> node_ptr(const Node *node) {
+    auto offset = data::ptr<Node>::difference_type((const char *)node - (const char *)data::table::shared().ptr_base());
+    return data::ptr<Node>(offset);
+}
+
+/// Values no larger than this are stored after the node's body instead of being allocated separately, see
+/// AG_INLINE_VALUE_SIZE.
+size_t max_inline_value_size() {
+    static size_t max_inline_value_size = []() -> size_t {
+        char *result = getenv("AG_INLINE_VALUE_SIZE");
+        if (result) {
+            return std::clamp(atoi(result), 0, 64);
+        }
+        return 16;
+    }();
+    return max_inline_value_size;
+}
+
+} // namespace
+
+Node::Node(const AttributeType &type, uint32_t type_id, const void *body)
+    : _state(State().with_self_initialized(true)), _type_id(type_id), _field1(0), _field2(0), _flags(Flags(0)) {
+    void *self = (char *)this + type.attribute_offset();
+    type.self_metadata().vw_initializeWithCopy(static_cast<swift::opaque_value *>(self),
+                                               static_cast<swift::opaque_value *>(const_cast<void *>(body)));
+}
+
+#pragma mark - Self
+
 void Node::update_self(const Graph &graph, void *new_self) {
     auto type = graph.attribute_type(_type_id);
     void *self = ((char *)this + type.attribute_offset());
@@ -41,6 +93,29 @@ void Node::destroy_self(const Graph &graph) {
     type.self_metadata().vw_destroy(static_cast<swift::opaque_value *>(self));
 }
 
+#pragma mark - Value
+
+uint32_t Node::inline_value_offset(const AttributeType &type, bool indirect_self) {
+    size_t size = type.value_metadata().vw_size();
+    size_t alignment = type.value_metadata().vw_alignment();
+    if (size == 0 || size > max_inline_value_size() || alignment > alignof(uint64_t) ||
+        dirty_bitmap_word_count(type) != 0) {
+        return 0;
+    }
+
+    size_t self_size = indirect_self ? sizeof(void *) : type.self_metadata().vw_size();
+    size_t end_of_self = type.attribute_offset() + self_size;
+    return uint32_t((end_of_self + alignment - 1) & ~(alignment - 1));
+}
+
+uint32_t Node::allocation_size(const AttributeType &type, bool indirect_self) {
+    if (uint32_t offset = inline_value_offset(type, indirect_self)) {
+        return offset + uint32_t(type.value_metadata().vw_size());
+    }
+    size_t self_size = indirect_self ? sizeof(void *) : type.self_metadata().vw_size();
+    return uint32_t(type.attribute_offset() + self_size);
+}
+
 void Node::allocate_value(Graph &graph, data::zone &zone) {
     if (_value) {
         return;
@@ -48,21 +123,53 @@ void Node::allocate_value(Graph &graph, data::zone &zone) {
 
     auto type = graph.attribute_type(_type_id);
     size_t size = type.value_metadata().vw_size();
-    size_t alignment = type.value_metadata().vw_alignment();
+    uint32_t alignment_mask = uint32_t(type.value_metadata().vw_alignment() - 1);
+
+    // the storage was allocated along with the node, so reads of the value share its cache lines
+    if (!has_indirect_value()) {
+        if (uint32_t offset = inline_value_offset(type, has_indirect_self())) {
+            _value = node_ptr(this) + offset;
+            graph.did_allocate_node_value(size);
+            return;
+        }
+    }
+
+    size_t dirty_word_count = dirty_bitmap_word_count(type);
+    size_t allocation_size = size;
+    if (dirty_word_count) {
+        allocation_size = dirty_bitmap_offset(size) + dirty_word_count * sizeof(uint64_t);
+        alignment_mask |= sizeof(uint64_t) - 1;
+    }
 
     if (has_indirect_value()) {
         _value = zone.alloc_bytes_recycle(sizeof(void *), sizeof(void *) - 1);
-        void *value = zone.alloc_persistent(size);
+        void *value = zone.alloc_persistent(allocation_size);
         *(static_cast<data::ptr<void *>>(_value)).get() = value;
+    } else if (dirty_word_count) {
+        _value = zone.alloc_bytes(uint32_t(allocation_size), alignment_mask);
     } else {
         if (size <= 0x10) {
-            _value = zone.alloc_bytes_recycle(uint32_t(size), uint32_t(alignment));
+            _value = zone.alloc_bytes_recycle(uint32_t(size), alignment_mask);
         } else {
-            _value = zone.alloc_bytes(uint32_t(size), uint32_t(alignment));
+            // specialize the common alignments
+            switch (alignment_mask) {
+            case 7:
+                _value = zone.alloc_bytes<7>(uint32_t(size));
+                break;
+            case 15:
+                _value = zone.alloc_bytes<15>(uint32_t(size));
+                break;
+            default:
+                _value = zone.alloc_bytes(uint32_t(size), alignment_mask);
+                break;
+            }
         }
     }
 
     graph.did_allocate_node_value(size);
+
+    // Nothing has been compared yet, so the first comparison has to look at the whole value
+    dirty_ranges(graph).mark_all();
 }
 
 void Node::destroy_value(Graph &graph) {
@@ -77,24 +184,118 @@ void Node::destroy_value(Graph &graph) {
         value = *(void **)value;
     }
 
-    type.value_metadata().vw_destroy(static_cast<swift::opaque_value *>(value));
+    LayoutDescriptor::ValueKernel::fetch(type.value_metadata()).destroy(value);
+}
+
+void Node::set_value(Graph &graph, const void *new_value) {
+    if (!_value) {
+        allocate_value(graph, *node_ptr(this).page_ptr()->zone);
+    }
+
+    auto &record = graph.attribute_type_record(_type_id);
+    void *value = value_pointer();
+
+    if (!record.value_needs_destroy()) {
+        memcpy(value, new_value, record.value_size());
+    } else {
+        auto &kernel = LayoutDescriptor::ValueKernel::fetch(record.type().value_metadata());
+        if (_state.is_value_initialized()) {
+            kernel.assign_with_copy(value, new_value);
+        } else {
+            kernel.initialize_with_copy(value, new_value);
+        }
+    }
+    _state = _state.with_value_initialized(true);
+
+    dirty_ranges(graph).mark_all();
+}
+
+void *Node::value_pointer() const {
+    if (!_value) {
+        return nullptr;
+    }
+    void *value = _value.get();
+    if (has_indirect_value()) {
+        value = *(void **)value;
+    }
+    return value;
+}
+
+LayoutDescriptor::DirtyRanges Node::dirty_ranges(const Graph &graph) const {
+    void *value = value_pointer();
+    if (!value) {
+        return LayoutDescriptor::DirtyRanges();
+    }
+
+    auto &type = graph.attribute_type(_type_id);
+    size_t word_count = dirty_bitmap_word_count(type);
+    if (!word_count) {
+        return LayoutDescriptor::DirtyRanges();
+    }
+    auto words = reinterpret_cast<uint64_t *>((char *)value + dirty_bitmap_offset(type.value_metadata().vw_size()));
+    return LayoutDescriptor::DirtyRanges(words, word_count);
+}
+
+void Node::mark_value_dirty(const Graph &graph, size_t offset, size_t size) { dirty_ranges(graph).mark(offset, size); }
+
+bool Node::compare_value(const Graph &graph, const void *other, LayoutDescriptor::ComparisonOptions options) {
+    auto &record = graph.attribute_type_record(_type_id);
+    auto value = static_cast<const unsigned char *>(value_pointer());
+    if (!value || !_state.is_value_initialized()) {
+        return false;
+    }
+
+    Profiler::CompareTimer timer = Profiler::CompareTimer(graph, _type_id);
+
+    // Values that compare bitwise don't need their layout at all
+    auto mode = options.comparision_mode();
+    auto strategy = record.comparison_strategy(mode);
+    ValueLayout layout = nullptr;
+    if (strategy != LayoutDescriptor::ComparisonStrategy::Bitwise) {
+        uint64_t missing_count = LayoutDescriptor::missing_layout_count();
+        layout = LayoutDescriptor::fetch(record.type().value_metadata(), options, 0);
+        if (!strategy && LayoutDescriptor::missing_layout_count() == missing_count) {
+            // a layout that is still being built is compared bytewise without deciding the strategy
+            strategy = LayoutDescriptor::comparison_strategy(layout, record.value_size());
+            record.set_comparison_strategy(mode, *strategy);
+        }
+        if (layout == ValueLayoutEmpty) {
+            layout = nullptr;
+        }
+    }
+
+    auto dirty = dirty_ranges(graph);
+    auto used_strategy = strategy.value_or(LayoutDescriptor::ComparisonStrategy::Layout);
+    bool result = LayoutDescriptor::compare_with_strategy(used_strategy, layout, value,
+                                                          static_cast<const unsigned char *>(other),
+                                                          record.value_size(), dirty, options);
+    dirty.clear();
+    if (!result) {
+        Trace::record(Trace::EventKind::CompareFailed, AttributeID(node_ptr(this)).to_raw_value(),
+                      uint64_t(&record.type().value_metadata()), uint64_t(used_strategy));
+    }
+    return result;
 }
 
 void Node::destroy(Graph &graph) {
+    graph.remove_edges(node_ptr(this), nullptr);
+
     auto type = graph.attribute_type(_type_id);
+    if (destroy_contents(type, true, true)) {
+        graph.did_destroy_node_value(type.value_metadata().vw_size());
+    }
+}
 
-    if (_state.is_value_initialized()) {
+bool Node::destroy_contents(AttributeType &type, bool destroy_value, bool destroy_self) {
+    if (destroy_value && _state.is_value_initialized()) {
         void *value = _value.get();
         if (has_indirect_value()) {
             value = *(void **)value;
         }
-        type.value_metadata().vw_destroy(static_cast<swift::opaque_value *>(value));
-    }
-    if (_value) {
-        graph.did_destroy_node_value(type.value_metadata().vw_size());
+        LayoutDescriptor::ValueKernel::fetch(type.value_metadata()).destroy(value);
     }
 
-    if (_state.is_self_initialized()) {
+    if (destroy_self && _state.is_self_initialized()) {
         void *self = ((char *)this + type.attribute_offset());
         if (has_indirect_self()) {
             self = *(void **)self;
@@ -103,6 +304,8 @@ void Node::destroy(Graph &graph) {
         type.v_destroy_self(self);
         type.self_metadata().vw_destroy(static_cast<swift::opaque_value *>(self));
     }
+
+    return bool(_value);
 }
 
 } // namespace AG
@@ -3,6 +3,9 @@
 #include <CoreFoundation/CFBase.h>
 
 #include "Data/Pointer.h"
+#include "Edges.h"
+#include "Layout/DirtyRanges.h"
+#include "Layout/LayoutDescriptor.h"
 
 CF_ASSUME_NONNULL_BEGIN
 
@@ -11,23 +14,42 @@ namespace AG {
 namespace data {
 class zone;
 }
+class AttributeID;
 class AttributeType;
 class Graph;
 
 class Node {
-  private:
+  public:
     class State {
       public:
         enum : uint8_t {
+            Dirty = 1 << 0,
+            Pending = 1 << 1,
             ValueInitialized = 1 << 4,
             SelfInitialized = 1 << 5,
+            Updating = 1 << 6,
+            UpdatingCyclic = 1 << 7,
         };
 
       private:
         uint8_t _data;
         explicit constexpr State(uint8_t data) : _data(data){};
 
+        State with_flag(uint8_t flag, bool value) const { return State((_data & ~flag) | (value ? flag : 0)); };
+
       public:
+        constexpr State() : _data(0){};
+
+        uint8_t to_raw_value() const { return _data; };
+
+        /// The value needs to be recomputed.
+        bool is_dirty() const { return _data & Dirty; };
+        State with_dirty(bool value) const { return with_flag(Dirty, value); };
+
+        /// The node is in the graph's batch of dirty nodes.
+        bool is_pending() const { return _data & Pending; };
+        State with_pending(bool value) const { return with_flag(Pending, value); };
+
         bool is_value_initialized() { return _data & ValueInitialized; };
         State with_value_initialized(bool value) const {
             return State((_data & ~ValueInitialized) | (value ? ValueInitialized : 0));
@@ -37,8 +59,17 @@ class Node {
         State with_self_initialized(bool value) const {
             return State((_data & ~SelfInitialized) | (value ? SelfInitialized : 0));
         };
+
+        /// The node has a frame on the update stack.
+        bool is_updating() const { return _data & Updating; };
+        State with_updating(bool value) const { return with_flag(Updating, value); };
+
+        /// A cycle through the node was found while it was updating.
+        bool is_updating_cyclic() const { return _data & UpdatingCyclic; };
+        State with_updating_cyclic(bool value) const { return with_flag(UpdatingCyclic, value); };
     };
 
+  private:
     enum Flags : uint8_t {
         HasIndirectSelf = 1 << 0,
         HasIndirectValue = 1 << 1,
@@ -50,19 +81,80 @@ class Node {
     uint8_t _field2;
     Flags _flags;
     data::ptr<void> _value;
+    EdgeList<InputEdge> _inputs;
+    EdgeList<AttributeID> _outputs;
+
+    void *_Nullable value_pointer() const;
 
   public:
+    /// Initializes a node of `type_id` in zone memory of `allocation_size(type, false)` bytes, copying `body` into
+    /// the space after the node. The value is allocated on first use.
+    Node(const AttributeType &type, uint32_t type_id, const void *body);
+
     uint32_t type_id() const { return _type_id; };
 
+    // Update state, see UpdateStack
+    bool is_dirty() const { return _state.is_dirty(); };
+    void set_dirty(bool value) { _state = _state.with_dirty(value); };
+    bool is_pending() const { return _state.is_pending(); };
+    void set_pending(bool value) { _state = _state.with_pending(value); };
+    bool is_updating() const { return _state.is_updating(); };
+    void set_updating(bool value) { _state = _state.with_updating(value); };
+    bool is_updating_cyclic() const { return _state.is_updating_cyclic(); };
+    void set_updating_cyclic(bool value) { _state = _state.with_updating_cyclic(value); };
+
+    // Edges, see Graph::add_input
+    EdgeList<InputEdge> &inputs() { return _inputs; };
+    const EdgeList<InputEdge> &inputs() const { return _inputs; };
+    EdgeList<AttributeID> &outputs() { return _outputs; };
+    const EdgeList<AttributeID> &outputs() const { return _outputs; };
+
     bool has_indirect_self() const { return _flags & Flags::HasIndirectSelf; };
     void update_self(const Graph &graph, void *new_self);
     void destroy_self(const Graph &graph);
 
-    bool has_indirect_value() const { return _flags * Flags::HasIndirectValue; };
+    bool has_indirect_value() const { return _flags & Flags::HasIndirectValue; };
+    bool has_value() const { return bool(_value); };
+
+    // Describing, see GraphDescription
+    State current_state() const { return _state; };
+
+    /// The value's offset in zone memory, or 0 if it isn't allocated or is stored indirectly on the heap.
+    data::ptr<void> direct_value() const { return has_indirect_value() ? data::ptr<void>() : _value; };
+
+    /// The offset from the node to its value if values of `type` are small enough to be stored right after the
+    /// body, otherwise 0. Nodes are allocated 8-byte aligned, so only values with at most that alignment are inline.
+    static uint32_t inline_value_offset(const AttributeType &type, bool indirect_self);
+
+    /// The number of bytes to allocate for a node of `type`, including its body and its value if that is inline.
+    static uint32_t allocation_size(const AttributeType &type, bool indirect_self);
+
+    /// Points the node at storage for its value. Inline values use the space after the body, larger ones are
+    /// allocated from `zone`.
     void allocate_value(Graph &graph, data::zone &zone);
     void destroy_value(Graph &graph);
 
+    /// Copies `new_value` into the value, allocating it from the node's zone first if needed, and assigning over the
+    /// old value if there is one. Values are copied and destroyed with their type's LayoutDescriptor::ValueKernel, so
+    /// values made of plain data and strong references don't go through their value witnesses. Marks the whole value
+    /// dirty.
+    void set_value(Graph &graph, const void *new_value);
+
+    /// The lines of the value written since it was last compared. Only values of attribute types that track dirty
+    /// ranges and are larger than a line have a bitmap, for any other value this tracks nothing.
+    LayoutDescriptor::DirtyRanges dirty_ranges(const Graph &graph) const;
+    void mark_value_dirty(const Graph &graph, size_t offset, size_t size);
+
+    /// Compares the value with `other`, only looking at the lines marked dirty since the last comparison, then
+    /// clears the dirty lines.
+    bool compare_value(const Graph &graph, const void *other, LayoutDescriptor::ComparisonOptions options);
+
+    /// Removes the node's edges from the nodes at their other ends, then destroys its value and body.
     void destroy(Graph &graph);
+
+    /// Destroys the value and body without updating the graph's accounting, skipping either one when its type has
+    /// nothing to destroy. Returns whether the node had a value, see Subgraph::destroy_nodes.
+    bool destroy_contents(AttributeType &type, bool destroy_value, bool destroy_self);
 };
 
 } // namespace AG
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <atomic>
+#include <stdint.h>
+#include <stdlib.h>
+#include <type_traits>
+
+#include "Errors/Errors.h"
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace AG {
+
+/// An open addressing table from pointer-sized keys to pointers that can be read without taking a lock.
+///
+/// Entries are never removed. Writers must be serialized by the caller. A new entry's value is stored before its key
+/// is published, so a reader that finds a key also sees a value for it. Growing copies the entries into a larger
+/// buffer before publishing it, and replaced buffers are kept alive because readers may still be probing them. A
+/// reader holding an old buffer can miss a recent insertion or see a value that has since been replaced, so callers
+/// treat a miss as a reason to look again under their lock.
+template <typename Value>
+    requires std::is_pointer_v<Value>
+class ConcurrentTable {
+  private:
+    struct Slot {
+        std::atomic<uintptr_t> key;
+        std::atomic<Value> value;
+    };
+    struct Buffer {
+        Buffer *_Nullable previous;
+        size_t mask;
+        /// The number of bits dropped from a hash to leave an index, i.e. 64 - log2(capacity).
+        uint32_t shift;
+        Slot slots[];
+    };
+
+    static constexpr size_t initial_capacity = 64;
+
+    std::atomic<Buffer *> _buffer = nullptr;
+    size_t _count = 0;
+
+    /// Fibonacci hashing: the key is multiplied by 2^64 / φ and the index taken from the top bits of the product,
+    /// which depend on every bit of the key. The low bits of the product are as sparse as the key's own, so aligned
+    /// pointers would crowd into a fraction of the slots if those were used instead.
+    static size_t home_index(const Buffer *buffer, uintptr_t key) {
+        return size_t((uint64_t(key) * 0x9e3779b97f4a7c15) >> buffer->shift);
+    };
+
+    static Buffer *make_buffer(size_t capacity, Buffer *_Nullable previous) {
+        Buffer *buffer = (Buffer *)calloc(1, sizeof(Buffer) + capacity * sizeof(Slot));
+        if (!buffer) {
+            precondition_failure("memory allocation failure");
+        }
+        buffer->previous = previous;
+        buffer->mask = capacity - 1;
+        buffer->shift = 64 - __builtin_ctzll(capacity);
+        return buffer;
+    };
+
+    /// Returns the slot holding the key, or the empty slot where it should be inserted. Only used by writers.
+    static Slot &find_slot(Buffer *buffer, uintptr_t key) {
+        size_t index = home_index(buffer, key);
+        while (true) {
+            uintptr_t slot_key = buffer->slots[index].key.load(std::memory_order_acquire);
+            if (slot_key == key || slot_key == 0) {
+                return buffer->slots[index];
+            }
+            index = (index + 1) & buffer->mask;
+        }
+    };
+
+    void grow() {
+        Buffer *old_buffer = _buffer.load(std::memory_order_relaxed);
+        size_t capacity = old_buffer ? (old_buffer->mask + 1) * 2 : initial_capacity;
+        Buffer *new_buffer = make_buffer(capacity, old_buffer);
+        if (old_buffer) {
+            for (size_t index = 0; index <= old_buffer->mask; ++index) {
+                Slot &old_slot = old_buffer->slots[index];
+                if (uintptr_t key = old_slot.key.load(std::memory_order_relaxed)) {
+                    Slot &slot = find_slot(new_buffer, key);
+                    slot.value.store(old_slot.value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                    slot.key.store(key, std::memory_order_relaxed);
+                }
+            }
+        }
+        _buffer.store(new_buffer, std::memory_order_release);
+    };
+
+  public:
+    /// Safe to call concurrently with other lookups and with a writer. Keys must not be null.
+    Value _Nullable lookup(const void *key, bool *found) const {
+        Buffer *buffer = _buffer.load(std::memory_order_acquire);
+        if (!buffer) {
+            *found = false;
+            return nullptr;
+        }
+        size_t index = home_index(buffer, (uintptr_t)key);
+        while (true) {
+            uintptr_t slot_key = buffer->slots[index].key.load(std::memory_order_acquire);
+            if (slot_key == (uintptr_t)key) {
+                *found = true;
+                return buffer->slots[index].value.load(std::memory_order_acquire);
+            }
+            if (slot_key == 0) {
+                *found = false;
+                return nullptr;
+            }
+            index = (index + 1) & buffer->mask;
+        }
+    };
+
+    /// Inserts or replaces the value for a key. Calls must be serialized with each other.
+    void insert(const void *key, Value _Nullable value) {
+        Buffer *buffer = _buffer.load(std::memory_order_relaxed);
+        if (!buffer || (_count + 1) * 4 > (buffer->mask + 1) * 3) {
+            grow();
+            buffer = _buffer.load(std::memory_order_relaxed);
+        }
+
+        Slot &slot = find_slot(buffer, (uintptr_t)key);
+        slot.value.store(value, std::memory_order_release);
+        if (slot.key.load(std::memory_order_relaxed) == 0) {
+            slot.key.store((uintptr_t)key, std::memory_order_release);
+            _count += 1;
+        }
+    };
+
+    size_t count() const { return _count; };
+    size_t capacity() const {
+        Buffer *buffer = _buffer.load(std::memory_order_acquire);
+        return buffer ? buffer->mask + 1 : 0;
+    };
+
+    /// Returns the number of slots a lookup of `key` visits, including the one it stops at.
+    size_t probe_length(const void *key) const {
+        Buffer *buffer = _buffer.load(std::memory_order_acquire);
+        if (!buffer) {
+            return 0;
+        }
+        size_t index = home_index(buffer, (uintptr_t)key);
+        size_t length = 1;
+        while (true) {
+            uintptr_t slot_key = buffer->slots[index].key.load(std::memory_order_acquire);
+            if (slot_key == (uintptr_t)key || slot_key == 0) {
+                return length;
+            }
+            index = (index + 1) & buffer->mask;
+            length += 1;
+        }
+    };
+};
+
+} // namespace AG
+
+CF_ASSUME_NONNULL_END
@@ -1,16 +1,27 @@
 #pragma once
 
 #include <CoreFoundation/CFBase.h>
+#include <bit>
 #include <stdint.h>
 
 CF_ASSUME_NONNULL_BEGIN
 
+// The size of the pages zones allocate from. `ptr::page_ptr` finds the page of a node by masking, so nodes and the
+// values stored after them must start within the first page of their allocation. Larger pages let graphs with large
+// values keep them in place, at the cost of less dense zones for small ones.
+#ifndef AG_PAGE_SIZE
+#define AG_PAGE_SIZE 0x200
+#endif
+
 namespace AG {
 namespace data {
 
-constexpr uint32_t page_size = 0x200;
+constexpr uint32_t page_size = AG_PAGE_SIZE;
 constexpr uint32_t page_alignment_mask = page_size - 1;
 
+static_assert(std::has_single_bit(page_size) && page_size >= 0x200 && page_size <= 0x4000,
+              "AG_PAGE_SIZE must be a power of two from 512 bytes to 16 KiB");
+
 } // namespace data
 } // namespace AG
 
@@ -27,7 +27,8 @@ template <typename T> class ptr {
 
   public:
     ptr(difference_type offset = 0) : _offset(offset){};
-    ptr(nullptr_t){};
+    ptr(nullptr_t) : _offset(0){};
+    template <typename U> ptr(const ptr<U> &other) : _offset(other._offset){};
 
     void assert_valid() const {
         if (_offset >= table::shared().ptr_max_offset()) {
@@ -40,6 +41,8 @@ template <typename T> class ptr {
         return reinterpret_cast<element_type *>(table::shared().ptr_base() + _offset);
     }
 
+    difference_type offset() const noexcept { return _offset; };
+
     ptr<page> page_ptr() const noexcept { return ptr<page>(_offset & ~page_alignment_mask); }
 
     difference_type page_relative_offset() const noexcept { return _offset & page_alignment_mask; }
@@ -48,20 +51,28 @@ template <typename T> class ptr {
         return ptr<U>((_offset + alignment_mask) & ~alignment_mask);
     };
 
-    operator bool() const noexcept { return _offset != 0; };
+    template <difference_type alignment_mask, typename U = T> ptr<U> aligned() const {
+        static_assert((alignment_mask & (alignment_mask + 1)) == 0, "alignment mask must be one less than a power of 2");
+        return ptr<U>((_offset + alignment_mask) & ~alignment_mask);
+    };
+
+    explicit operator bool() const noexcept { return _offset != 0; };
     std::add_lvalue_reference_t<T> operator*() const noexcept { return *get(); };
     T *_Nonnull operator->() const noexcept { return get(); };
 
     bool operator==(nullptr_t) const noexcept { return _offset == 0; };
     bool operator!=(nullptr_t) const noexcept { return _offset != 0; };
 
+    template <typename U> bool operator==(const ptr<U> &other) const noexcept { return _offset == other._offset; };
+    template <typename U> bool operator!=(const ptr<U> &other) const noexcept { return _offset != other._offset; };
+
     bool operator<(difference_type offset) const noexcept { return _offset < offset; };
     bool operator<=(difference_type offset) const noexcept { return _offset <= offset; };
     bool operator>(difference_type offset) const noexcept { return _offset > offset; };
     bool operator>=(difference_type offset) const noexcept { return _offset >= offset; };
 
-    template <typename U> ptr<U> operator+(difference_type shift) const noexcept { return ptr(_offset + shift); };
-    template <typename U> ptr<U> operator-(difference_type shift) const noexcept { return ptr(_offset - shift); };
+    ptr operator+(difference_type shift) const noexcept { return ptr(_offset + shift); };
+    ptr operator-(difference_type shift) const noexcept { return ptr(_offset - shift); };
 
     template <typename U> difference_type operator-(const ptr<U> &other) const noexcept {
         return _offset - other._offset;
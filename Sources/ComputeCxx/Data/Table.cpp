@@ -17,15 +17,21 @@ static void *AGGraphVMRegionBaseAddress;
 namespace AG {
 namespace data {
 
-table _shared_table_bytes;
+namespace {
+
+// Left uninitialized so that the table is constructed exactly once, by ensure_shared. A static table would reserve its
+// region at load time, only for ensure_shared to construct another one over it and leak the first reservation.
+alignas(table) unsigned char _shared_table_bytes[sizeof(table)];
+
+} // namespace
 
 table &table::ensure_shared() {
     static dispatch_once_t onceToken;
-    dispatch_once_f(&onceToken, nullptr, [](void *_Nullable context) { new (&_shared_table_bytes) table(); });
-    return _shared_table_bytes;
+    dispatch_once_f(&onceToken, nullptr, [](void *_Nullable context) { new (_shared_table_bytes) table(); });
+    return shared();
 }
 
-table &table::shared() { return _shared_table_bytes; }
+table &table::shared() { return *reinterpret_cast<table *>(_shared_table_bytes); }
 
 malloc_zone_t *table::_malloc_zone = nullptr;
 
@@ -37,12 +43,46 @@ std::unique_ptr<void, table::malloc_zone_deleter> table::alloc_persistent(size_t
     return std::unique_ptr<void, table::malloc_zone_deleter>(buffer);
 }
 
-table::table() {
-    constexpr vm_size_t initial_size = 32 * pages_per_map * page_size;
+namespace {
 
-    void *region = mmap(nullptr, initial_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
-    if (region == MAP_FAILED) {
-        precondition_failure("memory allocation failure (%u bytes, %u)", initial_size, errno);
+constexpr vm_size_t superpage_size = 2 * 1024 * 1024;
+
+// The largest region addressable by a 32-bit ptr offset, which starts one page before the region, rounded down to a
+// whole number of page maps
+constexpr vm_size_t max_region_size = (uint64_t(1) << 32) - 64 * page_size;
+
+uint32_t reusable_purge_threshold_from_environment() {
+    char *result = getenv("AG_REUSABLE_PURGE_THRESHOLD");
+    if (result) {
+        return atoi(result);
+    }
+    return 32;
+}
+
+bool superpages_enabled_by_environment() {
+    char *result = getenv("AG_USE_SUPERPAGES");
+    if (result) {
+        return atoi(result) != 0;
+    }
+    return false;
+}
+
+} // namespace
+
+table::table() : table(superpages_enabled_by_environment()) {}
+
+table::table(bool use_superpages)
+    : _use_superpages(use_superpages), _reusable_purge_threshold(reusable_purge_threshold_from_environment()) {
+    vm_size_t initial_size = 32 * pages_per_map * page_size;
+    if (_use_superpages) {
+        // superpage regions must be a multiple of the superpage size, growing by 4x keeps them so
+        initial_size = std::max(initial_size, superpage_size);
+    }
+
+    // Superpages are allocated up front rather than faulted in, so they can't be reserved
+    void *region = _use_superpages ? nullptr : reserve_region(max_region_size, initial_size);
+    if (!region) {
+        region = alloc_region(initial_size);
     }
 
     _vm_region_base_address = reinterpret_cast<vm_address_t>(region);
@@ -50,8 +90,8 @@ table::table() {
 
     AGGraphVMRegionBaseAddress = region;
 
-    _ptr_base = reinterpret_cast<vm_address_t>(region) - page_size;
-    _ptr_max_offset = initial_size + page_size;
+    _ptr_base.store(reinterpret_cast<vm_address_t>(region) - page_size, std::memory_order_relaxed);
+    _ptr_max_offset.store(initial_size + page_size, std::memory_order_relaxed);
 
     if (!_malloc_zone) {
         _malloc_zone = malloc_create_zone(0, 0);
@@ -65,7 +105,66 @@ void table::unlock() { os_unfair_lock_unlock(&_lock); }
 
 #pragma mark - Region
 
+void *table::alloc_region(vm_size_t size) {
+#if defined(VM_FLAGS_SUPERPAGE_SIZE_2MB)
+    if (_use_superpages && size % superpage_size == 0) {
+        vm_address_t address = 0;
+        kern_return_t error =
+            vm_allocate(mach_task_self(), &address, size, VM_FLAGS_ANYWHERE | VM_FLAGS_SUPERPAGE_SIZE_2MB);
+        if (error == KERN_SUCCESS) {
+            _region_uses_superpages = true;
+            _num_superpage_regions += 1;
+            return reinterpret_cast<void *>(address);
+        }
+    }
+#endif
+
+    // superpages are unavailable, either because the platform does not support them or none are free
+    if (_use_superpages) {
+        _num_superpage_fallbacks += 1;
+    }
+    _region_uses_superpages = false;
+
+    void *region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (region == MAP_FAILED) {
+        precondition_failure("memory allocation failure (%u bytes, %u)", size, errno);
+    }
+    return region;
+}
+
+void *table::reserve_region(vm_size_t reserved_size, vm_size_t initial_size) {
+    void *region = mmap(nullptr, reserved_size, PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (region == MAP_FAILED) {
+        return nullptr;
+    }
+
+    if (mprotect(region, initial_size, PROT_READ | PROT_WRITE) != 0) {
+        munmap(region, reserved_size);
+        return nullptr;
+    }
+
+    _vm_reserved_size = static_cast<uint32_t>(reserved_size);
+    return region;
+}
+
 void table::grow_region() {
+    if (_vm_reserved_size) {
+        // commit more of the reserved range in place
+        uint32_t new_size = static_cast<uint32_t>(std::min(uint64_t(4) * _vm_region_size, uint64_t(_vm_reserved_size)));
+        if (new_size <= _vm_region_size) {
+            precondition_failure("exhausted data space");
+        }
+
+        void *commit_address = reinterpret_cast<void *>(_vm_region_base_address + _vm_region_size);
+        if (mprotect(commit_address, new_size - _vm_region_size, PROT_READ | PROT_WRITE) != 0) {
+            precondition_failure("memory allocation failure (%u bytes, %u)", new_size, errno);
+        }
+
+        _vm_region_size = new_size;
+        _ptr_max_offset.store(new_size + page_size, std::memory_order_release);
+        return;
+    }
+
     uint64_t new_size = 4 * _vm_region_size;
 
     // Check size does not exceed 32 bits
@@ -73,10 +172,7 @@ void table::grow_region() {
         precondition_failure("exhausted data space");
     }
 
-    void *new_region = mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
-    if (new_region == MAP_FAILED) {
-        precondition_failure("memory allocation failure (%u bytes, %u)", new_size, errno);
-    }
+    void *new_region = alloc_region(new_size);
 
     vm_prot_t cur_protection = VM_PROT_NONE;
     vm_prot_t max_protection = VM_PROT_NONE;
@@ -94,76 +190,182 @@ void table::grow_region() {
     AGGraphVMRegionBaseAddress = new_region;
 
     _vm_region_size = static_cast<uint32_t>(new_size);
-    _ptr_base = reinterpret_cast<vm_address_t>(new_region) - page_size;
-    _ptr_max_offset = _vm_region_size + page_size;
+    // publish the new base before any offsets beyond the old region are handed out
+    _ptr_base.store(reinterpret_cast<vm_address_t>(new_region) - page_size, std::memory_order_release);
+    _ptr_max_offset.store(_vm_region_size + page_size, std::memory_order_release);
 }
 
 #pragma mark - Zones
 
 uint32_t table::make_zone_id() {
-    _num_zones += 1;
-    return _num_zones;
+    lock();
+
+    uint32_t slot;
+    if (!_free_zone_slots.empty()) {
+        slot = _free_zone_slots.back();
+        _free_zone_slots.pop_back();
+    } else {
+        if (_num_zone_slots > zone_slot_mask) {
+            precondition_failure("too many zones");
+        }
+        slot = _num_zone_slots;
+        _num_zone_slots += 1;
+
+        auto &chunk = _zone_generation_chunks[slot / zone_slots_per_chunk];
+        if (!chunk.load(std::memory_order_relaxed)) {
+            chunk.store(new std::atomic<uint32_t>[zone_slots_per_chunk](), std::memory_order_release);
+        }
+    }
+
+    auto chunk = _zone_generation_chunks[slot / zone_slots_per_chunk].load(std::memory_order_relaxed);
+    uint32_t generation = chunk[slot % zone_slots_per_chunk].load(std::memory_order_relaxed);
+
+    unlock();
+
+    return slot | (generation << zone_slot_bits);
 }
 
-#pragma mark - Pages
+void table::retire_zone_id(uint32_t zone_id) {
+    uint32_t slot = zone_id & zone_slot_mask;
+    uint32_t generation = zone_id >> zone_slot_bits;
+    if (!is_zone_id_live(zone_id)) {
+        precondition_failure("zone id already retired: %u", zone_id);
+    }
 
-ptr<page> table::alloc_page(zone *zone, uint32_t needed_size) {
     lock();
 
+    auto chunk = _zone_generation_chunks[slot / zone_slots_per_chunk].load(std::memory_order_relaxed);
+    if (generation < zone_generation_mask) {
+        chunk[slot % zone_slots_per_chunk].store(generation + 1, std::memory_order_release);
+        _free_zone_slots.push_back(slot);
+    } else {
+        // out of generations, the slot is never reused
+        chunk[slot % zone_slots_per_chunk].store(UINT32_MAX, std::memory_order_release);
+    }
+
+    unlock();
+}
+
+#pragma mark - Page magazines
+
+/// A per-thread cache of free single pages. Pages held by a magazine remain marked as used in the page maps, so zones
+/// on the owning thread can allocate and free pages without taking the table lock. The shared state is only touched
+/// when a magazine runs empty or overflows.
+class page_magazine {
+  public:
+    constexpr static uint32_t capacity = 32;
+
+  private:
+    table *_Nullable _table = nullptr;
+    uint32_t _count = 0;
+    uint32_t _page_indices[capacity];
+
+    void refill() {
+        _table->lock();
+        while (_count < capacity / 2) {
+            _page_indices[_count++] = _table->alloc_pages_locked(1);
+        }
+        _table->unlock();
+    }
+
+    void flush(uint32_t keep_count) {
+        _table->lock();
+        while (_count > keep_count) {
+            _table->dealloc_pages_locked(_page_indices[--_count], 1);
+        }
+        _table->unlock();
+    }
+
+  public:
+    ~page_magazine() {
+        if (_table && _count) {
+            flush(0);
+        }
+    }
+
+    /// Returns the magazine for the current thread, or nullptr if it is bound to another table.
+    static page_magazine *_Nullable current(table &table) {
+        static thread_local page_magazine magazine;
+        if (!magazine._table) {
+            magazine._table = &table;
+        }
+        return magazine._table == &table ? &magazine : nullptr;
+    }
+
+    uint32_t pop() {
+        if (_count == 0) {
+            _table->_magazine_misses.fetch_add(1, std::memory_order_relaxed);
+            refill();
+        } else {
+            _table->_magazine_hits.fetch_add(1, std::memory_order_relaxed);
+        }
+        return _page_indices[--_count];
+    }
+
+    void push(uint32_t page_index) {
+        if (_count == capacity) {
+            _table->_magazine_overflows.fetch_add(1, std::memory_order_relaxed);
+            flush(capacity / 2);
+        }
+        _page_indices[_count++] = page_index;
+    }
+};
+
+#pragma mark - Pages
+
+ptr<page> table::alloc_page(zone *zone, uint32_t needed_size) {
     uint32_t needed_pages = (needed_size + page_alignment_mask) / page_size;
 
-    // assume we'll have to append a new page
-    uint32_t new_page_index = _page_maps.size() * pages_per_map;
+    uint32_t new_page_index;
+    page_magazine *magazine = needed_pages == 1 ? page_magazine::current(*this) : nullptr;
+    if (magazine) {
+        new_page_index = magazine->pop();
+    } else {
+        new_page_index = alloc_pages(needed_pages);
+    }
 
-    // scan for consecutive free pages
-    if (!_page_maps.empty() && _num_used_pages <= _page_maps.size() * pages_per_map) {
+    // ptr offsets are "one"-based, so that we can treat 0 as null.
+    ptr<page> new_page = ptr<page>((new_page_index + 1) * page_size);
+    new_page->zone = zone;
+    new_page->previous = nullptr;
+    new_page->total = needed_pages * page_size;
+    new_page->in_use = sizeof(page);
 
-        uint32_t start_map_index = _map_search_start;
-        for (int i = 0; i < _page_maps.size(); i++) {
-            int map_index = start_map_index + i;
-            if (map_index >= _page_maps.size()) {
-                map_index -= _page_maps.size(); // wrap around
-            }
+    return new_page;
+}
 
-            page_map_type free_pages_map = _page_maps[map_index].flip();
-            while (free_pages_map.any()) {
-
-                int candidate_bit = std::countr_zero(static_cast<uint64_t>(free_pages_map.to_ullong()));
-
-                // scan ahead to find enough consecutive free pages
-                bool found = false;
-                if (needed_pages > 1) {
-                    for (int j = 1; j < needed_pages; j++) {
-                        int next_page_index = (map_index * pages_per_map) + candidate_bit + j;
-                        int next_map_index = next_page_index / pages_per_map;
-                        if (next_map_index == _page_maps.size()) {
-                            // There are not enough maps, but the trailing pages are contiguous so this page is
-                            // usable
-                            found = true;
-                            break;
-                        }
-                        if (_page_maps[next_map_index].test(next_page_index % pages_per_map)) {
-                            // next page is used, remove this page from free_pages_map
-                            free_pages_map.reset(candidate_bit);
-                            break;
-                        }
-                    }
-                    found = true;
-                } else {
-                    // only need one page
-                    found = true;
-                }
+uint32_t table::alloc_pages(uint32_t needed_pages) {
+    lock();
+    uint32_t new_page_index = alloc_pages_locked(needed_pages);
+    unlock();
+    return new_page_index;
+}
+
+uint32_t table::alloc_pages_locked(uint32_t needed_pages) {
+    // assume we'll have to append a new page
+    uint32_t new_page_index = _page_maps.size() * pages_per_map;
 
-                if (found) {
-                    new_page_index = (map_index * pages_per_map) + candidate_bit;
+    // scan for consecutive free pages, starting from the last map that satisfied a request
+    if (!_page_maps.empty() && _num_used_pages < _page_maps.size() * pages_per_map) {
+        uint32_t num_maps = _page_maps.size();
+        uint32_t search_start = std::min(_map_search_start, num_maps);
+
+        bool found = false;
+        for (int pass = 0; pass < 2 && !found; pass++) {
+            uint32_t map_index = pass == 0 ? search_start : 0;
+            uint32_t end_map_index = pass == 0 ? num_maps : search_start;
+            while (!found && (map_index = next_map_with_free_pages(map_index, end_map_index)) < end_map_index) {
+                if (find_free_pages(map_index, needed_pages, &new_page_index)) {
                     _map_search_start = map_index;
-                    break;
+                    found = true;
                 }
+                map_index += 1;
             }
         }
     }
 
     // update maps
+    uint32_t last_map_index = new_page_index / pages_per_map;
     for (int i = 0; i < needed_pages; i++) {
         uint32_t page_index = new_page_index + i;
         uint32_t map_index = page_index / pages_per_map;
@@ -171,15 +373,26 @@ ptr<page> table::alloc_page(zone *zone, uint32_t needed_size) {
         if (map_index == _page_maps.size()) {
             _page_maps.push_back(0);
             _page_metadata_maps.push_back(0);
-        } else if (_page_maps[map_index] == 0) {
-            make_pages_reusable(page_index, false);
+            _longest_free_runs.push_back(pages_per_map);
+            if (map_index % maps_per_summary == 0) {
+                _free_page_summary.push_back(0);
+                _pending_reusable_maps.push_back(0);
+            }
+        } else if (_page_maps[map_index] == 0 && !cancel_map_reusable(map_index)) {
+            make_maps_reusable(map_index, 1, false);
         }
 
         _page_maps[map_index].set(page_index % pages_per_map);
         if (i == 0) {
             _page_metadata_maps[map_index].set(page_index % pages_per_map);
         }
+
+        if (map_index != last_map_index) {
+            update_free_page_summary(last_map_index);
+            last_map_index = map_index;
+        }
     }
+    update_free_page_summary(last_map_index);
 
     _num_used_pages += needed_pages;
 
@@ -188,26 +401,121 @@ ptr<page> table::alloc_page(zone *zone, uint32_t needed_size) {
         grow_region();
     }
 
-    // ptr offsets are "one"-based, so that we can treat 0 as null.
-    ptr<page> new_page = ptr<page>((new_page_index + 1) * page_size);
-    new_page->zone = zone;
-    new_page->previous = nullptr;
-    new_page->total = (needed_size + page_alignment_mask) & ~page_alignment_mask;
-    new_page->in_use = sizeof(page);
+    return new_page_index;
+}
 
-    unlock();
+#pragma mark - Free page summary
 
-    return new_page;
+void table::update_free_page_summary(uint32_t map_index) {
+    uint64_t free_pages = ~static_cast<uint64_t>(_page_maps[map_index].to_ullong());
+
+    uint64_t summary_bit = uint64_t(1) << (map_index % maps_per_summary);
+    uint64_t &summary = _free_page_summary[map_index / maps_per_summary];
+    summary = free_pages ? (summary | summary_bit) : (summary & ~summary_bit);
+
+    // measure each run of free pages in turn
+    uint32_t longest_run = 0;
+    while (free_pages) {
+        uint32_t run_start = std::countr_zero(free_pages);
+        uint32_t run_length = std::countr_one(free_pages >> run_start);
+        longest_run = std::max(longest_run, run_length);
+        if (run_start + run_length == pages_per_map) {
+            break;
+        }
+        free_pages &= ~uint64_t(0) << (run_start + run_length);
+    }
+    _longest_free_runs[map_index] = longest_run;
+}
+
+uint32_t table::next_map_with_free_pages(uint32_t map_index, uint32_t end_map_index) {
+    while (map_index < end_map_index) {
+        uint32_t summary_index = map_index / maps_per_summary;
+        uint64_t candidates = _free_page_summary[summary_index] & (~uint64_t(0) << (map_index % maps_per_summary));
+        if (candidates) {
+            return std::min(summary_index * maps_per_summary + std::countr_zero(candidates), end_map_index);
+        }
+        map_index = (summary_index + 1) * maps_per_summary;
+    }
+    return end_map_index;
+}
+
+bool table::find_free_pages(uint32_t map_index, uint32_t needed_pages, uint32_t *page_index_out) {
+    uint64_t free_pages = ~static_cast<uint64_t>(_page_maps[map_index].to_ullong());
+
+    // look for a run that fits within this map
+    if (needed_pages <= _longest_free_runs[map_index]) {
+        // reduce to the bits that begin a run of needed_pages free pages, doubling the run length each step
+        uint64_t run_starts = free_pages;
+        for (uint32_t run_length = 1; run_length < needed_pages;) {
+            uint32_t shift = std::min(run_length, needed_pages - run_length);
+            run_starts &= run_starts >> shift;
+            run_length += shift;
+        }
+        *page_index_out = map_index * pages_per_map + std::countr_zero(run_starts);
+        return true;
+    }
+
+    // otherwise look for a run that starts at the top of this map and continues into the following maps
+    uint32_t run_length = std::countl_one(free_pages);
+    if (run_length == 0) {
+        return false;
+    }
+    for (uint32_t next_map_index = map_index + 1; run_length < needed_pages; next_map_index++) {
+        if (next_map_index == _page_maps.size()) {
+            // There are not enough maps, but the trailing pages are contiguous so this run is usable
+            run_length = needed_pages;
+            break;
+        }
+        uint32_t leading_free_pages = std::countr_one(~static_cast<uint64_t>(_page_maps[next_map_index].to_ullong()));
+        run_length += leading_free_pages;
+        if (leading_free_pages < pages_per_map) {
+            break;
+        }
+    }
+    if (run_length < needed_pages) {
+        return false;
+    }
+
+    *page_index_out = (map_index + 1) * pages_per_map - std::countl_one(free_pages);
+    return true;
+}
+
+void table::dealloc_page(ptr<page> page) {
+    // convert the page address (starts one page in) to an index (starts at 0)
+    uint32_t page_index = (page.offset() / page_size) - 1;
+    uint32_t num_pages = page->total / page_size;
+
+    page_magazine *magazine = num_pages == 1 ? page_magazine::current(*this) : nullptr;
+    if (magazine) {
+        // Clear the owning zone so that weak references into this page expire while it sits in the magazine
+        page->zone = nullptr;
+        _page_generation.fetch_add(1, std::memory_order_release);
+        magazine->push(page_index);
+        return;
+    }
+
+    dealloc_pages(page_index, num_pages);
+}
+
+void table::dealloc_pages(uint32_t page_index, uint32_t num_pages) {
+    lock();
+    dealloc_pages_locked(page_index, num_pages);
+    unlock();
 }
 
 void table::dealloc_page_locked(ptr<page> page) {
     int32_t total_bytes = page->total;
     int32_t num_pages = total_bytes / page_size;
 
+    // convert the page address (starts one page in) to an index (starts at 0)
+    int32_t page_index = (page.offset() / page_size) - 1;
+    dealloc_pages_locked(page_index, num_pages);
+}
+
+void table::dealloc_pages_locked(uint32_t page_index, uint32_t num_pages) {
     _num_used_pages -= num_pages;
+    _page_generation.fetch_add(1, std::memory_order_release);
 
-    // convert the page address (starts at 512) to an index (starts at 0)
-    int32_t page_index = (page / page_size) - 1;
     for (int32_t i = 0; i != num_pages; i += 1) {
 
         int32_t next_page_index = page_index + i;
@@ -218,20 +526,103 @@ void table::dealloc_page_locked(ptr<page> page) {
             _page_metadata_maps[next_map_index].reset(next_page_index % pages_per_map);
         }
 
+        if (i + 1 == num_pages || (next_page_index + 1) % pages_per_map == 0) {
+            update_free_page_summary(next_map_index);
+        }
+
         if (_page_maps[next_map_index].none()) {
-            make_pages_reusable(next_page_index, true);
+            defer_map_reusable(next_map_index);
         }
     }
 }
 
-void table::make_pages_reusable(uint32_t page_index, bool reusable) {
-    static constexpr uint32_t mapped_pages_size = page_size * pages_per_map; // 64 * 512 = 0x8000
+#pragma mark - Reusable pages
+
+void table::defer_map_reusable(uint32_t map_index) {
+    if (_reusable_purge_threshold == 0) {
+        make_maps_reusable(map_index, 1, true);
+        return;
+    }
+
+    uint64_t &pending = _pending_reusable_maps[map_index / maps_per_summary];
+    uint64_t pending_bit = uint64_t(1) << (map_index % maps_per_summary);
+    if (pending & pending_bit) {
+        return;
+    }
+    pending |= pending_bit;
+    _num_pending_reusable_maps += 1;
 
-    void *mapped_pages_address =
-        reinterpret_cast<void *>(_vm_region_base_address + ((page_index * page_size) & ~(mapped_pages_size - 1)));
+    if (_num_pending_reusable_maps >= _reusable_purge_threshold && !_reusable_purge_scheduled) {
+        _reusable_purge_scheduled = true;
+        dispatch_async_f(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), this,
+                         [](void *_Nullable context) { reinterpret_cast<table *>(context)->purge_reusable_pages(); });
+    }
+}
+
+/// Returns true if the map was still waiting to be made reusable, in which case its memory was never released.
+bool table::cancel_map_reusable(uint32_t map_index) {
+    uint64_t &pending = _pending_reusable_maps[map_index / maps_per_summary];
+    uint64_t pending_bit = uint64_t(1) << (map_index % maps_per_summary);
+    if (!(pending & pending_bit)) {
+        return false;
+    }
+    pending &= ~pending_bit;
+    _num_pending_reusable_maps -= 1;
+    return true;
+}
+
+uint64_t table::purge_reusable_pages() {
+    lock();
+    uint64_t purged_size = purge_reusable_pages_locked();
+    unlock();
+    return purged_size;
+}
+
+uint64_t table::purge_reusable_pages_locked() {
+    _reusable_purge_scheduled = false;
+    if (_num_pending_reusable_maps == 0) {
+        return 0;
+    }
+    uint64_t reusable_size = _num_reusable_pages;
+
+    // release each run of consecutive pending maps with a single call
+    uint32_t num_maps = _page_maps.size();
+    uint32_t map_index = 0;
+    while (_num_pending_reusable_maps > 0 && map_index < num_maps) {
+        uint32_t summary_index = map_index / maps_per_summary;
+        uint64_t pending = _pending_reusable_maps[summary_index] >> (map_index % maps_per_summary);
+        if (!pending) {
+            map_index = (summary_index + 1) * maps_per_summary;
+            continue;
+        }
+
+        uint32_t run_start = map_index + std::countr_zero(pending);
+        uint32_t run_end = run_start;
+        while (run_end < num_maps) {
+            uint64_t &run_pending = _pending_reusable_maps[run_end / maps_per_summary];
+            uint64_t run_bit = uint64_t(1) << (run_end % maps_per_summary);
+            if (!(run_pending & run_bit)) {
+                break;
+            }
+            run_pending &= ~run_bit;
+            run_end += 1;
+        }
+
+        _num_pending_reusable_maps -= run_end - run_start;
+        make_maps_reusable(run_start, run_end - run_start, true);
+        map_index = run_end;
+    }
+    return _num_reusable_pages - reusable_size;
+}
+
+void table::make_maps_reusable(uint32_t map_index, uint32_t num_maps, bool reusable) {
+    static constexpr uint32_t mapped_pages_size = page_size * pages_per_map;
+
+    void *mapped_pages_address = reinterpret_cast<void *>(_vm_region_base_address + map_index * mapped_pages_size);
+    uint32_t mapped_size = num_maps * mapped_pages_size;
 
     int advice = reusable ? MADV_FREE_REUSABLE : MADV_FREE_REUSE;
-    madvise(mapped_pages_address, mapped_pages_size, advice);
+    madvise(mapped_pages_address, mapped_size, advice);
 
     static bool unmap_reusable = []() -> bool {
         char *result = getenv("AG_UNMAP_REUSABLE");
@@ -243,10 +634,10 @@ void table::make_pages_reusable(uint32_t page_index, bool reusable) {
 
     if (unmap_reusable) {
         int protection = reusable ? PROT_NONE : (PROT_READ | PROT_WRITE);
-        mprotect(mapped_pages_address, mapped_pages_size, protection);
+        mprotect(mapped_pages_address, mapped_size, protection);
     }
 
-    _num_reusable_pages += reusable ? mapped_pages_size : -mapped_pages_size;
+    _num_reusable_pages += reusable ? mapped_size : -mapped_size;
 }
 
 uint64_t table::raw_page_seed(ptr<page> page) {
@@ -254,19 +645,95 @@ uint64_t table::raw_page_seed(ptr<page> page) {
 
     lock();
 
-    uint32_t page_index = (page / page_size) - 1;
+    uint32_t page_index = (page.offset() / page_size) - 1;
     uint32_t map_index = page_index / pages_per_map;
 
     uint64_t result = 0;
-    if (map_index < _page_metadata_maps.size() && _page_metadata_maps[map_index].test(page_index % page_size)) {
+    if (map_index < _page_metadata_maps.size() && _page_metadata_maps[map_index].test(page_index % pages_per_map) &&
+        page->zone) {
         auto raw_zone_info = page->zone->info().to_raw_value();
-        result = raw_zone_info | (1 < 8);
+        result = raw_zone_info | (1 << 8);
+    }
+
+    unlock();
+
+    return result;
+}
+
+#pragma mark - Copying
+
+table::region_copy &table::region_copy::operator=(region_copy &&other) {
+    if (this != &other) {
+        if (_address) {
+            vm_deallocate(mach_task_self(), _address, _size);
+        }
+        _address = other._address;
+        _size = other._size;
+        other._address = 0;
+        other._size = 0;
     }
+    return *this;
+}
 
+table::region_copy::~region_copy() {
+    if (_address) {
+        vm_deallocate(mach_task_self(), _address, _size);
+    }
+}
+
+vm_address_t table::region_copy::ptr_base() const { return _address - page_size; }
+
+table::region_copy table::copy_region() {
+    lock();
+    vm_address_t address = 0;
+    vm_size_t size = _vm_region_size;
+    vm_prot_t cur_protection = VM_PROT_NONE;
+    vm_prot_t max_protection = VM_PROT_NONE;
+    kern_return_t error = vm_remap(mach_task_self(), &address, size, 0, VM_FLAGS_ANYWHERE, mach_task_self(),
+                                   _vm_region_base_address, true, &cur_protection, &max_protection, VM_INHERIT_NONE);
     unlock();
 
+    if (error) {
+        non_fatal_precondition_failure("vm_remap failure: 0x%x", error);
+        return region_copy();
+    }
+    return region_copy(address, size);
+}
+
+vector<uint64_t, 0, uint32_t> table::used_page_map() {
+    lock();
+    vector<uint64_t, 0, uint32_t> result;
+    result.reserve(_page_maps.size());
+    for (const page_map_type &page_map : _page_maps) {
+        result.push_back(page_map.to_ullong());
+    }
+    unlock();
     return result;
 }
 
+#pragma mark - Printing
+
+void table::print() {
+    lock();
+    fprintf(stdout, "data::table %p:\n  %.2fKB allocated, %.2fKB used, %.2fKB reusable.\n", this,
+            _vm_region_size / 1024.0, (_num_used_pages * page_size) / 1024.0, _num_reusable_pages / 1024.0);
+    if (_vm_reserved_size) {
+        fprintf(stdout, "  %.2fKB reserved.\n", _vm_reserved_size / 1024.0);
+    }
+
+    uint64_t hits = _magazine_hits.load(std::memory_order_relaxed);
+    uint64_t misses = _magazine_misses.load(std::memory_order_relaxed);
+    uint64_t total = hits + misses;
+    fprintf(stdout, "  page magazines: %llu hits, %llu misses (%.1f%% hit rate), %llu overflows.\n", hits, misses,
+            total ? (100.0 * hits) / total : 0.0,
+            _magazine_overflows.load(std::memory_order_relaxed));
+
+    if (_use_superpages) {
+        fprintf(stdout, "  superpages: %s, %u regions, %u fallbacks.\n", _region_uses_superpages ? "active" : "inactive",
+                _num_superpage_regions, _num_superpage_fallbacks);
+    }
+    unlock();
+}
+
 } // namespace data
 } // namespace AG
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <CoreFoundation/CFBase.h>
+#include <atomic>
 #include <bitset>
 #include <mach/vm_types.h>
 #include <malloc/malloc.h>
@@ -8,6 +9,7 @@
 #include <stdint.h>
 #include <utility>
 
+#include "Constants.h"
 #include "Vector/Vector.h"
 
 CF_ASSUME_NONNULL_BEGIN
@@ -17,6 +19,7 @@ namespace data {
 
 class zone;
 class page;
+class page_magazine;
 template <typename T> class ptr;
 
 class table {
@@ -30,17 +33,31 @@ class table {
     static std::unique_ptr<void, malloc_zone_deleter> alloc_persistent(size_t size);
 
   private:
-    vm_address_t _ptr_base;
+    std::atomic<vm_address_t> _ptr_base;
     vm_address_t _vm_region_base_address;
     os_unfair_lock _lock = OS_UNFAIR_LOCK_INIT;
-    uint32_t _vm_region_size;
-    uint32_t _ptr_max_offset;
+    std::atomic<uint32_t> _vm_region_size;
+    uint32_t _vm_reserved_size = 0;
+    std::atomic<uint32_t> _ptr_max_offset;
 
-    uint32_t _num_used_pages = 0;
-    uint32_t _num_reusable_pages = 0;
+    // Only modified with the lock held, atomic so that they may be read from other threads
+    std::atomic<uint32_t> _num_used_pages = 0;
+    std::atomic<uint32_t> _num_reusable_pages = 0;
     uint32_t _map_search_start = 0;
 
-    uint32_t _num_zones = 0;
+    std::atomic<uint32_t> _page_generation = 0;
+
+    // Zone generations, see make_zone_id(). Chunks are allocated as slots are first used and never move, so that
+    // generations can be read without the lock
+    constexpr static unsigned int zone_slot_bits = 16;
+    constexpr static unsigned int zone_generation_bits = 15;
+    constexpr static uint32_t zone_slot_mask = (1 << zone_slot_bits) - 1;
+    constexpr static uint32_t zone_generation_mask = (1 << zone_generation_bits) - 1;
+    constexpr static unsigned int zone_slots_per_chunk = 1024;
+    constexpr static unsigned int num_zone_generation_chunks = (1 << zone_slot_bits) / zone_slots_per_chunk;
+    std::atomic<std::atomic<uint32_t> *> _zone_generation_chunks[num_zone_generation_chunks] = {};
+    uint32_t _num_zone_slots = 1; // slot 0 is never used, so that a zone id of 0 is never live
+    vector<uint32_t, 0, uint32_t> _free_zone_slots = {};
 
     using remapped_region = std::pair<vm_address_t, int64_t>;
     vector<remapped_region, 0, uint32_t> _remapped_regions = {};
@@ -50,31 +67,163 @@ class table {
     vector<page_map_type, 0, uint32_t> _page_maps = {};
     vector<page_map_type, 0, uint32_t> _page_metadata_maps = {};
 
+    // One bit per page map, set when the map has at least one free page
+    constexpr static unsigned int maps_per_summary = 64;
+    vector<uint64_t, 0, uint32_t> _free_page_summary = {};
+    // Longest run of consecutive free pages within each page map
+    vector<uint8_t, 0, uint32_t> _longest_free_runs = {};
+
+    // Page magazines
+    std::atomic<uint64_t> _magazine_hits = 0;
+    std::atomic<uint64_t> _magazine_misses = 0;
+    std::atomic<uint64_t> _magazine_overflows = 0;
+
+    friend class page_magazine;
+
+    // Superpages
+    bool _use_superpages = false;
+    bool _region_uses_superpages = false;
+    uint32_t _num_superpage_regions = 0;
+    uint32_t _num_superpage_fallbacks = 0;
+
+    void *alloc_region(vm_size_t size);
+    void *_Nullable reserve_region(vm_size_t reserved_size, vm_size_t initial_size);
+
+    void update_free_page_summary(uint32_t map_index);
+    uint32_t next_map_with_free_pages(uint32_t map_index, uint32_t end_map_index);
+    bool find_free_pages(uint32_t map_index, uint32_t num_pages, uint32_t *page_index_out);
+
+    uint32_t alloc_pages_locked(uint32_t num_pages);
+    void dealloc_pages_locked(uint32_t page_index, uint32_t num_pages);
+
+    // Empty page maps waiting to be made reusable, one bit per page map
+    vector<uint64_t, 0, uint32_t> _pending_reusable_maps = {};
+    uint32_t _num_pending_reusable_maps = 0;
+    uint32_t _reusable_purge_threshold;
+    bool _reusable_purge_scheduled = false;
+
+    void defer_map_reusable(uint32_t map_index);
+    bool cancel_map_reusable(uint32_t map_index);
+    void make_maps_reusable(uint32_t map_index, uint32_t num_maps, bool reusable);
+
   public:
     static table &ensure_shared();
     static table &shared();
 
     table();
+    table(bool use_superpages);
 
     void lock();
     void unlock();
 
     // Pointers
-    vm_address_t ptr_base() { return _ptr_base; };
-    uint32_t ptr_max_offset() { return _ptr_max_offset; };
+
+    /// The address that ptr offsets are relative to. This is a single relaxed load and is safe to call from any thread
+    /// while the region grows:
+    ///
+    /// - When the full address range is reserved, growing only commits more of the reservation and the base never
+    ///   changes.
+    /// - Otherwise the old region is remapped into the new one rather than copied, and retired regions stay mapped in
+    ///   `_remapped_regions` for the lifetime of the table. A stale base therefore still addresses the same memory for
+    ///   every offset that existed before the region grew. Any offset beyond that was handed out after the new base
+    ///   was stored, so a thread that received it through some synchronization also observes the new base.
+    vm_address_t ptr_base() { return _ptr_base.load(std::memory_order_relaxed); };
+    uint32_t ptr_max_offset() { return _ptr_max_offset.load(std::memory_order_relaxed); };
 
     // Region
     void grow_region();
 
+    /// Whether the table reserved its full address range up front, in which case growing the region only commits
+    /// more of the reservation and `ptr_base()` never changes.
+    bool region_is_reserved() { return _vm_reserved_size != 0; };
+
+    /// Whether the current VM region is backed by superpages. Only true if superpages were requested, either by
+    /// passing `use_superpages` or by setting AG_USE_SUPERPAGES, and the kernel was able to provide them.
+    bool region_uses_superpages() { return _region_uses_superpages; };
+    uint32_t num_superpage_regions() { return _num_superpage_regions; };
+    uint32_t num_superpage_fallbacks() { return _num_superpage_fallbacks; };
+
     // Zones
+
+    /// Returns an id for a new zone. Ids combine a slot in the zone generation table with the slot's current
+    /// generation, and slots of retired ids are reused with the next generation. A slot is retired for good once its
+    /// generation would wrap around, so an id is never handed out twice.
     uint32_t make_zone_id();
 
+    /// Marks `zone_id` as dead, expiring every weak reference into the zone.
+    void retire_zone_id(uint32_t zone_id);
+
+    /// Whether `zone_id` belongs to a zone that hasn't been retired. A single load that may be made from any thread.
+    bool is_zone_id_live(uint32_t zone_id) {
+        uint32_t slot = zone_id & zone_slot_mask;
+        std::atomic<uint32_t> *chunk =
+            _zone_generation_chunks[slot / zone_slots_per_chunk].load(std::memory_order_acquire);
+        if (slot == 0 || !chunk) {
+            return false;
+        }
+        return chunk[slot % zone_slots_per_chunk].load(std::memory_order_acquire) == (zone_id >> zone_slot_bits);
+    };
+
     // Pages
     ptr<page> alloc_page(zone *zone, uint32_t size);
+    void dealloc_page(ptr<page> page);
     void dealloc_page_locked(ptr<page> page);
-    void make_pages_reusable(uint32_t page_index, bool flag);
+
+    /// Allocates `num_pages` consecutive pages and returns the index of the first, without writing a page header. A
+    /// run that doesn't fit within one page map may span the end of one map and the start of the next.
+    uint32_t alloc_pages(uint32_t num_pages);
+    void dealloc_pages(uint32_t page_index, uint32_t num_pages);
+
+    /// Releases the memory of all empty page maps to the OS. Empty maps are normally released in batches on a
+    /// background queue once AG_REUSABLE_PURGE_THRESHOLD maps are pending (default 32, 0 releases immediately).
+    /// Returns the number of bytes released.
+    uint64_t purge_reusable_pages();
+    uint64_t purge_reusable_pages_locked();
     uint64_t raw_page_seed(ptr<page> page);
 
+    /// Changes whenever a page is deallocated, which is when weak references into the page expire. Anything derived
+    /// from weak references can be kept for as long as this doesn't change.
+    uint32_t page_generation() { return _page_generation.load(std::memory_order_acquire); };
+
+    // Stats, see AGGraphGetDataTableStats
+    uint32_t region_size() { return _vm_region_size.load(std::memory_order_relaxed); };
+    uint32_t reserved_size() { return _vm_reserved_size; };
+    uint32_t used_size() { return _num_used_pages.load(std::memory_order_relaxed) * page_size; };
+    uint32_t reusable_size() { return _num_reusable_pages.load(std::memory_order_relaxed); };
+    uint64_t magazine_hits() { return _magazine_hits.load(std::memory_order_relaxed); };
+    uint64_t magazine_misses() { return _magazine_misses.load(std::memory_order_relaxed); };
+
+    /// A copy-on-write copy of the table's region, see `copy_region()`.
+    class region_copy {
+      private:
+        vm_address_t _address = 0;
+        vm_size_t _size = 0;
+
+      public:
+        region_copy(){};
+        region_copy(vm_address_t address, vm_size_t size) : _address(address), _size(size){};
+        region_copy(region_copy &&other) : _address(other._address), _size(other._size) {
+            other._address = 0;
+            other._size = 0;
+        };
+        region_copy &operator=(region_copy &&other);
+        ~region_copy();
+
+        explicit operator bool() const { return _address != 0; };
+
+        /// The address that ptr offsets are relative to in the copy, the counterpart of `table::ptr_base()`.
+        vm_address_t ptr_base() const;
+        vm_size_t size() const { return _size; };
+    };
+
+    /// Maps a copy-on-write copy of the whole region, so that the contents of every zone at this moment can be read
+    /// from another thread while the zones change. Pages are only copied when they are next written. Returns an empty
+    /// copy if the region can't be mapped.
+    region_copy copy_region();
+
+    /// Copies the map of used pages, with bit `i % 64` of word `i / 64` set if the `i`th page of the region is used.
+    vector<uint64_t, 0, uint32_t> used_page_map();
+
     // Printing
     void print();
 };
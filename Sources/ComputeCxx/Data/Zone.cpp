@@ -10,20 +10,219 @@
 namespace AG {
 namespace data {
 
+namespace {
+
+/// For requests in a given size class, the largest class that fragments may be taken from. Small requests are kept
+/// away from large fragments so that these remain available for large values.
+constexpr uint32_t max_recycle_class[] = {
+    2, // 16 bytes: up to 64 byte fragments
+    3, // 32 bytes: up to 128 byte fragments
+    4, // 64 bytes: up to 256 byte fragments
+    5, // 128 bytes: any fragment
+    5, // 256 bytes: any fragment
+    5, // larger: any fragment
+};
+
+} // namespace
+
 zone::zone() : _info(info().with_zone_id(table::shared().make_zone_id())) {}
 
-zone::~zone() { clear(); }
+zone::~zone() {
+    release_pages();
+    table::shared().retire_zone_id(_info.zone_id());
+}
 
 void zone::clear() {
-    table::shared().lock();
+    release_pages();
+
+    // weak references to anything in the zone expire along with its id
+    table::shared().retire_zone_id(_info.zone_id());
+    _info = _info.with_zone_id(table::shared().make_zone_id());
+}
+
+void zone::release_pages() {
+    _compact_cursor = nullptr;
     while (_last_page) {
         auto page = _last_page;
         _last_page = page->previous;
-        table::shared().dealloc_page_locked(page);
+        did_dealloc_page(page);
+        table::shared().dealloc_page(page);
+    }
+
+    for (uint32_t index = 0; index < num_size_classes; index++) {
+        _free_bytes[index] = nullptr;
+    }
+    _stats.num_free_fragments.store(0, std::memory_order_relaxed);
+    _stats.free_fragment_bytes.store(0, std::memory_order_relaxed);
+}
+
+#pragma mark - Stats
+
+void zone::did_alloc_page(ptr<page> page) {
+    _stats.num_pages.fetch_add(1, std::memory_order_relaxed);
+    _stats.page_bytes.fetch_add(page->total, std::memory_order_relaxed);
+}
+
+void zone::did_dealloc_page(ptr<page> page) {
+    _stats.num_pages.fetch_sub(1, std::memory_order_relaxed);
+    _stats.page_bytes.fetch_sub(page->total, std::memory_order_relaxed);
+}
+
+#pragma mark - Marks
+
+zone::snapshot zone::mark() {
+    snapshot result;
+    result._last_page = _last_page;
+    result._last_page_previous = _last_page ? _last_page->previous : nullptr;
+    result._last_page_in_use = _last_page ? _last_page->in_use : 0;
+    result._num_malloc_buffers = _malloc_buffers.size();
+    result._num_free_fragments = _stats.num_free_fragments.load(std::memory_order_relaxed);
+    result._free_fragment_bytes = _stats.free_fragment_bytes.load(std::memory_order_relaxed);
+    result._zone_id = _info.zone_id();
+    _num_marks += 1;
+
+    // weak references into memory allocated from here on expire on rollback, along with this id
+    _info = _info.with_zone_id(table::shared().make_zone_id());
+
+    // fragments stay untouched while the mark is active
+    for (uint32_t index = 0; index < num_size_classes; index++) {
+        result._free_bytes[index] = _free_bytes[index];
+        _free_bytes[index] = nullptr;
+    }
+
+    return result;
+}
+
+void zone::rollback(const snapshot &mark) {
+    if (_num_marks == 0) {
+        precondition_failure("invalid zone mark");
+    }
+    _num_marks -= 1;
+
+    // the cursor may be one of the pages released below
+    _compact_cursor = nullptr;
+
+    // pages allocated since the mark are in front of the marked page...
+    while (_last_page != mark._last_page) {
+        if (!_last_page) {
+            precondition_failure("invalid zone mark");
+        }
+        auto page = _last_page;
+        _last_page = page->previous;
+        did_dealloc_page(page);
+        table::shared().dealloc_page(page);
+    }
+
+    if (_last_page) {
+        // ...except for large pages, which alloc_slow inserts directly behind the current page
+        while (_last_page->previous != mark._last_page_previous) {
+            auto page = _last_page->previous;
+            _last_page->previous = page->previous;
+            did_dealloc_page(page);
+            table::shared().dealloc_page(page);
+        }
+        _last_page->in_use = mark._last_page_in_use;
+    }
+
+    while (_malloc_buffers.size() > mark._num_malloc_buffers) {
+        _stats.num_persistent_buffers.fetch_sub(1, std::memory_order_relaxed);
+        _stats.persistent_bytes.fetch_sub(malloc_size(_malloc_buffers.back().get()), std::memory_order_relaxed);
+        _malloc_buffers.pop_back();
+    }
+
+    // drop fragments created since the mark, most of them lie in released memory
+    for (uint32_t index = 0; index < num_size_classes; index++) {
+        _free_bytes[index] = mark._free_bytes[index];
+    }
+    _stats.num_free_fragments.store(mark._num_free_fragments, std::memory_order_relaxed);
+    _stats.free_fragment_bytes.store(mark._free_fragment_bytes, std::memory_order_relaxed);
+
+    table::shared().retire_zone_id(_info.zone_id());
+    _info = _info.with_zone_id(mark._zone_id);
+}
+
+#pragma mark - Compaction
+
+uint64_t zone::compact(uint32_t max_fragments) {
+    if (_num_marks != 0) {
+        precondition_failure("can't compact a zone with an active mark");
+    }
+    if (!_last_page) {
+        return 0;
+    }
+
+    // Take up to `max_fragments` fragments off the lists. Fragments left on the lists are simply not considered, which
+    // can only keep a page alive, never release one that is still in use.
+    struct fragment {
+        ptr<bytes_info> bytes;
+        uint32_t size;
+    };
+    vector<fragment, 0, uint32_t> fragments;
+    for (uint32_t index = 0; index < num_size_classes && fragments.size() < max_fragments; index++) {
+        ptr<bytes_info> bytes = _free_bytes[index];
+        while (bytes && fragments.size() < max_fragments) {
+            fragments.push_back({bytes, bytes->size});
+            _stats.num_free_fragments.fetch_sub(1, std::memory_order_relaxed);
+            _stats.free_fragment_bytes.fetch_sub(bytes->size, std::memory_order_relaxed);
+            bytes = bytes->next;
+        }
+        _free_bytes[index] = bytes;
+    }
+    if (fragments.size() == 0) {
+        return 0;
+    }
+
+    // Merge fragments that touch. Every page starts with its header, so two fragments that touch are always in the
+    // same page, including large pages that span several table pages.
+    std::sort(fragments.begin(), fragments.end(),
+              [](const fragment &a, const fragment &b) { return a.bytes.offset() < b.bytes.offset(); });
+
+    uint32_t num_merged = 1;
+    for (uint32_t index = 1; index < fragments.size(); index++) {
+        fragment &merged = fragments[num_merged - 1];
+        fragment next = fragments[index];
+        if ((merged.bytes + merged.size).offset() == next.bytes.offset()) {
+            merged.size += next.size;
+        } else {
+            fragments[num_merged++] = next;
+        }
+    }
+    fragments.resize(num_merged);
+
+    // Look at up to `max_fragments` pages from the cursor. A page other than the current one whose used bytes are
+    // covered by a single fragment holds nothing live
+    uint64_t released_size = 0;
+    ptr<page> previous_page = _compact_cursor ? _compact_cursor : _last_page;
+    for (uint32_t num_pages = 0; num_pages < max_fragments && previous_page->previous; num_pages++) {
+        ptr<page> page = previous_page->previous;
+
+        ptr<bytes_info> first_bytes = (page + sizeof(struct page)).aligned<bytes_info>();
+        auto position = std::lower_bound(fragments.begin(), fragments.end(), first_bytes.offset(),
+                                         [](const fragment &f, auto offset) { return f.bytes.offset() < offset; });
+        if (position == fragments.end() || position->bytes.offset() != first_bytes.offset() ||
+            (position->bytes + position->size).offset() != (page + page->in_use).offset()) {
+            previous_page = page;
+            continue;
+        }
+
+        position->size = 0; // dropped along with the page
+        previous_page->previous = page->previous;
+        released_size += page->total;
+        did_dealloc_page(page);
+        table::shared().dealloc_page(page);
+    }
+    _compact_cursor = previous_page->previous ? previous_page : nullptr;
+
+    for (auto &fragment : fragments) {
+        if (fragment.size != 0) {
+            push_free_bytes(fragment.bytes, fragment.size);
+        }
     }
-    table::shared().unlock();
+    return released_size;
 }
 
+#pragma mark - Paged memory
+
 void zone::realloc_bytes(ptr<void> *buffer, uint32_t size, uint32_t new_size, uint32_t alignment_mask) {
     if (new_size > size && *buffer) {
         auto page = buffer->page_ptr();
@@ -36,21 +235,44 @@ void zone::realloc_bytes(ptr<void> *buffer, uint32_t size, uint32_t new_size, ui
                 memcpy(new_buffer.get(), (*buffer).get(), size);
 
                 ptr<bytes_info> old_bytes = (*buffer).aligned<bytes_info>();
-                uint32_t remaining_size = size + (*buffer - old_bytes);
-                if (remaining_size >= sizeof(bytes_info)) {
-                    old_bytes->next = _free_bytes;
-                    old_bytes->size = remaining_size;
-                    _free_bytes = old_bytes;
-                }
+                int32_t remaining_size = size + (*buffer - old_bytes);
+                push_free_bytes(old_bytes, remaining_size);
             }
             *buffer = new_buffer;
         }
     }
 }
 
+uint32_t zone::size_class(uint32_t size) {
+    uint32_t index = 0;
+    while (size > size_class_limits[index]) {
+        index += 1;
+    }
+    return index;
+}
+
+void zone::push_free_bytes(ptr<bytes_info> bytes, int32_t size) {
+    // alignment may leave nothing, or less than nothing, of the original fragment
+    if (size < int32_t(sizeof(bytes_info))) {
+        return;
+    }
+
+    uint32_t index = size_class(size);
+    bytes->next = _free_bytes[index];
+    bytes->size = size;
+    _free_bytes[index] = bytes;
+
+    _stats.num_free_fragments.fetch_add(1, std::memory_order_relaxed);
+    _stats.free_fragment_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
 ptr<void> zone::alloc_bytes_recycle(uint32_t size, uint32_t alignment_mask) {
-    for (ptr<bytes_info> bytes = _free_bytes; bytes; bytes = bytes->next) {
-        if (size > bytes->size) {
+    // The first class may hold fragments smaller than the request, every later class only holds fragments that are
+    // large enough, so only the head of each list needs to be checked.
+    uint32_t request_class = size_class(size);
+    for (uint32_t index = request_class; index <= max_recycle_class[request_class]; index++) {
+        ptr<bytes_info> bytes = _free_bytes[index];
+        if (!bytes || size > bytes->size) {
             continue;
         }
 
@@ -60,23 +282,16 @@ ptr<void> zone::alloc_bytes_recycle(uint32_t size, uint32_t alignment_mask) {
             continue;
         }
 
-        // Check the difference between needed and available bytes
-        // XXX: Dissassembly seems to rely on unsigned integer underflow here?
-        if (size - bytes->size > 0xff) {
-            continue;
-        }
+        _free_bytes[index] = bytes->next;
+        _stats.num_free_fragments.fetch_sub(1, std::memory_order_relaxed);
+        _stats.free_fragment_bytes.fetch_sub(bytes->size, std::memory_order_relaxed);
 
         // check if there will be some bytes remaining within the same page
         ptr<void> end = aligned_bytes + size;
-        if ((uint32_t(aligned_bytes) ^ uint32_t(end)) <= page_alignment_mask) {
+        if ((uint32_t(aligned_bytes.offset()) ^ uint32_t(end.offset())) <= page_alignment_mask) {
             ptr<bytes_info> aligned_end = end.aligned<bytes_info>();
-            uint32_t remaining_size = usable_size - size + (end - aligned_end);
-            if (remaining_size >= sizeof(bytes_info)) {
-                bytes_info *remaining_bytes = aligned_end.get();
-                remaining_bytes->next = _free_bytes;
-                remaining_bytes->size = remaining_size;
-                _free_bytes = aligned_end;
-            }
+            int32_t remaining_size = usable_size - size + (end - aligned_end);
+            push_free_bytes(aligned_end, remaining_size);
         }
 
         return aligned_bytes;
@@ -107,11 +322,8 @@ ptr<void> zone::alloc_slow(uint32_t size, uint32_t alignment_mask) {
 
             ptr<bytes_info> aligned_next_bytes = next_bytes.aligned<bytes_info>();
             int32_t remaining_size = _last_page->total - _last_page->in_use + (next_bytes - aligned_next_bytes);
-            if (remaining_size >= sizeof(bytes_info)) {
-                bytes_info *remaining_bytes = aligned_next_bytes.get();
-                remaining_bytes->next = _free_bytes;
-                remaining_bytes->size = remaining_size;
-                _free_bytes = aligned_next_bytes;
+            if (remaining_size > 0) {
+                push_free_bytes(aligned_next_bytes, remaining_size);
             }
 
             // consume this entire page
@@ -122,11 +334,13 @@ ptr<void> zone::alloc_slow(uint32_t size, uint32_t alignment_mask) {
     ptr<page> new_page;
     if (size <= page_size / 2) {
         new_page = table::shared().alloc_page(this, page_size);
+        did_alloc_page(new_page);
         new_page->previous = _last_page;
         _last_page = new_page;
     } else {
         uint32_t aligned_size = ((sizeof(page) + size) + alignment_mask) & ~alignment_mask;
         new_page = table::shared().alloc_page(this, aligned_size);
+        did_alloc_page(new_page);
         if (_last_page) {
             // It's less likely we will be able to alloc unused bytes from this page,
             // so insert it before the last page.
@@ -156,6 +370,8 @@ void *zone::alloc_persistent(size_t size) {
     }
 
     auto buffer = table::shared().alloc_persistent(size);
+    _stats.num_persistent_buffers.fetch_add(1, std::memory_order_relaxed);
+    _stats.persistent_bytes.fetch_add(malloc_size(buffer.get()), std::memory_order_relaxed);
     _malloc_buffers.push_back(std::move(buffer));
 
     return _malloc_buffers.back().get();
@@ -187,11 +403,15 @@ void zone::print() {
 
     unsigned long num_free_elements = 0;
     unsigned long free_bytes = 0;
-    if (_free_bytes) {
-        for (auto bytes = _free_bytes; bytes; bytes = bytes->next) {
-            num_free_elements++;
-            free_bytes += bytes->size;
+    unsigned long class_free_elements[num_size_classes] = {};
+    unsigned long class_free_bytes[num_size_classes] = {};
+    for (uint32_t index = 0; index < num_size_classes; index++) {
+        for (auto bytes = _free_bytes[index]; bytes; bytes = bytes->next) {
+            class_free_elements[index]++;
+            class_free_bytes[index] += bytes->size;
         }
+        num_free_elements += class_free_elements[index];
+        free_bytes += class_free_bytes[index];
     }
 
     unsigned long num_persistent_buffers = _malloc_buffers.size();
@@ -211,6 +431,19 @@ void zone::print() {
             num_persistent_buffers, // malloc
             malloc_total_size_kb    // total
     );
+
+    if (num_free_elements) {
+        fprintf(stdout, "%-16s", "  free by class");
+        for (uint32_t index = 0; index < num_size_classes; index++) {
+            if (index + 1 < num_size_classes) {
+                fprintf(stdout, " <=%u: %lu/%lu", size_class_limits[index], class_free_elements[index],
+                        class_free_bytes[index]);
+            } else {
+                fprintf(stdout, " >%u: %lu/%lu\n", size_class_limits[index - 1], class_free_elements[index],
+                        class_free_bytes[index]);
+            }
+        }
+    }
 }
 
 } // namespace data
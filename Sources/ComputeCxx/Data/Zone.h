@@ -1,6 +1,7 @@
 #pragma once
 
 #include <CoreFoundation/CFBase.h>
+#include <atomic>
 #include <malloc/malloc.h>
 
 #include "Page.h"
@@ -28,24 +29,94 @@ class zone {
         static info from_raw_value(uint32_t value) { return info(value); };
     };
 
+    /// Memory used by a zone. The counters may be read from any thread while the zone is in use, but are not
+    /// guaranteed to be consistent with each other.
+    class memory_stats {
+      public:
+        std::atomic<uint32_t> num_pages = 0;
+        std::atomic<uint64_t> page_bytes = 0;
+        std::atomic<uint32_t> num_free_fragments = 0;
+        std::atomic<uint64_t> free_fragment_bytes = 0;
+        std::atomic<uint32_t> num_persistent_buffers = 0;
+        std::atomic<uint64_t> persistent_bytes = 0;
+    };
+
   private:
     typedef struct _bytes_info {
         ptr<struct _bytes_info> next;
         uint32_t size;
     } bytes_info;
 
+    /// Free fragments are kept in separate lists by size class. Fragments in each list are no larger than the class
+    /// size, except for the last class which holds everything bigger than 256 bytes.
+    constexpr static uint32_t num_size_classes = 6;
+    constexpr static uint32_t size_class_limits[num_size_classes] = {16, 32, 64, 128, 256, ~uint32_t(0)};
+
+    static uint32_t size_class(uint32_t size);
+
     vector<std::unique_ptr<void, table::malloc_zone_deleter>, 0, uint32_t> _malloc_buffers;
     ptr<page> _last_page;
-    ptr<bytes_info> _free_bytes;
+    ptr<bytes_info> _free_bytes[num_size_classes];
     info _info;
+    memory_stats _stats;
+
+    // The number of marks not rolled back yet
+    uint32_t _num_marks = 0;
+
+    // The page whose previous page `compact` looks at next, or null to start again behind the current page
+    ptr<page> _compact_cursor;
+
+    void release_pages();
+
+    void did_alloc_page(ptr<page> page);
+    void did_dealloc_page(ptr<page> page);
+
+    void push_free_bytes(ptr<bytes_info> bytes, int32_t size);
 
   public:
+    /// The allocation state of a zone, see `mark()` and `rollback()`.
+    class snapshot {
+      private:
+        ptr<page> _last_page;
+        ptr<page> _last_page_previous;
+        uint32_t _last_page_in_use;
+        uint32_t _num_malloc_buffers;
+        ptr<bytes_info> _free_bytes[num_size_classes];
+        uint32_t _num_free_fragments;
+        uint64_t _free_fragment_bytes;
+        uint32_t _zone_id;
+
+        friend class zone;
+    };
+
     zone();
     ~zone();
 
     info info() { return _info; };
+    const memory_stats &stats() const { return _stats; };
 
+    /// Releases all the zone's memory. The zone gets a new id, so weak references to anything that was in it expire.
     void clear();
+
+    /// Captures the current allocation state. Until the matching `rollback()`, free fragments from before the mark
+    /// are not reused, so that the state can be restored exactly.
+    ///
+    /// The zone gets a new id for the duration of the mark, so that weak references made until the rollback expire
+    /// with it. This includes weak references to anything allocated before the mark.
+    snapshot mark();
+
+    /// Releases everything allocated since `mark` in one step: pages are returned to the table, bytes in the page
+    /// that was current at the mark are reclaimed and persistent buffers are freed. The id the zone had at the mark is
+    /// restored. Marks must be rolled back in reverse order.
+    void rollback(const snapshot &mark);
+
+    /// Merges adjacent free fragments and returns pages that hold nothing but free fragments to the table, looking at
+    /// no more than `max_fragments` fragments and as many pages. Each call looks at the pages after the ones the last
+    /// call looked at, so a zone with more pages than that is covered over several calls. Returns the number of bytes
+    /// of the released pages. Live allocations are never moved, since references to them can't all be found. Must not
+    /// be called while a mark is active.
+    uint64_t compact(uint32_t max_fragments);
+
     void realloc_bytes(ptr<void> *buffer, uint32_t size, uint32_t new_size, uint32_t alignment_mask);
 
     // Paged memory
@@ -53,6 +124,21 @@ class zone {
     ptr<void> alloc_bytes(uint32_t size, uint32_t alignment_mask);
     ptr<void> alloc_slow(uint32_t size, uint32_t alignment_mask);
 
+    /// Same as `alloc_bytes(size, alignment_mask)`, with the alignment known at compile time so that the fast path is
+    /// a bump and a compare.
+    template <uint32_t alignment_mask> ptr<void> alloc_bytes(uint32_t size) {
+        static_assert((alignment_mask & (alignment_mask + 1)) == 0, "alignment mask must be one less than a power of 2");
+        if (_last_page) {
+            uint32_t aligned_in_use = (_last_page->in_use + alignment_mask) & ~alignment_mask;
+            uint32_t new_used_size = aligned_in_use + size;
+            if (new_used_size <= _last_page->total) {
+                _last_page->in_use = new_used_size;
+                return _last_page + aligned_in_use;
+            }
+        }
+        return alloc_slow(size, alignment_mask);
+    };
+
     // Persistent memory
     void *alloc_persistent(size_t size);
 
@@ -0,0 +1,250 @@
+#include "AGGraph.h"
+
+#include <dispatch/dispatch.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "BufferedWriter.h"
+#include "Data/Table.h"
+#include "Errors/Errors.h"
+#include "Graph.h"
+#include "GraphDescription.h"
+#include "MemoryPressure.h"
+#include "Profiler.h"
+#include "Swift/Metadata.h"
+#include "Time/Time.h"
+#include "Trace/Trace.h"
+
+AGGraphMemoryStats AGGraphGetMemoryStats(AGGraphRef graph) {
+    auto context = AG::Graph::from_cf(graph);
+    if (!context) {
+        AG::precondition_failure("invalidated graph");
+    }
+
+    AGGraphMemoryStats stats;
+    stats.node_count = context->num_node_values();
+    stats.node_value_bytes = context->num_node_value_bytes();
+    return stats;
+}
+
+AGDataTableStats AGGraphGetDataTableStats() {
+    auto &table = AG::data::table::ensure_shared();
+
+    AGDataTableStats stats;
+    stats.region_bytes = table.region_size();
+    stats.reserved_bytes = table.reserved_size();
+    stats.used_bytes = table.used_size();
+    stats.reusable_bytes = table.reusable_size();
+    stats.page_cache_hits = table.magazine_hits();
+    stats.page_cache_misses = table.magazine_misses();
+    stats.page_size = AG::data::page_size;
+    return stats;
+}
+
+void AGGraphStartMemoryPressureResponder() { AG::MemoryPressure::start_responder(); }
+
+AGMemoryPressureReport AGGraphRespondToMemoryPressure() { return AG::MemoryPressure::respond(); }
+
+AGMemoryPressureReport AGGraphGetMemoryPressureReport() { return AG::MemoryPressure::total_report(); }
+
+uint64_t AGGraphTrimMemory(AGGraphRef graph) {
+    auto context = AG::Graph::from_cf(graph);
+    if (!context) {
+        AG::precondition_failure("invalidated graph");
+    }
+    return context->trim();
+}
+
+uint64_t AGGraphGetDeadline(AGGraphRef graph) {
+    auto context = AG::Graph::from_cf(graph);
+    if (!context) {
+        AG::precondition_failure("invalidated graph");
+    }
+    return context->deadline();
+}
+
+void AGGraphSetDeadline(AGGraphRef graph, uint64_t deadline) {
+    auto context = AG::Graph::from_cf(graph);
+    if (!context) {
+        AG::precondition_failure("invalidated graph");
+    }
+    context->set_deadline(deadline);
+}
+
+bool AGGraphHasDeadlinePassed(AGGraphRef graph) {
+    auto context = AG::Graph::from_cf(graph);
+    if (!context) {
+        AG::precondition_failure("invalidated graph");
+    }
+    return context->has_deadline_passed();
+}
+
+AGGraphUpdateStatus AGGraphUpdateDirtyAttributes(AGGraphRef graph) {
+    auto context = AG::Graph::from_cf(graph);
+    if (!context) {
+        AG::precondition_failure("invalidated graph");
+    }
+    return context->update_dirty_nodes() == AG::UpdateStack::Status::DeadlinePassed
+               ? AGGraphUpdateStatusDeadlinePassed
+               : AGGraphUpdateStatusComplete;
+}
+
+void AGGraphWithMainThreadHandler(AGGraphRef graph, void (*body)(const void *_Nullable context),
+                                  const void *_Nullable body_context,
+                                  void (*handler)(void (*thunk)(const void *_Nullable thunk_context),
+                                                  const void *_Nullable thunk_context,
+                                                  const void *_Nullable handler_context),
+                                  const void *_Nullable handler_context) {
+    auto context = AG::Graph::from_cf(graph);
+    if (!context) {
+        AG::precondition_failure("invalidated graph");
+    }
+    context->with_main_thread_handler(body, body_context, handler, handler_context);
+}
+
+void AGGraphStartProfiling() { AG::Profiler::start(); }
+
+void AGGraphStopProfiling() { AG::Profiler::stop(); }
+
+void AGGraphMarkProfile(const char *name) { AG::Profiler::mark(name); }
+
+void AGGraphResetProfile() { AG::Profiler::reset(); }
+
+size_t AGGraphCopyProfileEntries(AGProfileEntry *entries, size_t capacity) {
+    struct Context {
+        AGProfileEntry *_Nullable entries;
+        size_t capacity;
+        size_t count;
+    };
+    Context context = {entries, capacity, 0};
+    AG::Profiler::for_each_entry(
+        [](const AG::Profiler::Entry &entry, void *context_pointer) {
+            auto context = reinterpret_cast<Context *>(context_pointer);
+            if (context->count < context->capacity) {
+                context->entries[context->count] = {
+                    entry.mark,
+                    reinterpret_cast<AGTypeID>(entry.self_type),
+                    reinterpret_cast<AGTypeID>(entry.value_type),
+                    entry.update_count,
+                    AG::absolute_time_to_seconds(entry.update_time),
+                    AG::absolute_time_to_seconds(entry.self_time),
+                    entry.compare_count,
+                    AG::absolute_time_to_seconds(entry.compare_time),
+                };
+            }
+            context->count += 1;
+        },
+        &context);
+    return context.count;
+}
+
+AGProfileUpdateBatches AGGraphGetProfileUpdateBatches() {
+    AG::Profiler::UpdateBatches batches = AG::Profiler::update_batches();
+    return {
+        batches.count,
+        batches.interrupted_count,
+        AG::absolute_time_to_seconds(batches.time),
+        AG::absolute_time_to_seconds(batches.max_time),
+        AG::absolute_time_to_seconds(batches.last_time),
+    };
+}
+
+bool AGGraphStartTracing(const char *path) {
+    return AG::Trace::start(path ? AG::Trace::Sink::File : AG::Trace::Sink::Signpost, path);
+}
+
+void AGGraphStopTracing() { AG::Trace::stop(); }
+
+uint64_t AGGraphGetTraceDroppedCount() { return AG::Trace::dropped_count(); }
+
+void AGGraphAddTraceEvent(AGGraphRef graph, const char *event_name, const void *value, AGTypeID type) {
+    auto context = AG::Graph::from_cf(graph);
+    if (!context) {
+        AG::precondition_failure("invalidated graph");
+    }
+    if (!AG::Trace::is_enabled()) {
+        return;
+    }
+
+    auto metadata = reinterpret_cast<const AG::swift::metadata *>(type);
+    uint64_t data = 0;
+    if (metadata->vw_size() <= sizeof(data)) {
+        memcpy(&data, value, metadata->vw_size());
+    }
+    AG::Trace::record(AG::Trace::EventKind::Custom, AG::Trace::intern(event_name), 0, uint64_t(metadata), data);
+}
+
+namespace {
+
+struct DescriptionJob {
+    AG::GraphDescription description;
+    AG::GraphDescription::Format format;
+    int fd;
+};
+
+void write_description(void *context) {
+    auto job = static_cast<DescriptionJob *>(context);
+    {
+        AG::BufferedWriter writer(job->fd);
+        job->description.write(job->format, writer);
+    }
+    close(job->fd);
+    delete job;
+}
+
+} // namespace
+
+void AGGraphArchiveJSON(AGGraphRef graph, const char *name) {
+    auto context = AG::Graph::from_cf(graph);
+    if (!context) {
+        AG::precondition_failure("invalidated graph");
+    }
+
+    const char *directory = getenv("TMPDIR");
+    if (!directory || !*directory) {
+        directory = "/tmp";
+    }
+    size_t length = strlen(directory);
+    const char *separator = directory[length - 1] == '/' ? "" : "/";
+
+    char *path = nullptr;
+    asprintf(&path, "%s%s%s.ag-json", directory, separator, name ? name : "graph");
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        AG::non_fatal_precondition_failure("can't create %s", path);
+        free(path);
+        return;
+    }
+    free(path);
+
+    AGGraphWriteDescription(graph, AGGraphDescriptionFormatJSON, AGGraphDescriptionOptionsSnapshot, fd);
+}
+
+void AGGraphWriteDescription(AGGraphRef graph, AGGraphDescriptionFormat format, AGGraphDescriptionOptions options,
+                             int fd) {
+    auto context = AG::Graph::from_cf(graph);
+    if (!context) {
+        AG::precondition_failure("invalidated graph");
+    }
+
+    auto job = new DescriptionJob{AG::GraphDescription(*context, options), AG::GraphDescription::Format(format), fd};
+    if (job->description.has_snapshot()) {
+        dispatch_async_f(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), job, write_description);
+    } else {
+        write_description(job);
+    }
+}
+
+void AGGraphDescribe(AGGraphRef graph, AGGraphDescriptionFormat format, AGGraphDescriptionOptions options,
+                     void (*body)(const void *bytes, size_t size, void *context), void *context) {
+    auto graph_context = AG::Graph::from_cf(graph);
+    if (!graph_context) {
+        AG::precondition_failure("invalidated graph");
+    }
+
+    AG::GraphDescription description(*graph_context, options & ~AGGraphDescriptionOptionsSnapshot);
+    AG::BufferedWriter writer(body, context);
+    description.write(AG::GraphDescription::Format(format), writer);
+}
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <CoreFoundation/CFBase.h>
+#include <stdint.h>
 
 #include "AGSwiftSupport.h"
+#include "Swift/AGType.h"
 
 CF_ASSUME_NONNULL_BEGIN
 
@@ -10,6 +12,218 @@ CF_EXTERN_C_BEGIN
 
 typedef struct CF_BRIDGED_TYPE(id) AGGraphStorage *AGGraphRef AG_SWIFT_NAME(Graph);
 
+// Memory stats
+
+typedef struct AG_SWIFT_NAME(GraphMemoryStats) AGGraphMemoryStats {
+    uint64_t node_count;
+    uint64_t node_value_bytes;
+} AGGraphMemoryStats;
+
+/// Memory used by the shared table that holds the pages of all graphs.
+typedef struct AG_SWIFT_NAME(DataTableStats) AGDataTableStats {
+    uint64_t region_bytes;
+    uint64_t reserved_bytes;
+    uint64_t used_bytes;
+    uint64_t reusable_bytes;
+    uint64_t page_cache_hits;
+    uint64_t page_cache_misses;
+    uint64_t page_size; // see AG_PAGE_SIZE
+} AGDataTableStats;
+
+/// Returns the number and total size of node values in the graph, may be called from any thread.
+CF_EXPORT
+AGGraphMemoryStats AGGraphGetMemoryStats(AGGraphRef graph) CF_SWIFT_NAME(getter:Graph.memoryStats(self:));
+
+CF_EXPORT
+AGDataTableStats AGGraphGetDataTableStats(void) CF_SWIFT_NAME(getter:Graph.dataTableStats());
+
+// Memory pressure
+
+/// Memory released in response to memory pressure, see AGGraphStartMemoryPressureResponder.
+typedef struct AG_SWIFT_NAME(MemoryPressureReport) AGMemoryPressureReport {
+    uint64_t response_count;
+    uint64_t page_bytes;  // empty pages released to the OS
+    uint64_t cache_bytes; // spare capacity of the layout cache
+    uint64_t graph_bytes; // node lists trimmed and zone pages compacted by graphs, see AGGraphTrimMemory
+} AGMemoryPressureReport;
+
+/// Starts releasing memory that can be rebuilt whenever the system reports memory pressure. Graphs may only be used
+/// from their own thread, so each graph trims and compacts its memory at the end of its next
+/// AGGraphUpdateDirtyAttributes, and adds what it released to the report.
+CF_EXPORT
+void AGGraphStartMemoryPressureResponder(void) CF_SWIFT_NAME(Graph.startMemoryPressureResponder());
+
+/// Releases memory right away, as the responder does under memory pressure, and returns what was released. Graphs
+/// respond later, on their own thread.
+CF_EXPORT
+AGMemoryPressureReport AGGraphRespondToMemoryPressure(void) CF_SWIFT_NAME(Graph.respondToMemoryPressure());
+
+/// The memory released by all responses so far.
+CF_EXPORT
+AGMemoryPressureReport AGGraphGetMemoryPressureReport(void) CF_SWIFT_NAME(getter:Graph.memoryPressureReport());
+
+/// Releases the spare capacity of the node lists of `graph` and its subgraphs and returns the number of bytes freed.
+/// Must be called on the graph's thread.
+CF_EXPORT
+uint64_t AGGraphTrimMemory(AGGraphRef graph) CF_SWIFT_NAME(Graph.trimMemory(self:));
+
+// Deadline
+
+/// The time, in mach absolute time units, after which interruptible updates of the graph stop early. `UINT64_MAX`
+/// means no deadline.
+CF_EXPORT
+uint64_t AGGraphGetDeadline(AGGraphRef graph) CF_SWIFT_NAME(getter:Graph.deadline(self:));
+
+CF_EXPORT
+void AGGraphSetDeadline(AGGraphRef graph, uint64_t deadline) CF_SWIFT_NAME(setter:Graph.deadline(self:_:));
+
+CF_EXPORT
+bool AGGraphHasDeadlinePassed(AGGraphRef graph) CF_SWIFT_NAME(getter:Graph.hasDeadlinePassed(self:));
+
+typedef CF_ENUM(uint32_t, AGGraphUpdateStatus) {
+    AGGraphUpdateStatusComplete = 0,
+
+    /// The deadline passed before every dirty attribute was updated. The rest stay dirty and are updated by the next
+    /// call.
+    AGGraphUpdateStatusDeadlinePassed = 1,
+} CF_SWIFT_NAME(Graph.UpdateStatus);
+
+/// Updates the attributes of `graph` marked dirty since the last call, in the order they were marked, stopping between
+/// two attributes once the deadline has passed. Must be called on the graph's thread.
+CF_EXPORT
+AGGraphUpdateStatus AGGraphUpdateDirtyAttributes(AGGraphRef graph) CF_SWIFT_NAME(Graph.updateDirtyAttributes(self:));
+
+// Main thread handler
+
+/// Calls `body` with `handler` as the graph's main thread handler. While the graph updates nodes in parallel off the
+/// main thread, rules that aren't thread-safe are run by passing a thunk to the handler, which must call
+/// `thunk(thunk_context)` on the main thread before returning.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGGraphWithMainThreadHandler(AGGraphRef graph, void (*body)(const void *_Nullable context),
+                                  const void *_Nullable body_context,
+                                  void (*handler)(void (*thunk)(const void *_Nullable thunk_context),
+                                                  const void *_Nullable thunk_context,
+                                                  const void *_Nullable handler_context),
+                                  const void *_Nullable handler_context);
+
+// Profiling
+
+/// The updates and comparisons of one attribute type in one section of the profile, with times in seconds.
+typedef struct AG_SWIFT_NAME(ProfileEntry) AGProfileEntry {
+    /// The name of the mark that ended the section, or `NULL` for the section since the last mark.
+    const char *_Nullable mark;
+    AGTypeID self_type;
+    AGTypeID value_type;
+    uint64_t update_count;
+    double update_time;
+    double self_time;
+    uint64_t compare_count;
+    double compare_time;
+} AGProfileEntry;
+
+/// The batches of dirty attributes updated by `AGGraphUpdateDirtyAttributes`, with times in seconds.
+typedef struct AG_SWIFT_NAME(ProfileUpdateBatches) AGProfileUpdateBatches {
+    uint64_t count;
+
+    /// The batches stopped by the deadline.
+    uint64_t interrupted_count;
+    double total_time;
+    double max_time;
+    double last_time;
+} AGProfileUpdateBatches;
+
+/// Starts counting the updates and comparisons of every graph. Profiling is process-wide.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGGraphStartProfiling(void);
+
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGGraphStopProfiling(void);
+
+/// Ends the current section of the profile, naming it `name`.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGGraphMarkProfile(const char *name);
+
+/// Discards every section of the profile.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGGraphResetProfile(void);
+
+/// Copies up to `capacity` entries of the profile into `entries`, marked sections first, and returns the total number
+/// of entries. Mark names stay valid until the profile is reset.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+size_t AGGraphCopyProfileEntries(AGProfileEntry *_Nullable entries, size_t capacity);
+
+/// The batches of dirty attributes updated by every graph since profiling was last reset.
+CF_EXPORT
+AGProfileUpdateBatches AGGraphGetProfileUpdateBatches(void) CF_SWIFT_NAME(getter:Graph.profileUpdateBatches());
+
+// Tracing
+
+/// Starts recording trace events of every graph and streaming them to the file at `path`, or to os_signpost if `path`
+/// is `NULL`. Returns false if tracing is already running or the file can't be created.
+CF_EXPORT
+bool AGGraphStartTracing(const char *_Nullable path) CF_SWIFT_NAME(Graph.startTracing(path:));
+
+/// Writes the events still buffered, then stops tracing.
+CF_EXPORT
+void AGGraphStopTracing(void) CF_SWIFT_NAME(Graph.stopTracing());
+
+/// The number of trace events dropped because a thread recorded them faster than they were written.
+CF_EXPORT
+uint64_t AGGraphGetTraceDroppedCount(void) CF_SWIFT_NAME(getter:Graph.traceDroppedCount());
+
+/// Records a custom trace event named `event_name`. Values of `type` of up to 8 bytes are copied into the event, for
+/// larger ones only the type is recorded.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGGraphAddTraceEvent(AGGraphRef graph, const char *event_name, const void *value, AGTypeID type);
+
+// Describing
+
+typedef CF_ENUM(uint32_t, AGGraphDescriptionFormat) {
+    AGGraphDescriptionFormatJSON = 0,
+    AGGraphDescriptionFormatGraphviz = 1,
+
+    /// A binary snapshot that offline tools can map and read in place, see AG::GraphSnapshot.
+    AGGraphDescriptionFormatBinary = 2,
+} CF_SWIFT_NAME(Graph.DescriptionFormat);
+
+typedef CF_OPTIONS(uint32_t, AGGraphDescriptionOptions) {
+    AGGraphDescriptionOptionsNone = 0,
+
+    /// Writes the description on a background queue from a copy-on-write snapshot of the graph, returning
+    /// immediately.
+    AGGraphDescriptionOptionsSnapshot = 1 << 0,
+
+    /// Includes the bytes of values stored in zone memory, in hex.
+    AGGraphDescriptionOptionsIncludeValues = 1 << 1,
+} CF_SWIFT_NAME(Graph.DescriptionOptions);
+
+/// Writes a JSON description of `graph` to `name`.ag-json in the temporary directory, from a snapshot on a background
+/// queue. `name` defaults to "graph".
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGGraphArchiveJSON(AGGraphRef graph, const char *_Nullable name);
+
+/// Writes a description of `graph` to `fd`, which is closed once the description is written. If the snapshot can't be
+/// made the description is written before returning.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGGraphWriteDescription(AGGraphRef graph, AGGraphDescriptionFormat format, AGGraphDescriptionOptions options,
+                             int fd);
+
+/// Calls `body` with consecutive chunks of a description of `graph` before returning. The chunks are only valid
+/// during each call. `AGGraphDescriptionOptionsSnapshot` is ignored.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGGraphDescribe(AGGraphRef graph, AGGraphDescriptionFormat format, AGGraphDescriptionOptions options,
+                     void (*body)(const void *bytes, size_t size, void *_Nullable context), void *_Nullable context);
+
 CF_EXTERN_C_END
 
 CF_ASSUME_NONNULL_END
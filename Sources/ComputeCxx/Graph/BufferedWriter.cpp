@@ -0,0 +1,135 @@
+#include "BufferedWriter.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace AG {
+
+BufferedWriter::BufferedWriter(int fd) : _fd(fd), _buffer((char *)malloc(buffer_size)) {}
+
+BufferedWriter::BufferedWriter(Callback callback, void *_Nullable context)
+    : _callback(callback), _context(context), _buffer((char *)malloc(buffer_size)) {}
+
+BufferedWriter::~BufferedWriter() {
+    flush();
+    free(_buffer);
+}
+
+void BufferedWriter::write_through(const void *bytes, size_t size) {
+    if (_callback) {
+        _callback(bytes, size, _context);
+        return;
+    }
+
+    auto remaining = static_cast<const char *>(bytes);
+    while (size > 0 && !_failed) {
+        ssize_t written = ::write(_fd, remaining, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            _failed = true;
+            break;
+        }
+        remaining += written;
+        size -= written;
+    }
+}
+
+void BufferedWriter::flush() {
+    if (_size > 0) {
+        write_through(_buffer, _size);
+        _size = 0;
+    }
+}
+
+void BufferedWriter::write(const void *bytes, size_t size) {
+    _position += size;
+    if (_size + size > buffer_size) {
+        flush();
+        if (size > buffer_size) {
+            write_through(bytes, size);
+            return;
+        }
+    }
+    memcpy(_buffer + _size, bytes, size);
+    _size += size;
+}
+
+void BufferedWriter::write(const char *string) { write(string, strlen(string)); }
+
+void BufferedWriter::align(size_t alignment) {
+    static const char zeros[256] = {};
+    size_t padding = (alignment - _position % alignment) % alignment;
+    while (padding > 0) {
+        size_t size = std::min(padding, sizeof(zeros));
+        write(zeros, size);
+        padding -= size;
+    }
+}
+
+void BufferedWriter::write_format(const char *format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+    if (size_t(length) < sizeof(line)) {
+        write(line, length);
+        return;
+    }
+
+    char *long_line = (char *)malloc(length + 1);
+    va_start(args, format);
+    vsnprintf(long_line, length + 1, format, args);
+    va_end(args);
+    write(long_line, length);
+    free(long_line);
+}
+
+void BufferedWriter::write_hex(const void *bytes, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    auto data = static_cast<const unsigned char *>(bytes);
+    for (size_t index = 0; index < size; index++) {
+        write(digits[data[index] >> 4]);
+        write(digits[data[index] & 0xf]);
+    }
+}
+
+void BufferedWriter::write_json_string(const char *string) {
+    write('"');
+    for (auto c = reinterpret_cast<const unsigned char *>(string); *c; c++) {
+        switch (*c) {
+        case '"':
+            write("\\\"");
+            break;
+        case '\\':
+            write("\\\\");
+            break;
+        case '\n':
+            write("\\n");
+            break;
+        case '\t':
+            write("\\t");
+            break;
+        default:
+            if (*c < 0x20) {
+                write_format("\\u%04x", *c);
+            } else {
+                write(char(*c));
+            }
+            break;
+        }
+    }
+    write('"');
+}
+
+} // namespace AG
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <stddef.h>
+#include <stdint.h>
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace AG {
+
+/// Collects small writes into a fixed buffer and passes it on to a file descriptor or to a callback whenever it
+/// fills up, so that output of any size is written with a constant amount of memory.
+class BufferedWriter {
+  public:
+    using Callback = void (*)(const void *bytes, size_t size, void *_Nullable context);
+
+    static constexpr size_t buffer_size = 0x10000;
+
+  private:
+    int _fd = -1;
+    Callback _Nullable _callback = nullptr;
+    void *_Nullable _context = nullptr;
+    char *_buffer;
+    size_t _size = 0;
+    uint64_t _position = 0;
+    bool _failed = false;
+
+    void write_through(const void *bytes, size_t size);
+
+  public:
+    explicit BufferedWriter(int fd);
+    BufferedWriter(Callback callback, void *_Nullable context);
+    ~BufferedWriter();
+
+    BufferedWriter(const BufferedWriter &) = delete;
+    BufferedWriter &operator=(const BufferedWriter &) = delete;
+
+    /// Whether writing to the file descriptor failed. Later writes are dropped once it has.
+    bool failed() const { return _failed; };
+
+    /// The number of bytes written so far, including the ones still buffered.
+    uint64_t position() const { return _position; };
+
+    void write(const void *bytes, size_t size);
+    void write(const char *string);
+    void write(char c) {
+        if (_size == buffer_size) {
+            flush();
+        }
+        _buffer[_size++] = c;
+        _position += 1;
+    };
+
+    /// Writes zeros up to the next multiple of `alignment`.
+    void align(size_t alignment);
+
+    void write_format(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    void write_hex(const void *bytes, size_t size);
+
+    /// Writes `string` as a quoted JSON string.
+    void write_json_string(const char *string);
+
+    void flush();
+};
+
+} // namespace AG
+
+CF_ASSUME_NONNULL_END
@@ -1,19 +1,108 @@
 #include "Graph.h"
 
+#include <algorithm>
+
 #include "Attribute/AttributeType.h"
 #include "Attribute/Node/Node.h"
+#include "Attribute/OffsetAttributeID.h"
+#include "Errors/Errors.h"
+#include "MemoryPressure.h"
+#include "ParallelUpdate.h"
+#include "Profiler.h"
+#include "Subgraph/Subgraph.h"
+
+struct AGGraphStorage {
+    // CFRuntimeBase
+    uintptr_t _cfisa;
+    uint64_t _cfinfoa;
+
+    AG::Graph *_Nullable _graph;
+};
 
 namespace AG {
 
+namespace {
+
+/// The number of fragments and pages of each subgraph's zone that responding to memory pressure looks at, see
+/// `zone::compact`. Later responses continue where earlier ones stopped.
+constexpr uint32_t memory_pressure_compaction_budget = 256;
+
+} // namespace
+
+Graph *Graph::from_cf(AGGraphStorage *storage) { return storage->_graph; }
+
+Graph::Graph() { MemoryPressure::add_graph(*this); }
+
+Graph::~Graph() { MemoryPressure::remove_graph(*this); }
+
 void Graph::trace_assertion_failure(bool all_stop_tracing, const char *format, ...) {
     // TODO: Not implemented
 }
 
-const AttributeType &Graph::attribute_type(uint32_t type_id) const {
-    // TODO: Not implemented
-    throw;
+#pragma mark - Attribute types
+
+uint32_t Graph::add_attribute_type(AttributeType &type) {
+    if (_num_types == _type_records_capacity) {
+        uint32_t new_capacity = std::max(_type_records_capacity * 2, 64u);
+        auto records = std::unique_ptr<AttributeTypeRecord[]>(new AttributeTypeRecord[new_capacity]);
+        std::copy(_type_records.get(), _type_records.get() + _num_types, records.get());
+        _type_records = std::move(records);
+        _type_records_capacity = new_capacity;
+    }
+
+    _type_records[_num_types] = AttributeTypeRecord(type);
+    return _num_types++;
+}
+
+const AttributeType &Graph::attribute_type(uint32_t type_id) const { return attribute_type_record(type_id).type(); }
+
+#pragma mark - Subgraphs
+
+void Graph::did_create_subgraph(Subgraph &subgraph) { _subgraphs.push_back(&subgraph); }
+
+void Graph::will_destroy_subgraph(Subgraph &subgraph) {
+    auto iter = std::find(_subgraphs.begin(), _subgraphs.end(), &subgraph);
+    if (iter != _subgraphs.end()) {
+        *iter = _subgraphs.back();
+        _subgraphs.pop_back();
+    }
 }
 
+size_t Graph::trim() {
+    if (_is_updating_in_parallel) {
+        return 0;
+    }
+
+    size_t trimmed_size = 0;
+    for (Subgraph *subgraph : _subgraphs) {
+        trimmed_size += subgraph->trim();
+    }
+
+    size_t capacity = _subgraphs.capacity();
+    _subgraphs.shrink_to_fit();
+    trimmed_size += (capacity - _subgraphs.capacity()) * sizeof(Subgraph *);
+
+    capacity = _dirty_nodes.capacity();
+    _dirty_nodes.shrink_to_fit();
+    trimmed_size += (capacity - _dirty_nodes.capacity()) * sizeof(data::ptr<Node>);
+    return trimmed_size;
+}
+
+uint64_t Graph::respond_to_memory_pressure() {
+    if (_is_updating_in_parallel || !_memory_pressure_pending.exchange(false, std::memory_order_relaxed)) {
+        return 0;
+    }
+
+    uint64_t released_size = trim();
+    for (Subgraph *subgraph : _subgraphs) {
+        released_size += subgraph->compact(memory_pressure_compaction_budget);
+    }
+    MemoryPressure::did_release_graph_memory(released_size);
+    return released_size;
+}
+
+#pragma mark - Nodes
+
 const AttributeType &Graph::attribute_ref(data::ptr<Node> attribute, const void *_Nullable *_Nullable ref_out) const {
     auto &type = attribute_type(attribute->type_id());
     if (ref_out) {
@@ -27,15 +116,251 @@ const AttributeType &Graph::attribute_ref(data::ptr<Node> attribute, const void
 }
 
 void Graph::did_allocate_node_value(size_t size) {
-    // TODO: Not implemented
+    _num_node_values.fetch_add(1, std::memory_order_relaxed);
+    _num_node_value_bytes.fetch_add(size, std::memory_order_relaxed);
 }
 
 void Graph::did_destroy_node_value(size_t size) {
-    // TODO: Not implemented
+    _num_node_values.fetch_sub(1, std::memory_order_relaxed);
+    _num_node_value_bytes.fetch_sub(size, std::memory_order_relaxed);
 }
 
-void Graph::update_attribute(AttributeID attribute, bool option) {
-    // TODO: Not implemented
+void Graph::did_destroy_node_values(uint64_t count, uint64_t size) {
+    _num_node_values.fetch_sub(count, std::memory_order_relaxed);
+    _num_node_value_bytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+#pragma mark - Updates
+
+UpdateStack::Status Graph::update_attribute(AttributeID attribute, bool interruptible) {
+    OffsetAttributeID resolved = attribute.resolve(AttributeID::TraversalOptions::None);
+    if (!resolved.attribute().is_direct()) {
+        return UpdateStack::Status::Complete;
+    }
+    return update_stack().update(resolved.attribute().to_node_ptr(), interruptible);
+}
+
+UpdateStack &Graph::update_stack() {
+    UpdateStack *stack = UpdateStack::current();
+    if (stack && &stack->graph() == this) {
+        return *stack;
+    }
+    return _update_stack;
+}
+
+void Graph::mark_dirty(data::ptr<Node> attribute) {
+    if (_is_updating_in_parallel) {
+        // the batch belongs to the thread that started the update, and the node may belong to another worker
+        _nodes_marked_in_parallel.push(attribute);
+        return;
+    }
+
+    attribute->set_dirty(true);
+    if (!attribute->is_pending()) {
+        attribute->set_pending(true);
+        _dirty_nodes.push_back(attribute);
+    }
+}
+
+UpdateStack::Status Graph::update_dirty_nodes() {
+    UpdateStack::Status status = UpdateStack::Status::Complete;
+    if (!_dirty_nodes.empty()) {
+        Profiler::BatchTimer timer = Profiler::BatchTimer();
+        status = ParallelUpdate::max_workers() > 1 && _dirty_nodes.size() > 1 ? update_dirty_nodes_in_parallel()
+                                                                               : update_dirty_nodes_in_order();
+        timer.end(status == UpdateStack::Status::DeadlinePassed);
+    }
+
+    // the graph is known to be on its own thread here
+    respond_to_memory_pressure();
+    return status;
+}
+
+UpdateStack::Status Graph::update_dirty_nodes_in_order() {
+    // Nodes marked dirty while the batch is updated are added to the end and updated too
+    uint32_t index = 0;
+    while (index < _dirty_nodes.size()) {
+        data::ptr<Node> attribute = _dirty_nodes[index];
+        if (_update_stack.update(attribute, true) == UpdateStack::Status::DeadlinePassed) {
+            break;
+        }
+        attribute->set_pending(false);
+        index += 1;
+    }
+
+    if (index == _dirty_nodes.size()) {
+        _dirty_nodes.clear();
+        return UpdateStack::Status::Complete;
+    }
+
+    // keep the rest of the batch for the next frame
+    for (uint32_t i = index; i < _dirty_nodes.size(); i++) {
+        _dirty_nodes[i - index] = _dirty_nodes[i];
+    }
+    _dirty_nodes.resize(_dirty_nodes.size() - index);
+    return UpdateStack::Status::DeadlinePassed;
+}
+
+UpdateStack::Status Graph::update_dirty_nodes_in_parallel() {
+    while (!_dirty_nodes.empty()) {
+        ParallelUpdate update = ParallelUpdate(*this, _dirty_nodes);
+
+        _is_updating_in_parallel = true;
+        UpdateStack::Status status = update.update();
+        _is_updating_in_parallel = false;
+
+        // keep the nodes that weren't recomputed before the deadline for the next call, in batch order
+        uint32_t count = 0;
+        for (data::ptr<Node> attribute : _dirty_nodes) {
+            if (status == UpdateStack::Status::DeadlinePassed && attribute->is_dirty()) {
+                _dirty_nodes[count++] = attribute;
+            } else {
+                attribute->set_pending(false);
+            }
+        }
+        _dirty_nodes.resize(count);
+
+        _nodes_marked_in_parallel.drain([this](data::ptr<Node> &attribute) { mark_dirty(attribute); });
+
+        if (status == UpdateStack::Status::DeadlinePassed) {
+            return status;
+        }
+    }
+    return UpdateStack::Status::Complete;
+}
+
+void Graph::update_value(data::ptr<Node> attribute) {
+    const void *self = nullptr;
+    auto &type = attribute_ref(attribute, &self);
+    if (!type.has_update()) {
+        precondition_failure("attribute type has no update function: %u", attribute->type_id());
+    }
+    type.update(const_cast<void *>(self), AttributeID(attribute).to_raw_value());
+}
+
+bool Graph::set_value(data::ptr<Node> attribute, const void *value) {
+    if (attribute->compare_value(*this, value, LayoutDescriptor::ComparisonOptions())) {
+        return false;
+    }
+    attribute->set_value(*this, value);
+    return true;
+}
+
+void Graph::did_detect_cycle(data::ptr<Node> attribute) {
+    non_fatal_precondition_failure("cycle detected through attribute: %u", attribute.offset());
+}
+
+#pragma mark - Edges
+
+uint32_t Graph::add_input(data::ptr<Node> attribute, AttributeID input, bool always_enabled) {
+    if (_is_updating_in_parallel) {
+        precondition_failure("can't add inputs during a parallel update");
+    }
+    if (input.is_nil() || !InputEdge::can_store(input.to_raw_value())) {
+        precondition_failure("invalid input attribute: %u", input.to_raw_value());
+    }
+
+    uint32_t flags = always_enabled ? InputEdge::Flags::AlwaysEnabled : 0;
+    attribute->inputs().push_back(*AttributeID(attribute).subgraph(), InputEdge(input.to_raw_value(), flags));
+
+    if (input.is_direct()) {
+        data::ptr<Node> input_node = input.to_node_ptr();
+        input_node->outputs().push_back(*input.subgraph(), AttributeID(attribute));
+    } else if (input.subgraph() != AttributeID(attribute).subgraph()) {
+        input.subgraph()->add_indirect_dependent(input, attribute);
+    }
+
+    return attribute->inputs().size() - 1;
+}
+
+void Graph::remove_input(data::ptr<Node> attribute, uint32_t index) {
+    if (_is_updating_in_parallel) {
+        precondition_failure("can't remove inputs during a parallel update");
+    }
+
+    AttributeID input = this->input(attribute, index);
+    if (input.is_direct()) {
+        auto &outputs = input.to_node_ptr()->outputs();
+        uint32_t output_index = outputs.find(AttributeID(attribute));
+        if (output_index < outputs.size()) {
+            outputs.remove_unordered(output_index);
+        }
+    } else if (input.subgraph() != AttributeID(attribute).subgraph()) {
+        input.subgraph()->remove_indirect_dependent(input, attribute);
+    }
+
+    attribute->inputs().remove(index);
+}
+
+void Graph::remove_inputs(data::ptr<Node> attribute, AttributeID input) {
+    auto &inputs = attribute->inputs();
+    for (uint32_t index = inputs.size(); index > 0; index--) {
+        if (inputs[index - 1].attribute_value() == input.to_raw_value()) {
+            inputs.remove(index - 1);
+        }
+    }
+}
+
+void Graph::remove_edges(data::ptr<Node> attribute, const Subgraph *destroyed_subgraph) {
+    AttributeID attribute_id = AttributeID(attribute);
+
+    auto &inputs = attribute->inputs();
+    for (uint32_t index = 0; index < inputs.size(); index++) {
+        AttributeID input = AttributeID::from_raw_value(inputs[index].attribute_value());
+        Subgraph *input_subgraph = input.subgraph();
+        if (input_subgraph == destroyed_subgraph) {
+            continue;
+        }
+        if (input.is_direct()) {
+            auto &input_outputs = input.to_node_ptr()->outputs();
+            uint32_t output_index = input_outputs.find(attribute_id);
+            if (output_index < input_outputs.size()) {
+                input_outputs.remove_unordered(output_index);
+            }
+        } else if (input_subgraph != attribute_id.subgraph()) {
+            input_subgraph->remove_indirect_dependent(input, attribute);
+        }
+    }
+
+    auto &outputs = attribute->outputs();
+    for (uint32_t index = 0; index < outputs.size(); index++) {
+        AttributeID output = outputs[index];
+        if (output.subgraph() != destroyed_subgraph) {
+            remove_inputs(output.to_node_ptr(), attribute_id);
+        }
+    }
+}
+
+uint32_t Graph::num_inputs(data::ptr<Node> attribute) const { return attribute->inputs().size(); }
+
+AttributeID Graph::input(data::ptr<Node> attribute, uint32_t index) const {
+    return AttributeID::from_raw_value(attribute->inputs()[index].attribute_value());
+}
+
+#pragma mark - Main thread
+
+bool Graph::is_main_thread_only(data::ptr<Node> attribute) const {
+    return !attribute_type_record(attribute->type_id()).is_thread_safe();
+}
+
+void Graph::with_main_thread_handler(void (*body)(const void *_Nullable context), const void *_Nullable body_context,
+                                     MainThreadHandler handler, const void *_Nullable handler_context) {
+    MainThreadHandler old_handler = _main_thread_handler;
+    const void *old_handler_context = _main_thread_handler_context;
+    _main_thread_handler = handler;
+    _main_thread_handler_context = handler_context;
+
+    body(body_context);
+
+    _main_thread_handler = old_handler;
+    _main_thread_handler_context = old_handler_context;
+}
+
+void Graph::call_main_thread_handler(MainThreadThunk thunk, const void *_Nullable thunk_context) {
+    if (!_main_thread_handler) {
+        precondition_failure("no main thread handler");
+    }
+    _main_thread_handler(thunk, thunk_context, _main_thread_handler_context);
 }
 
 } // namespace AG
@@ -1,27 +1,191 @@
 #pragma once
 
 #include <CoreFoundation/CFBase.h>
+#include <atomic>
+#include <memory>
 #include <stdint.h>
 
+#include "AGGraph.h"
 #include "Attribute/AttributeID.h"
+#include "Attribute/AttributeType.h"
+#include "Errors/Errors.h"
+#include "Time/Time.h"
+#include "UpdateStack.h"
+#include "Utilities/MPSCQueue.h"
+#include "Vector/Vector.h"
 
 CF_ASSUME_NONNULL_BEGIN
 
 namespace AG {
 
-class AttributeType;
+class Subgraph;
 
 class Graph {
   public:
+    using MainThreadThunk = void (*)(const void *_Nullable thunk_context);
+    using MainThreadHandler = void (*)(MainThreadThunk thunk, const void *_Nullable thunk_context,
+                                       const void *_Nullable handler_context);
+
+  private:
+    // Attribute types, indexed by type id
+    std::unique_ptr<AttributeTypeRecord[]> _type_records;
+    uint32_t _num_types = 0;
+    uint32_t _type_records_capacity = 0;
+
+    std::atomic<uint64_t> _num_node_values = 0;
+    std::atomic<uint64_t> _num_node_value_bytes = 0;
+
+    vector<Subgraph *, 0, uint32_t> _subgraphs;
+
+    // Updates
+    UpdateStack _update_stack = UpdateStack(*this);
+    vector<data::ptr<Node>, 0, uint32_t> _dirty_nodes;
+    uint64_t _deadline = UINT64_MAX;
+
+    // Parallel updates
+    bool _is_updating_in_parallel = false;
+    util::MPSCQueue<data::ptr<Node>> _nodes_marked_in_parallel;
+    MainThreadHandler _Nullable _main_thread_handler = nullptr;
+    const void *_Nullable _main_thread_handler_context = nullptr;
+
+    // Set from any thread when memory pressure is reported, see MemoryPressure
+    std::atomic<bool> _memory_pressure_pending = false;
+
+    UpdateStack::Status update_dirty_nodes_in_order();
+    UpdateStack::Status update_dirty_nodes_in_parallel();
+
+  public:
+    static Graph *_Nullable from_cf(AGGraphStorage *storage);
+
+    Graph();
+    ~Graph();
+
     static void trace_assertion_failure(bool all_stop_tracing, const char *format, ...);
 
+    // Attribute types
+
+    /// Adds `type` to the graph's table of attribute types and returns its type id. Must not be called while a
+    /// parallel update is running, since the table may move.
+    uint32_t add_attribute_type(AttributeType &type);
+    uint32_t num_attribute_types() const { return _num_types; };
+
     const AttributeType &attribute_type(uint32_t type_id) const;
+
+    /// The precomputed fields of the type, read without touching the AttributeType itself.
+    const AttributeTypeRecord &attribute_type_record(uint32_t type_id) const {
+        if (type_id >= _num_types) {
+            precondition_failure("invalid attribute type: %u", type_id);
+        }
+        return _type_records[type_id];
+    };
+
+    /// Starts loading the record of a type that a batch operation is about to look at.
+    void prefetch_attribute_type_record(uint32_t type_id) const {
+        if (type_id < _num_types) {
+            __builtin_prefetch(&_type_records[type_id]);
+        }
+    };
     const AttributeType &attribute_ref(data::ptr<Node> attribute, const void *_Nullable *_Nullable ref_out) const;
 
     void did_allocate_node_value(size_t size);
     void did_destroy_node_value(size_t size);
+    void did_destroy_node_values(uint64_t count, uint64_t size);
+    uint64_t num_node_values() const { return _num_node_values.load(std::memory_order_relaxed); };
+    uint64_t num_node_value_bytes() const { return _num_node_value_bytes.load(std::memory_order_relaxed); };
+
+    // Subgraphs
+
+    void did_create_subgraph(Subgraph &subgraph);
+    void will_destroy_subgraph(Subgraph &subgraph);
+    const vector<Subgraph *, 0, uint32_t> &subgraphs() const { return _subgraphs; };
+
+    /// Releases the spare capacity of the graph's and its subgraphs' lists and returns the number of bytes freed.
+    /// Does nothing during a parallel update.
+    size_t trim();
+
+    /// Asks the graph to release memory the next time it is on its own thread. May be called from any thread.
+    void did_receive_memory_pressure() { _memory_pressure_pending.store(true, std::memory_order_relaxed); };
+
+    /// If memory pressure was reported since the last response, trims the graph and compacts part of the zone of each
+    /// of its subgraphs. Called at the end of `update_dirty_nodes`. Returns the number of bytes released.
+    uint64_t respond_to_memory_pressure();
+
+    // Updates
+
+    /// Updates the attribute that `attribute` resolves to, along with any of its inputs that are dirty. If
+    /// `interruptible` is set the update stops once the deadline has passed.
+    UpdateStack::Status update_attribute(AttributeID attribute, bool interruptible);
+
+    /// Marks the value of `attribute` as needing to be recomputed, and adds it to the batch of dirty nodes updated by
+    /// the next call to `update_dirty_nodes`.
+    void mark_dirty(data::ptr<Node> attribute);
+
+    /// Updates the nodes marked dirty since the last call, in the order they were marked. If the deadline passes
+    /// first, returns `DeadlinePassed` and the nodes that weren't updated stay in the batch, so the next call continues
+    /// where this one stopped. While profiling, the elapsed time of each batch is recorded, see
+    /// `Profiler::update_batches`.
+    ///
+    /// When AG_UPDATE_WORKERS allows more than one thread, nodes that don't depend on each other are updated in
+    /// parallel, see ParallelUpdate. Nodes marked dirty by rules meanwhile are added to the batch once the update
+    /// finishes.
+    ///
+    /// Afterwards the graph responds to any memory pressure reported since the last call, see
+    /// `respond_to_memory_pressure`.
+    UpdateStack::Status update_dirty_nodes();
+
+    /// The update stack for updates made on the calling thread.
+    UpdateStack &update_stack();
+
+    // Edges
+
+    /// Adds `input` to the inputs of `attribute`, and `attribute` to the outputs of `input` if that is a direct
+    /// attribute. Returns the index of the new input. Edges can't be added while a parallel update is running, since
+    /// the input may be read by other workers.
+    uint32_t add_input(data::ptr<Node> attribute, AttributeID input, bool always_enabled);
+    void remove_input(data::ptr<Node> attribute, uint32_t index);
+
+    /// Removes every input of `attribute` that is `input`, leaving the outputs of `input` alone.
+    void remove_inputs(data::ptr<Node> attribute, AttributeID input);
+
+    /// Removes the edges between `attribute` and other nodes from those nodes, before `attribute` is destroyed. Nodes
+    /// of `destroyed_subgraph`, which is being destroyed along with `attribute`, are skipped.
+    void remove_edges(data::ptr<Node> attribute, const Subgraph *_Nullable destroyed_subgraph);
+
+    uint32_t num_inputs(data::ptr<Node> attribute) const;
+    AttributeID input(data::ptr<Node> attribute, uint32_t index) const;
+
+    /// Recomputes the value of `attribute` by calling the update function of its type, which fails if the type has
+    /// none. Attributes that can't be recomputed must not be marked dirty.
+    void update_value(data::ptr<Node> attribute);
+
+    /// Sets the value of `attribute` to a copy of `value`, from the update function of its type. Returns whether the
+    /// value changed, an equal value is left as it is.
+    bool set_value(data::ptr<Node> attribute, const void *value);
+
+    void did_detect_cycle(data::ptr<Node> attribute);
+
+    // Main thread
+
+    /// Whether the rule of `attribute` has to run on the main thread when nodes are updated in parallel.
+    bool is_main_thread_only(data::ptr<Node> attribute) const;
+
+    /// Calls `body` with `handler` as the main thread handler, restoring the previous handler afterwards.
+    void with_main_thread_handler(void (*body)(const void *_Nullable context), const void *_Nullable body_context,
+                                  MainThreadHandler handler, const void *_Nullable handler_context);
+    bool has_main_thread_handler() const { return _main_thread_handler != nullptr; };
+
+    /// Passes `thunk` to the main thread handler, which calls it on the main thread before returning.
+    void call_main_thread_handler(MainThreadThunk thunk, const void *_Nullable thunk_context);
+
+    // Deadline
+
+    /// The time, in mach absolute time units, by which interruptible updates should stop. `UINT64_MAX` if there is no
+    /// deadline.
+    uint64_t deadline() const { return _deadline; };
+    void set_deadline(uint64_t deadline) { _deadline = deadline; };
 
-    void update_attribute(AttributeID attribute, bool option);
+    /// Checked between the nodes of interruptible updates, so without a deadline this costs a single compare.
+    bool has_deadline_passed() const { return _deadline != UINT64_MAX && absolute_time() >= _deadline; };
 };
 
 } // namespace AG
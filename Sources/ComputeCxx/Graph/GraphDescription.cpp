@@ -0,0 +1,244 @@
+#include "GraphDescription.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include "Attribute/AttributeType.h"
+#include "Attribute/Node/Node.h"
+#include "BufferedWriter.h"
+#include "Graph.h"
+#include "GraphSnapshot.h"
+#include "Subgraph/Subgraph.h"
+#include "Swift/Metadata.h"
+
+namespace AG {
+
+GraphDescription::GraphDescription(const Graph &graph, uint32_t options) : _options(options) {
+    for (uint32_t type_id = 0; type_id < graph.num_attribute_types(); type_id++) {
+        const AttributeType &type = graph.attribute_type(type_id);
+        _types.push_back({&type.self_metadata(), &type.value_metadata(), type.self_metadata().name(false),
+                          type.value_metadata().name(false), type.value_metadata().vw_size()});
+    }
+
+    for (const Subgraph *subgraph : graph.subgraphs()) {
+        uint32_t nodes_begin = _nodes.size();
+        for (data::ptr<Node> node : subgraph->nodes()) {
+            _nodes.push_back({node.offset(), node->type_id(), node->current_state().to_raw_value()});
+        }
+        std::sort(_nodes.begin() + nodes_begin, _nodes.end(),
+                  [](const NodeInfo &lhs, const NodeInfo &rhs) { return lhs.offset < rhs.offset; });
+        _subgraphs.push_back({uintptr_t(subgraph), nodes_begin, _nodes.size()});
+    }
+
+    data::table &table = data::table::shared();
+    _used_pages = table.used_page_map();
+    if (options & Options::Snapshot) {
+        _region = table.copy_region();
+    }
+    uint32_t region_size = _region ? uint32_t(_region.size()) : table.region_size();
+    _num_region_pages = std::min(region_size / data::page_size, _used_pages.size() * 64);
+}
+
+vm_address_t GraphDescription::ptr_base() const {
+    return _region ? _region.ptr_base() : data::table::shared().ptr_base();
+}
+
+void GraphDescription::write(Format format, BufferedWriter &writer) const {
+    switch (format) {
+    case Format::JSON:
+        write_json(writer);
+        break;
+    case Format::Graphviz:
+        write_graphviz(writer);
+        break;
+    case Format::Binary:
+        write_binary(writer);
+        break;
+    }
+    writer.flush();
+}
+
+const void *_Nullable GraphDescription::value_bytes(const NodeInfo &info) const {
+    if (!(_options & Options::IncludeValues) || !(info.state & Node::State::ValueInitialized)) {
+        return nullptr;
+    }
+    auto node = reinterpret_cast<const Node *>(ptr_base() + info.offset);
+    data::ptr<void> value = node->direct_value();
+    if (!value) {
+        return nullptr;
+    }
+    return reinterpret_cast<const void *>(ptr_base() + value.offset());
+}
+
+#pragma mark - JSON
+
+void GraphDescription::write_json(BufferedWriter &writer) const {
+    vm_address_t base = ptr_base();
+
+    writer.write("{\"version\":1,\"types\":[");
+    for (uint32_t type_id = 0; type_id < _types.size(); type_id++) {
+        const TypeInfo &type = _types[type_id];
+        writer.write_format("%s{\"id\":%u,\"name\":", type_id ? "," : "", type_id);
+        writer.write_json_string(type.self_name);
+        writer.write(",\"value\":");
+        writer.write_json_string(type.value_name);
+        writer.write_format(",\"size\":%zu}", type.value_size);
+    }
+
+    writer.write("],\"subgraphs\":[");
+    for (uint32_t subgraph_index = 0; subgraph_index < _subgraphs.size(); subgraph_index++) {
+        const SubgraphInfo &subgraph = _subgraphs[subgraph_index];
+        writer.write_format("%s{\"id\":\"%#lx\",\"nodes\":[", subgraph_index ? "," : "", subgraph.id);
+        for (uint32_t index = subgraph.nodes_begin; index < subgraph.nodes_end; index++) {
+            const NodeInfo &info = _nodes[index];
+            auto node = reinterpret_cast<const Node *>(base + info.offset);
+            writer.write_format("%s{\"id\":%u,\"type\":%u,\"state\":%u,\"inputs\":[", index > subgraph.nodes_begin ? "," : "",
+                                info.offset, info.type_id, info.state);
+            for (uint32_t input = 0; input < node->inputs().size(); input++) {
+                InputEdge edge = node->inputs().get(input, base);
+                writer.write_format("%s{\"id\":%u,\"flags\":%u}", input ? "," : "", edge.attribute_value(),
+                                    edge.to_raw_value() & InputEdge::FlagsMask);
+            }
+            writer.write("],\"outputs\":[");
+            for (uint32_t output = 0; output < node->outputs().size(); output++) {
+                writer.write_format("%s%u", output ? "," : "", node->outputs().get(output, base).to_raw_value());
+            }
+            writer.write(']');
+            if (const void *value = value_bytes(info)) {
+                writer.write(",\"value\":\"");
+                writer.write_hex(value, _types[info.type_id].value_size);
+                writer.write('"');
+            }
+            writer.write('}');
+        }
+        writer.write("]}");
+    }
+    writer.write("]}\n");
+}
+
+#pragma mark - Graphviz
+
+void GraphDescription::write_graphviz(BufferedWriter &writer) const {
+    vm_address_t base = ptr_base();
+
+    writer.write("digraph {\n");
+    for (const SubgraphInfo &subgraph : _subgraphs) {
+        writer.write_format("  subgraph \"cluster_%#lx\" {\n", subgraph.id);
+        for (uint32_t index = subgraph.nodes_begin; index < subgraph.nodes_end; index++) {
+            const NodeInfo &info = _nodes[index];
+
+            // type names are escaped as JSON strings, which Graphviz reads the same way
+            writer.write_format("    _%u [label=", info.offset);
+            writer.write_json_string(_types[info.type_id].self_name);
+            if (const void *value = value_bytes(info)) {
+                writer.write(" xlabel=\"");
+                writer.write_hex(value, _types[info.type_id].value_size);
+                writer.write('"');
+            }
+            writer.write((info.state & Node::State::Dirty) ? " style=dashed];\n" : "];\n");
+        }
+        writer.write("  }\n");
+    }
+
+    for (const NodeInfo &info : _nodes) {
+        auto node = reinterpret_cast<const Node *>(base + info.offset);
+        for (uint32_t input = 0; input < node->inputs().size(); input++) {
+            InputEdge edge = node->inputs().get(input, base);
+            writer.write_format("  _%u -> _%u%s;\n", edge.attribute_value(), info.offset,
+                                edge.is_changed() ? " [color=red]" : "");
+        }
+    }
+    writer.write("}\n");
+}
+
+#pragma mark - Binary
+
+void GraphDescription::write_binary(BufferedWriter &writer) const {
+    auto aligned = [](uint64_t offset, uint64_t alignment) { return (offset + alignment - 1) & ~(alignment - 1); };
+    auto is_used = [this](uint32_t page) { return (_used_pages[page / 64] >> (page % 64)) & 1; };
+
+    vector<uint32_t, 0, uint32_t> name_offsets;
+    uint32_t names_size = 0;
+    for (const TypeInfo &type : _types) {
+        name_offsets.push_back(names_size);
+        names_size += strlen(type.self_name) + 1;
+        name_offsets.push_back(names_size);
+        names_size += strlen(type.value_name) + 1;
+    }
+
+    vector<uint32_t, 0, uint32_t> page_index;
+    uint32_t num_pages = 0;
+    for (uint32_t page = 0; page < _num_region_pages; page++) {
+        page_index.push_back(is_used(page) ? num_pages++ : GraphSnapshot::no_page);
+    }
+
+    GraphSnapshot::Header header = {};
+    header.magic = GraphSnapshot::magic;
+    header.version = GraphSnapshot::version;
+    header.page_size = data::page_size;
+    header.num_types = _types.size();
+    header.num_subgraphs = _subgraphs.size();
+    header.num_nodes = _nodes.size();
+    header.num_region_pages = _num_region_pages;
+    header.num_pages = num_pages;
+    header.names_offset = sizeof(header);
+    header.names_size = names_size;
+    header.types_offset = aligned(header.names_offset + names_size, 8);
+    header.subgraphs_offset = header.types_offset + _types.size() * sizeof(GraphSnapshot::Type);
+    header.nodes_offset = header.subgraphs_offset + _subgraphs.size() * sizeof(GraphSnapshot::Subgraph);
+    header.page_index_offset = header.nodes_offset + _nodes.size() * sizeof(GraphSnapshot::Node);
+    header.pages_offset = aligned(header.page_index_offset + page_index.size() * sizeof(uint32_t), data::page_size);
+    writer.write(&header, sizeof(header));
+
+    for (const TypeInfo &type : _types) {
+        writer.write(type.self_name, strlen(type.self_name) + 1);
+        writer.write(type.value_name, strlen(type.value_name) + 1);
+    }
+    writer.align(8);
+
+    vector<const swift::metadata *, 0, uint32_t> metadata;
+    for (const TypeInfo &type : _types) {
+        metadata.push_back(type.self_type);
+        metadata.push_back(type.value_type);
+    }
+    vector<const void *, 0, uint32_t> signatures;
+    signatures.resize(metadata.size());
+    swift::metadata::signatures(metadata.data(), metadata.size(), signatures.data());
+
+    for (uint32_t type_id = 0; type_id < _types.size(); type_id++) {
+        GraphSnapshot::Type type = {};
+        if (signatures[2 * type_id]) {
+            memcpy(&type.self_signature, signatures[2 * type_id], sizeof(AGTypeSignature));
+        }
+        if (signatures[2 * type_id + 1]) {
+            memcpy(&type.value_signature, signatures[2 * type_id + 1], sizeof(AGTypeSignature));
+        }
+        type.value_size = _types[type_id].value_size;
+        type.self_name = name_offsets[2 * type_id];
+        type.value_name = name_offsets[2 * type_id + 1];
+        writer.write(&type, sizeof(type));
+    }
+
+    for (const SubgraphInfo &subgraph : _subgraphs) {
+        GraphSnapshot::Subgraph entry = {subgraph.id, subgraph.nodes_begin, subgraph.nodes_end};
+        writer.write(&entry, sizeof(entry));
+    }
+
+    for (const NodeInfo &info : _nodes) {
+        GraphSnapshot::Node node = {info.offset, info.type_id, info.state, {}};
+        writer.write(&node, sizeof(node));
+    }
+
+    writer.write(page_index.data(), page_index.size() * sizeof(uint32_t));
+    writer.align(data::page_size);
+
+    // pages are written in region order, so allocations spanning several pages stay contiguous
+    vm_address_t base = ptr_base();
+    for (uint32_t page = 0; page < _num_region_pages; page++) {
+        if (is_used(page)) {
+            writer.write(reinterpret_cast<const void *>(base + (page + 1) * data::page_size), data::page_size);
+        }
+    }
+}
+
+} // namespace AG
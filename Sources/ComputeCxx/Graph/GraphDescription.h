@@ -0,0 +1,92 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <stdint.h>
+
+#include "Data/Table.h"
+#include "Vector/Vector.h"
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace AG {
+
+namespace swift {
+class metadata;
+}
+
+class BufferedWriter;
+class Graph;
+
+/// Describes the attributes of a graph as JSON, as a Graphviz digraph or as a binary GraphSnapshot, written in chunks
+/// to a BufferedWriter.
+///
+/// Creating the description copies only what can't be read later: the nodes of each subgraph, their update states
+/// and the names of their types. With `Snapshot` it also maps a copy-on-write copy of the table's region, so the
+/// description can then be written from another thread while the graph keeps changing; without it the description
+/// must be written before the graph changes. Nodes are visited in the order of their offsets, so zone pages are read
+/// one after another rather than in creation order.
+class GraphDescription {
+  public:
+    enum Options : uint32_t {
+        Snapshot = 1 << 0,
+
+        /// Includes the bytes of every value stored in zone memory. Values of Swift types can't be described from
+        /// here, the bytes are written in hex.
+        IncludeValues = 1 << 1,
+    };
+
+    enum class Format : uint8_t {
+        JSON,
+        Graphviz,
+        Binary,
+    };
+
+  private:
+    struct TypeInfo {
+        const swift::metadata *self_type;
+        const swift::metadata *value_type;
+        const char *self_name;
+        const char *value_name;
+        size_t value_size;
+    };
+
+    struct NodeInfo {
+        uint32_t offset;
+        uint32_t type_id;
+        uint8_t state;
+    };
+
+    struct SubgraphInfo {
+        uintptr_t id;
+        uint32_t nodes_begin;
+        uint32_t nodes_end;
+    };
+
+    uint32_t _options;
+    vector<TypeInfo, 0, uint32_t> _types;
+    vector<NodeInfo, 0, uint32_t> _nodes;
+    vector<SubgraphInfo, 0, uint32_t> _subgraphs;
+    vector<uint64_t, 0, uint32_t> _used_pages;
+    uint32_t _num_region_pages;
+    data::table::region_copy _region;
+
+    vm_address_t ptr_base() const;
+
+    void write_json(BufferedWriter &writer) const;
+    void write_graphviz(BufferedWriter &writer) const;
+    void write_binary(BufferedWriter &writer) const;
+    /// The bytes of the node's value if values are included and it has one in zone memory.
+    const void *_Nullable value_bytes(const NodeInfo &info) const;
+
+  public:
+    GraphDescription(const Graph &graph, uint32_t options);
+
+    /// Whether a Snapshot was requested and the region could be copied.
+    bool has_snapshot() const { return bool(_region); };
+
+    void write(Format format, BufferedWriter &writer) const;
+};
+
+} // namespace AG
+
+CF_ASSUME_NONNULL_END
@@ -0,0 +1,63 @@
+#include "GraphSnapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace AG {
+
+GraphSnapshot::~GraphSnapshot() {
+    if (_data) {
+        munmap((void *)_data, _size);
+    }
+}
+
+bool GraphSnapshot::open(const char *path) {
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    auto header = static_cast<const Header *>(data);
+    uint64_t pages_end = header->pages_offset + uint64_t(header->num_pages) * header->page_size;
+    if (header->magic != magic || header->version != version || pages_end > uint64_t(info.st_size)) {
+        munmap(data, info.st_size);
+        return false;
+    }
+
+    if (_data) {
+        munmap((void *)_data, _size);
+    }
+    _data = static_cast<const unsigned char *>(data);
+    _size = info.st_size;
+    return true;
+}
+
+const void *_Nullable GraphSnapshot::resolve(uint32_t offset) const {
+    const Header &header = this->header();
+    uint32_t region_page = offset / header.page_size;
+    if (region_page == 0 || region_page > header.num_region_pages) {
+        return nullptr;
+    }
+
+    // offsets are relative to the page before the region, see data::table::ptr_base()
+    auto page_index = reinterpret_cast<const uint32_t *>(_data + header.page_index_offset);
+    uint32_t page = page_index[region_page - 1];
+    if (page == no_page) {
+        return nullptr;
+    }
+    return _data + header.pages_offset + uint64_t(page) * header.page_size + offset % header.page_size;
+}
+
+} // namespace AG
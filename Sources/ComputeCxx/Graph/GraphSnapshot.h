@@ -0,0 +1,98 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Swift/AGType.h"
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace AG {
+
+/// A binary snapshot of a graph, written by GraphDescription and read back by mapping the file.
+///
+/// The pages of the data table's region that were in use are written verbatim, so nodes, edge lists and values are
+/// found at the same 32-bit offsets as in the graph that was written, through the page index. Types are identified
+/// by their signatures, since metadata pointers don't outlive the process. Every section starts at a multiple of 8
+/// bytes and the pages at a multiple of the page size, so everything can be read in place.
+class GraphSnapshot {
+  public:
+    static constexpr uint32_t magic = 'A' | ('G' << 8) | ('S' << 16) | ('1' << 24);
+    static constexpr uint32_t version = 1;
+    static constexpr uint32_t no_page = UINT32_MAX;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t page_size;
+        uint32_t num_types;
+        uint32_t num_subgraphs;
+        uint32_t num_nodes;
+        uint32_t num_region_pages;
+        uint32_t num_pages;
+        uint64_t names_offset;
+        uint64_t names_size;
+        uint64_t types_offset;
+        uint64_t subgraphs_offset;
+        uint64_t nodes_offset;
+        uint64_t page_index_offset; // num_region_pages page numbers, or no_page for pages that weren't used
+        uint64_t pages_offset;
+    };
+
+    struct Type {
+        AGTypeSignature self_signature;
+        AGTypeSignature value_signature;
+        uint32_t value_size;
+        uint32_t self_name; // offsets into the names, which are null-terminated
+        uint32_t value_name;
+        uint32_t padding;
+    };
+
+    struct Subgraph {
+        uint64_t id;
+        uint32_t nodes_begin;
+        uint32_t nodes_end;
+    };
+
+    /// Nodes of each subgraph are sorted by offset.
+    struct Node {
+        uint32_t offset;
+        uint32_t type_id;
+        uint8_t state;
+        uint8_t padding[3];
+    };
+
+  private:
+    const unsigned char *_Nullable _data = nullptr;
+    size_t _size = 0;
+
+  public:
+    GraphSnapshot(){};
+    ~GraphSnapshot();
+
+    GraphSnapshot(const GraphSnapshot &) = delete;
+    GraphSnapshot &operator=(const GraphSnapshot &) = delete;
+
+    /// Maps the snapshot at `path`. Returns false if the file can't be mapped or isn't a snapshot of this version.
+    bool open(const char *path);
+
+    explicit operator bool() const { return _data != nullptr; };
+
+    const Header &header() const { return *reinterpret_cast<const Header *>(_data); };
+
+    const Type *types() const { return reinterpret_cast<const Type *>(_data + header().types_offset); };
+    const Subgraph *subgraphs() const { return reinterpret_cast<const Subgraph *>(_data + header().subgraphs_offset); };
+    const Node *nodes() const { return reinterpret_cast<const Node *>(_data + header().nodes_offset); };
+
+    const char *name(uint32_t name_offset) const {
+        return reinterpret_cast<const char *>(_data + header().names_offset + name_offset);
+    };
+
+    /// The bytes at `offset` in the graph that was written, or `nullptr` if the page wasn't in the snapshot.
+    const void *_Nullable resolve(uint32_t offset) const;
+};
+
+} // namespace AG
+
+CF_ASSUME_NONNULL_END
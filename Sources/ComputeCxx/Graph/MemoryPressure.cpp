@@ -0,0 +1,93 @@
+#include "MemoryPressure.h"
+
+#include <algorithm>
+#include <dispatch/dispatch.h>
+#include <os/lock.h>
+
+#include "Data/Table.h"
+#include "Graph.h"
+#include "Layout/LayoutDescriptor.h"
+#include "Vector/Vector.h"
+
+namespace AG {
+
+namespace {
+
+os_unfair_lock cumulative_report_lock = OS_UNFAIR_LOCK_INIT;
+MemoryPressure::Report cumulative_report = {};
+
+os_unfair_lock graphs_lock = OS_UNFAIR_LOCK_INIT;
+vector<Graph *, 0, uint32_t> &graphs() {
+    static auto graphs = new vector<Graph *, 0, uint32_t>();
+    return *graphs;
+}
+
+dispatch_once_t responder_once = 0;
+dispatch_source_t _Nullable responder_source = nullptr;
+
+} // namespace
+
+void MemoryPressure::add_graph(Graph &graph) {
+    os_unfair_lock_lock(&graphs_lock);
+    graphs().push_back(&graph);
+    os_unfair_lock_unlock(&graphs_lock);
+}
+
+void MemoryPressure::remove_graph(Graph &graph) {
+    os_unfair_lock_lock(&graphs_lock);
+    auto &list = graphs();
+    auto iter = std::find(list.begin(), list.end(), &graph);
+    if (iter != list.end()) {
+        *iter = list.back();
+        list.pop_back();
+    }
+    os_unfair_lock_unlock(&graphs_lock);
+}
+
+void MemoryPressure::did_release_graph_memory(uint64_t size) {
+    // the pages released by compaction are still queued in the table
+    uint64_t page_bytes = data::table::ensure_shared().purge_reusable_pages();
+
+    os_unfair_lock_lock(&cumulative_report_lock);
+    cumulative_report.page_bytes += page_bytes;
+    cumulative_report.graph_bytes += size;
+    os_unfair_lock_unlock(&cumulative_report_lock);
+}
+
+void MemoryPressure::start_responder() {
+    dispatch_once_f(&responder_once, nullptr, [](void *_Nullable context) {
+        responder_source = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+                                                  DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL,
+                                                  dispatch_get_global_queue(QOS_CLASS_UTILITY, 0));
+        dispatch_source_set_event_handler_f(responder_source, [](void *_Nullable context) { respond(); });
+        dispatch_activate(responder_source);
+    });
+}
+
+MemoryPressure::Report MemoryPressure::respond() {
+    Report report = {1, 0, 0, 0};
+    report.page_bytes = data::table::ensure_shared().purge_reusable_pages();
+    report.cache_bytes = LayoutDescriptor::trim_cache();
+
+    os_unfair_lock_lock(&graphs_lock);
+    for (Graph *graph : graphs()) {
+        graph->did_receive_memory_pressure();
+    }
+    os_unfair_lock_unlock(&graphs_lock);
+
+    os_unfair_lock_lock(&cumulative_report_lock);
+    cumulative_report.response_count += report.response_count;
+    cumulative_report.page_bytes += report.page_bytes;
+    cumulative_report.cache_bytes += report.cache_bytes;
+    os_unfair_lock_unlock(&cumulative_report_lock);
+    return report;
+}
+
+MemoryPressure::Report MemoryPressure::total_report() {
+    os_unfair_lock_lock(&cumulative_report_lock);
+    Report report = cumulative_report;
+    os_unfair_lock_unlock(&cumulative_report_lock);
+    return report;
+}
+
+} // namespace AG
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <stdint.h>
+
+#include "AGGraph.h"
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace AG {
+
+class Graph;
+
+/// Releases memory that can be rebuilt on demand when the system reports memory pressure.
+///
+/// A response releases the table's empty pages that are still waiting for a batched purge and the spare capacity of
+/// the layout cache's queues. Zones and node lists belong to graphs that may only be used from their own thread, so
+/// each live graph is told about the pressure instead and responds at the end of its next batch of updates, see
+/// Graph::respond_to_memory_pressure. Built layouts and the type caches are left alone, since their entries are held
+/// by callers without reference counting.
+class MemoryPressure {
+  public:
+    using Report = AGMemoryPressureReport;
+
+    /// Graphs register while they are alive so that responses can reach them.
+    static void add_graph(Graph &graph);
+    static void remove_graph(Graph &graph);
+
+    /// Called by a graph once it has responded on its own thread, with the number of bytes it released.
+    static void did_release_graph_memory(uint64_t size);
+
+    /// Installs a memory pressure source that responds on a background queue. Only the first call has an effect.
+    static void start_responder();
+
+    /// Releases memory on the calling thread and returns what this response released.
+    static Report respond();
+
+    /// The sum of all responses so far.
+    static Report total_report();
+};
+
+} // namespace AG
+
+CF_ASSUME_NONNULL_END
@@ -0,0 +1,267 @@
+#include "ParallelUpdate.h"
+
+#include <algorithm>
+#include <dispatch/dispatch.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Attribute/AttributeID.h"
+#include "Attribute/Node/Node.h"
+#include "Attribute/OffsetAttributeID.h"
+#include "Graph.h"
+#include "Utilities/HashTable.h"
+
+namespace AG {
+
+namespace {
+
+uint32_t find_set(vector<uint32_t, 0, uint32_t> &parents, uint32_t set) {
+    while (parents[set] != set) {
+        parents[set] = parents[parents[set]];
+        set = parents[set];
+    }
+    return set;
+}
+
+uint64_t make_range(uint32_t begin, uint32_t end) { return uint64_t(begin) | (uint64_t(end) << 32); }
+
+} // namespace
+
+uint32_t ParallelUpdate::max_workers() {
+    static uint32_t max_workers = []() -> uint32_t {
+        char *result = getenv("AG_UPDATE_WORKERS");
+        if (result) {
+            return std::clamp(atoi(result), 1, 32);
+        }
+        return 1;
+    }();
+    return max_workers;
+}
+
+ParallelUpdate::ParallelUpdate(Graph &graph, const vector<data::ptr<Node>, 0, uint32_t> &batch)
+    : _graph(graph), _num_workers(1) {
+    partition(batch);
+}
+
+#pragma mark - Partitioning
+
+void ParallelUpdate::partition(const vector<data::ptr<Node>, 0, uint32_t> &batch) {
+    // One set per subgraph, joined whenever a dependency between two subgraphs is found. Values are the set plus one,
+    // since missing keys look up as zero
+    util::Table<const void *, uintptr_t> subgraph_sets;
+    util::Table<const Node *, uintptr_t> visited_sets;
+    vector<uint32_t, 0, uint32_t> parents;
+    vector<bool, 0, uint32_t> main_thread;
+
+    auto set_for = [&](data::ptr<Node> node) -> uint32_t {
+        const void *subgraph = AttributeID(node).subgraph();
+        uintptr_t set = subgraph_sets.lookup(subgraph, nullptr);
+        if (set == 0) {
+            set = parents.size() + 1;
+            parents.push_back(uint32_t(set - 1));
+            main_thread.push_back(false);
+            subgraph_sets.insert(subgraph, set);
+        }
+        return uint32_t(set - 1);
+    };
+    auto join = [&](uint32_t a, uint32_t b) {
+        a = find_set(parents, a);
+        b = find_set(parents, b);
+        if (a != b) {
+            parents[b] = a;
+            main_thread[a] = main_thread[a] || main_thread[b];
+        }
+    };
+
+    vector<uint32_t, 0, uint32_t> batch_sets;
+    batch_sets.reserve(batch.size());
+    vector<data::ptr<Node>, 0, uint32_t> stack;
+    for (data::ptr<Node> node : batch) {
+        uint32_t set = set_for(node);
+        batch_sets.push_back(set);
+
+        // Walk the dirty nodes that updating this one would also update, the same ones UpdateStack visits
+        if (node->is_dirty()) {
+            stack.push_back(node);
+        }
+        while (!stack.empty()) {
+            data::ptr<Node> current = stack.back();
+            stack.pop_back();
+
+            if (uintptr_t visited = visited_sets.lookup(current.get(), nullptr)) {
+                join(set, uint32_t(visited - 1));
+                continue;
+            }
+            visited_sets.insert(current.get(), set + 1);
+            join(set, set_for(current));
+            if (_graph.is_main_thread_only(current)) {
+                main_thread[find_set(parents, set)] = true;
+            }
+
+            uint32_t num_inputs = _graph.num_inputs(current);
+            for (uint32_t index = 0; index < num_inputs; index++) {
+                OffsetAttributeID input = _graph.input(current, index).resolve(AttributeID::TraversalOptions::None);
+                if (input.attribute().is_direct() && input.attribute().to_node_ptr()->is_dirty()) {
+                    data::ptr<Node> input_node = input.attribute().to_node_ptr();
+                    _graph.prefetch_attribute_type_record(input_node->type_id());
+                    stack.push_back(input_node);
+                }
+            }
+        }
+    }
+
+    // Group the batch by partition, keeping the batch order within each partition
+    vector<uint32_t, 0, uint32_t> set_partitions;
+    set_partitions.resize(parents.size(), UINT32_MAX);
+    for (uint32_t &set : batch_sets) {
+        set = find_set(parents, set);
+        if (set_partitions[set] == UINT32_MAX) {
+            set_partitions[set] = _partitions.size();
+            _partitions.push_back({0, 0, main_thread[set]});
+        }
+        _partitions[set_partitions[set]].end += 1;
+    }
+
+    uint32_t begin = 0;
+    for (Partition &partition : _partitions) {
+        uint32_t count = partition.end;
+        partition.begin = begin;
+        partition.end = begin;
+        begin += count;
+    }
+
+    _nodes.resize(batch.size());
+    for (uint32_t index = 0; index < batch.size(); index++) {
+        Partition &partition = _partitions[set_partitions[batch_sets[index]]];
+        _nodes[partition.end] = batch[index];
+        partition.end += 1;
+    }
+}
+
+#pragma mark - Updating
+
+bool ParallelUpdate::update_partition(UpdateStack &stack, const Partition &partition) {
+    for (uint32_t index = partition.begin; index < partition.end; index++) {
+        if (_deadline_passed.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        if (stack.update(_nodes[index], true) == UpdateStack::Status::DeadlinePassed) {
+            _deadline_passed.store(true, std::memory_order_relaxed);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ParallelUpdate::take_partition(uint32_t worker_index, uint32_t *partition_index) {
+    // take the next partition of our own share
+    Share &own = _shares[worker_index];
+    uint64_t range = own.range.load(std::memory_order_relaxed);
+    while (uint32_t(range) < uint32_t(range >> 32)) {
+        uint32_t begin = uint32_t(range);
+        if (own.range.compare_exchange_weak(range, make_range(begin + 1, uint32_t(range >> 32)),
+                                            std::memory_order_relaxed)) {
+            *partition_index = _shared_partitions[begin];
+            return true;
+        }
+    }
+
+    // otherwise steal the last partition of the next worker that has any left
+    for (uint32_t offset = 1; offset < _num_workers; offset++) {
+        Share &other = _shares[(worker_index + offset) % _num_workers];
+        range = other.range.load(std::memory_order_relaxed);
+        while (uint32_t(range) < uint32_t(range >> 32)) {
+            uint32_t end = uint32_t(range >> 32);
+            if (other.range.compare_exchange_weak(range, make_range(uint32_t(range), end - 1),
+                                                  std::memory_order_relaxed)) {
+                *partition_index = _shared_partitions[end - 1];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void ParallelUpdate::run_worker(uint32_t worker_index, UpdateStack &stack) {
+    // nested updates made by rules on this thread use this worker's stack
+    UpdateStack *previous_stack = UpdateStack::current();
+    UpdateStack::set_current(&stack);
+
+    uint32_t partition_index;
+    while (!_deadline_passed.load(std::memory_order_relaxed) && take_partition(worker_index, &partition_index)) {
+        update_partition(stack, _partitions[partition_index]);
+    }
+
+    UpdateStack::set_current(previous_stack);
+}
+
+void ParallelUpdate::update_worker(void *context) {
+    Worker *worker = (Worker *)context;
+    UpdateStack stack = UpdateStack(worker->update->_graph);
+    worker->update->run_worker(worker->index, stack);
+}
+
+void ParallelUpdate::update_main_thread_partitions() {
+    auto body = [](const void *context) {
+        ParallelUpdate *update = (ParallelUpdate *)context;
+        UpdateStack stack = UpdateStack(update->_graph);
+        UpdateStack *previous_stack = UpdateStack::current();
+        UpdateStack::set_current(&stack);
+        for (const Partition &partition : update->_partitions) {
+            if (partition.main_thread && !update->update_partition(stack, partition)) {
+                break;
+            }
+        }
+        UpdateStack::set_current(previous_stack);
+    };
+
+    if (pthread_main_np() || !_graph.has_main_thread_handler()) {
+        body(this);
+    } else {
+        _graph.call_main_thread_handler(body, this);
+    }
+}
+
+UpdateStack::Status ParallelUpdate::update() {
+    bool has_main_thread_partitions = false;
+    for (uint32_t index = 0; index < _partitions.size(); index++) {
+        if (_partitions[index].main_thread) {
+            has_main_thread_partitions = true;
+        } else {
+            _shared_partitions.push_back(index);
+        }
+    }
+
+    // Deal the partitions out in contiguous shares, the calling thread being worker zero
+    _num_workers = std::clamp(_shared_partitions.size(), 1u, max_workers());
+    _shares.reset(new Share[_num_workers]);
+    for (uint32_t worker_index = 0; worker_index < _num_workers; worker_index++) {
+        uint32_t begin = uint32_t(uint64_t(_shared_partitions.size()) * worker_index / _num_workers);
+        uint32_t end = uint32_t(uint64_t(_shared_partitions.size()) * (worker_index + 1) / _num_workers);
+        _shares[worker_index].range.store(make_range(begin, end), std::memory_order_relaxed);
+    }
+
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_queue_global_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0);
+    std::unique_ptr<Worker[]> workers = std::unique_ptr<Worker[]>(new Worker[_num_workers]);
+    for (uint32_t worker_index = 1; worker_index < _num_workers; worker_index++) {
+        workers[worker_index] = {this, worker_index};
+        dispatch_group_async_f(group, queue, &workers[worker_index], update_worker);
+    }
+
+    // Rules that aren't thread-safe run while the workers get going, then this thread helps with the rest
+    if (has_main_thread_partitions) {
+        update_main_thread_partitions();
+    }
+    workers[0] = {this, 0};
+    update_worker(&workers[0]);
+
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    dispatch_release(group);
+
+    return _deadline_passed.load(std::memory_order_relaxed) ? UpdateStack::Status::DeadlinePassed
+                                                            : UpdateStack::Status::Complete;
+}
+
+} // namespace AG
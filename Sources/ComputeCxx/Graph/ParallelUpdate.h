@@ -0,0 +1,90 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+#include "Data/Pointer.h"
+#include "UpdateStack.h"
+#include "Vector/Vector.h"
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace AG {
+
+class Graph;
+class Node;
+
+/// Updates a batch of dirty nodes on several threads at once.
+///
+/// The batch is split into partitions that can't affect each other: nodes start out partitioned by subgraph, and the
+/// partitions of two subgraphs are joined whenever updating a node would also update a dirty node of the other
+/// subgraph. Each partition is then updated in batch order by one thread, using an update stack of its own.
+///
+/// Partitions are dealt out to the workers up front, and a worker that runs out of partitions steals from the back of
+/// another worker's share. A partition containing a node whose rule isn't thread-safe is updated by the calling thread
+/// instead, or through the graph's main thread handler if the calling thread isn't the main thread.
+class ParallelUpdate {
+  public:
+    /// The number of threads, including the calling one, that may update a batch, see AG_UPDATE_WORKERS. A value of 1
+    /// disables parallel updates.
+    static uint32_t max_workers();
+
+  private:
+    struct Partition {
+        uint32_t begin;
+        uint32_t end;
+        bool main_thread;
+    };
+
+    /// The indices of the partitions a worker hasn't started yet. The owner takes from the front and thieves from the
+    /// back, both by swapping the whole range.
+    struct alignas(64) Share {
+        std::atomic<uint64_t> range; // begin in the low half, end in the high half
+    };
+
+    struct Worker {
+        ParallelUpdate *update;
+        uint32_t index;
+    };
+
+    Graph &_graph;
+    vector<data::ptr<Node>, 0, uint32_t> _nodes; // grouped by partition
+    vector<Partition, 0, uint32_t> _partitions;
+    vector<uint32_t, 0, uint32_t> _shared_partitions; // partitions that may be updated on any thread
+
+    uint32_t _num_workers;
+    std::unique_ptr<Share[]> _shares;
+    std::atomic<bool> _deadline_passed = false;
+
+    void partition(const vector<data::ptr<Node>, 0, uint32_t> &batch);
+
+    bool update_partition(UpdateStack &stack, const Partition &partition);
+    bool take_partition(uint32_t worker_index, uint32_t *partition_index);
+    void run_worker(uint32_t worker_index, UpdateStack &stack);
+    void update_main_thread_partitions();
+
+    static void update_worker(void *context);
+
+  public:
+    ParallelUpdate(Graph &graph, const vector<data::ptr<Node>, 0, uint32_t> &batch);
+
+    // non-copyable
+    ParallelUpdate(const ParallelUpdate &) = delete;
+    ParallelUpdate &operator=(const ParallelUpdate &) = delete;
+
+    // non-movable
+    ParallelUpdate(ParallelUpdate &&) = delete;
+    ParallelUpdate &operator=(ParallelUpdate &&) = delete;
+
+    uint32_t num_partitions() const { return _partitions.size(); };
+
+    /// Updates every partition, returning once they have all finished. Nodes that weren't recomputed because the
+    /// graph's deadline passed are left dirty.
+    UpdateStack::Status update();
+};
+
+} // namespace AG
+
+CF_ASSUME_NONNULL_END
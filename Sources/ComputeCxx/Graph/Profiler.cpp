@@ -0,0 +1,277 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <mach/mach_time.h>
+#include <os/lock.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Attribute/AttributeType.h"
+#include "Graph.h"
+#include "Utilities/HashTable.h"
+#include "Vector/Vector.h"
+
+namespace AG {
+
+std::atomic<bool> Profiler::_enabled = false;
+
+namespace {
+
+using Entries = vector<Profiler::Entry, 0, uint32_t>;
+
+bool is_empty(const Profiler::Entry &entry) { return entry.update_count == 0 && entry.compare_count == 0; }
+
+/// Adds the counters of `entries` to the entry of the same type in `result`. Values of `indices` are the index in
+/// `result` plus one, since missing keys look up as zero.
+void merge(Entries &result, util::Table<const swift::metadata *, uintptr_t> &indices, const Entries &entries) {
+    for (const Profiler::Entry &entry : entries) {
+        if (is_empty(entry)) {
+            continue;
+        }
+        uintptr_t index = indices.lookup(entry.self_type, nullptr);
+        if (index == 0) {
+            result.push_back(entry);
+            indices.insert(entry.self_type, result.size());
+            continue;
+        }
+        Profiler::Entry &merged = result[index - 1];
+        merged.update_count += entry.update_count;
+        merged.update_time += entry.update_time;
+        merged.self_time += entry.self_time;
+        merged.compare_count += entry.compare_count;
+        merged.compare_time += entry.compare_time;
+    }
+}
+
+/// The counters of one thread. The thread locks them to record, readers lock them to merge or clear them.
+class ThreadProfile {
+  private:
+    os_unfair_lock _lock = OS_UNFAIR_LOCK_INIT;
+    util::Table<const swift::metadata *, uintptr_t> _indices;
+    Entries _entries;
+
+  public:
+    void lock() { os_unfair_lock_lock(&_lock); };
+    void unlock() { os_unfair_lock_unlock(&_lock); };
+
+    const Entries &entries() const { return _entries; };
+
+    /// Must be called with the lock held. Body types determine value types, so entries are keyed by body type alone.
+    Profiler::Entry &entry(const swift::metadata *self_type, const swift::metadata *value_type) {
+        uintptr_t index = _indices.lookup(self_type, nullptr);
+        if (index == 0) {
+            _entries.push_back({nullptr, self_type, value_type, 0, 0, 0, 0, 0});
+            index = _entries.size();
+            _indices.insert(self_type, index);
+        }
+        return _entries[index - 1];
+    };
+
+    /// Zeroes the counters, keeping the entries so that the thread doesn't have to add them again.
+    void clear() {
+        for (Profiler::Entry &entry : _entries) {
+            entry = {nullptr, entry.self_type, entry.value_type, 0, 0, 0, 0, 0};
+        }
+    };
+};
+
+/// The profile of the whole process: the threads that have recorded anything and the sections that were marked.
+struct Profile {
+    os_unfair_lock lock = OS_UNFAIR_LOCK_INIT;
+    vector<ThreadProfile *, 0, uint32_t> threads;
+    Entries exited_thread_entries; // in the current section
+    Entries marked_entries;
+    vector<char *, 0, uint32_t> mark_names;
+    Profiler::UpdateBatches update_batches = {0, 0, 0, 0, 0};
+
+    /// Merges the current section of every thread, clearing the threads' counters if `clear` is set. Must be called
+    /// with the lock held.
+    Entries current_entries(bool clear) {
+        Entries result;
+        util::Table<const swift::metadata *, uintptr_t> indices;
+        merge(result, indices, exited_thread_entries);
+        for (ThreadProfile *thread : threads) {
+            thread->lock();
+            merge(result, indices, thread->entries());
+            if (clear) {
+                thread->clear();
+            }
+            thread->unlock();
+        }
+        if (clear) {
+            exited_thread_entries.clear();
+        }
+        return result;
+    };
+};
+
+/// Never destroyed, since threads may still exit after static destructors ran.
+Profile &shared_profile() {
+    static Profile *profile = new Profile();
+    return *profile;
+}
+
+/// Registers the profile of the current thread on first use, and folds it into the shared profile when the thread
+/// exits.
+class ThreadProfileOwner {
+  private:
+    ThreadProfile *_Nullable _profile = nullptr;
+
+  public:
+    ~ThreadProfileOwner() {
+        if (!_profile) {
+            return;
+        }
+        Profile &profile = shared_profile();
+        os_unfair_lock_lock(&profile.lock);
+        Entries merged;
+        util::Table<const swift::metadata *, uintptr_t> indices;
+        merge(merged, indices, profile.exited_thread_entries);
+        merge(merged, indices, _profile->entries());
+        profile.exited_thread_entries = std::move(merged);
+
+        auto iter = std::find(profile.threads.begin(), profile.threads.end(), _profile);
+        *iter = profile.threads.back();
+        profile.threads.pop_back();
+        os_unfair_lock_unlock(&profile.lock);
+
+        delete _profile;
+    };
+
+    ThreadProfile &get() {
+        if (!_profile) {
+            _profile = new ThreadProfile();
+            Profile &profile = shared_profile();
+            os_unfair_lock_lock(&profile.lock);
+            profile.threads.push_back(_profile);
+            os_unfair_lock_unlock(&profile.lock);
+        }
+        return *_profile;
+    };
+};
+
+thread_local ThreadProfileOwner current_thread_profile;
+thread_local Profiler::UpdateTimer *_Nullable current_update_timer = nullptr;
+
+} // namespace
+
+#pragma mark - Recording
+
+void Profiler::UpdateTimer::begin(const Graph &graph, uint32_t type_id) {
+    const AttributeType &type = graph.attribute_type(type_id);
+    _self_type = &type.self_metadata();
+    _value_type = &type.value_metadata();
+    _nested_time = 0;
+    _parent = current_update_timer;
+    current_update_timer = this;
+    _start_time = mach_absolute_time();
+}
+
+void Profiler::UpdateTimer::end() {
+    uint64_t time = mach_absolute_time() - _start_time;
+    current_update_timer = _parent;
+    if (_parent) {
+        _parent->_nested_time += time;
+    }
+
+    ThreadProfile &profile = current_thread_profile.get();
+    profile.lock();
+    Entry &entry = profile.entry(_self_type, _value_type);
+    entry.update_count += 1;
+    entry.update_time += time;
+    entry.self_time += time - std::min(_nested_time, time);
+    profile.unlock();
+}
+
+void Profiler::CompareTimer::begin(const Graph &graph, uint32_t type_id) {
+    const AttributeType &type = graph.attribute_type(type_id);
+    _self_type = &type.self_metadata();
+    _value_type = &type.value_metadata();
+    _start_time = mach_absolute_time();
+}
+
+void Profiler::CompareTimer::end() {
+    uint64_t time = mach_absolute_time() - _start_time;
+
+    ThreadProfile &profile = current_thread_profile.get();
+    profile.lock();
+    Entry &entry = profile.entry(_self_type, _value_type);
+    entry.compare_count += 1;
+    entry.compare_time += time;
+    profile.unlock();
+}
+
+void Profiler::BatchTimer::begin() {
+    _started = true;
+    _start_time = mach_absolute_time();
+}
+
+void Profiler::BatchTimer::record(bool interrupted) {
+    uint64_t time = mach_absolute_time() - _start_time;
+
+    // a graph updates a batch or two per frame, so the shared lock is taken rather than a thread's
+    Profile &profile = shared_profile();
+    os_unfair_lock_lock(&profile.lock);
+    UpdateBatches &batches = profile.update_batches;
+    batches.count += 1;
+    batches.interrupted_count += interrupted ? 1 : 0;
+    batches.time += time;
+    batches.max_time = std::max(batches.max_time, time);
+    batches.last_time = time;
+    os_unfair_lock_unlock(&profile.lock);
+}
+
+#pragma mark - Controlling
+
+void Profiler::start() { _enabled.store(true, std::memory_order_relaxed); }
+
+void Profiler::stop() { _enabled.store(false, std::memory_order_relaxed); }
+
+void Profiler::mark(const char *name) {
+    Profile &profile = shared_profile();
+    os_unfair_lock_lock(&profile.lock);
+    char *mark_name = strdup(name);
+    profile.mark_names.push_back(mark_name);
+    for (Entry &entry : profile.current_entries(true)) {
+        entry.mark = mark_name;
+        profile.marked_entries.push_back(entry);
+    }
+    os_unfair_lock_unlock(&profile.lock);
+}
+
+void Profiler::reset() {
+    Profile &profile = shared_profile();
+    os_unfair_lock_lock(&profile.lock);
+    profile.current_entries(true);
+    profile.marked_entries.clear();
+    for (char *mark_name : profile.mark_names) {
+        free(mark_name);
+    }
+    profile.mark_names.clear();
+    profile.update_batches = {0, 0, 0, 0, 0};
+    os_unfair_lock_unlock(&profile.lock);
+}
+
+#pragma mark - Reading
+
+void Profiler::for_each_entry(void (*body)(const Entry &entry, void *_Nullable context), void *_Nullable context) {
+    Profile &profile = shared_profile();
+    os_unfair_lock_lock(&profile.lock);
+    for (const Entry &entry : profile.marked_entries) {
+        body(entry, context);
+    }
+    for (const Entry &entry : profile.current_entries(false)) {
+        body(entry, context);
+    }
+    os_unfair_lock_unlock(&profile.lock);
+}
+
+Profiler::UpdateBatches Profiler::update_batches() {
+    Profile &profile = shared_profile();
+    os_unfair_lock_lock(&profile.lock);
+    UpdateBatches result = profile.update_batches;
+    os_unfair_lock_unlock(&profile.lock);
+    return result;
+}
+
+} // namespace AG
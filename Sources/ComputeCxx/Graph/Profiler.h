@@ -0,0 +1,151 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <atomic>
+#include <stdint.h>
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace AG {
+
+namespace swift {
+class metadata;
+}
+
+class Graph;
+
+/// Counts attribute updates and value comparisons by attribute type while profiling is enabled.
+///
+/// Each thread records into counters of its own, locked only by that thread and by readers, so recording never
+/// contends with other threads. The counters of all threads are merged when the profile is read. Marking the profile
+/// ends the current section: the counters recorded so far are merged under the mark's name and start again from zero.
+///
+/// While profiling is disabled the timers cost a single branch, so they are compiled into every build.
+class Profiler {
+  public:
+    struct Entry {
+        /// The name of the mark that ended the section, or `nullptr` for the current section.
+        const char *_Nullable mark;
+        const swift::metadata *self_type;
+        const swift::metadata *value_type;
+
+        uint64_t update_count;
+        uint64_t update_time; // in mach absolute time units, including nested updates
+        uint64_t self_time;   // excluding nested updates
+        uint64_t compare_count;
+        uint64_t compare_time;
+    };
+
+    /// The batches of dirty nodes updated by `Graph::update_dirty_nodes`, counted across every graph since profiling
+    /// was last reset. Marks don't split them into sections.
+    struct UpdateBatches {
+        uint64_t count;
+        uint64_t interrupted_count; // stopped by the graph's deadline
+        uint64_t time;              // in mach absolute time units
+        uint64_t max_time;
+        uint64_t last_time;
+    };
+
+  private:
+    static std::atomic<bool> _enabled;
+
+  public:
+    static bool is_enabled() { return _enabled.load(std::memory_order_relaxed); };
+
+    static void start();
+    static void stop();
+    static void mark(const char *name);
+    static void reset();
+
+    /// Calls `body` with the entries of every marked section in order, then with the entries of the current section.
+    /// The profile stays locked meanwhile, so `body` must not start, stop, mark or reset it.
+    static void for_each_entry(void (*body)(const Entry &entry, void *_Nullable context), void *_Nullable context);
+
+    static UpdateBatches update_batches();
+
+    /// Times the update of an attribute from its construction to its destruction. Updates timed while another timer
+    /// of the same thread is running are nested in that update.
+    class UpdateTimer {
+      private:
+        const swift::metadata *_Nullable _self_type = nullptr;
+        const swift::metadata *_Nullable _value_type = nullptr;
+        uint64_t _start_time;
+        uint64_t _nested_time;
+        UpdateTimer *_Nullable _parent;
+
+        void begin(const Graph &graph, uint32_t type_id);
+        void end();
+
+      public:
+        UpdateTimer(const Graph &graph, uint32_t type_id) {
+            if (is_enabled()) {
+                begin(graph, type_id);
+            }
+        };
+        ~UpdateTimer() {
+            if (_self_type) {
+                end();
+            }
+        };
+
+        UpdateTimer(const UpdateTimer &) = delete;
+        UpdateTimer &operator=(const UpdateTimer &) = delete;
+    };
+
+    /// Times a comparison of two values of an attribute from its construction to its destruction.
+    class CompareTimer {
+      private:
+        const swift::metadata *_Nullable _self_type = nullptr;
+        const swift::metadata *_Nullable _value_type = nullptr;
+        uint64_t _start_time;
+
+        void begin(const Graph &graph, uint32_t type_id);
+        void end();
+
+      public:
+        CompareTimer(const Graph &graph, uint32_t type_id) {
+            if (is_enabled()) {
+                begin(graph, type_id);
+            }
+        };
+        ~CompareTimer() {
+            if (_self_type) {
+                end();
+            }
+        };
+
+        CompareTimer(const CompareTimer &) = delete;
+        CompareTimer &operator=(const CompareTimer &) = delete;
+    };
+
+    /// Times the update of a batch of dirty nodes from its construction to the call to `end`, which records whether
+    /// the deadline cut the batch short.
+    class BatchTimer {
+      private:
+        bool _started = false;
+        uint64_t _start_time;
+
+        void begin();
+        void record(bool interrupted);
+
+      public:
+        BatchTimer() {
+            if (is_enabled()) {
+                begin();
+            }
+        };
+
+        void end(bool interrupted) {
+            if (_started) {
+                record(interrupted);
+            }
+        };
+
+        BatchTimer(const BatchTimer &) = delete;
+        BatchTimer &operator=(const BatchTimer &) = delete;
+    };
+};
+
+} // namespace AG
+
+CF_ASSUME_NONNULL_END
@@ -0,0 +1,110 @@
+#include "UpdateStack.h"
+
+#include <stdlib.h>
+
+#include "Attribute/AttributeID.h"
+#include "Attribute/Node/Node.h"
+#include "Attribute/OffsetAttributeID.h"
+#include "Graph.h"
+#include "Profiler.h"
+#include "Trace/Trace.h"
+
+namespace AG {
+
+thread_local UpdateStack *UpdateStack::_current = nullptr;
+
+uint32_t UpdateStack::initial_capacity() {
+    static uint32_t capacity = []() -> uint32_t {
+        char *result = getenv("AG_UPDATE_STACK_SIZE");
+        if (result) {
+            return uint32_t(atoi(result));
+        }
+        return 256;
+    }();
+    return capacity;
+}
+
+void UpdateStack::push(data::ptr<Node> attribute) {
+    if (_frames.capacity() == 0) {
+        // sized up front so that typical updates never reallocate the stack
+        _frames.reserve(initial_capacity());
+    }
+    attribute->set_updating(true);
+    _frames.push_back({attribute, 0});
+}
+
+/// Pops the frames above `base` without recomputing their attributes, which stay dirty.
+void UpdateStack::unwind(uint32_t base) {
+    while (_frames.size() > base) {
+        Node &node = *_frames.back().attribute;
+        node.set_updating(false);
+        node.set_updating_cyclic(false);
+        _frames.pop_back();
+    }
+}
+
+UpdateStack::Status UpdateStack::update(data::ptr<Node> attribute, bool interruptible) {
+    if (!attribute->is_dirty() || attribute->is_updating()) {
+        return Status::Complete;
+    }
+
+    uint32_t base = _frames.size();
+    push(attribute);
+
+    while (_frames.size() > base) {
+        Frame &frame = _frames.back();
+        data::ptr<Node> node = frame.attribute;
+
+        // update dirty inputs first, continuing from where the frame left off
+        bool pushed_input = false;
+        uint32_t num_inputs = _graph.num_inputs(node);
+        while (frame.next_input < num_inputs) {
+            OffsetAttributeID input = _graph.input(node, frame.next_input).resolve(AttributeID::TraversalOptions::None);
+            frame.next_input += 1;
+            if (!input.attribute().is_direct()) {
+                continue;
+            }
+
+            data::ptr<Node> input_node = input.attribute().to_node_ptr();
+            if (input_node->is_updating()) {
+                if (!input_node->is_updating_cyclic()) {
+                    input_node->set_updating_cyclic(true);
+                    _graph.did_detect_cycle(input_node);
+                }
+                continue;
+            }
+            if (input_node->is_dirty()) {
+                push(input_node); // invalidates frame
+                pushed_input = true;
+                break;
+            }
+        }
+        if (pushed_input) {
+            continue;
+        }
+
+        if (interruptible && _graph.has_deadline_passed()) {
+            unwind(base);
+            return Status::DeadlinePassed;
+        }
+
+        // may update other attributes, using the frames above this one
+        Trace::record(Trace::EventKind::UpdateBegin, AttributeID(node).to_raw_value(), uint64_t(&_graph),
+                      node->type_id());
+        {
+            Profiler::UpdateTimer timer = Profiler::UpdateTimer(_graph, node->type_id());
+            _graph.update_value(node);
+        }
+        Trace::record(Trace::EventKind::UpdateEnd, AttributeID(node).to_raw_value(), uint64_t(&_graph),
+                      node->type_id());
+
+        node->set_dirty(false);
+        node->set_updating(false);
+        node->set_updating_cyclic(false);
+        _frames.pop_back();
+    }
+
+    return Status::Complete;
+}
+
+} // namespace AG
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <stdint.h>
+
+#include "Data/Pointer.h"
+#include "Vector/Vector.h"
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace AG {
+
+class Graph;
+class Node;
+
+/// Brings dirty attributes up to date without recursing on the C stack.
+///
+/// Each attribute being updated has a frame on an explicit stack that records how far through its inputs the update
+/// has got. An attribute is only recomputed once none of its inputs are dirty, and inputs that are already on the
+/// stack are reported as cycles instead of being updated again. Updates may be nested, e.g. when a rule reads an
+/// attribute that isn't up to date, in which case the nested update uses the frames above the current ones.
+class UpdateStack {
+  public:
+    enum class Status : uint8_t {
+        Complete,
+
+        /// The graph's deadline passed before the update finished. Attributes that weren't recomputed are still
+        /// dirty, so updating them again later picks up where this update stopped.
+        DeadlinePassed,
+    };
+
+    /// The number of frames the stack has room for before it has to grow, see AG_UPDATE_STACK_SIZE.
+    static uint32_t initial_capacity();
+
+    /// The stack used by updates on this thread when it isn't the graph's own, e.g. while a ParallelUpdate worker is
+    /// running on it.
+    static UpdateStack *_Nullable current() { return _current; };
+    static void set_current(UpdateStack *_Nullable stack) { _current = stack; };
+
+  private:
+    struct Frame {
+        data::ptr<Node> attribute;
+        uint32_t next_input;
+    };
+
+    static thread_local UpdateStack *_Nullable _current;
+
+    Graph &_graph;
+    vector<Frame, 0, uint32_t> _frames;
+
+    void push(data::ptr<Node> attribute);
+    void unwind(uint32_t base);
+
+  public:
+    UpdateStack(Graph &graph) : _graph(graph){};
+
+    // non-copyable
+    UpdateStack(const UpdateStack &) = delete;
+    UpdateStack &operator=(const UpdateStack &) = delete;
+
+    // non-movable
+    UpdateStack(UpdateStack &&) = delete;
+    UpdateStack &operator=(UpdateStack &&) = delete;
+
+    /// Updates `attribute` after updating its dirty inputs, recursively. If `interruptible` is set the update stops
+    /// once the graph's deadline has passed.
+    Status update(data::ptr<Node> attribute, bool interruptible);
+
+    Graph &graph() const { return _graph; };
+    uint32_t depth() const { return _frames.size(); };
+};
+
+} // namespace AG
+
+CF_ASSUME_NONNULL_END
@@ -1,5 +1,7 @@
 #include "AGComparison.h"
 
+#include "Layout/DiskCache.h"
+#include "Layout/FailureLog.h"
 #include "Layout/LayoutDescriptor.h"
 #include "Swift/ContextDescriptor.h"
 #include "Swift/Metadata.h"
@@ -21,12 +23,40 @@ AGTypeID AGComparisonStateGetFieldType(AGComparisonState state) { return state->
 
 bool AGCompareValues(const void *destination, const void *source, AGTypeID type_id, AGComparisonOptions options) {
     auto type = reinterpret_cast<const AG::swift::metadata *>(type_id);
+
+    // Failures are recorded by the full comparison, so a small bitwise type that differs falls through to it when
+    // they are reported
+    int small_size = AG::LayoutDescriptor::small_bitwise_size(*type, options);
+    if (small_size >= 0) {
+        if (AG::LayoutDescriptor::compare_small_bitwise((const unsigned char *)destination,
+                                                        (const unsigned char *)source, small_size)) {
+            return true;
+        }
+        if (!(options & AGComparisonOptionsReportFailures)) {
+            return false;
+        }
+    }
+
     auto layout = AG::LayoutDescriptor::fetch(*type, options, 0);
     if (layout == AG::ValueLayoutEmpty) {
         layout = nullptr;
     }
-    AG::LayoutDescriptor::compare(layout, (const unsigned char *)destination, (const unsigned char *)source,
-                                  type->vw_size(), options);
+    return AG::LayoutDescriptor::compare(layout, (const unsigned char *)destination, (const unsigned char *)source,
+                                         type->vw_size(), options);
+}
+
+uint64_t AGHashValue(const void *value, AGTypeID type_id, AGComparisonOptions options) {
+    auto type = reinterpret_cast<const AG::swift::metadata *>(type_id);
+    options = AGComparisonOptions(options & ~AGComparisonOptionsReportFailures);
+    options |= AGComparisonOptionsFetchLayoutsSynchronously;
+
+    int small_size = AG::LayoutDescriptor::small_bitwise_size(*type, options);
+    if (small_size >= 0) {
+        return AG::LayoutDescriptor::hash_bytes((const unsigned char *)value, small_size, 0);
+    }
+
+    auto layout = AG::LayoutDescriptor::fetch(*type, options, 0);
+    return AG::LayoutDescriptor::hash(layout, (const unsigned char *)value, type->vw_size(), options);
 }
 
 const unsigned char *AGPrefetchCompareValues(AGTypeID type_id, AGComparisonOptions options, uint32_t priority) {
@@ -34,8 +64,53 @@ const unsigned char *AGPrefetchCompareValues(AGTypeID type_id, AGComparisonOptio
     return AG::LayoutDescriptor::fetch(*type, options, priority);
 }
 
+void AGPrefetchCompareValuesBatch(const AGTypeID *type_ids, const uint32_t *priorities, size_t count,
+                                  AGComparisonOptions options, dispatch_group_t group) {
+    auto types = reinterpret_cast<const AG::swift::metadata *const *>(type_ids);
+    AG::LayoutDescriptor::prefetch(types, priorities, count, options, group);
+}
+
 void AGOverrideComparisonForTypeDescriptor(void *descriptor, AGComparisonMode mode) {
     AG::LayoutDescriptor::add_type_descriptor_override(
         reinterpret_cast<const AG::swift::context_descriptor *>(descriptor),
         AG::LayoutDescriptor::ComparisonMode(mode));
 }
+
+uint64_t AGComparisonGetMissingLayoutCount() { return AG::LayoutDescriptor::missing_layout_count(); }
+
+uint64_t AGComparisonGetLayoutGeneration() { return AG::LayoutDescriptor::layout_generation(); }
+
+void AGComparisonNotifyNextLayout(uint64_t generation, dispatch_queue_t queue, void *context,
+                                  dispatch_function_t function) {
+    AG::LayoutDescriptor::notify_next_layout(generation, queue, context, function);
+}
+
+AGPartialComparisonStats AGComparisonGetPartialStats() {
+    auto stats = AG::LayoutDescriptor::partial_cache_stats();
+    return {stats.hits, stats.misses};
+}
+
+size_t AGComparisonCopyRecentFailures(AGComparisonFailure *failures, size_t count) {
+    size_t index = 0;
+    return AG::LayoutDescriptor::FailureLog::visit_recent(count, [&](auto &record) {
+        failures[index++] = {
+            record.destination,
+            record.source,
+            {record.offset, record.size},
+            reinterpret_cast<AGTypeID>(record.type),
+            record.sequence,
+        };
+    });
+}
+
+void AGComparisonSetFailureSampleRate(uint32_t rate) { AG::LayoutDescriptor::FailureLog::set_sample_rate(rate); }
+
+bool AGComparisonSetLayoutCachePath(const char *path) { return AG::LayoutDescriptor::DiskCache::set_path(path); }
+
+bool AGComparisonSaveLayoutCache() {
+    auto disk_cache = AG::LayoutDescriptor::DiskCache::shared();
+    if (!disk_cache) {
+        return false;
+    }
+    return disk_cache->write();
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <CoreFoundation/CFBase.h>
+#include <dispatch/dispatch.h>
 #include <stdint.h>
 
 #include "AGSwiftSupport.h"
@@ -36,10 +37,70 @@ typedef CF_OPTIONS(uint16_t, AGComparisonMode) {
 
 bool AGCompareValues(const void *destination, const void *source, AGTypeID type_id, AGComparisonOptions options);
 
+/// Hashes a value by walking the same layout as `AGCompareValues`, so that values it finds equal with the same options
+/// hash the same. Meant for bucketing values before comparing them: parts compared by an Equatable conformance or by
+/// the contents of heap objects don't contribute, so values that only differ there collide. The layout is always
+/// fetched synchronously, since hashing bytewise while it is being built would change the hash of a value.
+uint64_t AGHashValue(const void *value, AGTypeID type_id, AGComparisonOptions options);
+
 const unsigned char *AGPrefetchCompareValues(AGTypeID type_id, AGComparisonOptions options, uint32_t priority);
 
+/// Prefetches the layouts of `count` types at once, with `priorities[i]` the priority of `type_ids[i]`. If `group`
+/// is not `NULL` it is notified once every layout in the batch has been built.
+void AGPrefetchCompareValuesBatch(const AGTypeID *type_ids, const uint32_t *priorities, size_t count,
+                                  AGComparisonOptions options, dispatch_group_t _Nullable group);
+
 void AGOverrideComparisonForTypeDescriptor(void *descriptor, AGComparisonMode mode);
 
+/// The number of layouts the current thread found still being built in the background, when a type is compared
+/// bytewise meanwhile. A comparison that returned `false` and bumped the count may be spurious.
+uint64_t AGComparisonGetMissingLayoutCount(void);
+
+/// Increases every time a layout has been built.
+uint64_t AGComparisonGetLayoutGeneration(void);
+
+/// Calls `function` with `context` on `queue` once the layout generation has moved past `generation`, right away if
+/// it already has.
+void AGComparisonNotifyNextLayout(uint64_t generation, dispatch_queue_t queue, void *_Nullable context,
+                                  dispatch_function_t function);
+
+/// How often a partial comparison found the layout for its field range among those recently looked up, summed over
+/// all threads.
+typedef struct AGPartialComparisonStats {
+    uint64_t hits;
+    uint64_t misses;
+} AGPartialComparisonStats;
+
+AGPartialComparisonStats AGComparisonGetPartialStats(void);
+
+typedef struct AGComparisonFailure {
+    const void *destination;
+    const void *source;
+    AGFieldRange field_range;
+    AGTypeID _Nullable field_type;
+
+    /// Increases by one with every failure, so gaps show where failures were dropped.
+    uint64_t sequence;
+} AGComparisonFailure;
+
+/// Copies up to `count` of the most recent failures reported by comparisons with
+/// `AGComparisonOptionsReportFailures`, oldest first, and returns how many were copied. Only a fixed number of
+/// failures is kept, older ones are overwritten.
+size_t AGComparisonCopyRecentFailures(AGComparisonFailure *failures, size_t count);
+
+/// Makes only one in `rate` comparisons with `AGComparisonOptionsReportFailures` report failures, the others skip
+/// the bookkeeping. Defaults to the `AG_COMPARISON_SAMPLE_RATE` environment variable, or 1.
+void AGComparisonSetFailureSampleRate(uint32_t rate);
+
+/// Sets the file used to keep layouts between launches, or disables the cache if `path` is `NULL`. Must be called
+/// before the first comparison, and returns `false` if it is too late. Defaults to the `AG_LAYOUT_CACHE` environment
+/// variable.
+bool AGComparisonSetLayoutCachePath(const char *_Nullable path);
+
+/// Writes the layout cache file now rather than when the process exits. Returns `false` if the cache is disabled or
+/// the file couldn't be written.
+bool AGComparisonSaveLayoutCache(void);
+
 CF_EXTERN_C_END
 
 CF_IMPLICIT_BRIDGING_DISABLED
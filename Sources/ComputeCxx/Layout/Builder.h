@@ -1,6 +1,7 @@
 #pragma once
 
 #include <CoreFoundation/CFBase.h>
+#include <variant>
 
 #include "LayoutDescriptor.h"
 #include "Swift/MetadataVisitor.h"
@@ -80,10 +81,20 @@ class Builder : public swift::metadata_visitor {
     template <> class Emitter<vector<unsigned char, 512, uint64_t>> {
       private:
         vector<unsigned char, 512, uint64_t> *_Nonnull _data;
-        size_t _emitted_size;
-        bool _layout_exceeds_object_size;
+        size_t _emitted_size = 0;
+        bool _layout_exceeds_object_size = false;
+
+        /// The length of the data run ending at `_emitted_size` that hasn't been written yet.
+        size_t _pending_data_size = 0;
+
+        void push_inline(const void *value, size_t size);
+        void push_varint(size_t value);
+        void push_run(size_t length, bool is_data);
+        void flush_data();
 
       public:
+        Emitter(vector<unsigned char, 512, uint64_t> *_Nonnull data) : _data(data){};
+
         void operator()(const DataItem &item);
         void operator()(const EqualsItem &item);
         void operator()(const IndirectItem &item);
@@ -102,17 +113,19 @@ class Builder : public swift::metadata_visitor {
     };
 
   private:
-    static os_unfair_lock _lock;
-    static size_t _avail;
-    static unsigned char *_buffer;
-    static void lock() { os_unfair_lock_lock(&_lock); };
-    static void unlock() { os_unfair_lock_unlock(&_lock); };
+    /// Layouts are carved out of a buffer owned by the building thread, so that layouts can be committed from
+    /// several threads at once without contending. Layouts are never freed, so neither are the buffers.
+    struct Arena {
+        unsigned char *_Nullable buffer = nullptr;
+        size_t avail = 0;
+    };
+    static thread_local Arena _arena;
 
     ComparisonMode _current_comparison_mode;
     HeapMode _heap_mode;
-    size_t _current_offset;
+    size_t _current_offset = 0;
     uint64_t _enum_case_depth = 0;
-    EnumItem::Case *_current_enum_case;
+    EnumItem::Case *_Nullable _current_enum_case = nullptr;
     vector<Item, 0, uint64_t> _items;
 
   public:
@@ -127,6 +140,9 @@ class Builder : public swift::metadata_visitor {
 
     ValueLayout commit(const swift::metadata &type);
 
+    /// Copies finished layout bytes into permanent storage and compiles their program.
+    static ValueLayout install(const unsigned char *layout_data, size_t layout_length);
+
     void add_field(size_t field_size);
     bool should_visit_fields(const swift::metadata &type, bool flag);
 
@@ -137,16 +153,25 @@ class Builder : public swift::metadata_visitor {
 
     void revert(const RevertItemsInfo &info);
 
-    virtual bool visit_element(const swift::metadata &type, const swift::metadata::ref_kind kind, size_t element_offset,
-                               size_t element_size);
+    bool visit_element(const swift::metadata &type, const swift::metadata::ref_kind kind, size_t element_offset,
+                       size_t element_size) override;
 
-    virtual bool visit_case(const swift::metadata &type, const swift::field_record &field, uint32_t arg);
-    virtual bool visit_existential(const swift::existential_type_metadata &type);
-    virtual bool visit_function(const swift::function_type_metadata &type);
-    virtual bool visit_native_object(const swift::metadata &type);
+    bool visit_case(const swift::metadata &type, const swift::field_table::field &field, uint32_t arg) override;
+    bool visit_existential(const swift::existential_type_metadata &type) override;
+    bool visit_function(const swift::function_type_metadata &type) override;
+    bool visit_native_object(const swift::metadata &type) override;
 };
 
 } // namespace LayoutDescriptor
+
+// Items are plain data apart from the vectors of enum items, which can be moved by copying their bytes
+template <> struct vector_traits<LayoutDescriptor::Builder::Item> : vector_traits<void *> {
+    static constexpr bool trivially_relocatable = true;
+};
+template <> struct vector_traits<LayoutDescriptor::Builder::EnumItem::Case> : vector_traits<void *> {
+    static constexpr bool trivially_relocatable = true;
+};
+
 } // namespace AG
 
 CF_ASSUME_NONNULL_END
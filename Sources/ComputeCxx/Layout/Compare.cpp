@@ -1,12 +1,74 @@
 #include "Compare.h"
 
+#include <bit>
+
 #include "Controls.h"
+#include "Errors/Errors.h"
+#include "FailureLog.h"
 #include "Swift/EquatableSupport.h"
 #include "Swift/Metadata.h"
 
 namespace AG {
 namespace LayoutDescriptor {
 
+namespace {
+
+/// Buffers for enum copies too large for the stack. Each thread keeps a few of them around so that comparing large
+/// enums reuses them instead of allocating every time.
+class CopyPool {
+  private:
+    // Precedes each buffer, sized to keep the copies suitably aligned
+    struct alignas(16) Header {
+        size_t capacity;
+    };
+
+    static constexpr uint32_t max_cached_buffers = 4;
+
+    Header *_Nullable _cached[max_cached_buffers] = {};
+    uint32_t _cached_count = 0;
+
+  public:
+    static CopyPool &current() {
+        static thread_local CopyPool pool;
+        return pool;
+    };
+
+    ~CopyPool() {
+        for (uint32_t i = 0; i < _cached_count; ++i) {
+            free(_cached[i]);
+        }
+    };
+
+    unsigned char *acquire(size_t size) {
+        for (uint32_t i = 0; i < _cached_count; ++i) {
+            if (_cached[i]->capacity >= size) {
+                Header *header = _cached[i];
+                _cached[i] = _cached[--_cached_count];
+                return reinterpret_cast<unsigned char *>(header + 1);
+            }
+        }
+
+        size_t capacity = std::bit_ceil(size);
+        Header *header = static_cast<Header *>(malloc(sizeof(Header) + capacity));
+        if (!header) {
+            precondition_failure("memory allocation failure");
+        }
+        header->capacity = capacity;
+        return reinterpret_cast<unsigned char *>(header + 1);
+    };
+
+    void release(const unsigned char *buffer) {
+        Header *header = reinterpret_cast<Header *>(const_cast<unsigned char *>(buffer)) - 1;
+        if (_cached_count < max_cached_buffers) {
+            _cached[_cached_count++] = header;
+            return;
+        }
+        free(header);
+    };
+};
+
+} // namespace
+
 Compare::Enum::Enum(const swift::metadata *type, Mode mode, unsigned int enum_tag, size_t offset,
                     const unsigned char *lhs, const unsigned char *lhs_copy, const unsigned char *rhs,
                     const unsigned char *rhs_copy, bool owns_copies) {
@@ -20,7 +82,7 @@ Compare::Enum::Enum(const swift::metadata *type, Mode mode, unsigned int enum_ta
     this->rhs_copy = rhs_copy;
     this->owns_copies = owns_copies;
 
-    if (type) {
+    if (type && mode != Mode::Borrowed) {
         if (mode == Mode::Managed) {
             type->vw_initializeWithCopy((swift::opaque_value *)lhs_copy, (swift::opaque_value *)lhs);
             type->vw_initializeWithCopy((swift::opaque_value *)rhs_copy, (swift::opaque_value *)rhs);
@@ -30,8 +92,16 @@ Compare::Enum::Enum(const swift::metadata *type, Mode mode, unsigned int enum_ta
     }
 }
 
+Compare::Enum::Enum(Enum &&other)
+    : type(other.type), enum_tag(other.enum_tag), lhs(other.lhs), rhs(other.rhs), lhs_copy(other.lhs_copy),
+      rhs_copy(other.rhs_copy), offset(other.offset), mode(other.mode), owns_copies(other.owns_copies) {
+    // the moved-from enum must not restore the tag or free the copies
+    other.type = nullptr;
+    other.owns_copies = false;
+}
+
 Compare::Enum::~Enum() {
-    if (type) {
+    if (type && mode != Mode::Borrowed) {
         type->vw_destructiveInjectEnumTag((swift::opaque_value *)lhs_copy, enum_tag);
         type->vw_destructiveInjectEnumTag((swift::opaque_value *)rhs_copy, enum_tag);
         if (mode == Mode::Managed) {
@@ -40,8 +110,8 @@ Compare::Enum::~Enum() {
         }
     }
     if (owns_copies) {
-        free((void *)lhs_copy);
-        free((void *)rhs_copy);
+        // Both copies share the buffer starting at the left copy
+        CopyPool::current().release(lhs_copy);
     }
 }
 
@@ -68,14 +138,14 @@ bool Compare::operator()(ValueLayout layout, const unsigned char *lhs, const uns
 
         // skip over unused layout
         if (*c >= 0x40 && *c < 0x80) {
-            offset += *c & 0x3f + 1; // Convert 0-63 to 1-64
+            offset += (*c & 0x3f) + 1; // Convert 0-63 to 1-64
             c += 1;
             continue;
         }
 
         // compare data as bytes
         if (*c >= 0x80) {
-            size_t data_size = *c & 0x7f + 1; // Convert 0-127 to 1-128
+            size_t data_size = (*c & 0x7f) + 1; // Convert 0-127 to 1-128
             c += 1;
 
             size_t smaller_size = remaining_size < data_size ? remaining_size : data_size;
@@ -90,14 +160,30 @@ bool Compare::operator()(ValueLayout layout, const unsigned char *lhs, const uns
         }
 
         switch (*c) {
-        case Controls::EqualsItemBegin: {
+        case Controls::ExtendedSkipItemBegin: {
             c += 1;
+            offset += read_varint(c);
+            continue;
+        }
+        case Controls::ExtendedDataItemBegin: {
+            c += 1;
+            size_t data_size = read_varint(c);
+
+            size_t smaller_size = remaining_size < data_size ? remaining_size : data_size;
+            size_t failure_location = 0;
+            if (!compare_bytes(lhs + offset, rhs + offset, smaller_size, &failure_location)) {
+                failed(options, lhs, rhs, offset, data_size, nullptr);
+                return false;
+            }
 
-            auto type = reinterpret_cast<const swift::metadata *>(c);
-            c += Controls::EqualsItemTypePointerSize;
+            offset += data_size;
+            continue;
+        }
+        case Controls::EqualsItemBegin: {
+            c += 1;
 
-            auto equatable = (const swift::equatable_witness_table *)(c);
-            c += Controls::EqualsItemEquatablePointerSize;
+            auto type = read_inline<const swift::metadata *>(c);
+            auto equatable = read_inline<const swift::equatable_witness_table *>(c);
 
             size_t item_size = type->vw_size();
             size_t item_end = offset + item_size;
@@ -108,7 +194,6 @@ bool Compare::operator()(ValueLayout layout, const unsigned char *lhs, const uns
                     return false;
                 }
             } else {
-                auto equatable = (const swift::equatable_witness_table *)(c + 9);
                 if (!AGDispatchEquatable((const void *)(lhs + offset), (const void *)(rhs + offset), type, equatable)) {
                     failed(options, lhs, rhs, offset, item_size, type);
                     return false;
@@ -121,11 +206,8 @@ bool Compare::operator()(ValueLayout layout, const unsigned char *lhs, const uns
         case Controls::IndirectItemBegin: {
             c += 1;
 
-            auto type = reinterpret_cast<const swift::metadata *>(c);
-            c += Controls::IndirectItemTypePointerSize;
-
-            ValueLayout layout_pointer = reinterpret_cast<ValueLayout>(c);
-            c += Controls::IndirectItemLayoutPointerSize;
+            auto type = read_inline<const swift::metadata *>(c);
+            auto layout_pointer = read_inline<ValueLayout>(c);
 
             size_t item_size = type->vw_size();
             size_t item_end = offset + item_size;
@@ -142,8 +224,7 @@ bool Compare::operator()(ValueLayout layout, const unsigned char *lhs, const uns
         case Controls::ExistentialItemBegin: {
             c += 1;
 
-            auto type = reinterpret_cast<const swift::metadata *>(c);
-            c += Controls::ExistentialItemTypePointerSize;
+            auto type = read_inline<const swift::metadata *>(c);
 
             size_t item_size = type->vw_size();
             size_t item_end = offset + item_size;
@@ -164,8 +245,10 @@ bool Compare::operator()(ValueLayout layout, const unsigned char *lhs, const uns
 
             size_t item_end = offset + 8;
 
-            if (lhs + offset != rhs + offset) {
-                if (!compare_heap_objects(lhs + offset, rhs + offset,
+            auto lhs_object = *(const unsigned char *const *)(lhs + offset);
+            auto rhs_object = *(const unsigned char *const *)(rhs + offset);
+            if (lhs_object != rhs_object) {
+                if (!compare_heap_objects(lhs_object, rhs_object,
                                           ComparisonOptions(options.without_reporting_failures()), is_function)) {
                     failed(options, lhs, rhs, offset, 8, nullptr);
                     return false;
@@ -178,18 +261,8 @@ bool Compare::operator()(ValueLayout layout, const unsigned char *lhs, const uns
         case Controls::NestedItemBegin: {
             c += 1;
 
-            auto item_layout = reinterpret_cast<ValueLayout>(c);
-            c += Controls::NestedItemLayoutPointerSize;
-
-            unsigned shift = 0;
-            size_t item_size = 0;
-            while (*(int *)c < 0) {
-                item_size = item_size | ((*c & 0x7f) << shift);
-                shift += 7;
-                c += 1;
-            }
-            item_size = item_size | ((*c & 0x7f) << shift);
-            c += 1;
+            auto item_layout = read_inline<ValueLayout>(c);
+            size_t item_size = read_varint(c);
 
             size_t item_end = offset + item_size;
 
@@ -205,11 +278,8 @@ bool Compare::operator()(ValueLayout layout, const unsigned char *lhs, const uns
         case Controls::CompactNestedItemBegin: {
             c += 1;
 
-            auto item_layout = reinterpret_cast<ValueLayout>(base_address + *(uint32_t *)c);
-            c += Controls::CompactNestedItemLayoutRelativePointerSize;
-
-            size_t item_size = *(uint16_t *)(c);
-            c += Controls::CompactNestedItemLayoutSize;
+            auto item_layout = reinterpret_cast<ValueLayout>(base_address + read_inline<uint32_t>(c));
+            size_t item_size = read_inline<uint16_t>(c);
 
             size_t item_end = offset + item_size;
 
@@ -230,26 +300,12 @@ bool Compare::operator()(ValueLayout layout, const unsigned char *lhs, const uns
             const swift::metadata *type;
             if (*c == Controls::EnumItemBeginVariadicCaseIndex) {
                 c += 1;
-
-                unsigned shift = 0;
-                enum_tag = 0;
-                while (*(int *)c < 0) {
-                    enum_tag = enum_tag | ((*c & 0x7f) << shift);
-                    shift += 7;
-                    c += 1;
-                }
-                enum_tag = enum_tag | ((*c & 0x7f) << shift);
-                c += 1;
-
-                type = reinterpret_cast<const swift::metadata *>(c);
-                c += Controls::EnumItemTypePointerSize;
+                enum_tag = read_varint(c);
             } else {
                 enum_tag = *c - Controls::EnumItemBeginCaseIndexFirst;
                 c += 1;
-
-                type = reinterpret_cast<const swift::metadata *>(c);
-                c += Controls::EnumItemTypePointerSize;
             }
+            type = read_inline<const swift::metadata *>(c);
 
             unsigned int lhs_tag = type->vw_getEnumTag((swift::opaque_value *)(lhs + offset));
             unsigned int rhs_tag = type->vw_getEnumTag((swift::opaque_value *)(rhs + offset));
@@ -260,7 +316,9 @@ bool Compare::operator()(ValueLayout layout, const unsigned char *lhs, const uns
 
             // Push enum
 
-            bool is_copy = options.copy_on_write();
+            // Payloads that don't need projecting are compared in place, without copying or touching the values
+            bool is_borrowed = type->has_in_place_enum_payloads();
+            bool is_copy = !is_borrowed && options.copy_on_write();
             const unsigned char *_Nonnull lhs_enum;
             const unsigned char *_Nonnull rhs_enum;
             bool owns_copies = false;
@@ -269,8 +327,9 @@ bool Compare::operator()(ValueLayout layout, const unsigned char *lhs, const uns
                 size_t enum_size = type->vw_size();
                 bool large_allocation = enum_size > 0x1000;
                 if (large_allocation) {
-                    lhs_enum = (unsigned char *)malloc(enum_size);
-                    rhs_enum = (unsigned char *)malloc(enum_size);
+                    size_t copy_stride = (enum_size + 15) & ~size_t(15);
+                    lhs_enum = CopyPool::current().acquire(copy_stride * 2);
+                    rhs_enum = lhs_enum + copy_stride;
                     owns_copies = true;
                 } else {
                     lhs_enum = (unsigned char *)alloca(enum_size);
@@ -283,9 +342,11 @@ bool Compare::operator()(ValueLayout layout, const unsigned char *lhs, const uns
                 rhs_enum = rhs + offset;
             }
 
-            Enum enum_value = Enum(type, is_copy ? Enum::Mode::Managed : Enum::Mode::Unmanaged, lhs_tag, offset,
-                                   lhs + offset, lhs_enum, rhs + offset, rhs_enum, owns_copies);
-            _enums.push_back(enum_value);
+            Enum::Mode mode = is_borrowed ? Enum::Mode::Borrowed
+                              : is_copy   ? Enum::Mode::Managed
+                                          : Enum::Mode::Unmanaged;
+            _enums.push_back(
+                Enum(type, mode, lhs_tag, offset, lhs + offset, lhs_enum, rhs + offset, rhs_enum, owns_copies));
 
             // Pretend the copies of the enum data are part the entire data
             // until we get to the end of the enum
@@ -313,16 +374,7 @@ bool Compare::operator()(ValueLayout layout, const unsigned char *lhs, const uns
             size_t enum_tag;
             if (*c == Controls::EnumItemContinueVariadicCaseIndex) {
                 c += 1;
-
-                unsigned shift = 0;
-                enum_tag = 0;
-                while (*(int *)c < 0) {
-                    enum_tag = enum_tag | ((*c & 0x7f) << shift);
-                    shift += 7;
-                    c += 1;
-                }
-                enum_tag = enum_tag | ((*c & 0x7f) << shift);
-                c += 1;
+                enum_tag = read_varint(c);
             } else {
                 enum_tag = *c - Controls::EnumItemContinueCaseIndexFirst;
                 c += 1;
@@ -341,9 +393,9 @@ bool Compare::operator()(ValueLayout layout, const unsigned char *lhs, const uns
             Enum &enum_item = _enums.back();
 
             // Restore actual data
-            if (enum_item.mode) {
-                lhs = enum_item.lhs - offset;
-                rhs = enum_item.rhs - offset;
+            if (enum_item.mode == Enum::Mode::Managed) {
+                lhs = enum_item.lhs - enum_item.offset;
+                rhs = enum_item.rhs - enum_item.offset;
             }
 
             offset = enum_item.offset + enum_item.type->vw_size();
@@ -358,8 +410,9 @@ bool Compare::operator()(ValueLayout layout, const unsigned char *lhs, const uns
 bool Compare::failed(ComparisonOptions options, const unsigned char *lhs, const unsigned char *rhs, size_t offset,
                      size_t size, const swift::metadata *type) {
     if (options.report_failures()) {
-        // TODO: tracing
+        FailureLog::record(lhs, rhs, offset, size, type);
     }
+    return false;
 }
 
 } // namespace LayoutDescriptor
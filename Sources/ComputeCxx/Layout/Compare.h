@@ -13,8 +13,14 @@ class Compare {
   public:
     struct Enum {
         enum Mode : uint32_t {
+            /// The payload is projected in place and the tag injected again afterwards.
             Unmanaged = 0,
+
+            /// The payload is projected from copies of the values.
             Managed = 1,
+
+            /// The payload is read in place as it is, see `metadata::has_in_place_enum_payloads`.
+            Borrowed = 2,
         };
 
         const swift::metadata *type;
@@ -32,6 +38,8 @@ class Compare {
               mode(Mode::Unmanaged), owns_copies(false){};
         Enum(const swift::metadata *type, Mode mode, unsigned int enum_tag, size_t offset, const unsigned char *lhs,
              const unsigned char *lhs_copy, const unsigned char *rhs, const unsigned char *rhs_copy, bool owns_copies);
+        Enum(Enum &&other);
+        Enum(const Enum &) = delete;
         ~Enum();
     };
 
@@ -56,6 +64,12 @@ class Compare {
 };
 
 } // namespace LayoutDescriptor
+
+// An enum refers to the values it saved by pointer only, so it can be moved by copying its bytes
+template <> struct vector_traits<LayoutDescriptor::Compare::Enum> : vector_traits<void *> {
+    static constexpr bool trivially_relocatable = true;
+};
+
 } // namespace AG
 
 CF_ASSUME_NONNULL_END
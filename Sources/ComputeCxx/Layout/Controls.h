@@ -1,5 +1,9 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
 namespace AG {
 namespace LayoutDescriptor {
 
@@ -46,8 +50,56 @@ enum Controls : unsigned char {
     EnumItemEnd = '\x16',
     EnumItemTypePointerSize = 8,
 
-    LastControlCharacter = '\x16',
+    // Runs too long to encode compactly, followed by the run length as a varint
+    ExtendedDataItemBegin = '\x17',
+    ExtendedSkipItemBegin = '\x18',
+
+    LastControlCharacter = '\x18',
 };
 
+// Runs of up to 128 bytes of data are encoded as 0x80 | (n - 1), runs of up to 64 skipped bytes as 0x40 | (n - 1).
+constexpr size_t DataRunMaxLength = 0x80;
+constexpr size_t SkipRunMaxLength = 0x40;
+
+// MARK: Decoding
+
+/// Reads a pointer or integer stored inline in a layout and advances past it. Inline values are not aligned.
+template <typename T> inline T read_inline(const unsigned char *&c) {
+    T value;
+    memcpy(&value, c, sizeof(T));
+    c += sizeof(T);
+    return value;
+}
+
+/// Reads a number encoded 7 bits at a time, using the 8th bit as a "has more" flag.
+inline size_t read_varint(const unsigned char *&c) {
+    size_t value = 0;
+    unsigned shift = 0;
+    while (*c & 0x80) {
+        value |= size_t(*c & 0x7f) << shift;
+        shift += 7;
+        c += 1;
+    }
+    value |= size_t(*c & 0x7f) << shift;
+    c += 1;
+    return value;
+}
+
+inline size_t varint_length(size_t value) {
+    size_t length = 1;
+    while (value > 0x7f) {
+        value = value >> 7;
+        length += 1;
+    }
+    return length;
+}
+
+inline void skip_varint(const unsigned char *&c) {
+    while (*c & 0x80) {
+        c += 1;
+    }
+    c += 1;
+}
+
 }
 } // namespace AG
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <bit>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace AG {
+namespace LayoutDescriptor {
+
+/// The parts of a value written since it was last compared, tracked at cache line granularity.
+///
+/// The bitmap is owned by the caller, one bit per `line_size` bytes of the value, so that it can be stored alongside
+/// the value it describes. A view with no words tracks nothing and is treated as entirely dirty.
+class DirtyRanges {
+  public:
+    static constexpr size_t line_size = 64;
+    static constexpr size_t lines_per_word = 64;
+
+    /// The number of words needed to track a value of `value_size` bytes.
+    static constexpr size_t word_count(size_t value_size) {
+        return (value_size + line_size * lines_per_word - 1) / (line_size * lines_per_word);
+    };
+
+  private:
+    uint64_t *_Nullable _words;
+    size_t _word_count;
+
+    size_t find_line(size_t line, bool dirty) const {
+        size_t word_index = line / lines_per_word;
+        if (word_index >= _word_count) {
+            return _word_count * lines_per_word;
+        }
+        uint64_t word = (dirty ? _words[word_index] : ~_words[word_index]) & (~uint64_t(0) << (line % lines_per_word));
+        while (word == 0) {
+            word_index += 1;
+            if (word_index == _word_count) {
+                return _word_count * lines_per_word;
+            }
+            word = dirty ? _words[word_index] : ~_words[word_index];
+        }
+        return word_index * lines_per_word + std::countr_zero(word);
+    };
+
+  public:
+    DirtyRanges() : _words(nullptr), _word_count(0){};
+    DirtyRanges(uint64_t *_Nullable words, size_t word_count) : _words(words), _word_count(words ? word_count : 0){};
+
+    bool is_tracking() const { return _word_count != 0; };
+
+    bool empty() const {
+        for (size_t i = 0; i < _word_count; ++i) {
+            if (_words[i]) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    void mark(size_t offset, size_t size) {
+        if (size == 0) {
+            return;
+        }
+        size_t first = offset / line_size;
+        size_t last = (offset + size - 1) / line_size;
+        size_t limit = _word_count * lines_per_word;
+        if (last >= limit) {
+            last = limit - 1;
+        }
+        for (size_t line = first; line <= last && line < limit; ++line) {
+            _words[line / lines_per_word] |= uint64_t(1) << (line % lines_per_word);
+        }
+    };
+
+    void mark_all() { memset(_words, 0xff, _word_count * sizeof(uint64_t)); };
+    void clear() { memset(_words, 0, _word_count * sizeof(uint64_t)); };
+
+    /// Calls `body(start, end)` for each run of consecutive dirty lines, with `start` and `end` byte offsets, stopping
+    /// early if `body` returns `false`. The last run may extend past the end of the value.
+    template <typename Body> bool for_each_run(Body body) const {
+        size_t line = 0;
+        while (true) {
+            line = find_line(line, true);
+            if (line == _word_count * lines_per_word) {
+                return true;
+            }
+            size_t run_end = find_line(line, false);
+            if (!body(line * line_size, run_end * line_size)) {
+                return false;
+            }
+            line = run_end;
+        }
+    };
+};
+
+} // namespace LayoutDescriptor
+} // namespace AG
+
+CF_ASSUME_NONNULL_END
@@ -0,0 +1,852 @@
+#include "DiskCache.h"
+
+#include <CommonCrypto/CommonDigest.h>
+#include <algorithm>
+#include <dispatch/dispatch.h>
+#include <fcntl.h>
+#include <mach-o/dyld.h>
+#include <mach-o/loader.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Builder.h"
+#include "Controls.h"
+#include "Swift/Metadata.h"
+#include "Swift/MetadataVisitor.h"
+#include "Swift/mach-o/dyld.h"
+
+namespace AG {
+namespace LayoutDescriptor {
+
+namespace {
+
+constexpr uint32_t file_magic = 0x41474c43; // 'AGLC'
+constexpr uint32_t file_version = 2;
+
+static_assert(sizeof(DiskCache::Entry::signature) == CC_SHA1_DIGEST_LENGTH);
+
+os_unfair_lock configuration_lock = OS_UNFAIR_LOCK_INIT;
+dispatch_once_t shared_once = 0;
+
+// Any address in this image, used to tell apart files written by a different build of the layout builder
+const char library_marker = 0;
+
+bool image_uuid(const mach_header *header, uuid_t uuid) {
+    auto header64 = reinterpret_cast<const mach_header_64 *>(header);
+    if (header64->magic != MH_MAGIC_64) {
+        return false;
+    }
+    auto command = reinterpret_cast<const load_command *>(header64 + 1);
+    for (uint32_t i = 0; i < header64->ncmds; i++) {
+        if (command->cmd == LC_UUID) {
+            memcpy(uuid, reinterpret_cast<const uuid_command *>(command)->uuid, sizeof(uuid_t));
+            return true;
+        }
+        command = reinterpret_cast<const load_command *>(reinterpret_cast<const char *>(command) + command->cmdsize);
+    }
+    return false;
+}
+
+int compare_keys(const unsigned char *signature, uint16_t comparison_mode, uint16_t heap_mode,
+                 const DiskCache::Entry &entry) {
+    if (int result = memcmp(signature, entry.signature, sizeof(entry.signature))) {
+        return result;
+    }
+    if (comparison_mode != entry.comparison_mode) {
+        return comparison_mode < entry.comparison_mode ? -1 : 1;
+    }
+    if (heap_mode != entry.heap_mode) {
+        return heap_mode < entry.heap_mode ? -1 : 1;
+    }
+    return 0;
+}
+
+bool key_less(const DiskCache::Entry &lhs, const DiskCache::Entry &rhs) {
+    return compare_keys(lhs.signature, lhs.comparison_mode, lhs.heap_mode, rhs) < 0;
+}
+
+void push_varint(vector<unsigned char, 512, uint64_t> &output, size_t value) {
+    do {
+        unsigned char byte = value & 0x7f;
+        value = value >> 7;
+        if (value) {
+            byte |= 0x80;
+        }
+        output.push_back(byte);
+    } while (value);
+}
+
+void push_skip(vector<unsigned char, 512, uint64_t> &output, size_t length) {
+    if (length > SkipRunMaxLength) {
+        output.push_back(Controls::ExtendedSkipItemBegin);
+        push_varint(output, length);
+        return;
+    }
+    if (length > 0) {
+        output.push_back(0x40 | (length - 1));
+    }
+}
+
+/// Collects the descriptors of a type and of every type whose fields are visited to build its layout. Types reached
+/// only by reference, e.g. classes stored in fields or indirect enum payloads, have their layouts fetched separately.
+class DependencyCollector : public swift::metadata_visitor {
+  private:
+    vector<const swift::metadata *, 16, uint32_t> _visited_types;
+
+    void add(const swift::metadata &type) {
+        auto descriptor = type.descriptor();
+        if (descriptor && std::find(descriptors.begin(), descriptors.end(), descriptor) == descriptors.end()) {
+            descriptors.push_back(descriptor);
+        }
+    };
+
+    bool visit_type(const swift::metadata &type) {
+        if (std::find(_visited_types.begin(), _visited_types.end(), &type) != _visited_types.end()) {
+            return true;
+        }
+        _visited_types.push_back(&type);
+        add(type);
+        return type.visit(*this);
+    };
+
+  public:
+    vector<const void *, 16, uint32_t> descriptors;
+
+    /// Visits the same parts of `type` as building its layout with `heap_mode`.
+    void visit_root(const swift::metadata &type, HeapMode heap_mode) {
+        _visited_types.push_back(&type);
+        add(type);
+        if (heap_mode == HeapMode::Option2) {
+            type.visit_heap(*this, swift::metadata::visit_options::heap_locals);
+        } else if (heap_mode == HeapMode::Option1) {
+            type.visit_heap(*this, swift::metadata::visit_options::heap_class_and_generic_locals);
+        } else {
+            type.visit(*this);
+        }
+    };
+
+    bool unknown_result() const override { return true; };
+
+    bool visit_element(const swift::metadata &type, const swift::metadata::ref_kind kind, size_t element_offset,
+                       size_t element_size) override {
+        return visit_type(type);
+    };
+
+    bool visit_case(const swift::metadata &type, const swift::field_table::field &field, uint32_t index) override {
+        if (!field.type) {
+            return true;
+        }
+        if (field.record && field.record->isIndirectCase()) {
+            add(*field.type);
+            return true;
+        }
+        return visit_type(*field.type);
+    };
+};
+
+bool write_all(int fd, const void *bytes, size_t length) {
+    auto c = static_cast<const unsigned char *>(bytes);
+    while (length > 0) {
+        ssize_t written = ::write(fd, c, length);
+        if (written < 0) {
+            return false;
+        }
+        c += written;
+        length -= written;
+    }
+    return true;
+}
+
+} // namespace
+
+DiskCache *DiskCache::_shared_cache = nullptr;
+char *DiskCache::_configured_path = nullptr;
+bool DiskCache::_configured = false;
+
+#pragma mark - Configuration
+
+DiskCache *DiskCache::shared() {
+    dispatch_once_f(&shared_once, nullptr, [](void *context) {
+        os_unfair_lock_lock(&configuration_lock);
+        _configured = true;
+        char *path = _configured_path;
+        os_unfair_lock_unlock(&configuration_lock);
+
+        if (!path) {
+            if (const char *environment_path = getenv("AG_LAYOUT_CACHE")) {
+                if (*environment_path) {
+                    path = strdup(environment_path);
+                }
+            }
+        }
+        if (path) {
+            _shared_cache = new DiskCache(path);
+        }
+    });
+    return _shared_cache;
+}
+
+bool DiskCache::set_path(const char *path) {
+    os_unfair_lock_lock(&configuration_lock);
+    bool result = !_configured;
+    if (result) {
+        free(_configured_path);
+        _configured_path = path ? strdup(path) : nullptr;
+    }
+    os_unfair_lock_unlock(&configuration_lock);
+    return result;
+}
+
+DiskCache::DiskCache(char *path) : _path(path) { map_file(); }
+
+#pragma mark - Reading
+
+void DiskCache::map_file() {
+    int fd = open(_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(Header)) {
+        close(fd);
+        return;
+    }
+
+    size_t size = info.st_size;
+    void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return;
+    }
+
+    // Only the header and the tables are checked here, entries are checked when they are used
+    auto header = static_cast<const Header *>(map);
+    uuid_t library_uuid = {};
+    dyld_image_uuid_offset library_info = {};
+    const void *library_address = &library_marker;
+    dyld_images_for_addresses(1, &library_address, &library_info);
+    memcpy(library_uuid, library_info.uuid, sizeof(uuid_t));
+
+    size_t tables_size = sizeof(Header) + size_t(header->image_count) * sizeof(ImageUUID) +
+                         size_t(header->entry_count) * sizeof(Entry);
+    if (header->magic != file_magic || header->version != file_version || header->pointer_size != sizeof(void *) ||
+        uuid_is_null(library_uuid) || uuid_compare(header->library_uuid, library_uuid) != 0 || tables_size > size) {
+        munmap(map, size);
+        return;
+    }
+
+    _map = static_cast<const unsigned char *>(map);
+    _map_size = size;
+    _header = header;
+
+    auto images = reinterpret_cast<const ImageUUID *>(_map + sizeof(Header));
+    for (uint32_t i = 0; i < header->image_count; i++) {
+        _images.push_back(images[i]);
+        _loaded_images.push_back(nullptr);
+    }
+
+    _entries = reinterpret_cast<const Entry *>(images + header->image_count);
+    _data = reinterpret_cast<const unsigned char *>(_entries + header->entry_count);
+}
+
+const DiskCache::Entry *DiskCache::find(const unsigned char *signature, ComparisonMode comparison_mode,
+                                        HeapMode heap_mode) const {
+    size_t low = 0;
+    size_t high = _header->entry_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int result = compare_keys(signature, comparison_mode, uint16_t(heap_mode), _entries[middle]);
+        if (result == 0) {
+            return &_entries[middle];
+        }
+        if (result < 0) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return nullptr;
+}
+
+const mach_header *DiskCache::resolve_image(uint32_t image_index) {
+    if (auto header = _loaded_images[image_index]) {
+        return header;
+    }
+
+    // Images are matched by UUID, looking again only when more images have been loaded since the last scan
+    uint32_t image_count = _dyld_image_count();
+    if (image_count != _scanned_image_count) {
+        for (uint32_t i = 0; i < image_count; i++) {
+            auto header = _dyld_get_image_header(i);
+            uuid_t uuid;
+            if (!header || !image_uuid(header, uuid)) {
+                continue;
+            }
+            for (uint32_t j = 0; j < _images.size(); j++) {
+                if (!_loaded_images[j] && uuid_compare(_images[j].bytes, uuid) == 0) {
+                    _loaded_images[j] = header;
+                }
+            }
+        }
+        _scanned_image_count = image_count;
+    }
+    return _loaded_images[image_index];
+}
+
+bool DiskCache::check_dependencies(const Entry &entry) {
+    size_t data_size = _map_size - (_data - _map);
+    if (entry.dependencies_offset > data_size ||
+        size_t(entry.dependency_count) * sizeof(uint32_t) > data_size - entry.dependencies_offset) {
+        return false;
+    }
+    for (uint32_t i = 0; i < entry.dependency_count; i++) {
+        uint32_t image_index;
+        memcpy(&image_index, _data + entry.dependencies_offset + i * sizeof(uint32_t), sizeof(uint32_t));
+        if (image_index >= _header->image_count || !resolve_image(image_index)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DiskCache::decode_pointers(unsigned char *layout, size_t length) {
+    unsigned char *end = layout + length;
+
+    auto decode = [&](unsigned char *slot) -> bool {
+        if (slot + sizeof(uint64_t) > end) {
+            return false;
+        }
+        uint64_t value;
+        memcpy(&value, slot, sizeof(uint64_t));
+        if (value == 0) {
+            return true;
+        }
+
+        uint32_t image_index = uint32_t(value >> 32) - 1;
+        if (image_index >= _header->image_count) {
+            return false;
+        }
+        auto header = resolve_image(image_index);
+        if (!header) {
+            return false;
+        }
+        uintptr_t pointer = uintptr_t(header) + uint32_t(value);
+        memcpy(slot, &pointer, sizeof(uintptr_t));
+        return true;
+    };
+
+    const unsigned char *c = layout;
+    while (c < end) {
+        unsigned char *slot = const_cast<unsigned char *>(c) + 1;
+        if (*c == '\0') {
+            return c + 1 == end;
+        }
+        if (*c >= 0x40) {
+            c += 1;
+            continue;
+        }
+        switch (*c) {
+        case Controls::ExtendedDataItemBegin:
+        case Controls::ExtendedSkipItemBegin:
+            c += 1;
+            skip_varint(c);
+            continue;
+        case Controls::EqualsItemBegin:
+            if (!decode(slot) || !decode(slot + Controls::EqualsItemTypePointerSize)) {
+                return false;
+            }
+            c = slot + Controls::EqualsItemTypePointerSize + Controls::EqualsItemEquatablePointerSize;
+            continue;
+        case Controls::IndirectItemBegin:
+            if (!decode(slot)) {
+                return false;
+            }
+            c = slot + Controls::IndirectItemTypePointerSize + Controls::IndirectItemLayoutPointerSize;
+            continue;
+        case Controls::ExistentialItemBegin:
+            if (!decode(slot)) {
+                return false;
+            }
+            c = slot + Controls::ExistentialItemTypePointerSize;
+            continue;
+        case Controls::HeapRefItemBegin:
+        case Controls::FunctionItemBegin:
+        case Controls::EnumItemEnd:
+            c += 1;
+            continue;
+        case Controls::EnumItemBeginVariadicCaseIndex:
+        case Controls::EnumItemBeginCaseIndex0:
+        case Controls::EnumItemBeginCaseIndex1:
+        case Controls::EnumItemBeginCaseIndex2:
+            if (*c == Controls::EnumItemBeginVariadicCaseIndex) {
+                c += 1;
+                skip_varint(c);
+            } else {
+                c += 1;
+            }
+            if (!decode(const_cast<unsigned char *>(c))) {
+                return false;
+            }
+            c += Controls::EnumItemTypePointerSize;
+            continue;
+        case Controls::EnumItemContinueVariadicCaseIndex:
+            c += 1;
+            skip_varint(c);
+            continue;
+        default:
+            if (*c >= Controls::EnumItemContinueCaseIndexFirst && *c <= Controls::EnumItemContinueCaseIndexLast) {
+                c += 1;
+                continue;
+            }
+            // Nested layouts are inlined when recording, so anything else means the entry is damaged
+            return false;
+        }
+    }
+    return false;
+}
+
+bool DiskCache::lookup(const swift::metadata &type, ComparisonMode comparison_mode, HeapMode heap_mode,
+                       ValueLayout *layout_out) {
+    if (!_header || _header->modes_digest != comparison_modes_digest()) {
+        return false;
+    }
+
+    auto signature = static_cast<const unsigned char *>(type.signature());
+    if (!signature) {
+        return false;
+    }
+
+    const Entry *entry = find(signature, comparison_mode, heap_mode);
+    if (!entry || entry->value_size != type.vw_size()) {
+        return false;
+    }
+
+    lock();
+    bool dependencies_loaded = check_dependencies(*entry);
+    unlock();
+    if (!dependencies_loaded) {
+        return false;
+    }
+
+    switch (entry->kind) {
+    case Entry::Kind::None:
+        *layout_out = nullptr;
+        return true;
+    case Entry::Kind::Empty:
+        *layout_out = ValueLayoutEmpty;
+        return true;
+    case Entry::Kind::Layout:
+        break;
+    default:
+        return false;
+    }
+
+    size_t data_size = _map_size - (_data - _map);
+    if (entry->data_offset > data_size || entry->data_length > data_size - entry->data_offset ||
+        entry->data_length == 0) {
+        return false;
+    }
+
+    auto layout = vector<unsigned char, 512, uint64_t>();
+    layout.reserve(entry->data_length);
+    for (uint32_t i = 0; i < entry->data_length; i++) {
+        layout.push_back(_data[entry->data_offset + i]);
+    }
+
+    lock();
+    bool decoded = decode_pointers(layout.data(), layout.size());
+    unlock();
+    if (!decoded) {
+        return false;
+    }
+
+    *layout_out = Builder::install(layout.data(), layout.size());
+    return true;
+}
+
+#pragma mark - Recording
+
+bool DiskCache::find_image(const void *address, uint32_t *image_index_out, uint32_t *offset_out) {
+    dyld_image_uuid_offset info = {};
+    dyld_images_for_addresses(1, &address, &info);
+    if (!info.image || info.offsetInImage > UINT32_MAX) {
+        return false;
+    }
+
+    uint32_t image_index = 0;
+    while (image_index < _images.size() && uuid_compare(_images[image_index].bytes, info.uuid) != 0) {
+        image_index += 1;
+    }
+    if (image_index == _images.size()) {
+        ImageUUID image;
+        memcpy(image.bytes, info.uuid, sizeof(uuid_t));
+        _images.push_back(image);
+        _loaded_images.push_back(info.image);
+    }
+    *image_index_out = image_index;
+    *offset_out = uint32_t(info.offsetInImage);
+    return true;
+}
+
+bool DiskCache::encode_dependencies(const vector<const void *, 16, uint32_t> &descriptors,
+                                    vector<unsigned char, 512, uint64_t> &output, uint32_t *count_out) {
+    auto image_indices = vector<uint32_t, 16, uint32_t>();
+    for (auto descriptor : descriptors) {
+        uint32_t index;
+        uint32_t offset;
+        if (!find_image(descriptor, &index, &offset)) {
+            return false;
+        }
+        if (std::find(image_indices.begin(), image_indices.end(), index) == image_indices.end()) {
+            image_indices.push_back(index);
+        }
+    }
+
+    for (auto index : image_indices) {
+        auto bytes = reinterpret_cast<const unsigned char *>(&index);
+        for (size_t i = 0; i < sizeof(uint32_t); i++) {
+            output.push_back(bytes[i]);
+        }
+    }
+    *count_out = image_indices.size();
+    return true;
+}
+
+bool DiskCache::encode_pointer(const void *pointer, vector<unsigned char, 512, uint64_t> &output) {
+    uint64_t value = 0;
+    if (pointer) {
+        uint32_t index;
+        uint32_t offset;
+        if (!find_image(pointer, &index, &offset)) {
+            return false;
+        }
+        value = (uint64_t(index + 1) << 32) | offset;
+    }
+
+    auto bytes = reinterpret_cast<const unsigned char *>(&value);
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        output.push_back(bytes[i]);
+    }
+    return true;
+}
+
+bool DiskCache::encode(ValueLayout layout, vector<unsigned char, 512, uint64_t> &output, size_t *consumed_size) {
+    struct EnumRange {
+        size_t offset;
+        size_t size;
+    };
+    auto enums = vector<EnumRange, 8, uint64_t>();
+
+    size_t offset = 0;
+    const unsigned char *c = layout;
+    while (true) {
+        if (*c == '\0') {
+            *consumed_size = offset;
+            return enums.size() == 0;
+        }
+
+        if (*c >= 0x40) {
+            offset += *c >= 0x80 ? (*c & 0x7f) + 1 : (*c & 0x3f) + 1;
+            output.push_back(*c);
+            c += 1;
+            continue;
+        }
+
+        switch (*c) {
+        case Controls::ExtendedDataItemBegin:
+        case Controls::ExtendedSkipItemBegin: {
+            output.push_back(*c);
+            c += 1;
+            size_t length = read_varint(c);
+            push_varint(output, length);
+            offset += length;
+            continue;
+        }
+        case Controls::EqualsItemBegin:
+        case Controls::IndirectItemBegin:
+        case Controls::ExistentialItemBegin: {
+            unsigned char control = *c;
+            output.push_back(control);
+            c += 1;
+            auto type = read_inline<const swift::metadata *>(c);
+            if (!encode_pointer(type, output)) {
+                return false;
+            }
+            if (control == Controls::EqualsItemBegin) {
+                if (!encode_pointer(read_inline<const void *>(c), output)) {
+                    return false;
+                }
+            } else if (control == Controls::IndirectItemBegin) {
+                // Indirect layouts are fetched lazily, so the slot is always stored empty
+                read_inline<ValueLayout>(c);
+                if (!encode_pointer(nullptr, output)) {
+                    return false;
+                }
+            }
+            offset += type->vw_size();
+            continue;
+        }
+        case Controls::HeapRefItemBegin:
+        case Controls::FunctionItemBegin:
+            output.push_back(*c);
+            c += 1;
+            offset += sizeof(void *);
+            continue;
+        case Controls::NestedItemBegin:
+        case Controls::CompactNestedItemBegin: {
+            ValueLayout item_layout;
+            size_t item_size;
+            if (*c == Controls::NestedItemBegin) {
+                c += 1;
+                item_layout = read_inline<ValueLayout>(c);
+                item_size = read_varint(c);
+            } else {
+                c += 1;
+                item_layout = reinterpret_cast<ValueLayout>(base_address + read_inline<uint32_t>(c));
+                item_size = read_inline<uint16_t>(c);
+            }
+
+            // Inline the nested layout, skipping whatever part of the item it doesn't cover
+            size_t nested_size = 0;
+            if (item_layout > ValueLayoutEmpty && !encode(item_layout, output, &nested_size)) {
+                return false;
+            }
+            if (nested_size > item_size) {
+                return false;
+            }
+            push_skip(output, item_size - nested_size);
+            offset += item_size;
+            continue;
+        }
+        case Controls::EnumItemBeginVariadicCaseIndex:
+        case Controls::EnumItemBeginCaseIndex0:
+        case Controls::EnumItemBeginCaseIndex1:
+        case Controls::EnumItemBeginCaseIndex2: {
+            output.push_back(*c);
+            if (*c == Controls::EnumItemBeginVariadicCaseIndex) {
+                c += 1;
+                push_varint(output, read_varint(c));
+            } else {
+                c += 1;
+            }
+            auto type = read_inline<const swift::metadata *>(c);
+            if (!encode_pointer(type, output)) {
+                return false;
+            }
+            enums.push_back({offset, type->vw_size()});
+            continue;
+        }
+        case Controls::EnumItemContinueVariadicCaseIndex:
+            output.push_back(*c);
+            c += 1;
+            push_varint(output, read_varint(c));
+            if (enums.size() == 0) {
+                return false;
+            }
+            offset = enums.back().offset;
+            continue;
+        case Controls::EnumItemEnd:
+            output.push_back(*c);
+            c += 1;
+            if (enums.size() == 0) {
+                return false;
+            }
+            offset = enums.back().offset + enums.back().size;
+            enums.pop_back();
+            continue;
+        default:
+            if (*c >= Controls::EnumItemContinueCaseIndexFirst && *c <= Controls::EnumItemContinueCaseIndexLast) {
+                output.push_back(*c);
+                c += 1;
+                if (enums.size() == 0) {
+                    return false;
+                }
+                offset = enums.back().offset;
+                continue;
+            }
+            return false;
+        }
+    }
+}
+
+void DiskCache::record(const swift::metadata &type, ComparisonMode comparison_mode, HeapMode heap_mode,
+                       ValueLayout layout) {
+    auto signature = static_cast<const unsigned char *>(type.signature());
+    if (!signature) {
+        return;
+    }
+
+    PendingEntry pending = {};
+    memcpy(pending.entry.signature, signature, sizeof(pending.entry.signature));
+    pending.entry.comparison_mode = comparison_mode;
+    pending.entry.heap_mode = uint16_t(heap_mode);
+    pending.entry.value_size = uint32_t(type.vw_size());
+
+    // Read the digest before building the entry, a concurrent override then leaves the entry unusable
+    pending.modes_digest = comparison_modes_digest();
+
+    // Visited without the lock, since visiting the fields may resolve type names
+    DependencyCollector collector;
+    collector.visit_root(type, heap_mode);
+
+    lock();
+
+    auto dependencies = vector<unsigned char, 512, uint64_t>();
+    auto encoded = vector<unsigned char, 512, uint64_t>();
+    uint32_t image_count = _images.size();
+    bool encoded_entry = encode_dependencies(collector.descriptors, dependencies, &pending.entry.dependency_count);
+    if (layout == nullptr) {
+        pending.entry.kind = Entry::Kind::None;
+    } else if (layout == ValueLayoutEmpty) {
+        pending.entry.kind = Entry::Kind::Empty;
+    } else {
+        size_t consumed_size = 0;
+        encoded_entry = encoded_entry && encode(layout, encoded, &consumed_size);
+        encoded.push_back('\0');
+        pending.entry.kind = Entry::Kind::Layout;
+    }
+    if (!encoded_entry || _pending_data.size() + dependencies.size() + encoded.size() > UINT32_MAX) {
+        // Keep the image table in step with the entries that refer to it
+        while (_images.size() > image_count) {
+            _images.pop_back();
+            _loaded_images.pop_back();
+        }
+        unlock();
+        return;
+    }
+
+    pending.entry.dependencies_offset = uint32_t(_pending_data.size());
+    for (auto byte : dependencies) {
+        _pending_data.push_back(byte);
+    }
+    if (pending.entry.kind == Entry::Kind::Layout) {
+        pending.entry.data_offset = uint32_t(_pending_data.size());
+        pending.entry.data_length = uint32_t(encoded.size());
+        for (auto byte : encoded) {
+            _pending_data.push_back(byte);
+        }
+    }
+    _pending_entries.push_back(pending);
+
+    bool register_writer = !_registered_writer;
+    _registered_writer = true;
+    unlock();
+
+    if (register_writer) {
+        atexit(write_at_exit);
+    }
+}
+
+#pragma mark - Writing
+
+void DiskCache::write_at_exit() {
+    if (auto cache = shared()) {
+        cache->write();
+    }
+}
+
+bool DiskCache::write() {
+    uint64_t modes_digest = comparison_modes_digest();
+
+    lock();
+
+    auto entries = vector<Entry, 0, uint32_t>();
+    auto data = vector<unsigned char, 0, uint64_t>();
+
+    // Copies `length` bytes from `source` to the end of the data, returning their new offset
+    auto append_data = [&data](const unsigned char *source, uint32_t length) -> uint32_t {
+        uint32_t offset = uint32_t(data.size());
+        for (uint32_t j = 0; j < length; j++) {
+            data.push_back(source[j]);
+        }
+        return offset;
+    };
+
+    // Entries written under the same overrides by this build are carried over
+    if (_header && _header->modes_digest == modes_digest) {
+        size_t data_size = _map_size - (_data - _map);
+        for (uint32_t i = 0; i < _header->entry_count; i++) {
+            Entry entry = _entries[i];
+            size_t dependencies_length = size_t(entry.dependency_count) * sizeof(uint32_t);
+            if (entry.data_offset > data_size || entry.data_length > data_size - entry.data_offset ||
+                entry.dependencies_offset > data_size || dependencies_length > data_size - entry.dependencies_offset) {
+                continue;
+            }
+            entry.dependencies_offset = append_data(_data + entry.dependencies_offset, dependencies_length);
+            entry.data_offset = append_data(_data + entry.data_offset, entry.data_length);
+            entries.push_back(entry);
+        }
+    }
+
+    for (auto &pending : _pending_entries) {
+        if (pending.modes_digest != modes_digest) {
+            continue;
+        }
+        if (_header && _header->modes_digest == modes_digest &&
+            find(pending.entry.signature, ComparisonMode(pending.entry.comparison_mode),
+                 HeapMode(pending.entry.heap_mode))) {
+            continue;
+        }
+        Entry entry = pending.entry;
+        entry.dependencies_offset = append_data(_pending_data.data() + entry.dependencies_offset,
+                                                entry.dependency_count * sizeof(uint32_t));
+        entry.data_offset = append_data(_pending_data.data() + entry.data_offset, entry.data_length);
+        entries.push_back(entry);
+    }
+
+    std::sort(entries.begin(), entries.end(), key_less);
+
+    // Duplicates can be recorded when two threads build the same layout
+    auto unique_end = std::unique(entries.begin(), entries.end(), [](const Entry &lhs, const Entry &rhs) {
+        return !key_less(lhs, rhs) && !key_less(rhs, lhs);
+    });
+    while (entries.end() != unique_end) {
+        entries.pop_back();
+    }
+
+    Header header = {};
+    header.magic = file_magic;
+    header.version = file_version;
+    header.pointer_size = sizeof(void *);
+    header.image_count = _images.size();
+    header.entry_count = entries.size();
+    header.modes_digest = modes_digest;
+
+    dyld_image_uuid_offset library_info = {};
+    const void *library_address = &library_marker;
+    dyld_images_for_addresses(1, &library_address, &library_info);
+    memcpy(header.library_uuid, library_info.uuid, sizeof(uuid_t));
+
+    // Write a temporary file next to the destination and move it into place, so readers never see a partial file
+    size_t path_length = strlen(_path);
+    char *temporary_path = (char *)malloc(path_length + 32);
+    snprintf(temporary_path, path_length + 32, "%s.%d.tmp", _path, getpid());
+
+    int fd = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        unlock();
+        free(temporary_path);
+        return false;
+    }
+
+    bool written = write_all(fd, &header, sizeof(Header)) &&
+                   write_all(fd, _images.data(), header.image_count * sizeof(ImageUUID)) &&
+                   write_all(fd, entries.data(), entries.size() * sizeof(Entry)) &&
+                   write_all(fd, data.data(), data.size());
+    written = close(fd) == 0 && written;
+    if (!written || rename(temporary_path, _path) != 0) {
+        unlink(temporary_path);
+        written = false;
+    }
+    unlock();
+
+    free(temporary_path);
+    return written;
+}
+
+} // namespace LayoutDescriptor
+} // namespace AG
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <os/lock.h>
+#include <stdint.h>
+#include <uuid/uuid.h>
+
+#include "LayoutDescriptor.h"
+#include "Vector/Vector.h"
+
+struct mach_header;
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace AG {
+namespace LayoutDescriptor {
+
+/// A file of layouts built by previous launches, keyed by type signature.
+///
+/// The file is mapped read-only when the cache is first used and entries are only validated when they are looked
+/// up, so a launch pays for the layouts it actually needs rather than for the whole file. Metadata and witness
+/// table pointers are stored relative to the image containing them and are resolved against the loaded image with
+/// the same UUID. Nested layouts are inlined when an entry is recorded, so an entry doesn't depend on any other.
+///
+/// A type's signature doesn't cover the types of its fields, which may be declared in other images and change
+/// without it. Each entry lists every image declaring a type whose fields were visited to build it, and is ignored
+/// unless all of those images are loaded with the same UUIDs as when it was recorded.
+///
+/// Only layouts whose pointers all refer into a loaded image can be recorded, which excludes types with generic
+/// metadata instantiated at runtime. Entries are ignored when the comparison mode overrides differ from those in
+/// effect when the file was written.
+class DiskCache {
+  public:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t pointer_size;
+        uint32_t image_count;
+        uint32_t entry_count;
+        uint32_t reserved;
+        uint64_t modes_digest;
+        uuid_t library_uuid;
+    };
+
+    struct Entry {
+        enum Kind : uint8_t {
+            Layout,
+            Empty,
+            None,
+        };
+
+        unsigned char signature[20];
+        uint16_t comparison_mode;
+        uint16_t heap_mode;
+        Kind kind;
+        uint8_t reserved[3];
+        uint32_t value_size;
+        uint32_t data_offset;
+        uint32_t data_length;
+
+        // The indices of the images the entry depends on, stored as uint32_t in the data
+        uint32_t dependencies_offset;
+        uint32_t dependency_count;
+    };
+
+  private:
+    struct ImageUUID {
+        uuid_t bytes;
+    };
+
+    struct PendingEntry {
+        Entry entry;
+        uint64_t modes_digest;
+    };
+
+    char *_Nullable _path;
+    os_unfair_lock _lock = OS_UNFAIR_LOCK_INIT;
+
+    // The mapped file, or null if there wasn't a usable one
+    const unsigned char *_Nullable _map = nullptr;
+    size_t _map_size = 0;
+    const Header *_Nullable _header = nullptr;
+    const Entry *_Nullable _entries = nullptr;
+    const unsigned char *_Nullable _data = nullptr;
+
+    // The images referenced by the mapped file, followed by those referenced by recorded entries
+    vector<ImageUUID, 0, uint32_t> _images;
+    vector<const mach_header *_Nullable, 0, uint32_t> _loaded_images;
+    uint32_t _scanned_image_count = 0;
+
+    vector<PendingEntry, 0, uint32_t> _pending_entries;
+    vector<unsigned char, 0, uint64_t> _pending_data;
+    bool _registered_writer = false;
+
+    static DiskCache *_Nullable _shared_cache;
+    static char *_Nullable _configured_path;
+    static bool _configured;
+
+    DiskCache(char *path);
+
+    void lock() { os_unfair_lock_lock(&_lock); };
+    void unlock() { os_unfair_lock_unlock(&_lock); };
+
+    void map_file();
+    const Entry *_Nullable find(const unsigned char *signature, ComparisonMode comparison_mode,
+                                HeapMode heap_mode) const;
+
+    const mach_header *_Nullable resolve_image(uint32_t image_index);
+    bool check_dependencies(const Entry &entry);
+    bool decode_pointers(unsigned char *layout, size_t length);
+
+    bool find_image(const void *address, uint32_t *image_index_out, uint32_t *offset_out);
+    bool encode_dependencies(const vector<const void *, 16, uint32_t> &descriptors,
+                             vector<unsigned char, 512, uint64_t> &output, uint32_t *count_out);
+    bool encode_pointer(const void *_Nullable pointer, vector<unsigned char, 512, uint64_t> &output);
+    bool encode(ValueLayout layout, vector<unsigned char, 512, uint64_t> &output, size_t *consumed_size);
+
+    static void write_at_exit();
+
+  public:
+    /// The cache configured with `set_path` or the `AG_LAYOUT_CACHE` environment variable, or `nullptr` if the
+    /// cache is disabled.
+    static DiskCache *_Nullable shared();
+
+    /// Sets the file used by the shared cache. Returns `false` if the shared cache has already been created.
+    static bool set_path(const char *_Nullable path);
+
+    /// Installs the layout stored for `type`, returning `false` if there isn't a usable one.
+    bool lookup(const swift::metadata &type, ComparisonMode comparison_mode, HeapMode heap_mode,
+                ValueLayout *_Nonnull layout_out);
+
+    /// Records a newly built layout to be included the next time the file is written.
+    void record(const swift::metadata &type, ComparisonMode comparison_mode, HeapMode heap_mode, ValueLayout layout);
+
+    /// Writes the mapped entries that are still valid together with any recorded since. Returns `false` if the file
+    /// couldn't be written.
+    bool write();
+};
+
+} // namespace LayoutDescriptor
+} // namespace AG
+
+CF_ASSUME_NONNULL_END
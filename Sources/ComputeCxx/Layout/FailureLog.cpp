@@ -0,0 +1,68 @@
+#include "FailureLog.h"
+
+#include <algorithm>
+#include <stdlib.h>
+
+namespace AG {
+namespace LayoutDescriptor {
+
+FailureLog::Slot FailureLog::_slots[FailureLog::capacity] = {};
+std::atomic<uint64_t> FailureLog::_next_sequence = 0;
+
+// Zero until the rate has been read from the environment or set explicitly
+std::atomic<uint32_t> FailureLog::_sample_rate = 0;
+
+void FailureLog::record(const unsigned char *lhs, const unsigned char *rhs, size_t offset, size_t size,
+                        const swift::metadata *type) {
+    uint64_t sequence = _next_sequence.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = _slots[sequence % capacity];
+
+    slot.state.store(sequence * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.destination.store(uintptr_t(lhs), std::memory_order_relaxed);
+    slot.source.store(uintptr_t(rhs), std::memory_order_relaxed);
+    slot.offset.store(offset, std::memory_order_relaxed);
+    slot.size.store(size, std::memory_order_relaxed);
+    slot.type.store(uintptr_t(type), std::memory_order_relaxed);
+    slot.state.store(sequence * 2 + 2, std::memory_order_release);
+}
+
+uint32_t FailureLog::sample_rate() {
+    uint32_t rate = _sample_rate.load(std::memory_order_relaxed);
+    if (rate == 0) {
+        rate = 1;
+        if (char *result = getenv("AG_COMPARISON_SAMPLE_RATE")) {
+            rate = uint32_t(std::max(atoi(result), 1));
+        }
+        uint32_t expected = 0;
+        if (!_sample_rate.compare_exchange_strong(expected, rate, std::memory_order_relaxed)) {
+            rate = expected;
+        }
+    }
+    return rate;
+}
+
+void FailureLog::set_sample_rate(uint32_t rate) { _sample_rate.store(rate ? rate : 1, std::memory_order_relaxed); }
+
+ComparisonOptions FailureLog::sample(ComparisonOptions options) {
+    if (!options.report_failures()) {
+        return options;
+    }
+
+    uint32_t rate = sample_rate();
+    if (rate == 1) {
+        return options;
+    }
+
+    // Each thread counts down to its next sampled comparison, so sampling doesn't contend
+    static thread_local uint32_t countdown = 0;
+    if (countdown == 0) {
+        countdown = rate - 1;
+        return options;
+    }
+    countdown -= 1;
+    return options.without_reporting_failures();
+}
+
+} // namespace LayoutDescriptor
+} // namespace AG
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <atomic>
+#include <stdint.h>
+
+#include "LayoutDescriptor.h"
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace AG {
+namespace LayoutDescriptor {
+
+/// The most recent comparison failures, kept in a fixed ring of records so that reporting a failure never allocates.
+///
+/// Writers claim a record with a single atomic increment and publish it with a sequence number, readers copy the
+/// record and discard it if the sequence number changed meanwhile. Once the ring is full each failure replaces the
+/// oldest one.
+///
+/// Only one in `sample_rate()` comparisons asking for failures to be reported actually reports them, the others run
+/// as if the option wasn't set.
+class FailureLog {
+  public:
+    struct Record {
+        const void *destination;
+        const void *source;
+        size_t offset;
+        size_t size;
+        const swift::metadata *_Nullable type;
+
+        /// Increases by one with every failure, so gaps show where earlier records were overwritten.
+        uint64_t sequence;
+    };
+
+    static constexpr size_t capacity = 1024;
+
+  private:
+    struct Slot {
+        // Twice the record's sequence number plus one while it is being written, plus two once it is complete
+        std::atomic<uint64_t> state;
+        std::atomic<uintptr_t> destination;
+        std::atomic<uintptr_t> source;
+        std::atomic<size_t> offset;
+        std::atomic<size_t> size;
+        std::atomic<uintptr_t> type;
+    };
+
+    static Slot _slots[capacity];
+    static std::atomic<uint64_t> _next_sequence;
+    static std::atomic<uint32_t> _sample_rate;
+
+  public:
+    static void record(const unsigned char *lhs, const unsigned char *rhs, size_t offset, size_t size,
+                       const swift::metadata *_Nullable type);
+
+    /// Calls `body` with up to `count` of the most recent failures, oldest first, returning how many were visited.
+    template <typename Body> static size_t visit_recent(size_t count, Body body) {
+        uint64_t end = _next_sequence.load(std::memory_order_acquire);
+        uint64_t available = end < capacity ? end : capacity;
+        if (count > available) {
+            count = available;
+        }
+
+        size_t visited = 0;
+        for (uint64_t sequence = end - count; sequence < end; ++sequence) {
+            Slot &slot = _slots[sequence % capacity];
+
+            uint64_t state = slot.state.load(std::memory_order_acquire);
+            if (state != sequence * 2 + 2) {
+                // Still being written, or already replaced by a newer failure
+                continue;
+            }
+            Record record = {
+                reinterpret_cast<const void *>(slot.destination.load(std::memory_order_relaxed)),
+                reinterpret_cast<const void *>(slot.source.load(std::memory_order_relaxed)),
+                slot.offset.load(std::memory_order_relaxed),
+                slot.size.load(std::memory_order_relaxed),
+                reinterpret_cast<const swift::metadata *>(slot.type.load(std::memory_order_relaxed)),
+                sequence,
+            };
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.state.load(std::memory_order_relaxed) != state) {
+                continue;
+            }
+            body(record);
+            visited += 1;
+        }
+        return visited;
+    };
+
+    static uint32_t sample_rate();
+    static void set_sample_rate(uint32_t rate);
+
+    /// Returns `options`, without `ReportFailures` unless this comparison is one of those sampled.
+    static ComparisonOptions sample(ComparisonOptions options);
+};
+
+} // namespace LayoutDescriptor
+} // namespace AG
+
+CF_ASSUME_NONNULL_END
@@ -1,13 +1,33 @@
 #include "LayoutDescriptor.h"
 
+#include <atomic>
+#include <bit>
 #include <os/lock.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
 #include <variant>
 
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 #include "Builder.h"
+#include "Containers/ConcurrentTable.h"
 #include "Compare.h"
 #include "Controls.h"
+#include "DirtyRanges.h"
+#include "DiskCache.h"
+#include "FailureLog.h"
+#include "Program.h"
+#include "Swift/EquatableSupport.h"
 #include "Swift/Metadata.h"
+#include "Swift/mach-o/dyld.h"
+#include "Errors/Errors.h"
 #include "Time/Time.h"
+#include "Trace/Trace.h"
 #include "Utilities/HashTable.h"
 
 namespace AG {
@@ -25,6 +45,46 @@ unsigned int print_layouts() {
     return print_layouts;
 }
 
+bool async_layouts() {
+    static bool async_layouts = []() {
+        char *result = getenv("AG_ASYNC_LAYOUTS");
+        if (result) {
+            return atoi(result) != 0;
+        }
+        return false;
+    }();
+    return async_layouts;
+}
+
+/// The number of background workers that may build queued layouts at the same time.
+uint32_t max_async_workers() {
+    static uint32_t max_async_workers = []() -> uint32_t {
+        char *result = getenv("AG_LAYOUT_WORKERS");
+        if (result) {
+            return std::clamp(atoi(result), 1, 32);
+        }
+        long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+        return uint32_t(std::clamp(cpu_count / 2, 1L, 8L));
+    }();
+    return max_async_workers;
+}
+
+/// The number of asynchronous fetches that may find a type's layout still queued before the next one builds it
+/// synchronously, or 0 to always wait for the background workers.
+uint32_t max_async_misses() {
+    static uint32_t max_async_misses = []() -> uint32_t {
+        char *result = getenv("AG_LAYOUT_SYNC_AFTER_MISSES");
+        if (result) {
+            return std::clamp(atoi(result), 0, 1 << 16);
+        }
+        return 8;
+    }();
+    return max_async_misses;
+}
+
+/// Counts the fetches of this thread that found a layout still queued, see `LayoutDescriptor::missing_layout_count`.
+thread_local uint64_t missing_layouts = 0;
+
 } // namespace
 
 #pragma mark - TypeDescriptorCache
@@ -42,16 +102,53 @@ class TypeDescriptorCache {
         bool operator<(const QueueEntry &other) const noexcept { return priority < other.priority; };
     };
 
+    /// A layout that has been requested but not built yet. Its table entry holds the `pending_layout` placeholder
+    /// until then.
+    struct InFlight {
+        /// Set once a thread has started building the layout, so no other thread builds it as well.
+        bool building;
+        pthread_t builder;
+
+        /// The number of asynchronous fetches that found the layout still queued, see `max_async_misses`.
+        uint32_t misses;
+
+        /// Entered by synchronous fetches waiting for another thread to finish building the layout.
+        dispatch_group_t _Nullable done;
+
+        /// Prefetch groups to leave once the layout is ready.
+        vector<dispatch_group_t, 0, uint32_t> groups;
+    };
+
+    struct WorkerStats {
+        double seconds;
+        uint64_t created_count;
+    };
+
+    /// A function to call once the next layout has been built, see `LayoutDescriptor::notify_next_layout`.
+    struct Observer {
+        dispatch_queue_t queue;
+        void *_Nullable context;
+        dispatch_function_t function;
+    };
+
+    /// Placeholder table entry of a requested layout, distinct from the `nullptr` layout of types that compare
+    /// bytewise. Never returned from `fetch`.
+    static inline const ValueLayout pending_layout = (ValueLayout)2;
+
   private:
     os_unfair_lock _lock;
-    util::UntypedTable _table;
+    ConcurrentTable<ValueLayout> _table;
     vector<QueueEntry, 8, uint64_t> _async_queue;
-    void *_field_0xf0;
-    uint64_t _async_queue_running;
+    util::Table<const void *, InFlight *> _in_flight;
+    uint32_t _async_worker_count;
+    uint32_t _busy_workers;
+    vector<WorkerStats, 8, uint32_t> _worker_stats;
     vector<std::pair<const swift::context_descriptor *, LayoutDescriptor::ComparisonMode>> _modes;
-    void *_field_0x118;
-    uint64_t _cache_hit_count;
+    std::atomic<uint64_t> _modes_digest;
+    std::atomic<uint64_t> _cache_hit_count;
     uint64_t _cache_miss_count;
+    std::atomic<uint64_t> _generation;
+    vector<Observer, 0, uint32_t> _observers;
     double _async_total_seconds;
     double _sync_total_seconds;
 
@@ -71,13 +168,30 @@ class TypeDescriptorCache {
     void lock() { os_unfair_lock_lock(&_lock); };
     void unlock() { os_unfair_lock_unlock(&_lock); };
 
-    vector<std::pair<const swift::context_descriptor *, LayoutDescriptor::ComparisonMode>> modes() { return _modes; };
+    vector<std::pair<const swift::context_descriptor *, LayoutDescriptor::ComparisonMode>> &modes() { return _modes; };
+    std::atomic<uint64_t> &modes_digest() { return _modes_digest; };
+
+    uint64_t generation() const { return _generation.load(std::memory_order_acquire); };
+    size_t trim();
+    void notify_next_layout(uint64_t generation, dispatch_queue_t queue, void *_Nullable context,
+                            dispatch_function_t function);
 
     static void *make_key(const swift::metadata *type, LayoutDescriptor::ComparisonMode comparison_mode,
                           LayoutDescriptor::HeapMode heap_mode);
 
     ValueLayout fetch(const swift::metadata &type, LayoutDescriptor::ComparisonOptions options,
                       LayoutDescriptor::HeapMode heap_mode, uint32_t priority);
+    void prefetch(const swift::metadata *_Nonnull const *_Nonnull types, const uint32_t *priorities, size_t count,
+                  LayoutDescriptor::ComparisonOptions options, LayoutDescriptor::HeapMode heap_mode,
+                  dispatch_group_t _Nullable group);
+
+    InFlight &begin_request(void *key);
+    void add_group(InFlight &in_flight, dispatch_group_t group);
+    ValueLayout build(void *key, InFlight &in_flight, const swift::metadata &type,
+                      LayoutDescriptor::ComparisonMode comparison_mode, LayoutDescriptor::HeapMode heap_mode);
+    void enqueue(const swift::metadata &type, LayoutDescriptor::ComparisonMode comparison_mode,
+                 LayoutDescriptor::HeapMode heap_mode, uint32_t priority);
+    void start_workers();
     static void drain_queue(void *cache);
 };
 
@@ -96,57 +210,215 @@ void *TypeDescriptorCache::make_key(const swift::metadata *type, LayoutDescripto
 ValueLayout TypeDescriptorCache::fetch(const swift::metadata &type, LayoutDescriptor::ComparisonOptions options,
                                        LayoutDescriptor::HeapMode heap_mode, uint32_t priority) {
     LayoutDescriptor::ComparisonMode comparison_mode = options.comparision_mode();
+    bool synchronous = options.fetch_layouts_synchronously() || !async_layouts();
 
     void *key = make_key(&type, comparison_mode, heap_mode);
 
+    // Layouts are only ever added, so the common case of an existing entry doesn't need the lock. A fetch that finds
+    // a placeholder has to check whether the layout is still being built.
+    bool found = false;
+    ValueLayout layout = _table.lookup(key, &found);
+    if (found && layout != pending_layout) {
+        if (print_layouts()) {
+            _cache_hit_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        return layout;
+    }
+
     lock();
 
-    const void *found = nullptr;
-    ValueLayout layout = (ValueLayout)_table.lookup((void *)key, &found);
-    if (found) {
-        _cache_hit_count += 1;
+    // Check again in case another thread inserted the entry meanwhile
+    layout = _table.lookup(key, &found);
+    InFlight *in_flight = found ? _in_flight.lookup(key, nullptr) : nullptr;
+    if (found && !in_flight) {
         unlock();
         return layout;
     }
 
-    _cache_miss_count += 1;
+    // A type that keeps being compared before its layout is built is built here instead, rather than comparing
+    // its values bytewise every time meanwhile
+    uint32_t misses = in_flight ? in_flight->misses + 1 : 1;
+    if (!synchronous && !(in_flight && in_flight->building) && max_async_misses() > 0 &&
+        misses >= max_async_misses()) {
+        synchronous = true;
+    }
+
+    if (!synchronous) {
+        // insert layout asynchronously
+        if (!found) {
+            _cache_miss_count += 1;
+            in_flight = &begin_request(key);
+            enqueue(type, comparison_mode, heap_mode, priority);
+            start_workers();
+        }
+        in_flight->misses = misses;
+        unlock();
+        missing_layouts += 1;
+        return nullptr;
+    }
+
+    if (!in_flight) {
+        _cache_miss_count += 1;
+        in_flight = &begin_request(key);
+    } else if (in_flight->building) {
+        // A nested fetch of a layout this thread is already building can't wait for itself
+        if (pthread_equal(in_flight->builder, pthread_self())) {
+            unlock();
+            missing_layouts += 1;
+            return nullptr;
+        }
+
+        // Wait for the other thread rather than building the same layout twice
+        if (!in_flight->done) {
+            in_flight->done = dispatch_group_create();
+            dispatch_group_enter(in_flight->done);
+        }
+        dispatch_group_t done = in_flight->done;
+        dispatch_retain(done);
+        unlock();
+
+        dispatch_group_wait(done, DISPATCH_TIME_FOREVER);
+        dispatch_release(done);
+        return _table.lookup(key, &found);
+    }
+
+    // insert layout synchronously, taking over the request if it is still queued
+    double start_time = current_time();
+    layout = build(key, *in_flight, type, comparison_mode, heap_mode);
+    double end_time = current_time();
+
+    double time = end_time - start_time;
+    if ((print_layouts() & 4) != 0) {
+        const char *name = type.name(false);
+        std::fprintf(stdout, "!! synchronous layout creation for %s: %g ms\n", name, time * 1000.0);
+    }
+    _sync_total_seconds += time;
+
     unlock();
+    return layout;
+}
 
-    static bool async_layouts = []() {
-        char *result = getenv("AG_ASYNC_LAYOUTS");
-        if (result) {
-            return atoi(result) != 0;
+void TypeDescriptorCache::prefetch(const swift::metadata *const *types, const uint32_t *priorities, size_t count,
+                                   LayoutDescriptor::ComparisonOptions options, LayoutDescriptor::HeapMode heap_mode,
+                                   dispatch_group_t group) {
+    if (options.fetch_layouts_synchronously() || !async_layouts()) {
+        for (size_t i = 0; i < count; i++) {
+            fetch(*types[i], options, heap_mode, priorities[i]);
         }
-        return false;
-    }();
+        return;
+    }
 
-    if (options.fetch_layouts_synchronously() || !async_layouts) {
-        // insert layout synchronously
-        double start_time = current_time();
-        layout = LayoutDescriptor::make_layout(type, comparison_mode, heap_mode);
-        double end_time = current_time();
+    LayoutDescriptor::ComparisonMode comparison_mode = options.comparision_mode();
 
-        if (comparison_mode < 0) {
-            lock();
-        } else {
-            double time = end_time - start_time;
-            if ((print_layouts() & 4) != 0) {
-                const char *name = type.name(false);
-                std::fprintf(stdout, "!! synchronous layout creation for %s: %g ms\n", name, time * 1000.0);
+    lock();
+    bool enqueued = false;
+    for (size_t i = 0; i < count; i++) {
+        void *key = make_key(types[i], comparison_mode, heap_mode);
+
+        bool found = false;
+        _table.lookup(key, &found);
+        if (!found) {
+            _cache_miss_count += 1;
+            InFlight &in_flight = begin_request(key);
+            if (group) {
+                add_group(in_flight, group);
+            }
+            enqueue(*types[i], comparison_mode, heap_mode, priorities[i]);
+            enqueued = true;
+        } else if (group) {
+            // Already requested by someone else, so wait for that build to finish
+            if (InFlight *in_flight = _in_flight.lookup(key, nullptr)) {
+                add_group(*in_flight, group);
             }
-            lock();
-            _sync_total_seconds += time;
         }
+    }
+    if (enqueued) {
+        start_workers();
+    }
+    unlock();
+}
 
-        _table.insert((void *)key, layout);
-        unlock();
-        return layout;
+TypeDescriptorCache::InFlight &TypeDescriptorCache::begin_request(void *key) {
+    _table.insert(key, pending_layout);
+
+    auto in_flight = new InFlight();
+    _in_flight.insert(key, in_flight);
+    return *in_flight;
+}
+
+void TypeDescriptorCache::add_group(InFlight &in_flight, dispatch_group_t group) {
+    dispatch_retain(group);
+    dispatch_group_enter(group);
+    in_flight.groups.push_back(group);
+}
+
+/// Builds the layout of a request, dropping the lock while doing so. Called and returns with the lock held.
+ValueLayout TypeDescriptorCache::build(void *key, InFlight &in_flight, const swift::metadata &type,
+                                       LayoutDescriptor::ComparisonMode comparison_mode,
+                                       LayoutDescriptor::HeapMode heap_mode) {
+    in_flight.building = true;
+    in_flight.builder = pthread_self();
+    unlock();
+
+    ValueLayout layout = LayoutDescriptor::make_layout(type, comparison_mode, heap_mode);
+    Trace::record(Trace::EventKind::LayoutBuilt, 0, uint64_t(&type), comparison_mode);
+
+    lock();
+    _table.insert(key, layout);
+    _in_flight.remove(key);
+    _generation.fetch_add(1, std::memory_order_release);
+
+    for (auto group : in_flight.groups) {
+        dispatch_group_leave(group);
+        dispatch_release(group);
+    }
+    if (in_flight.done) {
+        dispatch_group_leave(in_flight.done);
+        dispatch_release(in_flight.done);
+    }
+    delete &in_flight;
+
+    for (auto &observer : _observers) {
+        dispatch_async_f(observer.queue, observer.context, observer.function);
+        dispatch_release(observer.queue);
     }
+    _observers.clear();
 
-    // insert layout asynchronously
+    return layout;
+}
+
+size_t TypeDescriptorCache::trim() {
     lock();
-    _table.insert((void *)key, nullptr);
+    size_t trimmed_size = 0;
+    // the queue is shrunk by its last worker, and must keep its buffer while workers are popping from it
+    if (_async_worker_count == 0) {
+        size_t capacity = _async_queue.capacity();
+        _async_queue.shrink_to_fit();
+        trimmed_size += (capacity - _async_queue.capacity()) * sizeof(QueueEntry);
+    }
+    size_t capacity = _observers.capacity();
+    _observers.shrink_to_fit();
+    trimmed_size += (capacity - _observers.capacity()) * sizeof(Observer);
+    unlock();
+    return trimmed_size;
+}
 
+void TypeDescriptorCache::notify_next_layout(uint64_t generation, dispatch_queue_t queue, void *context,
+                                             dispatch_function_t function) {
+    lock();
+    if (_generation.load(std::memory_order_relaxed) != generation) {
+        // a layout was built since the caller looked
+        unlock();
+        dispatch_async_f(queue, context, function);
+        return;
+    }
+    dispatch_retain(queue);
+    _observers.push_back({queue, context, function});
+    unlock();
+}
+
+void TypeDescriptorCache::enqueue(const swift::metadata &type, LayoutDescriptor::ComparisonMode comparison_mode,
+                                  LayoutDescriptor::HeapMode heap_mode, uint32_t priority) {
     _async_queue.push_back({
         &type,
         comparison_mode,
@@ -154,15 +426,14 @@ ValueLayout TypeDescriptorCache::fetch(const swift::metadata &type, LayoutDescri
         priority,
     });
     std::push_heap(_async_queue.begin(), _async_queue.end());
+}
 
-    if (!_async_queue_running) {
-        _async_queue_running = true;
-        dispatch_queue_global_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0);
+void TypeDescriptorCache::start_workers() {
+    dispatch_queue_global_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0);
+    while (_async_worker_count < max_async_workers() && _async_worker_count < _async_queue.size()) {
+        _async_worker_count += 1;
         dispatch_async_f(queue, this, drain_queue);
     }
-
-    unlock();
-    return nullptr;
 }
 
 void TypeDescriptorCache::drain_queue(void *context) {
@@ -171,40 +442,52 @@ void TypeDescriptorCache::drain_queue(void *context) {
     double start_time = current_time();
     cache->lock();
 
+    // Each running worker owns a slot in the stats, reused by later workers once it has finished
+    uint32_t worker_index = std::countr_one(cache->_busy_workers);
+    cache->_busy_workers |= 1u << worker_index;
+    while (cache->_worker_stats.size() <= worker_index) {
+        cache->_worker_stats.push_back({0, 0});
+    }
+
+    // Several workers may run at once, each taking the most urgent entry left in the queue
     uint64_t created_count = 0;
     while (cache->_async_queue.size() > 0) {
         std::pop_heap(cache->_async_queue.begin(), cache->_async_queue.end());
         auto entry = cache->_async_queue.back();
+        cache->_async_queue.pop_back();
 
+        // Skip requests that a synchronous fetch has taken over meanwhile
         void *key = make_key(entry.type, entry.comparison_mode, entry.heap_mode);
-
-        const void *found = nullptr;
-        ValueLayout layout = (ValueLayout)cache->_table.lookup(key, &found);
-
-        if (layout == nullptr && found != nullptr) {
-            cache->unlock();
-            layout = LayoutDescriptor::make_layout(*entry.type, entry.comparison_mode, entry.heap_mode);
-            cache->lock();
-            cache->_table.insert(key, layout);
+        InFlight *in_flight = cache->_in_flight.lookup(key, nullptr);
+        if (in_flight && !in_flight->building) {
+            cache->build(key, *in_flight, *entry.type, entry.comparison_mode, entry.heap_mode);
+            created_count += 1;
         }
-
-        cache->_async_queue.pop_back();
     }
-    cache->_async_queue.shrink_to_fit();
 
-    cache->_async_queue_running = false;
+    cache->_async_worker_count -= 1;
+    cache->_busy_workers &= ~(1u << worker_index);
+    if (cache->_async_worker_count == 0) {
+        cache->_async_queue.shrink_to_fit();
+    }
 
     double time = current_time() - start_time;
+    WorkerStats &stats = cache->_worker_stats[worker_index];
+    stats.seconds += time;
+    stats.created_count += created_count;
+    cache->_async_total_seconds += time;
+
     if (print_layouts() & 2) {
         std::fprintf(stdout,
-                     "## bg queue ran for %g ms, created %u layouts (%u extant). "
+                     "## bg worker %u ran for %g ms, created %u layouts (%u extant). "
+                     "Worker totals: %g ms, %u layouts. "
                      "Totals: %g ms async, %g ms sync. %u hits, %u misses.\n",
-                     time * 1000.0, (uint)created_count, (uint)cache->_table.count(),
-                     cache->_async_total_seconds * 1000.0, cache->_sync_total_seconds * 1000.0,
-                     (uint)cache->_cache_hit_count, (uint)cache->_cache_miss_count);
+                     worker_index, time * 1000.0, (uint)created_count, (uint)cache->_table.count(),
+                     stats.seconds * 1000.0, (uint)stats.created_count, cache->_async_total_seconds * 1000.0,
+                     cache->_sync_total_seconds * 1000.0,
+                     (uint)cache->_cache_hit_count.load(std::memory_order_relaxed), (uint)cache->_cache_miss_count);
     }
 
-    cache->_async_total_seconds += time;
     cache->unlock();
 }
 
@@ -229,7 +512,7 @@ ComparisonMode mode_for_type(const swift::metadata *type, ComparisonMode default
 
     ComparisonMode result = default_mode;
     TypeDescriptorCache::shared_cache().lock();
-    auto modes = TypeDescriptorCache::shared_cache().modes();
+    auto &modes = TypeDescriptorCache::shared_cache().modes();
     auto iter = std::find_if(modes.begin(), modes.end(),
                              [&](const auto &element) -> bool { return element.first == descriptor; });
     if (iter != modes.end()) {
@@ -239,29 +522,112 @@ ComparisonMode mode_for_type(const swift::metadata *type, ComparisonMode default
     return result;
 }
 
+namespace {
+
+/// Identifies a type descriptor by its image and offset, so the value is the same in every launch.
+uint64_t descriptor_identity(const swift::context_descriptor *type_descriptor) {
+    const void *address = type_descriptor;
+    dyld_image_uuid_offset info = {};
+    dyld_images_for_addresses(1, &address, &info);
+    if (!info.image) {
+        return uintptr_t(type_descriptor);
+    }
+
+    // FNV-1a
+    uint64_t result = 0xcbf29ce484222325;
+    for (auto byte : info.uuid) {
+        result = (result ^ byte) * 0x100000001b3;
+    }
+    for (size_t i = 0; i < sizeof(info.offsetInImage); i++) {
+        result = (result ^ ((info.offsetInImage >> (i * 8)) & 0xff)) * 0x100000001b3;
+    }
+    return result;
+}
+
+uint64_t override_hash(uint64_t identity, ComparisonMode mode) {
+    uint64_t result = (identity ^ mode) * 0x9e3779b97f4a7c15;
+    return result ^ (result >> 32);
+}
+
+/// Each slot packs a type's address and a comparison mode with the classification of the type under that mode: bits
+/// 16 to 63 hold the address, bits 8 to 15 the mode, bit 7 is set if values compare bitwise and bits 0 to 4 hold
+/// their size. Types that map to the same slot replace each other.
+constexpr size_t small_bitwise_slot_count = 256;
+constexpr uint64_t small_bitwise_flag = 1 << 7;
+constexpr uint64_t small_bitwise_size_mask = 0x1f;
+static_assert(max_small_bitwise_size <= small_bitwise_size_mask);
+
+std::atomic<uint64_t> small_bitwise_slots[small_bitwise_slot_count] = {};
+
+std::atomic<uint64_t> &small_bitwise_slot(uintptr_t address, ComparisonMode mode) {
+    uint64_t hash = ((address >> 3) ^ mode) * 0x9e3779b97f4a7c15;
+    return small_bitwise_slots[hash >> 56];
+}
+
+/// Forgets every type, since comparison mode overrides can change their layouts.
+void clear_small_bitwise_slots() {
+    for (auto &slot : small_bitwise_slots) {
+        slot.store(0, std::memory_order_relaxed);
+    }
+}
+
+} // namespace
+
 void add_type_descriptor_override(const swift::context_descriptor *_Nullable type_descriptor,
                                   ComparisonMode override_mode) {
     if (!type_descriptor) {
         return;
     }
 
+    uint64_t identity = descriptor_identity(type_descriptor);
+
     TypeDescriptorCache::shared_cache().lock();
-    auto modes = TypeDescriptorCache::shared_cache().modes();
+    auto &modes = TypeDescriptorCache::shared_cache().modes();
+    auto &digest = TypeDescriptorCache::shared_cache().modes_digest();
     auto iter = std::find_if(modes.begin(), modes.end(),
                              [&](const auto &element) -> bool { return element.first == type_descriptor; });
     if (iter != modes.end()) {
+        digest.store(digest.load(std::memory_order_relaxed) ^ override_hash(identity, iter->second) ^
+                         override_hash(identity, override_mode),
+                     std::memory_order_relaxed);
         iter->second = override_mode;
     } else {
+        digest.store(digest.load(std::memory_order_relaxed) ^ override_hash(identity, override_mode),
+                     std::memory_order_relaxed);
         modes.push_back({type_descriptor, override_mode});
     }
     TypeDescriptorCache::shared_cache().unlock();
+
+    clear_small_bitwise_slots();
+}
+
+uint64_t comparison_modes_digest() {
+    return TypeDescriptorCache::shared_cache().modes_digest().load(std::memory_order_relaxed);
 }
 
 ValueLayout _Nullable fetch(const swift::metadata &type, ComparisonOptions options, uint32_t priority) {
     return TypeDescriptorCache::shared_cache().fetch(type, options, HeapMode(0), priority);
 }
 
-ValueLayout make_layout(const swift::metadata &type, ComparisonMode default_mode, HeapMode heap_mode) {
+uint64_t missing_layout_count() { return missing_layouts; }
+
+uint64_t layout_generation() { return TypeDescriptorCache::shared_cache().generation(); }
+
+size_t trim_cache() { return TypeDescriptorCache::shared_cache().trim(); }
+
+void notify_next_layout(uint64_t generation, dispatch_queue_t queue, void *_Nullable context,
+                        dispatch_function_t function) {
+    TypeDescriptorCache::shared_cache().notify_next_layout(generation, queue, context, function);
+}
+
+void prefetch(const swift::metadata *_Nonnull const *_Nonnull types, const uint32_t *priorities, size_t count,
+              ComparisonOptions options, dispatch_group_t _Nullable group) {
+    TypeDescriptorCache::shared_cache().prefetch(types, priorities, count, options, HeapMode(0), group);
+}
+
+namespace {
+
+ValueLayout build_layout(const swift::metadata &type, ComparisonMode default_mode, HeapMode heap_mode) {
     ComparisonMode comparison_mode = mode_for_type(&type, default_mode);
 
     Builder builder = Builder(comparison_mode, heap_mode);
@@ -270,6 +636,7 @@ ValueLayout make_layout(const swift::metadata &type, ComparisonMode default_mode
         if (!type.visit_heap(builder, swift::metadata::visit_options::heap_locals)) {
             return nullptr;
         }
+        return builder.commit(type);
     } else {
         if (heap_mode == HeapMode::Option1) {
             if (type.isClassObject()) {
@@ -287,32 +654,51 @@ ValueLayout make_layout(const swift::metadata &type, ComparisonMode default_mode
             if (!type.visit_heap(builder, swift::metadata::visit_options::heap_class_and_generic_locals)) {
                 return nullptr;
             }
-        }
-        if (heap_mode != HeapMode::Option0) {
-            return nullptr;
+            return builder.commit(type);
         }
 
         int mode = type.getValueWitnesses()->isPOD() ? 3 : 2; // TODO: check
-        if (builder.current_comparison_mode() < mode) {
-            if (!type.visit(builder)) {
-                return nullptr;
-            }
-        }
-        auto equatable = type.equatable();
-        if (equatable == nullptr) {
-            if (!type.visit(builder)) {
-                return nullptr;
+        if (mode <= builder.current_comparison_mode()) {
+            if (auto equatable = type.equatable()) {
+                size_t offset = builder.current_offset();
+                size_t size = type.vw_size();
+                Builder::EqualsItem item = {offset, size, &type, equatable};
+                builder.get_items().push_back(item);
+                return builder.commit(type);
             }
         }
 
-        size_t offset = builder.current_offset();
-        size_t size = type.vw_size();
-        Builder::EqualsItem item = {offset, size, &type, equatable};
-        builder.get_items().push_back(item);
+        if (!type.visit(builder)) {
+            return nullptr;
+        }
         return builder.commit(type);
     }
 }
 
+} // namespace
+
+ValueLayout make_layout(const swift::metadata &type, ComparisonMode default_mode, HeapMode heap_mode) {
+    auto disk_cache = DiskCache::shared();
+
+    ValueLayout layout = nullptr;
+    if (disk_cache && disk_cache->lookup(type, default_mode, heap_mode, &layout)) {
+        return layout;
+    }
+
+    layout = build_layout(type, default_mode, heap_mode);
+    if (disk_cache) {
+        disk_cache->record(type, default_mode, heap_mode, layout);
+    }
+    return layout;
+}
+
+const Program *_Nullable program(ValueLayout layout) {
+    if (layout <= ValueLayoutEmpty) {
+        return nullptr;
+    }
+    return reinterpret_cast<const Program *const *>(layout)[-1];
+}
+
 size_t length(ValueLayout layout) {
     const unsigned char *c = layout;
     unsigned int enum_depth = 0;
@@ -323,8 +709,12 @@ size_t length(ValueLayout layout) {
         }
         switch (*c) {
         case 0:
+            return c + 1 - layout;
+        case Controls::ExtendedDataItemBegin:
+        case Controls::ExtendedSkipItemBegin:
             c += 1;
-            break;
+            skip_varint(c);
+            continue;
         case Controls::EqualsItemBegin:
             c += 1;
             c += Controls::EqualsItemTypePointerSize;
@@ -346,10 +736,7 @@ size_t length(ValueLayout layout) {
         case Controls::NestedItemBegin: {
             c += 1;
             c += Controls::NestedItemLayoutPointerSize;
-            while (*(int *)c < 0) {
-                c += 1;
-            }
-            c += 1;
+            skip_varint(c);
             continue;
         }
         case Controls::CompactNestedItemBegin: {
@@ -361,10 +748,7 @@ size_t length(ValueLayout layout) {
         case Controls::EnumItemBeginVariadicCaseIndex: {
             enum_depth += 1;
             c += 1;
-            while (*(int *)c < 0) {
-                c += 1;
-            }
-            c += 1;
+            skip_varint(c);
             c += Controls::EnumItemTypePointerSize;
             continue;
         }
@@ -378,13 +762,10 @@ size_t length(ValueLayout layout) {
         }
         case Controls::EnumItemContinueVariadicCaseIndex: {
             if (enum_depth == 0) {
-                break;
-            }
-            c += 1;
-            while (*(int *)c < 0) {
-                c += 1;
+                return c - layout;
             }
             c += 1;
+            skip_varint(c);
             continue;
         }
         case Controls::EnumItemContinueCaseIndex0:
@@ -397,21 +778,21 @@ size_t length(ValueLayout layout) {
         case Controls::EnumItemContinueCaseIndex7:
         case Controls::EnumItemContinueCaseIndex8: {
             if (enum_depth == 0) {
-                break;
+                return c - layout;
             }
             c += 1;
             continue;
         }
         case Controls::EnumItemEnd: {
             if (enum_depth == 0) {
-                break;
+                return c - layout;
             }
             enum_depth -= 1;
             c += 1;
+            continue;
         }
         }
     }
-    return c - layout;
 }
 
 // MARK: Comparing values
@@ -421,9 +802,16 @@ bool compare(ValueLayout layout, const unsigned char *lhs, const unsigned char *
     if (lhs == rhs) {
         return true;
     }
+    options = FailureLog::sample(options);
     if (!layout) {
         return compare_bytes_top_level(lhs, rhs, size, options);
     }
+    // Programs don't track where a comparison failed, so reporting failures always goes through the interpreter
+    if (auto layout_program = program(layout)) {
+        if (size >= layout_program->extent() && !options.report_failures()) {
+            return layout_program->compare(lhs, rhs, options);
+        }
+    }
     auto compare_object = Compare();
     return compare_object(layout, lhs, rhs, 0, size, options);
 }
@@ -433,47 +821,131 @@ bool compare_bytes_top_level(const unsigned char *lhs, const unsigned char *rhs,
     size_t failure_location = 0;
     bool result = compare_bytes(lhs, rhs, size, &failure_location);
     if (options.report_failures() && !result) {
-        // TODO: tracing
+        FailureLog::record(lhs, rhs, failure_location, size - failure_location, nullptr);
     }
     return result;
 }
 
+namespace {
+
+inline uint64_t load_word(const unsigned char *bytes) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+/// Returns the index of the first byte that differs between the 8-byte words at lhs and rhs, or 8 if they are equal.
+inline size_t word_mismatch(const unsigned char *lhs, const unsigned char *rhs) {
+    uint64_t difference = load_word(lhs) ^ load_word(rhs);
+    return difference ? std::countr_zero(difference) / 8 : 8; // little endian
+}
+
+#if defined(__ARM_NEON) || defined(__SSE2__)
+
+constexpr size_t vector_size = 16;
+
+/// Returns the index of the first byte that differs between the 16-byte blocks at lhs and rhs, or 16 if they are
+/// equal. Neither pointer needs to be aligned.
+inline size_t vector_mismatch(const unsigned char *lhs, const unsigned char *rhs) {
+#if defined(__ARM_NEON)
+    uint8x16_t equal = vceqq_u8(vld1q_u8(lhs), vld1q_u8(rhs));
+    // narrow each byte of the comparison to 4 bits
+    uint64_t equal_nibbles = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+    uint64_t different_nibbles = ~equal_nibbles;
+    return different_nibbles ? std::countr_zero(different_nibbles) / 4 : vector_size;
+#else
+    __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(lhs)),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i *>(rhs)));
+    uint32_t different_bytes = ~uint32_t(_mm_movemask_epi8(equal)) & 0xffff;
+    return different_bytes ? std::countr_zero(different_bytes) : vector_size;
+#endif
+}
+
+#endif
+
+#if defined(__AVX2__)
+
+constexpr size_t wide_vector_size = 32;
+
+inline size_t wide_vector_mismatch(const unsigned char *lhs, const unsigned char *rhs) {
+    __m256i equal = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(lhs)),
+                                      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rhs)));
+    uint32_t different_bytes = ~uint32_t(_mm256_movemask_epi8(equal));
+    return different_bytes ? std::countr_zero(different_bytes) : wide_vector_size;
+}
+
+#endif
+
+} // namespace
+
 bool compare_bytes(const unsigned char *lhs, const unsigned char *rhs, size_t size, size_t *failure_location) {
-    if (size == 0) {
+    size_t location = 0;
+    size_t mismatch = 0;
+
+    auto fail = [&](size_t failed_location) -> bool {
+        if (failure_location) {
+            *failure_location = failed_location;
+        }
+        return false;
+    };
+
+    // Compare the widest blocks available. A final partial block is compared by loading the last full block of the
+    // buffer instead, its leading bytes overlap bytes already known to be equal so the first mismatch is still exact.
+#if defined(__AVX2__)
+    if (size >= wide_vector_size) {
+        for (; location + wide_vector_size <= size; location += wide_vector_size) {
+            if ((mismatch = wide_vector_mismatch(lhs + location, rhs + location)) < wide_vector_size) {
+                return fail(location + mismatch);
+            }
+        }
+        if (location < size) {
+            location = size - wide_vector_size;
+            if ((mismatch = wide_vector_mismatch(lhs + location, rhs + location)) < wide_vector_size) {
+                return fail(location + mismatch);
+            }
+        }
         return true;
     }
+#endif
 
-    size_t location = 0;
-    size_t remaining_size = size;
-
-    // If both aligned to 8 bytes, compare 8 bytes at a time
-    if ((((uintptr_t)lhs | (uintptr_t)rhs) & 7) == 0) {
-        while (remaining_size >= 8) {
-            if (*(uint64_t *)lhs != *(uint64_t *)rhs) {
-                if (failure_location) {
-                    *failure_location = location;
-                }
-                return false;
+#if defined(__ARM_NEON) || defined(__SSE2__)
+    if (size >= vector_size) {
+        for (; location + vector_size <= size; location += vector_size) {
+            if ((mismatch = vector_mismatch(lhs + location, rhs + location)) < vector_size) {
+                return fail(location + mismatch);
+            }
+        }
+        if (location < size) {
+            location = size - vector_size;
+            if ((mismatch = vector_mismatch(lhs + location, rhs + location)) < vector_size) {
+                return fail(location + mismatch);
             }
-            lhs += 8;
-            rhs += 8;
-            location += 8;
         }
+        return true;
     }
+#endif
 
-    // Compare one byte at a time
-    while (remaining_size > 0) {
-        if (*(uint8_t *)lhs != *(uint8_t *)rhs) {
-            if (failure_location) {
-                *failure_location = location;
+    if (size >= 8) {
+        for (; location + 8 <= size; location += 8) {
+            if ((mismatch = word_mismatch(lhs + location, rhs + location)) < 8) {
+                return fail(location + mismatch);
+            }
+        }
+        if (location < size) {
+            location = size - 8;
+            if ((mismatch = word_mismatch(lhs + location, rhs + location)) < 8) {
+                return fail(location + mismatch);
             }
-            return false;
         }
-        lhs += 1;
-        rhs += 1;
-        location += 1;
+        return true;
     }
 
+    // Compare one byte at a time
+    for (; location < size; location++) {
+        if (lhs[location] != rhs[location]) {
+            return fail(location);
+        }
+    }
     return true;
 }
 
@@ -486,8 +958,8 @@ bool compare_heap_objects(const unsigned char *lhs, const unsigned char *rhs, Co
         return false;
     }
 
-    auto lhs_type = (const swift::metadata *)lhs;
-    auto rhs_type = (const swift::metadata *)rhs;
+    auto lhs_type = *(const swift::metadata *const *)lhs;
+    auto rhs_type = *(const swift::metadata *const *)rhs;
     if (lhs_type != rhs_type) {
         return false;
     }
@@ -504,9 +976,39 @@ bool compare_heap_objects(const unsigned char *lhs, const unsigned char *rhs, Co
     return false;
 }
 
+namespace {
+
+/// Compares the values in the boxes of two indirect enum payloads.
+bool compare_boxes(ValueLayout *layout_ref, const swift::metadata &layout_type, ComparisonOptions options,
+                   const unsigned char *lhs_box, const unsigned char *rhs_box) {
+    if (lhs_box == rhs_box) {
+        // projected data are referentially equal
+        return true;
+    }
+
+    if (*layout_ref == nullptr) {
+        *layout_ref = fetch(layout_type, options.without_copying_on_write(), 0);
+    }
+
+    ValueLayout layout = *layout_ref == ValueLayoutEmpty ? nullptr : *layout_ref;
+
+    static_assert(sizeof(::swift::HeapObject) == 0x10);
+    size_t alignment_mask = layout_type.getValueWitnesses()->getAlignmentMask();
+    size_t offset = (sizeof(::swift::HeapObject) + alignment_mask) & ~alignment_mask;
+    return compare(layout, lhs_box + offset, rhs_box + offset, layout_type.vw_size(),
+                   options.without_copying_on_write());
+}
+
+} // namespace
+
 // https://www.swift.org/blog/how-mirror-works/
 bool compare_indirect(ValueLayout *layout_ref, const swift::metadata &enum_type, const swift::metadata &layout_type,
                       ComparisonOptions options, const unsigned char *lhs, const unsigned char *rhs) {
+    // A payload stored in place is the box itself, so it can be read without copying the enum
+    if (enum_type.has_in_place_enum_payloads()) {
+        return compare_boxes(layout_ref, layout_type, options, *(const unsigned char *const *)lhs,
+                             *(const unsigned char *const *)rhs);
+    }
 
     size_t enum_size = enum_type.vw_size();
     bool large_allocation = enum_size > 0x1000;
@@ -542,25 +1044,8 @@ bool compare_indirect(ValueLayout *layout_ref, const swift::metadata &enum_type,
     enum_type.vw_destructiveProjectEnumData((swift::opaque_value *)rhs_copy);
 
     // compare as heap objects
-    bool result;
-    if (*lhs_copy == *rhs_copy) {
-        // projected data are referentially equal
-        result = true;
-    } else {
-        if (*layout_ref == nullptr) {
-            *layout_ref = fetch(layout_type, options.without_copying_on_write(), 0);
-        }
-
-        ValueLayout layout = *layout_ref == ValueLayoutEmpty ? nullptr : *layout_ref;
-
-        static_assert(sizeof(::swift::HeapObject) == 0x10);
-        size_t alignment_mask = layout_type.getValueWitnesses()->getAlignmentMask();
-        size_t offset = (sizeof(::swift::HeapObject) + alignment_mask) & ~alignment_mask;
-        unsigned char *lhs_value = (unsigned char *)(*lhs_copy + offset);
-        unsigned char *rhs_value = (unsigned char *)(*rhs_copy + offset);
-
-        result = compare(layout, lhs_value, rhs_value, layout_type.vw_size(), options.without_copying_on_write());
-    }
+    bool result = compare_boxes(layout_ref, layout_type, options, *(const unsigned char *const *)lhs_copy,
+                                *(const unsigned char *const *)rhs_copy);
 
     if (large_allocation) {
         free(lhs_copy);
@@ -577,7 +1062,7 @@ bool compare_existential_values(const swift::existential_type_metadata &type, co
         if (auto rhs_dynamic_type = type.dynamic_type((void *)rhs)) {
             if (lhs_dynamic_type == rhs_dynamic_type) {
                 unsigned char *lhs_value = (unsigned char *)type.project_value((void *)lhs);
-                unsigned char *rhs_value = (unsigned char *)type.project_value((void *)lhs);
+                unsigned char *rhs_value = (unsigned char *)type.project_value((void *)rhs);
                 if (lhs_value == rhs_value) {
                     return true;
                 }
@@ -586,10 +1071,10 @@ bool compare_existential_values(const swift::existential_type_metadata &type, co
                     options = options.without_copying_on_write();
                 }
 
-                ValueLayout wrapped_layout = fetch(reinterpret_cast<const swift::metadata &>(type), options, 0);
-                ValueLayout layout = wrapped_layout == ValueLayoutEmpty ? nullptr : layout;
+                ValueLayout wrapped_layout = fetch(*lhs_dynamic_type, options, 0);
+                ValueLayout layout = wrapped_layout == ValueLayoutEmpty ? nullptr : wrapped_layout;
 
-                return compare(layout, lhs_value, rhs_value, type.vw_size(), options);
+                return compare(layout, lhs_value, rhs_value, lhs_dynamic_type->vw_size(), options);
             }
         }
     }
@@ -601,75 +1086,346 @@ bool compare_partial(ValueLayout layout, const unsigned char *lhs, const unsigne
     if (lhs == rhs) {
         return true;
     }
+    options = FailureLog::sample(options);
 
     if (layout) {
         Partial partial = find_partial(layout, offset, size);
         if (partial.layout != nullptr) {
-            size_t remaining_size = size;
-            if (partial.location != 0) {
-                if (!compare_bytes_top_level(lhs, rhs, partial.location, options)) {
+            // Bytes before the first item starting inside the range belong to an item straddling its start
+            size_t prefix_size = std::min(partial.location, size);
+            if (prefix_size != 0) {
+                if (!compare_bytes_top_level(lhs, rhs, prefix_size, options)) {
                     return false;
                 }
-                remaining_size = size >= partial.location ? size - partial.location : 0;
+            }
+            if (prefix_size == size) {
+                return true;
             }
 
             Compare compare_object = Compare();
-            return compare_object(partial.layout, lhs, rhs, partial.location, remaining_size, options);
+            return compare_object(partial.layout, lhs, rhs, partial.location, size - partial.location, options);
         }
     }
 
     return compare_bytes_top_level(lhs, rhs, size, options);
 }
 
-Partial find_partial(ValueLayout layout, size_t range_location, size_t range_size) {
+bool compare_dirty(ValueLayout layout, const unsigned char *lhs, const unsigned char *rhs, size_t size,
+                   const DirtyRanges &dirty, ComparisonOptions options) {
+    if (lhs == rhs) {
+        return true;
+    }
+    if (!dirty.is_tracking()) {
+        return compare(layout, lhs, rhs, size, options);
+    }
+    if (!layout) {
+        options = FailureLog::sample(options);
+        return dirty.for_each_run([&](size_t start, size_t end) {
+            if (start >= size) {
+                return true;
+            }
+            return compare_bytes_top_level(lhs + start, rhs + start, std::min(end, size) - start, options);
+        });
+    }
+    if (auto layout_program = program(layout)) {
+        if (size >= layout_program->extent() && !options.report_failures()) {
+            return layout_program->compare_dirty(lhs, rhs, dirty, options);
+        }
+    }
+    return compare(layout, lhs, rhs, size, options);
+}
 
-    if (range_location == 0) {
-        return {layout, 0};
+ComparisonStrategy comparison_strategy(ValueLayout layout, size_t size) {
+    if (!layout || layout == ValueLayoutEmpty) {
+        return ComparisonStrategy::Bitwise;
+    }
+
+    // A value that is one equatable item only needs its conformance
+    if (*layout == Controls::EqualsItemBegin) {
+        const unsigned char *c = layout + 1;
+        auto type = read_inline<const swift::metadata *>(c);
+        c += Controls::EqualsItemEquatablePointerSize;
+        if (*c == '\0' && type->vw_size() == size) {
+            return ComparisonStrategy::EquatableOnly;
+        }
+        return ComparisonStrategy::Layout;
+    }
+
+    // Otherwise only flat layouts of data, skipped bytes and references are classified, anything nested or
+    // equatable may not be equal to itself bytewise, e.g. a floating point NaN
+    const unsigned char *c = layout;
+    size_t offset = 0;
+    bool only_data = true;
+    while (*c != '\0') {
+        if (*c >= 0x80) {
+            offset += (*c & 0x7f) + 1;
+            c += 1;
+            continue;
+        }
+        if (*c >= 0x40) {
+            only_data = false;
+            offset += (*c & 0x3f) + 1;
+            c += 1;
+            continue;
+        }
+        switch (*c) {
+        case Controls::ExtendedDataItemBegin:
+            c += 1;
+            offset += read_varint(c);
+            continue;
+        case Controls::ExtendedSkipItemBegin:
+            only_data = false;
+            c += 1;
+            offset += read_varint(c);
+            continue;
+        case Controls::HeapRefItemBegin:
+        case Controls::FunctionItemBegin:
+            only_data = false;
+            c += 1;
+            offset += 8;
+            continue;
+        default:
+            return ComparisonStrategy::Layout;
+        }
+    }
+
+    // Bytes past the end of the layout aren't compared, so a shorter layout isn't bitwise
+    return only_data && offset >= size ? ComparisonStrategy::Bitwise : ComparisonStrategy::PointerIdentity;
+}
+
+bool compare_with_strategy(ComparisonStrategy strategy, ValueLayout layout, const unsigned char *lhs,
+                           const unsigned char *rhs, size_t size, const DirtyRanges &dirty,
+                           ComparisonOptions options) {
+    switch (strategy) {
+    case ComparisonStrategy::Bitwise:
+        return compare_dirty(nullptr, lhs, rhs, size, dirty, options);
+    case ComparisonStrategy::PointerIdentity:
+        // Dirty values only compare their dirty lines, which is already less than comparing all the bytes
+        if (!dirty.is_tracking() && memcmp(lhs, rhs, size) == 0) {
+            return true;
+        }
+        return compare_dirty(layout, lhs, rhs, size, dirty, options);
+    case ComparisonStrategy::EquatableOnly: {
+        if (lhs == rhs) {
+            return true;
+        }
+        const unsigned char *c = layout + 1;
+        auto type = read_inline<const swift::metadata *>(c);
+        auto equatable = read_inline<const swift::equatable_witness_table *>(c);
+
+        // The program of the layout knows whether the type has a native comparison
+        auto kind = Program::Op::Kind::Equals;
+        auto layout_program = program(layout);
+        if (layout_program && layout_program->ops().size() == 1) {
+            kind = layout_program->ops()[0].kind;
+        }
+        if (Program::compare_equatable(kind, lhs, rhs, *type, equatable)) {
+            return true;
+        }
+        options = FailureLog::sample(options);
+        if (options.report_failures()) {
+            FailureLog::record(lhs, rhs, 0, size, type);
+        }
+        return false;
+    }
+    case ComparisonStrategy::Layout:
+        return compare_dirty(layout, lhs, rhs, size, dirty, options);
+    }
+}
+
+#pragma mark - Hashing values
+
+namespace {
+
+constexpr uint64_t hash_secret[4] = {0xa0761d6478bd642f, 0xe7037ed1a0b428db, 0x8ebc6af09c88c6e3, 0x589965cc75374cc3};
+
+/// Multiplies two words into 128 bits and folds the halves together.
+inline uint64_t hash_mix(uint64_t a, uint64_t b) {
+    __uint128_t product = __uint128_t(a) * b;
+    return uint64_t(product) ^ uint64_t(product >> 64);
+}
+
+inline uint64_t load_word32(const unsigned char *bytes) {
+    uint32_t word;
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+constexpr size_t hash_stripe_size = 32;
+
+/// Accumulates 32 bytes into four lanes. Each lane adds the product of the low and high halves of its word keyed by
+/// the secret, and the unkeyed word of its neighbour, so that no byte can cancel out. The vector and scalar versions
+/// compute the same result.
+inline void hash_accumulate(uint64_t *acc, const unsigned char *bytes) {
+#if defined(__ARM_NEON)
+    for (size_t half = 0; half < 2; half++) {
+        uint64x2_t data = vreinterpretq_u64_u8(vld1q_u8(bytes + half * 16));
+        uint64x2_t keyed = veorq_u64(data, vld1q_u64(hash_secret + half * 2));
+        uint64x2_t product = vmull_u32(vmovn_u64(keyed), vshrn_n_u64(keyed, 32));
+        uint64x2_t sum = vaddq_u64(vld1q_u64(acc + half * 2), vextq_u64(data, data, 1));
+        vst1q_u64(acc + half * 2, vaddq_u64(sum, product));
+    }
+#elif defined(__SSE2__)
+    for (size_t half = 0; half < 2; half++) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + half * 16));
+        __m128i keyed = _mm_xor_si128(data, _mm_loadu_si128(reinterpret_cast<const __m128i *>(hash_secret + half * 2)));
+        __m128i product = _mm_mul_epu32(keyed, _mm_srli_epi64(keyed, 32));
+        __m128i accumulator = _mm_loadu_si128(reinterpret_cast<const __m128i *>(acc + half * 2));
+        __m128i sum = _mm_add_epi64(accumulator, _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(acc + half * 2), _mm_add_epi64(sum, product));
+    }
+#else
+    uint64_t data[4];
+    memcpy(data, bytes, sizeof(data));
+    for (size_t lane = 0; lane < 4; lane++) {
+        uint64_t keyed = data[lane] ^ hash_secret[lane];
+        acc[lane ^ 1] += data[lane];
+        acc[lane] += (keyed & 0xffffffff) * (keyed >> 32);
+    }
+#endif
+}
+
+} // namespace
+
+uint64_t hash_bytes(const unsigned char *bytes, size_t size, uint64_t seed) {
+    seed ^= hash_mix(seed ^ hash_secret[0], hash_secret[1]);
+
+    // Small runs, the most common, are read as two possibly overlapping words
+    uint64_t a = 0;
+    uint64_t b = 0;
+    if (size <= 16) {
+        if (size >= 8) {
+            a = load_word(bytes);
+            b = load_word(bytes + size - 8);
+        } else if (size >= 4) {
+            a = load_word32(bytes);
+            b = load_word32(bytes + size - 4);
+        } else if (size > 0) {
+            a = (uint64_t(bytes[0]) << 16) | (uint64_t(bytes[size >> 1]) << 8) | bytes[size - 1];
+        }
+    } else if (size <= hash_stripe_size) {
+        seed = hash_mix(load_word(bytes) ^ hash_secret[1], load_word(bytes + 8) ^ seed);
+        a = load_word(bytes + size - 16);
+        b = load_word(bytes + size - 8);
+    } else {
+        uint64_t acc[4] = {hash_secret[0], hash_secret[1], hash_secret[2], hash_secret[3]};
+        size_t location = 0;
+        for (; location + hash_stripe_size <= size; location += hash_stripe_size) {
+            hash_accumulate(acc, bytes + location);
+        }
+        // A final partial stripe is accumulated by loading the last full stripe of the run instead
+        if (location < size) {
+            hash_accumulate(acc, bytes + size - hash_stripe_size);
+        }
+        seed = hash_mix(acc[0] ^ hash_secret[2], acc[1] ^ seed) ^ hash_mix(acc[2] ^ hash_secret[3], acc[3]);
+        a = acc[0] ^ acc[3];
+        b = acc[1] ^ acc[2];
+    }
+
+    a ^= hash_secret[1];
+    b ^= seed;
+    return hash_mix(hash_secret[0] ^ size, hash_mix(a, b) ^ hash_secret[3]);
+}
+
+uint64_t combine_hashes(uint64_t hash, uint64_t item_hash) {
+    return hash_mix(hash ^ hash_secret[0], item_hash ^ hash_secret[2]);
+}
+
+uint64_t hash(ValueLayout layout, const unsigned char *value, size_t size, ComparisonOptions options) {
+    if (!layout || layout == ValueLayoutEmpty) {
+        return hash_bytes(value, size, 0);
+    }
+    if (auto layout_program = program(layout)) {
+        // A value that is all data hashes like a bitwise value, whether or not its type was classified as one yet
+        auto &ops = layout_program->ops();
+        if (ops.size() == 1 && ops[0].kind == Program::Op::Kind::Bytes && ops[0].offset == 0 && ops[0].size == size) {
+            return hash_bytes(value, size, 0);
+        }
+        if (size >= layout_program->extent()) {
+            return layout_program->hash(value, options);
+        }
+    }
+    // Interpreted layouts are rare enough not to be worth a hashing interpreter, only their size is hashed
+    return combine_hashes(0, size);
+}
+
+#pragma mark - Fast paths
+
+int small_bitwise_size(const swift::metadata &type, ComparisonOptions options) {
+    uintptr_t address = (uintptr_t)&type;
+    ComparisonMode mode = options.comparision_mode();
+    if (address >> 48) {
+        return -1;
+    }
+
+    // the whole entry is one word, so relaxed loads and stores can't see a torn entry
+    uint64_t key = (uint64_t(address) << 16) | (uint64_t(mode & 0xff) << 8);
+    std::atomic<uint64_t> &slot = small_bitwise_slot(address, mode);
+    uint64_t entry = slot.load(std::memory_order_relaxed);
+    if ((entry & ~uint64_t(0xff)) == key) {
+        return (entry & small_bitwise_flag) ? int(entry & small_bitwise_size_mask) : -1;
     }
 
+    // A layout that is still being built compares bitwise meanwhile, but isn't remembered
+    uint64_t missing_count = missing_layouts;
+    ValueLayout layout = fetch(type, options, 0);
+    size_t size = type.vw_size();
+    if (missing_layouts != missing_count) {
+        return size <= max_small_bitwise_size ? int(size) : -1;
+    }
+    bool bitwise = size <= max_small_bitwise_size &&
+                   comparison_strategy(layout, size) == ComparisonStrategy::Bitwise;
+    slot.store(key | (bitwise ? small_bitwise_flag | size : 0), std::memory_order_relaxed);
+    return bitwise ? int(size) : -1;
+}
+
+namespace {
+
+Partial scan_partial(ValueLayout layout, size_t range_location, size_t range_size) {
     const unsigned char *c = layout;
     size_t accumulated_size = 0;
 
-    const swift::metadata *enum_type = nullptr;
     while (accumulated_size < range_location) {
-
         if (*c == '\0') {
             return {nullptr, 0};
         }
 
         if (*c >= 0x80) {
-            accumulated_size += *c & 0x7f + 1; // Convert 0-127 to 1-128
+            accumulated_size += (*c & 0x7f) + 1; // Convert 0-127 to 1-128
             c += 1;
             continue;
         }
 
         if (*c >= 0x40) {
-            accumulated_size += *c & 0x3f + 1; // Convert 0-63 to 1-64
+            accumulated_size += (*c & 0x3f) + 1; // Convert 0-63 to 1-64
             c += 1;
             continue;
         }
 
         switch (*c) {
+        case Controls::ExtendedDataItemBegin:
+        case Controls::ExtendedSkipItemBegin: {
+            c += 1;
+            accumulated_size += read_varint(c);
+            continue;
+        }
         case Controls::EqualsItemBegin: {
             c += 1;
-            auto type = reinterpret_cast<const swift::metadata *>(c);
-            c += Controls::EqualsItemTypePointerSize;
+            auto type = read_inline<const swift::metadata *>(c);
             c += Controls::EqualsItemEquatablePointerSize;
             accumulated_size += type->vw_size();
             continue;
         }
         case Controls::IndirectItemBegin: {
             c += 1;
-            auto type = reinterpret_cast<const swift::metadata *>(c);
-            c += Controls::IndirectItemTypePointerSize;
+            auto type = read_inline<const swift::metadata *>(c);
             c += Controls::IndirectItemLayoutPointerSize;
             accumulated_size += type->vw_size();
             continue;
         }
         case Controls::ExistentialItemBegin: {
             c += 1;
-            auto type = reinterpret_cast<const swift::metadata *>(c);
-            c += Controls::ExistentialItemTypePointerSize;
+            auto type = read_inline<const swift::metadata *>(c);
             accumulated_size += type->vw_size();
             continue;
         }
@@ -679,47 +1435,23 @@ Partial find_partial(ValueLayout layout, size_t range_location, size_t range_siz
             accumulated_size += sizeof(void *);
             continue;
         }
-        case Controls::NestedItemBegin: {
-            c += 1;
-
-            auto item_layout = reinterpret_cast<ValueLayout>(c);
-            c += Controls::NestedItemLayoutPointerSize;
-
-            unsigned shift = 0;
-            size_t item_size = 0;
-            while (*(int *)c < 0) {
-                item_size = item_size | ((*c & 0x7f) << shift);
-                shift += 7;
+        case Controls::NestedItemBegin:
+        case Controls::CompactNestedItemBegin: {
+            ValueLayout item_layout;
+            size_t item_size;
+            if (*c == Controls::NestedItemBegin) {
                 c += 1;
-            }
-            item_size = item_size | ((*c & 0x7f) << shift);
-            c += 1;
-
-            if (accumulated_size + item_size > range_location &&
-                accumulated_size + item_size >= range_location + range_size) {
-                // offset after applying nested layout exceeds range
-                // restart search from nested layout
-                range_location -= accumulated_size;
-                accumulated_size = 0;
-                c = item_layout;
+                item_layout = read_inline<ValueLayout>(c);
+                item_size = read_varint(c);
             } else {
-                accumulated_size += item_size;
+                c += 1;
+                item_layout = reinterpret_cast<ValueLayout>(base_address + read_inline<uint32_t>(c));
+                item_size = read_inline<uint16_t>(c);
             }
-            continue;
-        }
-        case Controls::CompactNestedItemBegin: {
-            c += 1;
-
-            auto item_layout = reinterpret_cast<ValueLayout>(base_address + (uint32_t *)c);
-            c += Controls::CompactNestedItemLayoutRelativePointerSize;
-
-            size_t item_size = *(uint16_t *)(c);
-            c += Controls::CompactNestedItemLayoutSize;
 
             if (accumulated_size + item_size > range_location &&
                 accumulated_size + item_size >= range_location + range_size) {
-                // offset after applying nested layout exceeds range
-                // restart search from nested layout
+                // The nested item covers the rest of the range, so restart the search from its layout
                 range_location -= accumulated_size;
                 accumulated_size = 0;
                 c = item_layout;
@@ -734,57 +1466,100 @@ Partial find_partial(ValueLayout layout, size_t range_location, size_t range_siz
         case Controls::EnumItemBeginCaseIndex2: {
             if (*c == Controls::EnumItemBeginVariadicCaseIndex) {
                 c += 1;
-                while (*(int *)c < 0) {
-                    c += 1;
-                }
-                c += 1;
-                enum_type = reinterpret_cast<const swift::metadata *>(c);
-                c += Controls::EnumItemTypePointerSize;
+                skip_varint(c);
             } else {
                 c += 1;
-                enum_type = reinterpret_cast<const swift::metadata *>(c);
-                c += Controls::EnumItemTypePointerSize;
             }
+            auto enum_type = read_inline<const swift::metadata *>(c);
 
-            c += length(c);
-        }
-        case Controls::EnumItemContinueVariadicCaseIndex:
-        case Controls::EnumItemContinueCaseIndex0:
-        case Controls::EnumItemContinueCaseIndex1:
-        case Controls::EnumItemContinueCaseIndex2:
-        case Controls::EnumItemContinueCaseIndex3:
-        case Controls::EnumItemContinueCaseIndex4:
-        case Controls::EnumItemContinueCaseIndex5:
-        case Controls::EnumItemContinueCaseIndex6:
-        case Controls::EnumItemContinueCaseIndex7:
-        case Controls::EnumItemContinueCaseIndex8: {
-            if (*c == Controls::EnumItemContinueVariadicCaseIndex) {
-                c += 1;
-                while (*(int *)c < 0) {
+            // Which case applies depends on the values, so the enum is only ever skipped as a whole
+            while (true) {
+                c += length(c);
+                if (*c == Controls::EnumItemEnd) {
+                    c += 1;
+                    break;
+                }
+                if (*c == Controls::EnumItemContinueVariadicCaseIndex) {
+                    c += 1;
+                    skip_varint(c);
+                } else {
                     c += 1;
                 }
-                c += 1;
-            } else {
-                c += 1;
             }
-
-            c += length(c);
-        }
-        case Controls::EnumItemEnd: {
-            c += 1;
             accumulated_size += enum_type->vw_size();
-            enum_type = nullptr;
             continue;
         }
-        default: {
-            c += 1;
+        default:
+            // Enum case markers only appear inside an enum item, anything else here is malformed
+            return {nullptr, 0};
         }
+    }
+
+    return {c, accumulated_size - range_location};
+}
+
+/// Remembers recent `find_partial` results. Layouts are immutable and never freed, so a result stays valid for as
+/// long as the process runs. Each thread has its own direct mapped table so lookups don't synchronize.
+class PartialCache {
+  private:
+    struct Entry {
+        ValueLayout _Nullable layout;
+        size_t range_location;
+        size_t range_size;
+        Partial partial;
+    };
+
+    static constexpr size_t capacity = 256;
+
+    Entry _entries[capacity] = {};
+
+    static std::atomic<uint64_t> _hits;
+    static std::atomic<uint64_t> _misses;
+
+    static size_t index(ValueLayout layout, size_t range_location, size_t range_size) {
+        uint64_t hash = (uint64_t(uintptr_t(layout)) ^ (uint64_t(range_location) << 20) ^ range_size) *
+                        0x9e3779b97f4a7c15;
+        return hash >> (64 - std::countr_zero(capacity));
+    };
+
+  public:
+    static PartialCache &current() {
+        static thread_local PartialCache cache;
+        return cache;
+    };
+
+    Partial find(ValueLayout layout, size_t range_location, size_t range_size) {
+        Entry &entry = _entries[index(layout, range_location, range_size)];
+        if (entry.layout == layout && entry.range_location == range_location && entry.range_size == range_size) {
+            _hits.fetch_add(1, std::memory_order_relaxed);
+            return entry.partial;
         }
+        _misses.fetch_add(1, std::memory_order_relaxed);
+
+        Partial partial = scan_partial(layout, range_location, range_size);
+        entry = {layout, range_location, range_size, partial};
+        return partial;
     };
 
-    return {c, accumulated_size};
+    static PartialCacheStats stats() {
+        return {_hits.load(std::memory_order_relaxed), _misses.load(std::memory_order_relaxed)};
+    };
+};
+
+std::atomic<uint64_t> PartialCache::_hits = 0;
+std::atomic<uint64_t> PartialCache::_misses = 0;
+
+} // namespace
+
+Partial find_partial(ValueLayout layout, size_t range_location, size_t range_size) {
+    if (range_location == 0) {
+        return {layout, 0};
+    }
+    return PartialCache::current().find(layout, range_location, range_size);
 }
 
+PartialCacheStats partial_cache_stats() { return PartialCache::stats(); }
+
 void print(std::string &output, ValueLayout layout) {
     auto print_format = [&output](const char *format, ...) {
         char *message = nullptr;
@@ -810,7 +1585,7 @@ void print(std::string &output, ValueLayout layout) {
         }
 
         if (*c >= 0x40 && *c < 0x80) {
-            size_t length = *c & 0x3f + 1; // Convert 0-63 to 1-64
+            size_t length = (*c & 0x3f) + 1; // Convert 0-63 to 1-64
             c += 1;
             output.push_back('\n');
             output.append(indent * 2, ' ');
@@ -819,7 +1594,7 @@ void print(std::string &output, ValueLayout layout) {
         }
 
         if (*c >= 0x80) {
-            size_t length = *c & 0x7f + 1; // Convert 0-127 to 1-128
+            size_t length = (*c & 0x7f) + 1; // Convert 0-127 to 1-128
             c += 1;
             output.push_back('\n');
             output.append(indent * 2, ' ');
@@ -828,6 +1603,16 @@ void print(std::string &output, ValueLayout layout) {
         }
 
         switch (*c) {
+        case Controls::ExtendedDataItemBegin:
+        case Controls::ExtendedSkipItemBegin: {
+            bool is_data = *c == Controls::ExtendedDataItemBegin;
+            c += 1;
+            size_t length = read_varint(c);
+            output.push_back('\n');
+            output.append(indent * 2, ' ');
+            print_format(is_data ? "(read %zu)" : "(skip %zu)", length);
+            continue;
+        }
         case Controls::EqualsItemBegin: {
             c += 1;
 
@@ -994,9 +1779,36 @@ void print(std::string &output, ValueLayout layout) {
 
 #pragma mark - Builder
 
-os_unfair_lock Builder::_lock = OS_UNFAIR_LOCK_INIT;
-size_t Builder::_avail = 0;
-unsigned char *Builder::_buffer = nullptr;
+thread_local Builder::Arena Builder::_arena;
+
+ValueLayout Builder::install(const unsigned char *layout_data, size_t layout_length) {
+    // Each layout is preceded by a pointer-aligned slot holding its compiled program, see program().
+    constexpr size_t program_slot_size = sizeof(const Program *);
+    size_t allocation_size = (program_slot_size + layout_length + program_slot_size - 1) & ~(program_slot_size - 1);
+
+    unsigned char *allocation;
+
+    Arena &arena = _arena;
+    if (allocation_size < 0x400) {
+        if (arena.avail < allocation_size) {
+            arena.avail = 0x1000;
+            arena.buffer = (unsigned char *)malloc(0x1000);
+        }
+        allocation = arena.buffer;
+        arena.avail -= allocation_size;
+        arena.buffer += allocation_size;
+    } else {
+        allocation = (unsigned char *)malloc(allocation_size);
+    }
+
+    unsigned char *result = allocation + program_slot_size;
+    memcpy(result, layout_data, layout_length);
+
+    // Nested layouts were committed before this one, so their programs are already available to be inlined.
+    *reinterpret_cast<const Program **>(allocation) = Program::compile(result);
+
+    return result;
+}
 
 ValueLayout Builder::commit(const swift::metadata &type) {
     if (_heap_mode == HeapMode(0)) {
@@ -1015,7 +1827,8 @@ ValueLayout Builder::commit(const swift::metadata &type) {
         }
     }
 
-    auto emitter = Emitter<vector<unsigned char, 512, uint64_t>>();
+    vector<unsigned char, 512, uint64_t> layout_data = {};
+    auto emitter = Emitter<vector<unsigned char, 512, uint64_t>>(&layout_data);
     for (auto &&item : _items) {
         std::visit(emitter, item);
     }
@@ -1025,30 +1838,14 @@ ValueLayout Builder::commit(const swift::metadata &type) {
         return nullptr;
     }
     if (_heap_mode == HeapMode(0)) {
-        emitter.set_layout_exceeds_object_size(type.vw_size() < emitter.emitted_size());
+        emitter.set_layout_exceeds_object_size(emitter.layout_exceeds_object_size() ||
+                                               type.vw_size() < emitter.emitted_size());
         if (emitter.layout_exceeds_object_size()) {
             return ValueLayoutEmpty;
         }
     }
-    auto layout_data = emitter.data();
 
-    unsigned char *result;
-
-    lock();
-    if (layout_data.size() < 0x400) {
-        if (_avail < layout_data.size()) {
-            _avail = 0x1000;
-            _buffer = (unsigned char *)malloc(0x1000);
-        }
-        result = _buffer;
-        _avail -= layout_data.size();
-        _buffer += layout_data.size();
-    } else {
-        result = (unsigned char *)malloc(layout_data.size());
-    }
-    unlock();
-
-    memcpy(result, layout_data.data(), layout_data.size());
+    ValueLayout result = install(layout_data.data(), layout_data.size());
 
     if (print_layouts()) {
         std::string message = {};
@@ -1065,6 +1862,8 @@ ValueLayout Builder::commit(const swift::metadata &type) {
             fprintf(stdout, "== Unknown heap type %p ==\n%s", &type, message.data());
         }
     }
+
+    return result;
 }
 
 void Builder::add_field(size_t field_size) {
@@ -1072,9 +1871,9 @@ void Builder::add_field(size_t field_size) {
         return;
     }
 
-    auto items = get_items();
+    auto &items = get_items();
     if (auto data_item = !items.empty() ? std::get_if<DataItem>(&items.back()) : nullptr) {
-        if (data_item->offset == _current_offset) {
+        if (data_item->offset + data_item->size == _current_offset) {
             data_item->size += field_size;
             return;
         }
@@ -1121,7 +1920,7 @@ bool Builder::should_visit_fields(const swift::metadata &type, bool no_fetch) {
 }
 
 void Builder::revert(const RevertItemsInfo &info) {
-    auto items = get_items();
+    auto &items = get_items();
     while (items.size() > info.item_index) {
         items.pop_back();
     }
@@ -1143,7 +1942,7 @@ bool Builder::visit_element(const swift::metadata &type, const swift::metadata::
         _current_comparison_mode = mode_for_type(&type, _current_comparison_mode);
 
         if (should_visit_fields(type, false)) {
-            auto items = get_items();
+            auto &items = get_items();
 
             auto num_items = items.size();
 
@@ -1170,12 +1969,12 @@ bool Builder::visit_element(const swift::metadata &type, const swift::metadata::
     return true;
 }
 
-bool Builder::visit_case(const swift::metadata &type, const swift::field_record &field, uint32_t index) {
+bool Builder::visit_case(const swift::metadata &type, const swift::field_table::field &field, uint32_t index) {
     if (_enum_case_depth > 7) {
         return false;
     }
 
-    auto items = get_items();
+    auto &items = get_items();
 
     // Add EnumItem if this is the first case
     if (index == 0) {
@@ -1185,9 +1984,9 @@ bool Builder::visit_case(const swift::metadata &type, const swift::field_record
             &type,
             {},
         };
-        items.push_back(item);
+        items.push_back(std::move(item));
     }
-    EnumItem enum_item = std::get<EnumItem>(items.back()); // throws
+    EnumItem &enum_item = std::get<EnumItem>(items.back()); // throws
 
     // Add this case to the enum item
     EnumItem::Case enum_case = {
@@ -1195,7 +1994,7 @@ bool Builder::visit_case(const swift::metadata &type, const swift::field_record
         _current_offset,
         {},
     };
-    enum_item.cases.push_back(enum_case);
+    enum_item.cases.push_back(std::move(enum_case));
 
     bool result;
 
@@ -1203,17 +2002,16 @@ bool Builder::visit_case(const swift::metadata &type, const swift::field_record
     EnumItem::Case *prev_enum_case = _current_enum_case;
     _current_enum_case = &enum_item.cases.back();
 
-    if (field.isIndirectCase() && _current_comparison_mode == 0) {
+    bool is_indirect = field.record && field.record->isIndirectCase();
+    if (is_indirect && _current_comparison_mode == 0) {
         add_field(sizeof(void *));
         result = true;
     } else {
-        auto mangled_name = field.FieldName.get();
-        auto field_type = mangled_name != nullptr ? type.mangled_type_name_ref(mangled_name, false, nullptr) : nullptr;
+        auto field_type = field.type;
         if (field_type == nullptr) {
             // bail out if we can't get a type for the enum case payload
-            items.pop_back();
             result = false;
-        } else if (field.isIndirectCase()) {
+        } else if (is_indirect) {
             if (auto field_size = field_type->vw_size()) {
                 IndirectItem item = {
                     _current_offset,
@@ -1230,7 +2028,7 @@ bool Builder::visit_case(const swift::metadata &type, const swift::field_record
             if (should_visit_fields(*field_type, false)) {
 
                 // same as visit_element
-                auto items = get_items();
+                auto &items = get_items();
                 size_t prev_offset = -1;
                 size_t prev_size = 0;
                 if (auto data_item = items.size() > 0 ? std::get_if<DataItem>(&items.back()) : nullptr) {
@@ -1266,13 +2064,16 @@ bool Builder::visit_case(const swift::metadata &type, const swift::field_record
     }
 
     if (_current_enum_case->children.empty()) {
-        auto last_case = enum_item.cases.back();
-        enum_item.cases.pop_back(); // make call destructor
+        enum_item.cases.pop_back();
     }
 
     _enum_case_depth -= 1;
     _current_enum_case = prev_enum_case;
 
+    if (!result) {
+        items.pop_back();
+    }
+
     return result;
 }
 
@@ -1307,54 +2108,83 @@ bool Builder::visit_native_object(const swift::metadata &type) {
 
 #pragma mark - Builder::Emitter
 
-void Builder::Emitter<vector<unsigned char, 512, uint64_t>>::operator()(const DataItem &item) {
-    enter(item);
-    size_t item_size = item.size;
-    while (item_size > 0x80) {
-        _data->push_back(0xff);
-        item_size -= 0x80;
+void Builder::Emitter<vector<unsigned char, 512, uint64_t>>::push_inline(const void *value, size_t size) {
+    _data->reserve(_data->size() + size);
+    for (size_t i = 0; i < size; ++i) {
+        _data->push_back(((const unsigned char *)value)[i]);
+    }
+}
+
+void Builder::Emitter<vector<unsigned char, 512, uint64_t>>::push_varint(size_t value) {
+    // Emit 7 bits at a time, using the 8th bit as a "has more" flag
+    do {
+        _data->push_back((value & 0x7f) | (value > 0x7f ? 1 << 7 : 0));
+        value = value >> 7;
+    } while (value);
+}
+
+void Builder::Emitter<vector<unsigned char, 512, uint64_t>>::push_run(size_t length, bool is_data) {
+    unsigned char chunk_control = is_data ? 0x80 : 0x40;
+    size_t max_chunk_length = is_data ? DataRunMaxLength : SkipRunMaxLength;
+
+    // Prefer a single extended run once it is shorter than a series of chunks
+    size_t num_chunks = (length + max_chunk_length - 1) / max_chunk_length;
+    if (num_chunks > 1 + varint_length(length)) {
+        _data->push_back(is_data ? Controls::ExtendedDataItemBegin : Controls::ExtendedSkipItemBegin);
+        push_varint(length);
+        return;
+    }
+
+    while (length > max_chunk_length) {
+        _data->push_back(chunk_control | (max_chunk_length - 1));
+        length -= max_chunk_length;
+    }
+    if (length > 0) {
+        _data->push_back(chunk_control | (length - 1));
     }
-    if (item_size != 0) {
-        _data->push_back((item_size - 1) | 0x80);
+}
+
+void Builder::Emitter<vector<unsigned char, 512, uint64_t>>::flush_data() {
+    if (_pending_data_size > 0) {
+        push_run(_pending_data_size, true);
+        _pending_data_size = 0;
+    }
+}
+
+void Builder::Emitter<vector<unsigned char, 512, uint64_t>>::operator()(const DataItem &item) {
+    // Data items that directly follow another data run are merged into it
+    if (_pending_data_size > 0 && item.offset == _emitted_size && !_layout_exceeds_object_size) {
+        _pending_data_size += item.size;
+        _emitted_size += item.size;
+        return;
     }
+
+    enter(item);
+    _pending_data_size = item.size;
     _emitted_size += item.size;
 }
 
 void Builder::Emitter<vector<unsigned char, 512, uint64_t>>::operator()(const EqualsItem &item) {
     enter(item);
     _data->push_back(Controls::EqualsItemBegin);
-    _data->reserve(_data->size() + 8);
-    for (int i = 0; i < sizeof(void *); ++i) {
-        _data->push_back(*((unsigned char *)item.type + i));
-    }
-    _data->reserve(_data->size() + 8);
-    for (int i = 0; i < sizeof(void *); ++i) {
-        _data->push_back(*((unsigned char *)item.equatable + i));
-    }
+    push_inline(&item.type, Controls::EqualsItemTypePointerSize);
+    push_inline(&item.equatable, Controls::EqualsItemEquatablePointerSize);
     _emitted_size += item.size;
 }
 
 void Builder::Emitter<vector<unsigned char, 512, uint64_t>>::operator()(const IndirectItem &item) {
     enter(item);
     _data->push_back(Controls::IndirectItemBegin);
-    _data->reserve(_data->size() + 8);
-    for (int i = 0; i < sizeof(void *); ++i) {
-        _data->push_back(*((unsigned char *)item.type + i));
-    }
-    _data->reserve(_data->size() + 8);
-    for (int i = 0; i < sizeof(void *); ++i) {
-        _data->push_back(0);
-    }
+    push_inline(&item.type, Controls::IndirectItemTypePointerSize);
+    ValueLayout layout = nullptr; // fetched lazily when compared
+    push_inline(&layout, Controls::IndirectItemLayoutPointerSize);
     _emitted_size += item.size;
 }
 
 void Builder::Emitter<vector<unsigned char, 512, uint64_t>>::operator()(const ExistentialItem &item) {
     enter(item);
     _data->push_back(Controls::ExistentialItemBegin);
-    _data->reserve(_data->size() + 8);
-    for (int i = 0; i < sizeof(void *); ++i) {
-        _data->push_back(*((unsigned char *)item.type + i));
-    }
+    push_inline(&item.type, Controls::ExistentialItemTypePointerSize);
     _emitted_size += item.size;
 }
 
@@ -1367,40 +2197,21 @@ void Builder::Emitter<vector<unsigned char, 512, uint64_t>>::operator()(const He
 void Builder::Emitter<vector<unsigned char, 512, uint64_t>>::operator()(const NestedItem &item) {
     enter(item);
 
-    size_t item_length = length(item.layout);
-    if (item_length <= 0x20) {
-        // append nested layout directly
-        //        _data->push_back(item.layout); // append length - 1 bytes from nested layout to _data
-    } else {
-        uintptr_t layout_relative_address = (uintptr_t)item.layout - (uintptr_t)&base_address;
-        if ((uint32_t)layout_relative_address == layout_relative_address && item.size < 0xffff) {
-            _data->push_back(Controls::CompactNestedItemBegin);
-
-            // layout addressin 4 bytes
-            _data->reserve(_data->size() + 4);
-            for (int i = 0; i < sizeof(uint32_t); ++i) {
-                _data->push_back(*((unsigned char *)layout_relative_address + i));
-            }
+    uintptr_t layout_relative_address = (uintptr_t)item.layout - base_address;
+    if ((uint32_t)layout_relative_address == layout_relative_address && item.size < 0xffff) {
+        _data->push_back(Controls::CompactNestedItemBegin);
 
-            // size in two bytes
-            _data->push_back(*((unsigned char *)item.size + 0));
-            _data->push_back(*((unsigned char *)item.size + 1));
-        } else {
-            _data->push_back(Controls::NestedItemBegin);
-
-            // full pointer to layout
-            _data->reserve(_data->size() + 8);
-            for (int i = 0; i < sizeof(void *); ++i) {
-                _data->push_back(*((unsigned char *)item.layout + i)); // TODO: how to split the pointer into 8 bytes
-            }
+        // layout address in 4 bytes, size in 2 bytes
+        uint32_t compact_address = (uint32_t)layout_relative_address;
+        uint16_t compact_size = (uint16_t)item.size;
+        push_inline(&compact_address, Controls::CompactNestedItemLayoutRelativePointerSize);
+        push_inline(&compact_size, Controls::CompactNestedItemLayoutSize);
+    } else {
+        _data->push_back(Controls::NestedItemBegin);
 
-            // Emit length 7 bits at a time, using the 8th bit as a "has more" flag
-            size_t length = item.size;
-            while (length) {
-                _data->push_back((length & 0x7f) | (length > 0x7f ? 1 << 7 : 0));
-                length = length >> 7;
-            }
-        }
+        // full pointer to layout
+        push_inline(&item.layout, Controls::NestedItemLayoutPointerSize);
+        push_varint(item.size);
     }
 
     _emitted_size += item.size;
@@ -1410,14 +2221,11 @@ void Builder::Emitter<vector<unsigned char, 512, uint64_t>>::operator()(const En
     enter(item);
 
     if (item.cases.empty()) {
-        _data->push_back('\t');
-        _data->reserve(_data->size() + 8);
-        for (int i = 0; i < sizeof(void *); ++i) {
-            _data->push_back(*((unsigned char *)item.type + i));
-        }
+        _data->push_back(Controls::EnumItemBeginCaseIndex0);
+        push_inline(&item.type, Controls::EnumItemTypePointerSize);
     } else {
         bool is_first = true;
-        for (auto enum_case : item.cases) {
+        for (auto &enum_case : item.cases) {
             /*
              Case indices are encoding using the numbers 8 through 21
 
@@ -1436,63 +2244,48 @@ void Builder::Emitter<vector<unsigned char, 512, uint64_t>>::operator()(const En
                 is_first ? Controls::EnumItemBeginCaseIndexLast : Controls::EnumItemContinueCaseIndexLast;
             if (direct_encoded_index <= last_direct) {
                 _data->push_back(direct_encoded_index);
-
             } else {
                 _data->push_back(is_first ? Controls::EnumItemBeginVariadicCaseIndex
                                           : Controls::EnumItemContinueVariadicCaseIndex);
-
-                // Emit case.index 7 bits at a time, using the 8th bit as a "has more" flag
-                size_t number = enum_case.item_index;
-                while (number) {
-                    _data->push_back((number & 0x7f) | (number > 0x7f ? 1 << 7 : 0));
-                    number = number >> 7;
-                }
+                push_varint(enum_case.item_index);
             }
 
             if (is_first) {
-                _data->reserve(_data->size() + 8);
-                for (int i = 0; i < sizeof(void *); ++i) {
-                    _data->push_back(*((unsigned char *)item.type + i));
-                }
+                push_inline(&item.type, Controls::EnumItemTypePointerSize);
             }
 
+            // Every case payload starts at the beginning of the enum
+            _emitted_size = item.offset;
             for (auto &&child : enum_case.children) {
                 std::visit(*this, child);
             }
+            flush_data();
 
             is_first = false;
 
-            size_t new_size = _emitted_size + item.type->vw_size();
-            _layout_exceeds_object_size = (_layout_exceeds_object_size || new_size < _emitted_size);
+            _layout_exceeds_object_size = _layout_exceeds_object_size || item.offset + item.size < _emitted_size;
         }
     }
 
     _data->push_back(Controls::EnumItemEnd);
 
-    _emitted_size += item.size;
+    _emitted_size = item.offset + item.size;
 }
 
 void Builder::Emitter<vector<unsigned char, 512, uint64_t>>::enter(const RangeItem &item) {
+    flush_data();
     if (!_layout_exceeds_object_size) {
-        _layout_exceeds_object_size = item.offset <= _emitted_size;
+        _layout_exceeds_object_size = item.offset < _emitted_size;
         if (!_layout_exceeds_object_size) {
-
             // Emit number of bytes until item offset
-            // encode as a series of numbers from 0-63, indicating chunks of bytes 1-64
-            size_t length = item.offset - _emitted_size;
-            while (length > 0x40) {
-                _data->push_back('\x7f');
-                length -= 0x40;
-            }
-            if (length > 0) {
-                _data->push_back((length - 1) | 0x40);
-            }
+            push_run(item.offset - _emitted_size, false);
         }
     }
     _emitted_size = item.offset;
 }
 
 void Builder::Emitter<vector<unsigned char, 512, uint64_t>>::finish() {
+    flush_data();
     _data->push_back('\0'); // NULL terminating char
 }
 
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <CoreFoundation/CFBase.h>
+#include <dispatch/dispatch.h>
+#include <stdint.h>
+#include <string.h>
 #include <string>
 
 CF_ASSUME_NONNULL_BEGIN
@@ -20,6 +23,9 @@ extern const ValueLayout ValueLayoutEmpty;
 
 namespace LayoutDescriptor {
 
+class DirtyRanges;
+class Program;
+
 enum class HeapMode : uint16_t {
     Option0 = 0,
     Option1 = 1,
@@ -66,12 +72,44 @@ ComparisonMode mode_for_type(const swift::metadata *_Nullable type, ComparisonMo
 void add_type_descriptor_override(const swift::context_descriptor *_Nullable type_descriptor,
                                   ComparisonMode override_mode);
 
+/// Summarizes the comparison mode overrides so that layouts built under different overrides can be told apart.
+uint64_t comparison_modes_digest();
+
 // MARK: Obtaining layouts
 
+/// Returns the layout of `type`. With asynchronous layouts a layout that isn't built yet is queued and `nullptr` is
+/// returned meanwhile, like the layout of a type that compares bytewise; `missing_layout_count` tells them apart.
+/// After a type has been fetched `AG_LAYOUT_SYNC_AFTER_MISSES` times while queued, the next fetch builds its layout
+/// synchronously.
 ValueLayout fetch(const swift::metadata &type, ComparisonOptions options, uint32_t priority);
 
+/// The number of fetches of the current thread that returned `nullptr` because the layout wasn't built yet. A caller
+/// whose comparison bumped the count may have compared bytewise values that are equal under their layout.
+uint64_t missing_layout_count();
+
+/// Increases every time a layout has been built.
+uint64_t layout_generation();
+
+/// Calls `function` on `queue` once the layout generation has moved past `generation`, right away if it already
+/// has. A caller that compared values with a missing layout can use this to compare them again.
+void notify_next_layout(uint64_t generation, dispatch_queue_t queue, void *_Nullable context,
+                        dispatch_function_t function);
+
+/// Releases the spare capacity of the layout cache's queues and returns the number of bytes freed. Built layouts are
+/// kept, callers hold on to them without reference counting.
+size_t trim_cache();
+
+/// Queues layouts to be built in the background, taking the cache lock once for the whole batch. If `group` is
+/// given it is entered once for each layout that is still to be built and left when that layout is ready.
+void prefetch(const swift::metadata *_Nonnull const *_Nonnull types, const uint32_t *priorities, size_t count,
+              ComparisonOptions options, dispatch_group_t _Nullable group);
+
+/// Builds the layout of `type`, or loads it from the on-disk layout cache if one is configured.
 ValueLayout make_layout(const swift::metadata &type, ComparisonMode default_mode, HeapMode heap_mode);
 
+/// Returns the program compiled when the layout was committed, or `nullptr` if the layout has to be interpreted.
+const Program *_Nullable program(ValueLayout layout);
+
 // MARK: Comparing values
 
 /// Returns the number of characters in the layout, up to the next sibling enum marker or until the end of the layout.
@@ -92,14 +130,117 @@ bool compare_indirect(ValueLayout *_Nullable layout_ref, const swift::metadata &
 bool compare_existential_values(const swift::existential_type_metadata &type, const unsigned char *lhs,
                                 const unsigned char *rhs, ComparisonOptions options);
 
+/// Compares the `size` bytes at `offset` in two values with layout `layout`, with `lhs` and `rhs` pointing at those
+/// bytes rather than at the start of the values.
 bool compare_partial(ValueLayout layout, const unsigned char *lhs, const unsigned char *rhs, size_t offset, size_t size,
                      ComparisonOptions options);
+
 struct Partial {
     ValueLayout layout;
     size_t location;
 };
+
+/// Returns the layout of the first item starting at or after `range_location`, descending into nested layouts that
+/// cover the rest of the range, together with that item's offset from `range_location`. Results are memoized.
 Partial find_partial(ValueLayout layout, size_t range_location, size_t range_size);
 
+struct PartialCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+};
+PartialCacheStats partial_cache_stats();
+
+/// Compares the parts of two values of `size` bytes that overlap `dirty`, assuming the rest is equal. Falls back to
+/// comparing the whole value when `dirty` isn't tracking anything or the layout can't be compared piecewise.
+bool compare_dirty(ValueLayout layout, const unsigned char *lhs, const unsigned char *rhs, size_t size,
+                   const DirtyRanges &dirty, ComparisonOptions options);
+
+// MARK: Hashing values
+
+/// Hashes a value of `size` bytes with layout `layout` so that values `compare` finds equal under the same options
+/// hash the same. Data runs are hashed by their bytes, while items compared by an Equatable conformance or by heap
+/// object contents only add whether they are present, since equal values may differ in their bits there. The layout
+/// must have been fetched synchronously, a missing layout hashes the value bytewise.
+uint64_t hash(ValueLayout layout, const unsigned char *value, size_t size, ComparisonOptions options);
+
+/// Hashes `size` bytes, with runs longer than 32 bytes accumulated a vector at a time.
+uint64_t hash_bytes(const unsigned char *bytes, size_t size, uint64_t seed);
+
+/// Mixes the hash of an item into the hash of the items before it.
+uint64_t combine_hashes(uint64_t hash, uint64_t item_hash);
+
+// MARK: Comparison strategies
+
+/// The cheapest way to compare values with a given layout, decided once per layout by `comparison_strategy`.
+enum class ComparisonStrategy : uint8_t {
+    /// The values are equal exactly when their bytes are.
+    Bitwise = 1,
+
+    /// The values are equal when their bytes are, including their references, otherwise the layout decides.
+    PointerIdentity,
+
+    /// The whole value is compared by its Equatable conformance.
+    EquatableOnly,
+
+    /// The layout has to be walked.
+    Layout,
+};
+
+/// Classifies `layout` for values of `size` bytes. A null or empty layout compares bitwise.
+ComparisonStrategy comparison_strategy(ValueLayout layout, size_t size);
+
+/// Same as `compare_dirty`, but takes the shortcut allowed by `strategy`, which must be the strategy of `layout`.
+bool compare_with_strategy(ComparisonStrategy strategy, ValueLayout layout, const unsigned char *lhs,
+                           const unsigned char *rhs, size_t size, const DirtyRanges &dirty,
+                           ComparisonOptions options);
+
+// MARK: Fast paths
+
+/// Values that compare bitwise and are no larger than this are compared without their layout, see
+/// `small_bitwise_size`.
+constexpr size_t max_small_bitwise_size = 16;
+
+/// Returns the size of values of `type` if they compare bitwise and are at most `max_small_bitwise_size` bytes,
+/// otherwise -1. Types are classified once per comparison mode from their layout and remembered in a small
+/// direct-mapped cache, so that a hit is a single load. Nothing is remembered while the layout is still being built.
+int small_bitwise_size(const swift::metadata &type, ComparisonOptions options);
+
+/// Compares two values of at most `max_small_bitwise_size` bytes, with single loads for the common sizes.
+inline bool compare_small_bitwise(const unsigned char *lhs, const unsigned char *rhs, size_t size) {
+    switch (size) {
+    case 0:
+        return true;
+    case 1:
+        return *lhs == *rhs;
+    case 2: {
+        uint16_t l, r;
+        memcpy(&l, lhs, 2);
+        memcpy(&r, rhs, 2);
+        return l == r;
+    }
+    case 4: {
+        uint32_t l, r;
+        memcpy(&l, lhs, 4);
+        memcpy(&r, rhs, 4);
+        return l == r;
+    }
+    case 8: {
+        uint64_t l, r;
+        memcpy(&l, lhs, 8);
+        memcpy(&r, rhs, 8);
+        return l == r;
+    }
+    case 16: {
+        uint64_t l[2], r[2];
+        memcpy(l, lhs, 16);
+        memcpy(r, rhs, 16);
+        return ((l[0] ^ r[0]) | (l[1] ^ r[1])) == 0;
+    }
+    default:
+        return memcmp(lhs, rhs, size) == 0;
+    }
+}
+
 // MARK: Printing
 
 void print(std::string &output, ValueLayout layout);
@@ -0,0 +1,386 @@
+#include "Program.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include "Compare.h"
+#include "Controls.h"
+#include "Swift/EquatableSupport.h"
+#include "Swift/Metadata.h"
+
+namespace AG {
+namespace LayoutDescriptor {
+
+#pragma mark - Compiling
+
+const Program *Program::compile(ValueLayout layout) {
+    if (layout <= ValueLayoutEmpty) {
+        return nullptr;
+    }
+
+    auto program = new Program();
+    if (!program->append_layout(layout, 0)) {
+        delete program;
+        return nullptr;
+    }
+    program->_ops.shrink_to_fit();
+    return program;
+}
+
+bool Program::push(Op::Kind kind, size_t offset, size_t size, const swift::metadata *type, const void *data) {
+    if (size == 0) {
+        return true;
+    }
+    if (offset + size > UINT32_MAX) {
+        return false;
+    }
+
+    // Merge with the previous data run if the two are contiguous
+    if (kind == Op::Kind::Bytes && !_ops.empty()) {
+        Op &last = _ops.back();
+        if (last.kind == Op::Kind::Bytes && last.offset + last.size == offset) {
+            last.size += size;
+            _extent = std::max(_extent, offset + size);
+            return true;
+        }
+    }
+
+    _ops.push_back({kind, uint32_t(offset), uint32_t(size), type, data});
+    _extent = std::max(_extent, offset + size);
+    return true;
+}
+
+bool Program::append_nested(ValueLayout layout, size_t offset, size_t size) {
+    // Nested layouts are committed before the layouts containing them, so their programs can be copied in directly
+    if (auto nested_program = program(layout)) {
+        for (auto &op : nested_program->_ops) {
+            if (!push(op.kind, offset + op.offset, op.size, op.type, op.data)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return push(Op::Kind::Layout, offset, size, nullptr, layout);
+}
+
+bool Program::append_layout(ValueLayout layout, size_t offset) {
+    const unsigned char *c = layout;
+    while (true) {
+        if (*c == '\0') {
+            return true;
+        }
+
+        // skip over unused layout
+        if (*c >= 0x40 && *c < 0x80) {
+            offset += (*c & 0x3f) + 1; // Convert 0-63 to 1-64
+            c += 1;
+            continue;
+        }
+
+        // compare data as bytes
+        if (*c >= 0x80) {
+            size_t data_size = (*c & 0x7f) + 1; // Convert 0-127 to 1-128
+            c += 1;
+            if (!push(Op::Kind::Bytes, offset, data_size, nullptr, nullptr)) {
+                return false;
+            }
+            offset += data_size;
+            continue;
+        }
+
+        switch (*c) {
+        case Controls::ExtendedSkipItemBegin: {
+            c += 1;
+            offset += read_varint(c);
+            continue;
+        }
+        case Controls::ExtendedDataItemBegin: {
+            c += 1;
+            size_t data_size = read_varint(c);
+            if (!push(Op::Kind::Bytes, offset, data_size, nullptr, nullptr)) {
+                return false;
+            }
+            offset += data_size;
+            continue;
+        }
+        case Controls::EqualsItemBegin: {
+            c += 1;
+            auto type = read_inline<const swift::metadata *>(c);
+            auto equatable = read_inline<const swift::equatable_witness_table *>(c);
+
+            size_t item_size = type->vw_size();
+            if (!push(equals_kind(*type), offset, item_size, type, equatable)) {
+                return false;
+            }
+            offset += item_size;
+            continue;
+        }
+        case Controls::ExistentialItemBegin: {
+            c += 1;
+            auto type = read_inline<const swift::metadata *>(c);
+
+            size_t item_size = type->vw_size();
+            if (!push(Op::Kind::Existential, offset, item_size, type, nullptr)) {
+                return false;
+            }
+            offset += item_size;
+            continue;
+        }
+        case Controls::HeapRefItemBegin:
+        case Controls::FunctionItemBegin: {
+            auto kind = *c == Controls::FunctionItemBegin ? Op::Kind::Function : Op::Kind::HeapRef;
+            c += 1;
+            if (!push(kind, offset, sizeof(void *), nullptr, nullptr)) {
+                return false;
+            }
+            offset += sizeof(void *);
+            continue;
+        }
+        case Controls::NestedItemBegin: {
+            c += 1;
+            auto item_layout = read_inline<ValueLayout>(c);
+            size_t item_size = read_varint(c);
+
+            if (!append_nested(item_layout, offset, item_size)) {
+                return false;
+            }
+            offset += item_size;
+            continue;
+        }
+        case Controls::CompactNestedItemBegin: {
+            c += 1;
+            auto item_layout = reinterpret_cast<ValueLayout>(base_address + read_inline<uint32_t>(c));
+            size_t item_size = read_inline<uint16_t>(c);
+
+            if (!append_nested(item_layout, offset, item_size)) {
+                return false;
+            }
+            offset += item_size;
+            continue;
+        }
+        case Controls::EnumItemBeginVariadicCaseIndex:
+        case Controls::EnumItemBeginCaseIndex0:
+        case Controls::EnumItemBeginCaseIndex1:
+        case Controls::EnumItemBeginCaseIndex2: {
+            ValueLayout enum_layout = c;
+            if (*c == Controls::EnumItemBeginVariadicCaseIndex) {
+                c += 1;
+                skip_varint(c);
+            } else {
+                c += 1;
+            }
+            auto type = read_inline<const swift::metadata *>(c);
+
+            // Advance over every case up to the matching end marker
+            while (true) {
+                c += length(c);
+                if (*c == Controls::EnumItemEnd) {
+                    c += 1;
+                    break;
+                }
+                if (*c == Controls::EnumItemContinueVariadicCaseIndex) {
+                    c += 1;
+                    skip_varint(c);
+                } else {
+                    c += 1;
+                }
+            }
+
+            size_t item_size = type->vw_size();
+            if (!push(Op::Kind::Layout, offset, item_size, type, enum_layout)) {
+                return false;
+            }
+            offset += item_size;
+            continue;
+        }
+        default:
+            // Indirect items only appear within enum cases, anything else here is malformed
+            return false;
+        }
+    }
+}
+
+#pragma mark - Comparing
+
+namespace {
+
+// The second word of a string on 64-bit platforms holds its discriminator in the top bits. Both are set for small
+// strings of only ASCII characters, which are equal exactly when their bits are, since every ASCII string is in its
+// canonical form and unused bytes are zero. Other strings may be canonically equivalent with different bits.
+constexpr uint64_t small_ascii_string_mask = 0x6000000000000000;
+
+bool is_small_ascii_string(uint64_t object_bits) {
+    return (object_bits & small_ascii_string_mask) == small_ascii_string_mask;
+}
+
+} // namespace
+
+Program::Op::Kind Program::equals_kind(const swift::metadata &type) {
+    static const swift::metadata *string_type = type.mangled_type_name_ref("SS", false, nullptr);
+    static const void *array_descriptor = [&type]() -> const void * {
+        auto array_type = type.mangled_type_name_ref("SaySiG", false, nullptr);
+        return array_type ? array_type->nominal_descriptor() : nullptr;
+    }();
+
+    if (&type == string_type && type.vw_size() == 2 * sizeof(uint64_t)) {
+        return Op::Kind::StringEquals;
+    }
+    if (array_descriptor && type.nominal_descriptor() == array_descriptor && type.vw_size() == sizeof(void *)) {
+        return Op::Kind::ArrayEquals;
+    }
+    return Op::Kind::Equals;
+}
+
+bool Program::compare_equatable(Op::Kind kind, const unsigned char *lhs, const unsigned char *rhs,
+                                const swift::metadata &type, const void *equatable) {
+    switch (kind) {
+    case Op::Kind::StringEquals: {
+        uint64_t lhs_bits[2];
+        uint64_t rhs_bits[2];
+        memcpy(lhs_bits, lhs, sizeof(lhs_bits));
+        memcpy(rhs_bits, rhs, sizeof(rhs_bits));
+        if (lhs_bits[0] == rhs_bits[0] && lhs_bits[1] == rhs_bits[1]) {
+            return true;
+        }
+        if (is_small_ascii_string(lhs_bits[1]) && is_small_ascii_string(rhs_bits[1])) {
+            return false;
+        }
+        break;
+    }
+    case Op::Kind::ArrayEquals: {
+        if (*(const void *const *)lhs == *(const void *const *)rhs) {
+            return true;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+    return AGDispatchEquatable(lhs, rhs, &type, reinterpret_cast<const swift::equatable_witness_table *>(equatable));
+}
+
+bool Program::compare_op(const Op &op, const unsigned char *lhs, const unsigned char *rhs,
+                         ComparisonOptions options) const {
+    const unsigned char *lhs_item = lhs + op.offset;
+    const unsigned char *rhs_item = rhs + op.offset;
+
+    switch (op.kind) {
+    case Op::Kind::Bytes:
+        return compare_bytes(lhs_item, rhs_item, op.size, nullptr);
+    case Op::Kind::Equals:
+        return AGDispatchEquatable(lhs_item, rhs_item, op.type,
+                                   reinterpret_cast<const swift::equatable_witness_table *>(op.data));
+    case Op::Kind::StringEquals:
+    case Op::Kind::ArrayEquals:
+        return compare_equatable(op.kind, lhs_item, rhs_item, *op.type, op.data);
+    case Op::Kind::Existential:
+        return compare_existential_values(*reinterpret_cast<const swift::existential_type_metadata *>(op.type),
+                                          lhs_item, rhs_item, options);
+    case Op::Kind::HeapRef:
+    case Op::Kind::Function: {
+        auto lhs_object = *(const unsigned char *const *)lhs_item;
+        auto rhs_object = *(const unsigned char *const *)rhs_item;
+        return lhs_object == rhs_object ||
+               compare_heap_objects(lhs_object, rhs_object, options, op.kind == Op::Kind::Function);
+    }
+    case Op::Kind::Layout: {
+        Compare compare_object = Compare();
+        return compare_object(reinterpret_cast<ValueLayout>(op.data), lhs, rhs, op.offset, op.size, options);
+    }
+    }
+}
+
+bool Program::compare(const unsigned char *lhs, const unsigned char *rhs, ComparisonOptions options) const {
+    for (uint32_t i = 0; i < _ops.size(); ++i) {
+        if (!compare_op(_ops[i], lhs, rhs, options)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Program::compare_dirty(const unsigned char *lhs, const unsigned char *rhs, const DirtyRanges &dirty,
+                            ComparisonOptions options) const {
+    const Op *ops = _ops.data();
+    const Op *ops_end = ops + _ops.size();
+
+    // Ops are ordered by offset and don't overlap, so each run can binary search for its first op. `next` is the
+    // first op that hasn't been compared in full, so an op spanning several runs is only compared once.
+    const Op *next = ops;
+    return dirty.for_each_run([&](size_t start, size_t end) {
+        const Op *op = std::partition_point(next, ops_end, [start](const Op &candidate) {
+            return size_t(candidate.offset) + candidate.size <= start;
+        });
+        for (; op != ops_end && op->offset < end; ++op) {
+            size_t op_end = size_t(op->offset) + op->size;
+            if (op->kind == Op::Kind::Bytes) {
+                size_t from = std::max(size_t(op->offset), start);
+                size_t to = std::min(op_end, end);
+                if (!compare_bytes(lhs + from, rhs + from, to - from, nullptr)) {
+                    return false;
+                }
+                if (op_end > end) {
+                    // The rest of the run may be covered by a later run
+                    next = op;
+                    return true;
+                }
+            } else if (!compare_op(*op, lhs, rhs, options)) {
+                return false;
+            }
+            next = op + 1;
+        }
+        return true;
+    });
+}
+
+#pragma mark - Hashing
+
+uint64_t Program::hash(const unsigned char *value, ComparisonOptions options) const {
+    uint64_t result = 0;
+    for (auto &op : _ops) {
+        const unsigned char *item = value + op.offset;
+
+        uint64_t item_hash = 0;
+        switch (op.kind) {
+        case Op::Kind::Bytes:
+            item_hash = hash_bytes(item, op.size, op.offset);
+            break;
+        case Op::Kind::Equals:
+        case Op::Kind::StringEquals:
+        case Op::Kind::ArrayEquals:
+            // Equal values may have different bits, only their conformance can tell
+            continue;
+        case Op::Kind::Existential: {
+            // Equal existentials hold values of the same dynamic type that are equal under its layout
+            auto &type = *reinterpret_cast<const swift::existential_type_metadata *>(op.type);
+            auto dynamic_type = type.dynamic_type((void *)item);
+            if (!dynamic_type) {
+                break;
+            }
+            auto wrapped_value = (const unsigned char *)type.project_value((void *)item);
+            ValueLayout wrapped_layout = fetch(*dynamic_type, options, 0);
+            item_hash = combine_hashes(uintptr_t(dynamic_type),
+                                       LayoutDescriptor::hash(wrapped_layout, wrapped_value,
+                                                              dynamic_type->vw_size(), options));
+            break;
+        }
+        case Op::Kind::HeapRef:
+        case Op::Kind::Function:
+            // Different objects may be equal, and the header of an object isn't stable, so only null is told apart
+            item_hash = *(const void *const *)item != nullptr;
+            break;
+        case Op::Kind::Layout:
+            // Equal enums are in the same case, the case's payload is left to the comparison
+            if (!op.type) {
+                continue;
+            }
+            item_hash = op.type->vw_getEnumTag((swift::opaque_value *)item);
+            break;
+        }
+        result = combine_hashes(result, item_hash);
+    }
+    return result;
+}
+
+} // namespace LayoutDescriptor
+} // namespace AG
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+
+#include "DirtyRanges.h"
+#include "LayoutDescriptor.h"
+#include "Vector/Vector.h"
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace AG {
+namespace LayoutDescriptor {
+
+/// A layout lowered into a flat list of comparison operations.
+///
+/// A program is compiled once, when its layout is committed. Adjacent data runs are merged, nested layouts are
+/// inlined and the sizes of equatable and existential items are resolved up front, so comparing two values doesn't
+/// decode any layout bytes. Enums are kept as a single operation that interprets the enum's part of the layout,
+/// because which case applies depends on the values being compared.
+///
+/// Equatable strings and arrays of the standard library are lowered to ops of their own, which decide the common
+/// cases without calling their conformance, see `StringEquals` and `ArrayEquals`.
+class Program {
+  public:
+    struct Op {
+        enum class Kind : uint8_t {
+            Bytes,
+            Equals,
+
+            /// Equal strings of identical bits, unequal small ASCII strings of different bits, otherwise `Equals`.
+            StringEquals,
+
+            /// Equal arrays of the same buffer, otherwise `Equals`.
+            ArrayEquals,
+
+            Existential,
+            HeapRef,
+            Function,
+            Layout,
+        };
+
+        Kind kind;
+        uint32_t offset;
+        uint32_t size;
+        const swift::metadata *_Nullable type;
+
+        /// The equatable witness table of an `Equals` op, or the layout interpreted by a `Layout` op.
+        const void *_Nullable data;
+    };
+
+  private:
+    vector<Op, 0, uint32_t> _ops;
+    size_t _extent = 0;
+
+    bool push(Op::Kind kind, size_t offset, size_t size, const swift::metadata *_Nullable type,
+              const void *_Nullable data);
+    bool append_layout(ValueLayout layout, size_t offset);
+    bool append_nested(ValueLayout layout, size_t offset, size_t size);
+
+    bool compare_op(const Op &op, const unsigned char *lhs, const unsigned char *rhs, ComparisonOptions options) const;
+
+  public:
+    /// Returns the kind of op that compares values of `type` with its equatable conformance.
+    static Op::Kind equals_kind(const swift::metadata &type);
+
+    /// Compares two values of `type` like an op of `kind`, with `equatable` the type's equatable witness table.
+    static bool compare_equatable(Op::Kind kind, const unsigned char *lhs, const unsigned char *rhs,
+                                  const swift::metadata &type, const void *equatable);
+
+    /// Lowers a committed layout. Returns `nullptr` if the layout can't be expressed as a program, in which case
+    /// the layout should be interpreted instead.
+    static const Program *_Nullable compile(ValueLayout layout);
+
+    const vector<Op, 0, uint32_t> &ops() const { return _ops; };
+
+    /// The number of bytes from the start of a value covered by the program. A comparison of fewer bytes must be
+    /// interpreted instead.
+    size_t extent() const { return _extent; };
+
+    bool compare(const unsigned char *lhs, const unsigned char *rhs, ComparisonOptions options) const;
+
+    /// Hashes a value consistently with `compare`, see `LayoutDescriptor::hash`.
+    uint64_t hash(const unsigned char *value, ComparisonOptions options) const;
+
+    /// Compares only the operations overlapping `dirty`, treating every other byte as equal. Data runs are narrowed
+    /// to the dirty lines, any other operation is compared in full.
+    bool compare_dirty(const unsigned char *lhs, const unsigned char *rhs, const DirtyRanges &dirty,
+                       ComparisonOptions options) const;
+};
+
+} // namespace LayoutDescriptor
+} // namespace AG
+
+CF_ASSUME_NONNULL_END
@@ -0,0 +1,292 @@
+#include "ValueKernel.h"
+
+#include <new>
+#include <os/lock.h>
+#include <string.h>
+#include <swift/Runtime/HeapObject.h>
+
+#include "Containers/ConcurrentTable.h"
+#include "Swift/MetadataVisitor.h"
+#include "Swift/Metadata.h"
+#include "Utilities/Heap.h"
+#include "Vector/Vector.h"
+
+namespace AG {
+namespace LayoutDescriptor {
+
+namespace {
+
+/// Collects the offsets of the strong references in a value, failing on anything that can't be copied by copying its
+/// bytes and retaining those references.
+class ReferenceCollector : public swift::metadata_visitor {
+  private:
+    size_t _offset = 0;
+
+    void add(size_t offset, ValueKernel::Reference::Kind kind) {
+        references.push_back({uint32_t(_offset + offset), kind});
+    };
+
+  public:
+    vector<ValueKernel::Reference, 8, uint32_t> references;
+
+    bool visit_element(const swift::metadata &type, const swift::metadata::ref_kind kind, size_t element_offset,
+                       size_t element_size) override {
+        // unowned(unsafe) references are copied as plain pointers
+        if (element_size == 0 || kind == swift::metadata::ref_kind::unmanaged) {
+            return true;
+        }
+        if (kind != swift::metadata::ref_kind::strong) {
+            return false;
+        }
+        if (type.getValueWitnesses()->isPOD()) {
+            return true;
+        }
+
+        switch (type.getKind()) {
+        case ::swift::MetadataKind::Struct:
+        case ::swift::MetadataKind::Tuple: {
+            size_t offset = _offset;
+            _offset += element_offset;
+            bool result = type.visit(*this);
+            _offset = offset;
+            return result;
+        }
+        case ::swift::MetadataKind::Optional: {
+            // Only an optional reference is known to be null when empty, others may keep their tag anywhere
+            auto wrapped = reinterpret_cast<const ::swift::EnumMetadata *>(&type)->getGenericArgs()[0];
+            switch (wrapped->getKind()) {
+            case ::swift::MetadataKind::Class:
+            case ::swift::MetadataKind::ObjCClassWrapper:
+            case ::swift::MetadataKind::ForeignClass:
+                add(element_offset, ValueKernel::Reference::Kind::Unknown);
+                return true;
+            default:
+                return false;
+            }
+        }
+        case ::swift::MetadataKind::Class:
+        case ::swift::MetadataKind::ObjCClassWrapper:
+        case ::swift::MetadataKind::ForeignClass:
+            // Swift classes may inherit from Objective-C ones, so only the runtime can tell how to retain them
+            add(element_offset, ValueKernel::Reference::Kind::Unknown);
+            return true;
+        case ::swift::MetadataKind::Existential: {
+            auto &existential = reinterpret_cast<const swift::existential_type_metadata &>(type);
+            if (existential.representation() != ::swift::ExistentialTypeRepresentation::Class) {
+                return false;
+            }
+            // the object is followed by its witness tables, which aren't retained
+            add(element_offset, ValueKernel::Reference::Kind::Unknown);
+            return true;
+        }
+        case ::swift::MetadataKind::Function: {
+            auto function = reinterpret_cast<const ::swift::FunctionTypeMetadata *>(&type);
+            if (function->getConvention() != ::swift::FunctionMetadataConvention::Swift ||
+                function->isDifferentiable() || element_size != 2 * sizeof(void *)) {
+                return false;
+            }
+            // a thick function is its entry point followed by its context
+            add(element_offset + sizeof(void *), ValueKernel::Reference::Kind::Native);
+            return true;
+        }
+        case ::swift::MetadataKind::Opaque: {
+            // Builtin.NativeObject and Builtin.BridgeObject, see
+            // https://github.com/swiftlang/swift/blob/main/docs/ABI/Mangling.rst
+            static const swift::metadata *native_object = type.mangled_type_name_ref("Bo", true, nullptr);
+            static const swift::metadata *bridge_object = type.mangled_type_name_ref("Bb", true, nullptr);
+            if (&type == native_object) {
+                add(element_offset, ValueKernel::Reference::Kind::Native);
+                return true;
+            }
+            if (&type == bridge_object) {
+                add(element_offset, ValueKernel::Reference::Kind::Bridge);
+                return true;
+            }
+            return false;
+        }
+        default:
+            return false;
+        }
+    };
+};
+
+/// Kernels of the types seen so far, which can be looked up without taking a lock. Kernels are allocated from a heap
+/// owned by the cache and never freed.
+class ValueKernelCache {
+  private:
+    os_unfair_lock _lock;
+    ConcurrentTable<const ValueKernel *> _table;
+    util::Heap _heap;
+
+  public:
+    ValueKernelCache() : _lock(OS_UNFAIR_LOCK_INIT), _table(), _heap(nullptr, 0, util::Heap::minimum_increment) {};
+
+    static ValueKernelCache &shared() {
+        static ValueKernelCache *cache = new ValueKernelCache();
+        return *cache;
+    };
+
+    /// Safe to call without the lock.
+    const ValueKernel *_Nullable lookup(const swift::metadata &type) const {
+        bool found = false;
+        return _table.lookup(&type, &found);
+    };
+
+    /// Returns the kernel already cached for `type` if another thread built one first.
+    const ValueKernel &insert(const swift::metadata &type, ValueKernel::Kind kind,
+                              const vector<ValueKernel::Reference, 8, uint32_t> &references) {
+        os_unfair_lock_lock(&_lock);
+
+        bool found = false;
+        const ValueKernel *result = _table.lookup(&type, &found);
+        if (!found) {
+            ValueKernel::Reference *stored_references = nullptr;
+            if (!references.empty()) {
+                stored_references = _heap.alloc<ValueKernel::Reference>(references.size());
+                memcpy(stored_references, references.data(), references.size() * sizeof(ValueKernel::Reference));
+            }
+            auto kernel = _heap.alloc<ValueKernel>();
+            new (kernel) ValueKernel(type, kind, uint32_t(type.vw_size()), stored_references, references.size());
+            _table.insert(&type, kernel);
+            result = kernel;
+        }
+
+        os_unfair_lock_unlock(&_lock);
+        return *result;
+    };
+};
+
+void retain_references(ValueKernel::Reference::Kind kind, void *_Nullable object, uint32_t count) {
+    switch (kind) {
+    case ValueKernel::Reference::Kind::Native:
+        ::swift::swift_retain_n(static_cast<::swift::HeapObject *>(object), count);
+        break;
+    case ValueKernel::Reference::Kind::Bridge:
+        ::swift::swift_bridgeObjectRetain_n(object, int(count));
+        break;
+    case ValueKernel::Reference::Kind::Unknown:
+        ::swift::swift_unknownObjectRetain_n(object, int(count));
+        break;
+    }
+}
+
+void release_references(ValueKernel::Reference::Kind kind, void *_Nullable object, uint32_t count) {
+    switch (kind) {
+    case ValueKernel::Reference::Kind::Native:
+        ::swift::swift_release_n(static_cast<::swift::HeapObject *>(object), count);
+        break;
+    case ValueKernel::Reference::Kind::Bridge:
+        ::swift::swift_bridgeObjectRelease_n(object, int(count));
+        break;
+    case ValueKernel::Reference::Kind::Unknown:
+        ::swift::swift_unknownObjectRelease_n(object, int(count));
+        break;
+    }
+}
+
+/// Calls `body` once for each run of references at consecutive offsets that point to the same object.
+template <typename Body>
+void for_each_reference_run(const ValueKernel::Reference *references, uint32_t reference_count, const void *value,
+                            Body body) {
+    auto object_at = [value](const ValueKernel::Reference &reference) {
+        return *reinterpret_cast<void *const *>(static_cast<const char *>(value) + reference.offset);
+    };
+
+    uint32_t index = 0;
+    while (index < reference_count) {
+        auto &reference = references[index];
+        void *object = object_at(reference);
+        uint32_t count = 1;
+        while (index + count < reference_count && references[index + count].kind == reference.kind &&
+               object_at(references[index + count]) == object) {
+            count += 1;
+        }
+        body(reference.kind, object, count);
+        index += count;
+    }
+}
+
+} // namespace
+
+const ValueKernel &ValueKernel::fetch(const swift::metadata &type) {
+    auto &cache = ValueKernelCache::shared();
+    if (auto kernel = cache.lookup(type)) {
+        return *kernel;
+    }
+
+    // Built without the lock, since visiting the fields may resolve type names. Threads missing the same type at once
+    // may each build it, but only the first kernel is kept.
+    ReferenceCollector collector;
+    Kind kind;
+    if (type.getValueWitnesses()->isPOD()) {
+        kind = Kind::Trivial;
+    } else if (collector.visit_element(type, swift::metadata::ref_kind::strong, 0, type.vw_size())) {
+        kind = collector.references.empty() ? Kind::Trivial : Kind::References;
+    } else {
+        kind = Kind::ValueWitnesses;
+        collector.references.clear();
+    }
+    return cache.insert(type, kind, collector.references);
+}
+
+void ValueKernel::retain(const void *value) const {
+    for_each_reference_run(_references, _reference_count, value, retain_references);
+}
+
+void ValueKernel::release(const void *value) const {
+    for_each_reference_run(_references, _reference_count, value, release_references);
+}
+
+void ValueKernel::initialize_with_copy(void *dest, const void *src) const {
+    switch (_kind) {
+    case Kind::Trivial:
+        memcpy(dest, src, _size);
+        break;
+    case Kind::References:
+        memcpy(dest, src, _size);
+        retain(dest);
+        break;
+    case Kind::ValueWitnesses:
+        _type->vw_initializeWithCopy(static_cast<swift::opaque_value *>(dest),
+                                     static_cast<swift::opaque_value *>(const_cast<void *>(src)));
+        break;
+    }
+}
+
+void ValueKernel::assign_with_copy(void *dest, const void *src) const {
+    switch (_kind) {
+    case Kind::Trivial:
+        if (dest != src) {
+            memcpy(dest, src, _size);
+        }
+        break;
+    case Kind::References:
+        if (dest != src) {
+            // retained first, in case the old value holds the only references to the new one's objects
+            retain(src);
+            release(dest);
+            memcpy(dest, src, _size);
+        }
+        break;
+    case Kind::ValueWitnesses:
+        _type->vw_assignWithCopy(static_cast<swift::opaque_value *>(dest),
+                                 static_cast<swift::opaque_value *>(const_cast<void *>(src)));
+        break;
+    }
+}
+
+void ValueKernel::destroy(void *value) const {
+    switch (_kind) {
+    case Kind::Trivial:
+        break;
+    case Kind::References:
+        release(value);
+        break;
+    case Kind::ValueWitnesses:
+        _type->vw_destroy(static_cast<swift::opaque_value *>(value));
+        break;
+    }
+}
+
+} // namespace LayoutDescriptor
+} // namespace AG
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <stddef.h>
+#include <stdint.h>
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace AG {
+
+namespace swift {
+class metadata;
+} // namespace swift
+
+namespace LayoutDescriptor {
+
+/// Copies and destroys values of one type without calling its value witnesses.
+///
+/// Values made only of plain data are copied with memcpy. Values made of plain data and strong references are copied
+/// with memcpy too, with their references then retained, or released when destroyed, by calling the runtime directly.
+/// References to the same object at consecutive offsets are retained and released with a single call. Any other
+/// value, e.g. one holding a weak reference, an existential or a multi-payload enum, uses the value witnesses.
+///
+/// Kernels are built from the type's fields the first time they're fetched, then cached for the life of the process.
+class ValueKernel {
+  public:
+    enum class Kind : uint8_t {
+        Trivial,
+        References,
+        ValueWitnesses,
+    };
+
+    struct Reference {
+        enum class Kind : uint32_t {
+            /// A Swift object, possibly null, retained with `swift_retain_n`.
+            Native,
+            /// A `Builtin.BridgeObject`, which is how arrays, dictionaries, sets and strings hold their storage.
+            Bridge,
+            /// A class instance that may be an Objective-C object, possibly null.
+            Unknown,
+        };
+
+        uint32_t offset;
+        Kind kind;
+    };
+
+  private:
+    const swift::metadata *_type;
+    Kind _kind;
+    uint32_t _size;
+    uint32_t _reference_count;
+    const Reference *_Nullable _references;
+
+    void retain(const void *value) const;
+    void release(const void *value) const;
+
+  public:
+    ValueKernel(const swift::metadata &type, Kind kind, uint32_t size, const Reference *_Nullable references,
+                uint32_t reference_count)
+        : _type(&type), _kind(kind), _size(size), _reference_count(reference_count), _references(references){};
+
+    /// Returns the kernel of `type`, building it if this is the first time it's fetched. Safe to call from any
+    /// thread.
+    static const ValueKernel &fetch(const swift::metadata &type);
+
+    const swift::metadata &type() const { return *_type; };
+    Kind kind() const { return _kind; };
+    uint32_t reference_count() const { return _reference_count; };
+
+    void initialize_with_copy(void *dest, const void *src) const;
+    void assign_with_copy(void *dest, const void *src) const;
+    void destroy(void *value) const;
+};
+
+} // namespace LayoutDescriptor
+} // namespace AG
+
+CF_ASSUME_NONNULL_END
@@ -0,0 +1,59 @@
+#include "AGSubgraph.h"
+
+#include "Attribute/AttributeID.h"
+#include "Errors/Errors.h"
+#include "Subgraph.h"
+
+namespace {
+
+AG::Subgraph &subgraph_from_ref(AGSubgraphRef subgraph) {
+    auto result = AG::Subgraph::from_cf(subgraph);
+    if (!result) {
+        AG::precondition_failure("accessing invalidated subgraph");
+    }
+    return *result;
+}
+
+} // namespace
+
+AGSubgraphMemoryStats AGSubgraphGetMemoryStats(AGSubgraphRef subgraph) {
+    auto &stats = subgraph_from_ref(subgraph).stats();
+
+    AGSubgraphMemoryStats result;
+    result.page_count = stats.num_pages.load(std::memory_order_relaxed);
+    result.page_bytes = stats.page_bytes.load(std::memory_order_relaxed);
+    result.free_fragment_count = stats.num_free_fragments.load(std::memory_order_relaxed);
+    result.free_fragment_bytes = stats.free_fragment_bytes.load(std::memory_order_relaxed);
+    result.persistent_buffer_count = stats.num_persistent_buffers.load(std::memory_order_relaxed);
+    result.persistent_bytes = stats.persistent_bytes.load(std::memory_order_relaxed);
+    return result;
+}
+
+void AGSubgraphBeginScratchAllocations(AGSubgraphRef subgraph) {
+    subgraph_from_ref(subgraph).begin_scratch_allocations();
+}
+
+void AGSubgraphEndScratchAllocations(AGSubgraphRef subgraph) { subgraph_from_ref(subgraph).end_scratch_allocations(); }
+
+uint64_t AGSubgraphCompact(AGSubgraphRef subgraph, uint32_t max_fragments) {
+    return subgraph_from_ref(subgraph).compact(max_fragments);
+}
+
+void AGSubgraphAddAttributes(AGSubgraphRef subgraph, uint32_t type_id, const void *bodies, size_t body_stride,
+                             uint32_t count, AGAttribute *attributes) {
+    static_assert(sizeof(AG::data::ptr<AG::Node>) == sizeof(AGAttribute));
+    auto nodes = reinterpret_cast<AG::data::ptr<AG::Node> *>(attributes);
+    subgraph_from_ref(subgraph).add_nodes(type_id, bodies, body_stride, count, nodes);
+    for (uint32_t index = 0; index < count; index++) {
+        attributes[index] = AG::AttributeID(nodes[index]).to_raw_value();
+    }
+}
+
+AGAttribute AGGraphCreateOffsetAttribute(AGAttribute attribute, uint32_t offset, uint64_t size) {
+    auto source = AG::AttributeID::from_raw_value(attribute);
+    if (source.is_nil()) {
+        AG::precondition_failure("invalid attribute: %u", attribute);
+    }
+    auto node = source.subgraph()->add_indirect_node(source, offset, size_t(size));
+    return AG::AttributeID(node).to_raw_value();
+}
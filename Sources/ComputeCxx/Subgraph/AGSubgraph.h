@@ -1,6 +1,10 @@
 #pragma once
 
 #include <CoreFoundation/CFBase.h>
+#include <stdint.h>
+
+#include "AGSwiftSupport.h"
+#include "Attribute/AGAttribute.h"
 
 CF_ASSUME_NONNULL_BEGIN
 
@@ -8,6 +12,64 @@ CF_EXTERN_C_BEGIN
 
 typedef struct CF_BRIDGED_TYPE(id) AGSubgraphStorage *AGSubgraphRef CF_SWIFT_NAME(Subgraph);
 
+// Memory stats
+
+typedef struct AG_SWIFT_NAME(SubgraphMemoryStats) AGSubgraphMemoryStats {
+    uint32_t page_count;
+    uint64_t page_bytes;
+    uint32_t free_fragment_count;
+    uint64_t free_fragment_bytes;
+    uint32_t persistent_buffer_count;
+    uint64_t persistent_bytes;
+} AGSubgraphMemoryStats;
+
+/// Returns the memory held by the subgraph's zone, may be called from any thread. `free_fragment_bytes` counts bytes
+/// within `page_bytes` that have been freed but not yet reused.
+CF_EXPORT
+AGSubgraphMemoryStats AGSubgraphGetMemoryStats(AGSubgraphRef subgraph) CF_SWIFT_NAME(getter:Subgraph.memoryStats(self:));
+
+// Scratch allocations
+
+/// Marks the start of a scope whose allocations in the subgraph's zone are all released by the matching call to
+/// `AGSubgraphEndScratchAllocations`. Scopes may be nested. Weak attributes made inside a scope expire when it ends.
+/// Attributes and tree elements can't be created inside a scope.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGSubgraphBeginScratchAllocations(AGSubgraphRef subgraph);
+
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGSubgraphEndScratchAllocations(AGSubgraphRef subgraph);
+
+// Compaction
+
+/// Merges adjacent free fragments in the subgraph's memory and releases pages that hold nothing else, looking at no
+/// more than `max_fragments` fragments and as many pages so that it can run in idle time. Each call continues with the
+/// pages after those the last call looked at. Returns the number of bytes released.
+CF_EXPORT
+uint64_t AGSubgraphCompact(AGSubgraphRef subgraph, uint32_t max_fragments)
+    CF_SWIFT_NAME(Subgraph.compact(self:maxFragments:));
+
+// Attributes
+
+/// Creates `count` attributes of the attribute type `type_id` at once, with one allocation in the subgraph's zone for
+/// each page of nodes. The body of attribute `i` is copied from `bodies + i * body_stride` and the attribute is stored
+/// in `attributes[i]`. `bodies` may be `NULL` if `count` is 0.
+///
+/// A node is found through the header of the page it starts in, so nodes can't continue past the end of a page and
+/// the attributes are evenly spaced only within each page. They are therefore returned one by one rather than as a
+/// range.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGSubgraphAddAttributes(AGSubgraphRef subgraph, uint32_t type_id, const void *_Nullable bodies,
+                             size_t body_stride, uint32_t count, AGAttribute *_Nullable attributes);
+
+/// Creates an attribute whose value is the `size` bytes at `offset` in the value of `attribute`, without a body of
+/// its own. It is allocated in the subgraph of `attribute`.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+AGAttribute AGGraphCreateOffsetAttribute(AGAttribute attribute, uint32_t offset, uint64_t size);
+
 CF_EXTERN_C_END
 
 CF_ASSUME_NONNULL_END
@@ -0,0 +1,109 @@
+#include "AGTreeElement.h"
+
+#include "Attribute/AttributeID.h"
+#include "Errors/Errors.h"
+#include "Subgraph.h"
+#include "Swift/Metadata.h"
+#include "TreeElement.h"
+
+namespace {
+
+AG::Subgraph &subgraph_from_ref(AGSubgraphRef subgraph) {
+    auto result = AG::Subgraph::from_cf(subgraph);
+    if (!result) {
+        AG::precondition_failure("accessing invalidated subgraph");
+    }
+    return *result;
+}
+
+AG::TreeElement &element_from_ref(AGTreeElement element) {
+    if (element == 0) {
+        AG::precondition_failure("invalid tree element");
+    }
+    return *AG::data::ptr<AG::TreeElement>(element);
+}
+
+AG::TreeValue &value_from_ref(AGTreeValue tree_value) {
+    if (tree_value == 0) {
+        AG::precondition_failure("invalid tree value");
+    }
+    return *AG::data::ptr<AG::TreeValue>(tree_value);
+}
+
+} // namespace
+
+#pragma mark - Building
+
+void AGSubgraphBeginTreeElement(AGSubgraphRef subgraph, AGAttribute value, AGTypeID type, uint32_t flags) {
+    auto metadata = reinterpret_cast<const AG::swift::metadata *>(type);
+    subgraph_from_ref(subgraph).begin_tree_element(AG::AttributeID::from_raw_value(value), *metadata, flags);
+}
+
+void AGSubgraphEndTreeElement(AGSubgraphRef subgraph, AGAttribute value) {
+    subgraph_from_ref(subgraph).end_tree_element(AG::AttributeID::from_raw_value(value));
+}
+
+void AGSubgraphAddTreeValue(AGSubgraphRef subgraph, AGAttribute value, AGTypeID type, const char *key,
+                            uint32_t flags) {
+    auto metadata = reinterpret_cast<const AG::swift::metadata *>(type);
+    subgraph_from_ref(subgraph).add_tree_value(AG::AttributeID::from_raw_value(value), *metadata, key, flags);
+}
+
+AGTreeElement AGSubgraphGetTreeRoot(AGSubgraphRef subgraph) {
+    return subgraph_from_ref(subgraph).tree_root().offset();
+}
+
+#pragma mark - Elements
+
+AGTypeID AGTreeElementGetType(AGTreeElement element) {
+    return reinterpret_cast<AGTypeID>(element_from_ref(element).type);
+}
+
+AGAttribute AGTreeElementGetValue(AGTreeElement element) { return element_from_ref(element).value; }
+
+uint32_t AGTreeElementGetFlags(AGTreeElement element) { return element_from_ref(element).flags; }
+
+AGTreeElement AGTreeElementGetParent(AGTreeElement element) { return element_from_ref(element).parent.offset(); }
+
+AGTreeElement AGTreeElementGetFirstChild(AGTreeElement element) {
+    return element_from_ref(element).first_child.offset();
+}
+
+AGTreeElement AGTreeElementGetNextSibling(AGTreeElement element) {
+    return element_from_ref(element).next_sibling.offset();
+}
+
+AGTreeValue AGTreeElementGetFirstValue(AGTreeElement element) {
+    return element_from_ref(element).first_value.offset();
+}
+
+uint32_t AGTreeElementGetNodeCount(AGTreeElement element) { return element_from_ref(element).nodes.size(); }
+
+AGAttribute AGTreeElementGetNode(AGTreeElement element, uint32_t index) {
+    auto &nodes = element_from_ref(element).nodes;
+    if (index >= nodes.size()) {
+        AG::precondition_failure("invalid node index: %u", index);
+    }
+    return nodes[index].to_raw_value();
+}
+
+void AGTreeElementForEachDescendant(AGTreeElement element, void (*body)(AGTreeElement descendant, const void *context),
+                                    const void *context) {
+    element_from_ref(element);
+    AG::for_each_tree_element(AG::data::ptr<AG::TreeElement>(element),
+                              [&](AG::data::ptr<AG::TreeElement> descendant) { body(descendant.offset(), context); });
+}
+
+#pragma mark - Values
+
+AGTypeID AGTreeValueGetType(AGTreeValue tree_value) {
+    return reinterpret_cast<AGTypeID>(value_from_ref(tree_value).type);
+}
+
+AGAttribute AGTreeValueGetValue(AGTreeValue tree_value) { return value_from_ref(tree_value).value; }
+
+const char *AGTreeValueGetKey(AGTreeValue tree_value) { return value_from_ref(tree_value).key; }
+
+uint32_t AGTreeValueGetFlags(AGTreeValue tree_value) { return value_from_ref(tree_value).flags; }
+
+AGTreeValue AGTreeValueGetNext(AGTreeValue tree_value) { return value_from_ref(tree_value).next.offset(); }
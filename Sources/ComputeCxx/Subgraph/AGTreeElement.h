@@ -0,0 +1,107 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <stdint.h>
+
+#include "AGSubgraph.h"
+#include "AGSwiftSupport.h"
+#include "Attribute/AGAttribute.h"
+#include "Swift/AGType.h"
+
+CF_ASSUME_NONNULL_BEGIN
+
+CF_EXTERN_C_BEGIN
+
+/// An element of a subgraph's attribute tree. Zero means no element.
+typedef uint32_t AGTreeElement AG_SWIFT_STRUCT AG_SWIFT_NAME(TreeElement);
+
+/// A named attribute of a tree element. Zero means no value.
+typedef uint32_t AGTreeValue AG_SWIFT_STRUCT AG_SWIFT_NAME(TreeValue);
+
+// Building
+
+/// Opens a child of the subgraph's open tree element, or the root of its tree if no element is open yet. Attributes
+/// created in the subgraph until the matching `AGSubgraphEndTreeElement` are recorded as the element's nodes.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGSubgraphBeginTreeElement(AGSubgraphRef subgraph, AGAttribute value, AGTypeID type, uint32_t flags);
+
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGSubgraphEndTreeElement(AGSubgraphRef subgraph, AGAttribute value);
+
+/// Adds a value to the subgraph's open tree element. `key` isn't copied and must stay valid as long as the subgraph.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGSubgraphAddTreeValue(AGSubgraphRef subgraph, AGAttribute value, AGTypeID type, const char *key,
+                            uint32_t flags);
+
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+AGTreeElement AGSubgraphGetTreeRoot(AGSubgraphRef subgraph);
+
+// Elements
+
+CF_EXPORT
+AGTypeID AGTreeElementGetType(AGTreeElement element) CF_SWIFT_NAME(getter:TreeElement.type(self:));
+
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+AGAttribute AGTreeElementGetValue(AGTreeElement element);
+
+CF_EXPORT
+uint32_t AGTreeElementGetFlags(AGTreeElement element) CF_SWIFT_NAME(getter:TreeElement.flags(self:));
+
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+AGTreeElement AGTreeElementGetParent(AGTreeElement element);
+
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+AGTreeElement AGTreeElementGetFirstChild(AGTreeElement element);
+
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+AGTreeElement AGTreeElementGetNextSibling(AGTreeElement element);
+
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+AGTreeValue AGTreeElementGetFirstValue(AGTreeElement element);
+
+/// The number of attributes created while the element was open.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+uint32_t AGTreeElementGetNodeCount(AGTreeElement element);
+
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+AGAttribute AGTreeElementGetNode(AGTreeElement element, uint32_t index);
+
+/// Calls `body` with `element` and each of its descendants in preorder, without allocating.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGTreeElementForEachDescendant(AGTreeElement element,
+                                    void (*body)(AGTreeElement descendant, const void *_Nullable context),
+                                    const void *_Nullable context);
+
+// Values
+
+CF_EXPORT
+AGTypeID AGTreeValueGetType(AGTreeValue tree_value) CF_SWIFT_NAME(getter:TreeValue.type(self:));
+
+CF_EXPORT
+AGAttribute AGTreeValueGetValue(AGTreeValue tree_value) CF_SWIFT_NAME(getter:TreeValue.value(self:));
+
+CF_EXPORT
+const char *AGTreeValueGetKey(AGTreeValue tree_value) CF_SWIFT_NAME(getter:TreeValue.key(self:));
+
+CF_EXPORT
+uint32_t AGTreeValueGetFlags(AGTreeValue tree_value) CF_SWIFT_NAME(getter:TreeValue.flags(self:));
+
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+AGTreeValue AGTreeValueGetNext(AGTreeValue tree_value);
+
+CF_EXTERN_C_END
+
+CF_ASSUME_NONNULL_END
@@ -0,0 +1,287 @@
+#include "Subgraph.h"
+
+#include <algorithm>
+
+#include "Attribute/AttributeID.h"
+#include "Attribute/AttributeType.h"
+#include "Attribute/Node/IndirectNode.h"
+#include "Errors/Errors.h"
+#include "Graph/Graph.h"
+#include "Trace/Trace.h"
+#include "TreeElement.h"
+
+struct AGSubgraphStorage {
+    // CFRuntimeBase
+    uintptr_t _cfisa;
+    uint64_t _cfinfoa;
+
+    AG::Subgraph *_Nullable _subgraph;
+};
+
+namespace AG {
+
+Subgraph *Subgraph::from_cf(AGSubgraphStorage *storage) { return storage->_subgraph; }
+
+Subgraph::Subgraph(Graph &graph) : _graph(&graph) { graph.did_create_subgraph(*this); }
+
+Subgraph::~Subgraph() {
+    // the zone only retires its current id, so the ids of open scratch scopes are retired here
+    while (!_scratch_marks.empty()) {
+        end_scratch_allocations();
+    }
+    _graph->will_destroy_subgraph(*this);
+}
+
+#pragma mark - Nodes
+
+size_t Subgraph::trim() {
+    size_t capacity = _nodes.capacity();
+    _nodes.shrink_to_fit();
+    size_t trimmed_size = (capacity - _nodes.capacity()) * sizeof(data::ptr<Node>);
+
+    capacity = _indirect_dependents.capacity();
+    _indirect_dependents.shrink_to_fit();
+    trimmed_size += (capacity - _indirect_dependents.capacity()) * sizeof(IndirectDependent);
+
+    capacity = _scratch_marks.capacity();
+    _scratch_marks.shrink_to_fit();
+    trimmed_size += (capacity - _scratch_marks.capacity()) * sizeof(data::zone::snapshot);
+    return trimmed_size;
+}
+
+uint64_t Subgraph::compact(uint32_t max_fragments) {
+    if (_scratch_marks.size() != 0) {
+        return 0;
+    }
+    return data::zone::compact(max_fragments);
+}
+
+void Subgraph::add_nodes(uint32_t type_id, const void *bodies, size_t body_stride, uint32_t count,
+                         data::ptr<Node> *nodes) {
+    if (!_scratch_marks.empty()) {
+        precondition_failure("attribute created in scratch allocations");
+    }
+
+    const AttributeType &type = _graph->attribute_type(type_id);
+
+    // Nodes are 8-byte aligned, bodies may need more
+    uint32_t alignment_mask = std::max(uint32_t(type.self_metadata().vw_alignment() - 1), uint32_t(7));
+    uint32_t stride = (Node::allocation_size(type, false) + alignment_mask) & ~alignment_mask;
+
+    // AttributeID::page_ptr finds a node's page by masking, so each allocation holds as many nodes as fit in a
+    // single page, and nodes that don't fit get an allocation of their own
+    uint32_t page_capacity = data::page_size - ((sizeof(data::page) + alignment_mask) & ~alignment_mask);
+    uint32_t nodes_per_allocation = std::max(page_capacity / stride, uint32_t(1));
+
+    _nodes.reserve(_nodes.size() + count);
+    for (uint32_t index = 0; index < count;) {
+        uint32_t allocation_count = std::min(count - index, nodes_per_allocation);
+        data::ptr<Node> first = alloc_bytes(stride * allocation_count, alignment_mask);
+        for (uint32_t offset = 0; offset < allocation_count * stride; offset += stride, index++) {
+            data::ptr<Node> node = first + offset;
+            new (node.get()) Node(type, type_id, (const char *)bodies + index * body_stride);
+            did_add_node(node);
+            nodes[index] = node;
+        }
+    }
+}
+
+data::ptr<IndirectNode> Subgraph::add_indirect_node(AttributeID source, uint32_t offset,
+                                                    std::optional<size_t> size) {
+    OffsetAttributeID resolved = source.resolve(AttributeID::TraversalOptions::SkipMutableReference);
+    uint64_t total_offset = uint64_t(resolved.offset()) + offset;
+    if (total_offset > IndirectNode::max_offset) {
+        precondition_failure("invalid offset: %llu", total_offset);
+    }
+    AttributeID attribute = resolved.attribute();
+    if (attribute.is_nil()) {
+        precondition_failure("invalid attribute: %u", source.to_raw_value());
+    }
+
+    auto weak_source = WeakAttributeID(attribute, attribute.subgraph()->info().zone_id());
+    data::ptr<IndirectNode> node = alloc_bytes(sizeof(IndirectNode), 7);
+    new (node.get()) IndirectNode(weak_source, false, uint32_t(total_offset), size);
+    return node;
+}
+
+void Subgraph::did_add_node(data::ptr<Node> node) {
+    // the node list outlives any scratch scope, so it must not hold nodes that a rollback frees
+    if (!_scratch_marks.empty()) {
+        precondition_failure("attribute created in scratch allocations");
+    }
+
+    Trace::record(Trace::EventKind::AttributeCreated, AttributeID(node).to_raw_value(), uint64_t(_graph),
+                  node->type_id());
+    _nodes.push_back(node);
+    if (_tree_current) {
+        _tree_current->nodes.push_back(*this, AttributeID(node));
+    }
+}
+
+void Subgraph::add_indirect_dependent(AttributeID input, data::ptr<Node> node) {
+    _indirect_dependents.push_back({input.to_raw_value(), node});
+}
+
+void Subgraph::remove_indirect_dependent(AttributeID input, data::ptr<Node> node) {
+    for (uint32_t index = 0; index < _indirect_dependents.size(); index++) {
+        auto &dependent = _indirect_dependents[index];
+        if (dependent.input == input.to_raw_value() && dependent.node == node) {
+            dependent = _indirect_dependents.back();
+            _indirect_dependents.pop_back();
+            return;
+        }
+    }
+}
+
+void Subgraph::destroy_nodes() {
+    if (Trace::is_enabled()) {
+        for (data::ptr<Node> node : _nodes) {
+            Trace::record(Trace::EventKind::AttributeInvalidated, AttributeID(node).to_raw_value(), uint64_t(_graph),
+                          node->type_id());
+        }
+    }
+
+    // nodes of other subgraphs mustn't be left with edges into pages that are about to be released
+    for (data::ptr<Node> node : _nodes) {
+        _graph->remove_edges(node, this);
+    }
+    for (auto &dependent : _indirect_dependents) {
+        _graph->remove_inputs(dependent.node, AttributeID::from_raw_value(dependent.input));
+    }
+    _indirect_dependents.clear();
+
+    // group the nodes by type
+    std::sort(_nodes.begin(), _nodes.end(), [](data::ptr<Node> a, data::ptr<Node> b) {
+        return a->type_id() < b->type_id() || (a->type_id() == b->type_id() && a.offset() < b.offset());
+    });
+
+    uint64_t num_values = 0;
+    uint64_t value_bytes = 0;
+    uint32_t begin = 0;
+    while (begin < _nodes.size()) {
+        uint32_t type_id = _nodes[begin]->type_id();
+        uint32_t end = begin + 1;
+        while (end < _nodes.size() && _nodes[end]->type_id() == type_id) {
+            end += 1;
+        }
+
+        if (end < _nodes.size()) {
+            graph().prefetch_attribute_type_record(_nodes[end]->type_id());
+        }
+
+        auto &record = graph().attribute_type_record(type_id);
+        bool destroy_value = record.value_needs_destroy();
+        bool destroy_self = record.self_needs_destroy();
+
+        uint64_t num_type_values = 0;
+        if (destroy_value || destroy_self) {
+            for (uint32_t index = begin; index < end; index++) {
+                if (_nodes[index]->destroy_contents(record.type(), destroy_value, destroy_self)) {
+                    num_type_values += 1;
+                }
+            }
+        } else {
+            // only the accounting is left to do
+            for (uint32_t index = begin; index < end; index++) {
+                if (_nodes[index]->has_value()) {
+                    num_type_values += 1;
+                }
+            }
+        }
+        num_values += num_type_values;
+        value_bytes += num_type_values * record.value_size();
+
+        begin = end;
+    }
+
+    if (num_values) {
+        graph().did_destroy_node_values(num_values, value_bytes);
+    }
+
+    while (!_scratch_marks.empty()) {
+        end_scratch_allocations();
+    }
+
+    // the nodes go away with the pages
+    _nodes.clear();
+    _tree_root = nullptr;
+    _tree_current = nullptr;
+    clear();
+}
+
+#pragma mark - Tree
+
+void Subgraph::begin_tree_element(AttributeID value, const swift::metadata &type, uint32_t flags) {
+    if (!_scratch_marks.empty()) {
+        precondition_failure("tree element in scratch allocations");
+    }
+    if (!_tree_current && _tree_root) {
+        precondition_failure("subgraph already has a tree");
+    }
+
+    data::ptr<TreeElement> element = alloc_bytes<alignof(TreeElement) - 1>(sizeof(TreeElement));
+    new (element.get()) TreeElement{&type, value.to_raw_value(), flags, _tree_current, nullptr, nullptr, nullptr, {}};
+
+    // children are pushed to the front while their parent is open, and put in order when it ends
+    if (_tree_current) {
+        element->next_sibling = _tree_current->first_child;
+        _tree_current->first_child = element;
+    } else {
+        _tree_root = element;
+    }
+    _tree_current = element;
+}
+
+void Subgraph::end_tree_element(AttributeID value) {
+    if (!_tree_current || _tree_current->value != value.to_raw_value()) {
+        precondition_failure("mismatched tree element: %u", value.to_raw_value());
+    }
+
+    data::ptr<TreeElement> element = _tree_current;
+    data::ptr<TreeElement> previous_child = nullptr;
+    for (data::ptr<TreeElement> child = element->first_child; child;) {
+        data::ptr<TreeElement> next = child->next_sibling;
+        child->next_sibling = previous_child;
+        previous_child = child;
+        child = next;
+    }
+    element->first_child = previous_child;
+
+    data::ptr<TreeValue> previous_value = nullptr;
+    for (data::ptr<TreeValue> tree_value = element->first_value; tree_value;) {
+        data::ptr<TreeValue> next = tree_value->next;
+        tree_value->next = previous_value;
+        previous_value = tree_value;
+        tree_value = next;
+    }
+    element->first_value = previous_value;
+
+    _tree_current = element->parent;
+}
+
+void Subgraph::add_tree_value(AttributeID value, const swift::metadata &type, const char *key, uint32_t flags) {
+    if (!_tree_current) {
+        precondition_failure("tree value without an open element");
+    }
+    if (!_scratch_marks.empty()) {
+        precondition_failure("tree value in scratch allocations");
+    }
+
+    data::ptr<TreeValue> tree_value = alloc_bytes<alignof(TreeValue) - 1>(sizeof(TreeValue));
+    new (tree_value.get()) TreeValue{&type, key, value.to_raw_value(), flags, _tree_current->first_value};
+    _tree_current->first_value = tree_value;
+}
+
+#pragma mark - Scratch allocations
+
+void Subgraph::begin_scratch_allocations() { _scratch_marks.push_back(mark()); }
+
+void Subgraph::end_scratch_allocations() {
+    if (_scratch_marks.empty()) {
+        precondition_failure("unbalanced scratch allocations");
+    }
+    rollback(_scratch_marks.back());
+    _scratch_marks.pop_back();
+}
+
+} // namespace AG
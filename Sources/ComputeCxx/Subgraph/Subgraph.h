@@ -1,21 +1,103 @@
 #pragma once
 
 #include <CoreFoundation/CFBase.h>
+#include <optional>
 
+#include "AGSubgraph.h"
+#include "Attribute/Node/Node.h"
 #include "Data/Zone.h"
+#include "Vector/Vector.h"
 
 CF_ASSUME_NONNULL_BEGIN
 
 namespace AG {
 
+class AttributeID;
 class Graph;
+class IndirectNode;
+struct TreeElement;
+
+namespace swift {
+class metadata;
+}
 
 class Subgraph : public data::zone {
   private:
+    struct IndirectDependent {
+        uint32_t input; // the raw value of the indirect attribute
+        data::ptr<Node> node;
+    };
+
     Graph *_graph;
+    vector<data::zone::snapshot, 0, uint32_t> _scratch_marks;
+    vector<data::ptr<Node>, 0, uint32_t> _nodes;
+    vector<IndirectDependent, 0, uint32_t> _indirect_dependents;
+    data::ptr<TreeElement> _tree_root;
+    data::ptr<TreeElement> _tree_current; // the innermost open element
 
   public:
+    static Subgraph *_Nullable from_cf(AGSubgraphStorage *storage);
+
+    explicit Subgraph(Graph &graph);
+    ~Subgraph();
+
     Graph &graph() const { return *_graph; };
+
+    // Nodes
+
+    /// Creates `count` nodes of the attribute type `type_id`, copying the body of node `i` from
+    /// `bodies + i * body_stride` and storing the node in `nodes[i]`. The attribute type is looked up once, and
+    /// nodes share one zone allocation per page.
+    void add_nodes(uint32_t type_id, const void *_Nullable bodies, size_t body_stride, uint32_t count,
+                   data::ptr<Node> *nodes);
+
+    /// Creates an immutable indirect node for the `size` bytes at `offset` in the value of `source`. Offsets into
+    /// other immutable indirect nodes are folded into a single node of the attribute they resolve to.
+    data::ptr<IndirectNode> add_indirect_node(AttributeID source, uint32_t offset, std::optional<size_t> size);
+
+    /// Called once `node` has been allocated in the subgraph. Nodes can't be created while scratch allocations are
+    /// active.
+    void did_add_node(data::ptr<Node> node);
+    uint32_t num_nodes() const { return _nodes.size(); };
+    const vector<data::ptr<Node>, 0, uint32_t> &nodes() const { return _nodes; };
+
+    /// Destroys every node of the subgraph and releases the zone's pages.
+    ///
+    /// Edges to nodes of other subgraphs are first removed from those nodes, while edges within the subgraph go away
+    /// with its pages. Nodes are destroyed a type at a time, so each attribute type is looked up once, and values and
+    /// bodies of trivial types aren't visited at all. The graph's accounting is updated once for the whole subgraph.
+    void destroy_nodes();
+
+    /// Records that `node`, a node of another subgraph, has the indirect attribute `input` of this subgraph as an
+    /// input. Indirect nodes have no outputs, so this is how such edges are found when the subgraph is destroyed.
+    void add_indirect_dependent(AttributeID input, data::ptr<Node> node);
+    void remove_indirect_dependent(AttributeID input, data::ptr<Node> node);
+
+    /// Releases the spare capacity of the subgraph's node lists and returns the number of bytes freed.
+    size_t trim();
+
+    /// Compacts the subgraph's zone, see `zone::compact`, and returns the number of bytes released. Does nothing while
+    /// scratch allocations are active, since rolling them back relies on the zone's pages staying where they are.
+    uint64_t compact(uint32_t max_fragments);
+
+    // Tree
+
+    /// Opens a child of the open element, or the root of the tree if no element is open yet. Attributes created until
+    /// the matching `end_tree_element` are recorded as the element's nodes.
+    void begin_tree_element(AttributeID value, const swift::metadata &type, uint32_t flags);
+    void end_tree_element(AttributeID value);
+
+    /// Adds a value to the open element. `key` isn't copied and must stay valid as long as the subgraph.
+    void add_tree_value(AttributeID value, const swift::metadata &type, const char *key, uint32_t flags);
+
+    data::ptr<TreeElement> tree_root() const { return _tree_root; };
+
+    // Scratch allocations
+
+    /// Opens a scope whose allocations are released by the matching `end_scratch_allocations`. Nodes and tree elements
+    /// must not be created in the scope, since the subgraph keeps track of them beyond it.
+    void begin_scratch_allocations();
+    void end_scratch_allocations();
 };
 
 } // namespace AG
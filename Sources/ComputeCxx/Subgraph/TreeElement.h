@@ -0,0 +1,71 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <stdint.h>
+
+#include "Attribute/AttributeID.h"
+#include "Attribute/Node/Edges.h"
+#include "Data/Pointer.h"
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace AG {
+
+namespace swift {
+class metadata;
+}
+
+struct TreeValue;
+
+/// An element of a subgraph's attribute tree, allocated in the subgraph's zone.
+///
+/// Elements are linked by zone offsets, each to its first child and next sibling, so the whole tree costs 40 bytes
+/// per element and walking it touches nothing else. Elements are allocated as they begin, in preorder, so a walk
+/// mostly moves forward through memory.
+struct TreeElement {
+    const swift::metadata *type;
+    uint32_t value; // raw value of the element's attribute
+    uint32_t flags;
+    data::ptr<TreeElement> parent;
+    data::ptr<TreeElement> first_child;
+    data::ptr<TreeElement> next_sibling;
+    data::ptr<TreeValue> first_value;
+
+    /// The attributes created in the subgraph while the element was open.
+    EdgeList<AttributeID> nodes;
+};
+
+static_assert(sizeof(TreeElement) == 40);
+
+/// A named attribute of a tree element.
+struct TreeValue {
+    const swift::metadata *type;
+    const char *key;
+    uint32_t value; // raw value of the attribute
+    uint32_t flags;
+    data::ptr<TreeValue> next;
+};
+
+/// Calls `body` with `root` and each of its descendants in preorder. The walk follows the elements' links and needs no
+/// stack, so it doesn't allocate.
+template <typename Body> void for_each_tree_element(data::ptr<TreeElement> root, Body body) {
+    data::ptr<TreeElement> element = root;
+    while (element) {
+        body(element);
+        if (element->first_child) {
+            element = element->first_child;
+            continue;
+        }
+        while (element != root && !element->next_sibling) {
+            element = element->parent;
+        }
+        if (element == root) {
+            return;
+        }
+        element = element->next_sibling;
+    }
+}
+
+} // namespace AG
+
+CF_ASSUME_NONNULL_END
@@ -0,0 +1,102 @@
+#include "AGTuple.h"
+
+#include <algorithm>
+#include <alloca.h>
+#include <stdlib.h>
+
+#include "Errors/Errors.h"
+#include "Metadata.h"
+#include "TupleType.h"
+
+namespace {
+
+const AG::swift::tuple_type &tuple_type_for(AGTupleType tuple_type) {
+    return AG::swift::tuple_type::get(*reinterpret_cast<const AG::swift::metadata *>(tuple_type));
+}
+
+const AG::swift::metadata &metadata_for(AGTypeID type) { return *reinterpret_cast<const AG::swift::metadata *>(type); }
+
+/// Buffers up to this size are allocated on the stack by AGTupleWithBuffer.
+constexpr size_t max_stack_buffer_size = 0x1000;
+
+} // namespace
+
+AGTupleType AGNewTupleType(size_t count, const AGTypeID *elements) {
+    auto types = reinterpret_cast<const AG::swift::metadata *const *>(elements);
+    return reinterpret_cast<AGTupleType>(&AG::swift::tuple_type::make(count, types));
+}
+
+size_t AGTupleCount(AGTupleType tuple_type) { return tuple_type_for(tuple_type).count(); }
+
+size_t AGTupleSize(AGTupleType tuple_type) { return tuple_type_for(tuple_type).size(); }
+
+size_t AGTupleStride(AGTupleType tuple_type) { return tuple_type_for(tuple_type).stride(); }
+
+size_t AGTupleAlignment(AGTupleType tuple_type) { return tuple_type_for(tuple_type).alignment_mask() + 1; }
+
+AGTypeID AGTupleElementType(AGTupleType tuple_type, size_t index) {
+    return reinterpret_cast<AGTypeID>(tuple_type_for(tuple_type).element_at(index).type);
+}
+
+size_t AGTupleElementSize(AGTupleType tuple_type, size_t index) {
+    return tuple_type_for(tuple_type).element_at(index).size;
+}
+
+size_t AGTupleElementOffset(AGTupleType tuple_type, size_t index) {
+    return tuple_type_for(tuple_type).element_at(index).offset;
+}
+
+size_t AGTupleElementOffsetChecked(AGTupleType tuple_type, size_t index, AGTypeID element_type) {
+    return tuple_type_for(tuple_type).element_at(index, metadata_for(element_type)).offset;
+}
+
+void *AGTupleSetElement(AGTupleType tuple_type, void *tuple_value, size_t index, const void *element_value,
+                        AGTypeID element_type, AGTupleCopyOptions options) {
+    auto &type = tuple_type_for(tuple_type);
+    type.set_element(tuple_value, index, element_value, metadata_for(element_type),
+                     AG::swift::tuple_type::copy_options(options));
+    return (char *)tuple_value + type.element_at(index).offset;
+}
+
+void *AGTupleGetElement(AGTupleType tuple_type, void *tuple_value, size_t index, void *element_value,
+                        AGTypeID element_type, AGTupleCopyOptions options) {
+    auto &type = tuple_type_for(tuple_type);
+    type.get_element(tuple_value, index, element_value, metadata_for(element_type),
+                     AG::swift::tuple_type::copy_options(options));
+    return (char *)tuple_value + type.element_at(index).offset;
+}
+
+void AGTupleDestroy(AGTupleType tuple_type, void *tuple_value) { tuple_type_for(tuple_type).destroy(tuple_value, 1); }
+
+void AGTupleDestroyElement(AGTupleType tuple_type, void *tuple_value, size_t index) {
+    tuple_type_for(tuple_type).destroy_element(tuple_value, index);
+}
+
+void AGTupleCopyBuffer(AGTupleType tuple_type, void *destination, void *source, size_t count,
+                       AGTupleCopyOptions options) {
+    tuple_type_for(tuple_type).copy(destination, source, count, AG::swift::tuple_type::copy_options(options));
+}
+
+void AGTupleDestroyBuffer(AGTupleType tuple_type, void *tuple_values, size_t count) {
+    tuple_type_for(tuple_type).destroy(tuple_values, count);
+}
+
+void AGTupleWithBuffer(AGTupleType tuple_type, size_t count, void (*body)(AGUnsafeMutableTuple tuple, void *context),
+                       void *context) {
+    auto &type = tuple_type_for(tuple_type);
+    size_t size = type.stride() * count;
+    size_t alignment = std::max(type.alignment_mask() + 1, sizeof(void *));
+    if (size <= max_stack_buffer_size) {
+        void *buffer = alloca(size + alignment - 1);
+        buffer = (void *)(((uintptr_t)buffer + alignment - 1) & ~(alignment - 1));
+        body({tuple_type, buffer}, context);
+        return;
+    }
+
+    void *buffer = nullptr;
+    if (posix_memalign(&buffer, alignment, size) != 0) {
+        AG::precondition_failure("memory allocation failure");
+    }
+    body({tuple_type, buffer}, context);
+    free(buffer);
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "AGSwiftSupport.h"
+#include "AGType.h"
+
+CF_ASSUME_NONNULL_BEGIN
+CF_IMPLICIT_BRIDGING_ENABLED
+
+CF_EXTERN_C_BEGIN
+
+/// The metadata of a tuple type, or of any other type as a tuple of one element.
+typedef const struct AGSwiftMetadata *AGTupleType AG_SWIFT_STRUCT AG_SWIFT_NAME(TupleType);
+
+typedef CF_OPTIONS(uint32_t, AGTupleCopyOptions) {
+    AGTupleCopyOptionsNone = 0,
+
+    /// The destination is uninitialized, otherwise its old value is replaced.
+    AGTupleCopyOptionsInitialize = 1 << 0,
+
+    /// The source is left uninitialized, otherwise it is copied.
+    AGTupleCopyOptionsTake = 1 << 1,
+} CF_SWIFT_NAME(TupleType.CopyOptions);
+
+typedef struct AG_SWIFT_NAME(UnsafeTuple) AGUnsafeTuple {
+    AGTupleType type;
+    const void *value;
+} AGUnsafeTuple;
+
+typedef struct AG_SWIFT_NAME(UnsafeMutableTuple) AGUnsafeMutableTuple {
+    AGTupleType type;
+    void *value;
+} AGUnsafeMutableTuple;
+
+/// The tuple of `count` elements, or the element itself if `count` is 1.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+AGTupleType AGNewTupleType(size_t count, const AGTypeID _Nonnull *_Nonnull elements);
+
+CF_EXPORT
+size_t AGTupleCount(AGTupleType tuple_type) CF_SWIFT_NAME(getter:TupleType.count(self:));
+
+CF_EXPORT
+size_t AGTupleSize(AGTupleType tuple_type) CF_SWIFT_NAME(getter:TupleType.size(self:));
+
+CF_EXPORT
+size_t AGTupleStride(AGTupleType tuple_type) CF_SWIFT_NAME(getter:TupleType.stride(self:));
+
+CF_EXPORT
+size_t AGTupleAlignment(AGTupleType tuple_type) CF_SWIFT_NAME(getter:TupleType.alignment(self:));
+
+CF_EXPORT
+AGTypeID AGTupleElementType(AGTupleType tuple_type, size_t index) CF_SWIFT_NAME(TupleType.elementType(self:at:));
+
+CF_EXPORT
+size_t AGTupleElementSize(AGTupleType tuple_type, size_t index) CF_SWIFT_NAME(TupleType.elementSize(self:at:));
+
+CF_EXPORT
+size_t AGTupleElementOffset(AGTupleType tuple_type, size_t index) CF_SWIFT_NAME(TupleType.elementOffset(self:at:));
+
+/// Fails a precondition unless the element at `index` is of type `element_type`.
+CF_EXPORT
+size_t AGTupleElementOffsetChecked(AGTupleType tuple_type, size_t index, AGTypeID element_type)
+    CF_SWIFT_NAME(TupleType.elementOffset(self:at:type:));
+
+/// Copies `element_value` into the element at `index` of `tuple_value` and returns the element's address.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void *AGTupleSetElement(AGTupleType tuple_type, void *tuple_value, size_t index, const void *element_value,
+                        AGTypeID element_type, AGTupleCopyOptions options);
+
+/// Copies the element at `index` of `tuple_value` into `element_value` and returns the element's address.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void *AGTupleGetElement(AGTupleType tuple_type, void *tuple_value, size_t index, void *element_value,
+                        AGTypeID element_type, AGTupleCopyOptions options);
+
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGTupleDestroy(AGTupleType tuple_type, void *tuple_value);
+
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGTupleDestroyElement(AGTupleType tuple_type, void *tuple_value, size_t index);
+
+/// Copies `count` consecutive tuples, with a single memmove for tuples of POD elements.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGTupleCopyBuffer(AGTupleType tuple_type, void *destination, void *source, size_t count,
+                       AGTupleCopyOptions options);
+
+/// Destroys `count` consecutive tuples. Does nothing for tuples of POD elements.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGTupleDestroyBuffer(AGTupleType tuple_type, void *tuple_values, size_t count);
+
+/// Calls `body` with uninitialized storage for `count` consecutive tuples, on the stack if it is small enough. `body`
+/// must leave the storage uninitialized.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGTupleWithBuffer(AGTupleType tuple_type, size_t count,
+                       void (*body)(AGUnsafeMutableTuple tuple, void *_Nullable context), void *_Nullable context);
+
+CF_EXTERN_C_END
+
+CF_IMPLICIT_BRIDGING_DISABLED
+CF_ASSUME_NONNULL_END
@@ -5,6 +5,7 @@
 #include "ContextDescriptor.h"
 #include "Metadata.h"
 #include "MetadataVisitor.h"
+#include "Vector/Vector.h"
 
 CFStringRef AGTypeDescription(AGTypeID typeID) {
     auto type = reinterpret_cast<const AG::swift::metadata *>(typeID);
@@ -54,6 +55,26 @@ const AGTypeSignature AGTypeGetSignature(AGTypeID typeID) {
     return signature;
 }
 
+void AGTypeGetSignatures(const AGTypeID *typeIDs, size_t count, AGTypeSignature *signatures) {
+    auto types = reinterpret_cast<const AG::swift::metadata *const *>(typeIDs);
+
+    auto data = AG::vector<const void *, 64, uint64_t>();
+    data.reserve(count);
+    AG::swift::metadata::signatures(types, count, data.data());
+
+    for (size_t i = 0; i < count; i++) {
+        signatures[i] = AGTypeSignature();
+        if (data.data()[i]) {
+            memcpy(signatures[i].data, data.data()[i], sizeof(signatures[i].data));
+        }
+    }
+}
+
+AGTypeNameCacheStats AGTypeGetNameCacheStats() {
+    auto stats = AG::swift::metadata::mangled_type_name_cache_stats();
+    return {stats.entry_count, stats.hits, stats.misses, stats.shared_misses};
+}
+
 const void *AGTypeGetDescriptor(AGTypeID typeID) {
     auto type = reinterpret_cast<const AG::swift::metadata *>(typeID);
     return type->descriptor();
@@ -87,13 +108,9 @@ void AGTypeApplyFields(AGTypeID typeID,
             : _body(body), _context(context) {}
 
         bool unknown_result() const override { return true; }
-        bool visit_field(const AG::swift::metadata &type, const AG::swift::field_record &field, size_t field_offset,
-                         size_t field_size) const override {
-            auto mangled_name = field.MangledTypeName.get();
-            auto field_type = type.mangled_type_name_ref(mangled_name, true, nullptr);
-            if (field_type) {
-                auto field_name = field.FieldName.get();
-                _body(field_name, field_offset, AGTypeID(field_type), _context);
+        bool visit_field(const AG::swift::metadata &type, const AG::swift::field_table::field &field) override {
+            if (field.type) {
+                _body(field.name, field.offset, AGTypeID(field.type), _context);
             }
             return true;
         }
@@ -121,27 +138,20 @@ bool AGTypeApplyFields2(AGTypeID typeID, AGTypeApplyOptions options,
             : _options(options), _body(body), _context(context) {}
 
         bool unknown_result() const override { return _options & 2; }
-        bool visit_field(const AG::swift::metadata &type, const AG::swift::field_record &field, size_t field_offset,
-                         size_t field_size) const override {
-            auto mangled_name = field.MangledTypeName.get();
-            auto field_type = type.mangled_type_name_ref(mangled_name, true, nullptr);
-            if (!field_type) {
+        bool visit_field(const AG::swift::metadata &type, const AG::swift::field_table::field &field) override {
+            if (!field.type) {
                 return unknown_result();
             }
-            auto field_name = field.FieldName.get();
-            _body(field_name, field_offset, AGTypeID(field_type), _context);
-            return field_name != nullptr;
+            _body(field.name, field.offset, AGTypeID(field.type), _context);
+            return field.name != nullptr;
         }
-        bool visit_case(const AG::swift::metadata &type, const AG::swift::field_record &field,
-                        uint32_t index) const override {
-            auto mangled_name = field.MangledTypeName.get();
-            auto field_type = type.mangled_type_name_ref(mangled_name, true, nullptr);
-            if (!field_type) {
+        bool visit_case(const AG::swift::metadata &type, const AG::swift::field_table::field &field,
+                        uint32_t index) override {
+            if (!field.type) {
                 return unknown_result();
             }
-            auto field_name = field.FieldName.get();
-            _body(field_name, index, AGTypeID(field_type), _context);
-            return field_name != nullptr;
+            _body(field.name, index, AGTypeID(field.type), _context);
+            return field.name != nullptr;
         }
     };
 
@@ -40,6 +40,11 @@ CF_EXPORT
 CF_REFINED_FOR_SWIFT
 const AGTypeSignature AGTypeGetSignature(AGTypeID typeID) CF_SWIFT_NAME(getter:Metadata.signature(self:));
 
+/// Writes the signatures of `count` types to `signatures`, locating the images of all the types with one query.
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+void AGTypeGetSignatures(const AGTypeID *typeIDs, size_t count, AGTypeSignature *signatures);
+
 CF_EXPORT
 CF_REFINED_FOR_SWIFT
 const void *_Nullable AGTypeGetDescriptor(AGTypeID typeID) CF_SWIFT_NAME(getter:Metadata.descriptor(self:));
@@ -53,6 +58,21 @@ CF_REFINED_FOR_SWIFT
 const char *_Nullable AGTypeNominalDescriptorName(AGTypeID typeID)
     CF_SWIFT_NAME(getter:Metadata.nominalDescriptorName(self:));
 
+/// Counters for the cache of types named by mangled field type names, which is consulted for every field visited while
+/// building layouts.
+typedef struct AG_SWIFT_NAME(NameCacheStats) AGTypeNameCacheStats {
+    uint64_t entry_count;
+    uint64_t hits;
+    uint64_t misses;
+
+    /// Misses that waited for another thread resolving the same name instead of resolving it again.
+    uint64_t shared_misses;
+} AGTypeNameCacheStats;
+
+CF_EXPORT
+CF_REFINED_FOR_SWIFT
+AGTypeNameCacheStats AGTypeGetNameCacheStats(void) CF_SWIFT_NAME(getter:Metadata.nameCacheStats());
+
 typedef CF_OPTIONS(uint32_t, AGTypeApplyOptions) {
     AGTypeApplyOptionsNone = 0,
     AGTypeApplyOptionsHeapClasses = 1 << 0,
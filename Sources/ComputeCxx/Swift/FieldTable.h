@@ -0,0 +1,62 @@
+#pragma once
+
+// needed by swift/RemoteInspection/Records.h
+#include <cassert>
+#include <type_traits>
+
+#include <CoreFoundation/CFBase.h>
+#include <swift/RemoteInspection/Records.h>
+
+#include "Metadata.h"
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace AG {
+namespace swift {
+
+using field_record = ::swift::reflection::FieldRecord;
+
+/// The fields of a type with their offsets and resolved types, flattened into one array the first time the type is
+/// visited so that later visits don't read the field descriptors or demangle type names again.
+///
+/// A struct or class table lists the stored properties declared by the type itself, an enum table lists its cases and
+/// a heap local variable table lists its captures. A field whose type couldn't be resolved is kept with a null type,
+/// so visitors still see it in the same position.
+class field_table {
+  public:
+    struct field {
+        /// Null for captures, which have no field record.
+        const field_record *_Nullable record;
+        const char *_Nullable name;
+
+        /// Zero for enum cases.
+        size_t offset;
+
+        /// The distance to the next field, or -1 if unknown. Zero for enum cases.
+        size_t size;
+
+        const metadata *_Nullable type;
+        metadata::ref_kind kind;
+    };
+
+  private:
+    uint32_t _count;
+    field _fields[];
+
+  public:
+    static size_t allocation_size(uint32_t count) { return sizeof(field_table) + count * sizeof(field); };
+
+    field_table(uint32_t count) : _count(count){};
+
+    uint32_t count() const { return _count; };
+
+    field *begin() { return _fields; };
+    field *end() { return _fields + _count; };
+    const field *begin() const { return _fields; };
+    const field *end() const { return _fields + _count; };
+};
+
+} // namespace swift
+} // namespace AG
+
+CF_ASSUME_NONNULL_END
@@ -3,14 +3,20 @@
 #include <CommonCrypto/CommonDigest.h>
 #include <CoreFoundation/CFString.h>
 #include <SwiftEquatableSupport.h>
+#include <algorithm>
+#include <bit>
+#include <dispatch/dispatch.h>
 #include <swift/Runtime/Casting.h>
 #include <swift/Runtime/ExistentialContainer.h>
 #include <swift/Runtime/HeapObject.h>
 
 #include "ContextDescriptor.h"
+#include "Containers/ConcurrentTable.h"
 #include "Errors/Errors.h"
+#include "FieldTable.h"
 #include "MetadataVisitor.h"
 #include "Swift/mach-o/dyld.h"
+#include "Utilities/ConcurrentHeap.h"
 #include "Utilities/HashTable.h"
 #include "Utilities/Heap.h"
 #include "_SwiftStdlibCxxOverlay.h"
@@ -172,42 +178,58 @@ void metadata::append_description(CFMutableStringRef description) const {
 
 namespace {
 
+/// Signatures of the types seen so far, which can be looked up without taking a lock. Types without any nominal type
+/// descriptor have no signature, which is cached as a null entry. Signatures are allocated from a heap owned by the
+/// cache and never freed.
 class TypeSignatureCache {
+  public:
+    struct Signature {
+        unsigned char bytes[CC_SHA1_DIGEST_LENGTH];
+    };
+
   private:
     os_unfair_lock _lock;
-    util::Table<const metadata *, const unsigned char *> _table;
+    ConcurrentTable<const Signature *> _table;
+    util::Heap _heap;
 
   public:
-    TypeSignatureCache() : _lock(OS_UNFAIR_LOCK_INIT), _table() {};
+    TypeSignatureCache() : _lock(OS_UNFAIR_LOCK_INIT), _table(), _heap(nullptr, 0, util::Heap::minimum_increment) {};
+
+    static TypeSignatureCache &shared() {
+        static TypeSignatureCache *cache = new TypeSignatureCache();
+        return *cache;
+    };
 
     void lock() { os_unfair_lock_lock(&_lock); };
     void unlock() { os_unfair_lock_unlock(&_lock); };
 
-    const unsigned char *lookup(const metadata *type, const metadata **_Nullable found) {
-        return _table.lookup(type, found);
-    }
-
-    bool insert(const metadata *type, const unsigned char *signature) { return _table.insert(type, signature); }
-};
-
-} // namespace
+    /// Safe to call without the lock.
+    const Signature *_Nullable lookup(const metadata *type, bool *found) const { return _table.lookup(type, found); }
 
-const void *metadata::signature() const {
-    static TypeSignatureCache *cache = new TypeSignatureCache();
+    /// Must be called with the lock held. Returns the signature already cached for `type` if there is one.
+    const Signature *_Nullable insert(const metadata *type, const unsigned char *_Nullable digest) {
+        bool found = false;
+        auto existing = _table.lookup(type, &found);
+        if (found) {
+            return existing;
+        }
 
-    const metadata *found = nullptr;
-    cache->lock();
-    const unsigned char *signature = cache->lookup(this, &found);
-    cache->unlock();
-    if (found) {
+        Signature *signature = nullptr;
+        if (digest) {
+            signature = _heap.alloc<Signature>();
+            memcpy(signature->bytes, digest, sizeof(signature->bytes));
+        }
+        _table.insert(type, signature);
         return signature;
     }
+};
 
+/// Appends the descriptors of a type and of all its generic arguments, which together identify the type.
+void append_signature_descriptors(const metadata &type, vector<const context_descriptor *, 8, uint64_t> &descriptors) {
     auto metadata_queue = vector<const metadata *, 8, uint64_t>();
     auto generic_args = vector<context_descriptor::generic_arg, 8, uint64_t>();
-    auto descriptors = vector<const context_descriptor *, 8, uint64_t>();
 
-    metadata_queue.push_back(this);
+    metadata_queue.push_back(&type);
 
     while (metadata_queue.size() > 0) {
         auto metadata = metadata_queue.back();
@@ -221,43 +243,103 @@ const void *metadata::signature() const {
             descriptor->push_generic_args(*metadata, generic_args);
         }
         for (auto generic_arg : generic_args) {
-            for (int i = 0; i < generic_arg.num_types; i++) {
-                metadata_queue.push_back(&generic_arg.types[i]);
+            if (generic_arg.is_pack) {
+                // A pack argument points to the pack's array of metadata pointers
+                auto pack = reinterpret_cast<const metadata *const *>(generic_arg.types);
+                for (uint64_t i = 0; i < generic_arg.num_types; i++) {
+                    metadata_queue.push_back(pack[i]);
+                }
+            } else {
+                metadata_queue.push_back(generic_arg.types);
             }
         }
     }
+}
 
-    if (descriptors.size()) {
-        auto context = CC_SHA1_CTX();
-        CC_SHA1_Init(&context);
+} // namespace
 
-        const char prefix[] = "AGTypeSignature";
-        CC_SHA1_Update(&context, prefix, sizeof(prefix));
+const void *metadata::signature() const {
+    bool found = false;
+    auto signature = TypeSignatureCache::shared().lookup(this, &found);
+    if (found) {
+        return signature;
+    }
 
-        auto infos = vector<dyld_image_uuid_offset, 8, uint64_t>();
-        infos.reserve(descriptors.size());
+    const metadata *type = this;
+    const void *result = nullptr;
+    signatures(&type, 1, &result);
+    return result;
+}
 
-        dyld_images_for_addresses((unsigned)descriptors.size(), static_cast<const void *[]>(descriptors.data()),
-                                  infos.data());
+void metadata::signatures(const metadata *const *types, size_t count, const void *_Nullable *signatures) {
+    auto &cache = TypeSignatureCache::shared();
 
-        for (auto info : infos) {
-            CC_SHA1_Update(&context, info.uuid, sizeof(((dyld_image_uuid_offset *)0)->uuid));
-            CC_SHA1_Update(&context, &info.offsetInImage, sizeof(((dyld_image_uuid_offset *)0)->offsetInImage));
+    auto missing = vector<size_t, 8, uint64_t>();
+    for (size_t i = 0; i < count; i++) {
+        bool found = false;
+        signatures[i] = cache.lookup(types[i], &found);
+        if (!found) {
+            missing.push_back(i);
         }
+    }
+    if (missing.empty()) {
+        return;
+    }
 
-        auto digest = new unsigned char[CC_SHA1_DIGEST_LENGTH];
-        CC_SHA1_Final(digest, &context);
+    // Signatures are computed with the lock held, so that threads missing the same type at once compute it only once.
+    // Computing one is cheap next to dyld's own locking, so this doesn't serialize much that could run in parallel.
+    cache.lock();
 
-        signature = digest;
-    } else {
-        signature = nullptr;
+    auto descriptors = vector<const context_descriptor *, 8, uint64_t>();
+    auto descriptor_ends = vector<uint64_t, 8, uint64_t>();
+    auto computed = vector<size_t, 8, uint64_t>();
+    for (size_t i : missing) {
+        bool found = false;
+        signatures[i] = cache.lookup(types[i], &found);
+        if (found) {
+            continue;
+        }
+        append_signature_descriptors(*types[i], descriptors);
+        descriptor_ends.push_back(descriptors.size());
+        computed.push_back(i);
+    }
+
+    // Locate the images of every descriptor with one query rather than one per type
+    auto infos = vector<dyld_image_uuid_offset, 8, uint64_t>();
+    if (descriptors.size()) {
+        infos.reserve(descriptors.size());
+        dyld_images_for_addresses((unsigned)descriptors.size(), static_cast<const void *[]>(descriptors.data()),
+                                  infos.data());
     }
 
-    cache->lock();
-    cache->insert(this, signature);
-    cache->unlock();
+    uint64_t start = 0;
+    for (size_t j = 0; j < computed.size(); j++) {
+        uint64_t end = descriptor_ends[j];
+
+        const unsigned char *digest = nullptr;
+        unsigned char digest_buffer[CC_SHA1_DIGEST_LENGTH];
+        if (end > start) {
+            auto context = CC_SHA1_CTX();
+            CC_SHA1_Init(&context);
 
-    return signature;
+            const char prefix[] = "AGTypeSignature";
+            CC_SHA1_Update(&context, prefix, sizeof(prefix));
+
+            for (uint64_t k = start; k < end; k++) {
+                auto &info = infos.data()[k];
+                CC_SHA1_Update(&context, info.uuid, sizeof(((dyld_image_uuid_offset *)0)->uuid));
+                CC_SHA1_Update(&context, &info.offsetInImage, sizeof(((dyld_image_uuid_offset *)0)->offsetInImage));
+            }
+
+            CC_SHA1_Final(digest_buffer, &context);
+            digest = digest_buffer;
+        }
+
+        signatures[computed[j]] = cache.insert(types[computed[j]], digest);
+        start = end;
+    }
+
+    cache.unlock();
 }
 
 const equatable_witness_table *metadata::equatable() const {
@@ -295,6 +377,14 @@ const equatable_witness_table *metadata::equatable() const {
     }
 }
 
+bool metadata::has_in_place_enum_payloads() const {
+    auto context = descriptor();
+    if (!context || !::swift::EnumDescriptor::classof(context)) {
+        return false;
+    }
+    return reinterpret_cast<const ::swift::EnumDescriptor *>(context)->getNumPayloadCases() <= 1;
+}
+
 #pragma mark Mutating objects
 
 void metadata::copy_on_write_heap_object(void **object_ref) const {
@@ -400,50 +490,131 @@ const metadata *metadata::mangled_type_name_ref(const char *type_name, bool faul
 
 namespace {
 
+/// The types named by mangled names, keyed by the metadata the name is resolved in and by the address of the name.
+///
+/// The cache is split into shards by key, each with its own lock, so that threads resolving different names rarely
+/// contend. A name that is being resolved has an entry marked as building, and threads needing the same name wait
+/// for it instead of demangling it again.
 class TypeCache {
   public:
     using key_info = std::pair<const metadata *, const char *>;
-    using value_info = std::pair<const metadata *, metadata::ref_kind>;
+
+    struct Entry {
+        const metadata *_Nullable type;
+        metadata::ref_kind kind;
+        bool building;
+
+        /// Created once a second thread waits for the entry to be built.
+        dispatch_group_t _Nullable done;
+    };
 
   private:
-    os_unfair_lock _lock;
-    util::Heap _heap;
-    char _heap_buffer[4096];
-    util::Table<const key_info *, const value_info *> _table;
+    static constexpr size_t shard_count = 16;
+
+    struct Shard {
+        os_unfair_lock lock;
+        util::Heap heap;
+        char heap_buffer[1024];
+        util::Table<const key_info *, Entry *> table;
+
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t shared_misses = 0;
+
+        Shard()
+            : lock(OS_UNFAIR_LOCK_INIT), heap(heap_buffer, sizeof(heap_buffer), 0),
+              table([](const key_info *key) -> uint64_t { return hash(*key); },
+                    [](const key_info *a, const key_info *b) -> bool {
+                        if (a->first != b->first) {
+                            return false;
+                        }
+                        return a->second == b->second;
+                    },
+                    nullptr, nullptr, &heap) {};
+    };
 
-  public:
-    TypeCache()
-        : _lock(OS_UNFAIR_LOCK_INIT), _heap(_heap_buffer, 4096, 0),
-          _table([](const key_info *key) -> uint64_t { return uintptr_t(key->first) * 0x21 ^ uintptr_t(key->second); },
-                 [](const key_info *a, const key_info *b) -> bool {
-                     if (a->first != b->first) {
-                         return false;
-                     }
-                     return a->second == b->second;
-                 },
-                 nullptr, nullptr, &_heap) {};
+    Shard _shards[shard_count];
 
-    void lock() { os_unfair_lock_lock(&_lock); };
-    void unlock() { os_unfair_lock_unlock(&_lock); };
+    static uint64_t hash(const key_info &key) { return uintptr_t(key.first) * 0x21 ^ uintptr_t(key.second); };
 
-    const value_info *lookup(const key_info *type, const key_info **_Nullable found) {
-        return _table.lookup(type, found);
-    }
+    // The tables use the low bits of the hash, so shards are picked by the high bits of a remix of it
+    Shard &shard(const key_info &key) {
+        return _shards[(hash(key) * 0x9e3779b97f4a7c15) >> (64 - std::countr_zero(shard_count))];
+    };
+
+  public:
+    static TypeCache &shared() {
+        static TypeCache *cache = new TypeCache();
+        return *cache;
+    };
 
-    bool insert(const key_info *key, const value_info *value) { return _table.insert(key, value); };
+    const metadata *_Nullable resolve(const metadata &type, const char *type_name,
+                                      metadata::ref_kind *_Nullable kind_out) {
+        key_info lookup_key = {&type, type_name};
+        Shard &shard = this->shard(lookup_key);
+
+        os_unfair_lock_lock(&shard.lock);
+        Entry *entry = shard.table.lookup(&lookup_key, nullptr);
+        if (entry && !entry->building) {
+            shard.hits += 1;
+            os_unfair_lock_unlock(&shard.lock);
+        } else if (entry) {
+            // Another thread is demangling the name, wait for its result
+            shard.shared_misses += 1;
+            if (!entry->done) {
+                entry->done = dispatch_group_create();
+                dispatch_group_enter(entry->done);
+            }
+            dispatch_group_t done = entry->done;
+            dispatch_retain(done);
+            os_unfair_lock_unlock(&shard.lock);
+
+            // The entry is complete once the group has been left
+            dispatch_group_wait(done, DISPATCH_TIME_FOREVER);
+            dispatch_release(done);
+        } else {
+            shard.misses += 1;
+            auto key = shard.heap.alloc<key_info>();
+            *key = lookup_key;
+            entry = shard.heap.alloc<Entry>();
+            *entry = {nullptr, metadata::ref_kind::strong, true, nullptr};
+            shard.table.insert(key, entry);
+            os_unfair_lock_unlock(&shard.lock);
+
+            metadata::ref_kind kind = metadata::ref_kind::strong;
+            const metadata *result = type.mangled_type_name_ref(type_name, true, &kind);
+
+            os_unfair_lock_lock(&shard.lock);
+            entry->type = result;
+            entry->kind = kind;
+            entry->building = false;
+            dispatch_group_t done = entry->done;
+            entry->done = nullptr;
+            os_unfair_lock_unlock(&shard.lock);
+
+            if (done) {
+                dispatch_group_leave(done);
+                dispatch_release(done);
+            }
+        }
 
-    key_info *create_key(const metadata *type, const char *type_name) {
-        auto key = _heap.alloc<key_info>();
-        key->first = type;
-        key->second = type_name;
-        return key;
+        if (kind_out) {
+            *kind_out = entry->kind;
+        }
+        return entry->type;
     };
 
-    value_info *create_value(const metadata *type, metadata::ref_kind ref_kind) {
-        auto value = _heap.alloc<value_info>();
-        value->first = type;
-        value->second = ref_kind;
-        return value;
+    metadata::name_cache_stats stats() {
+        metadata::name_cache_stats stats = {};
+        for (auto &shard : _shards) {
+            os_unfair_lock_lock(&shard.lock);
+            stats.entry_count += shard.table.count();
+            stats.hits += shard.hits;
+            stats.misses += shard.misses;
+            stats.shared_misses += shard.shared_misses;
+            os_unfair_lock_unlock(&shard.lock);
+        }
+        return stats;
     };
 };
 
@@ -453,34 +624,229 @@ const metadata *metadata::mangled_type_name_ref_cached(const char *type_name, re
     if (!type_name) {
         return nullptr;
     }
+    return TypeCache::shared().resolve(*this, type_name, kind_out);
+}
 
-    static TypeCache *cache = new TypeCache();
+metadata::name_cache_stats metadata::mangled_type_name_cache_stats() { return TypeCache::shared().stats(); }
 
-    cache->lock();
-    TypeCache::key_info lookup_key = {this, type_name};
-    auto result = cache->lookup(&lookup_key, nullptr);
-    cache->unlock();
+#pragma mark Visiting
 
-    if (!result) {
-        ref_kind kind;
-        const metadata *type = mangled_type_name_ref(type_name, true, &kind);
+namespace {
+
+using field_vector = vector<field_table::field, 16, uint32_t>;
 
-        cache->lock();
-        auto key = cache->create_key(this, type_name);
-        auto value = cache->create_value(type, kind);
-        cache->insert(key, value);
-        cache->unlock();
+field_table::field make_field(const metadata &type, const field_record &record, size_t offset, size_t size) {
+    metadata::ref_kind kind = metadata::ref_kind::strong;
+    const char *mangled_name = record.MangledTypeName ? record.MangledTypeName.get() : nullptr;
+    const metadata *field_type = mangled_name ? type.mangled_type_name_ref(mangled_name, false, &kind) : nullptr;
+    return {&record, record.FieldName.get(), offset, size, field_type, kind};
+}
 
-        result = value;
+bool collect_struct_fields(const metadata &type, field_vector &fields) {
+    auto struct_type = reinterpret_cast<const ::swift::StructMetadata *>(&type);
+    auto context = type.descriptor();
+    if (!context || !::swift::StructDescriptor::classof(context)) {
+        return false;
+    }
+    auto struct_context = reinterpret_cast<const ::swift::StructDescriptor *>(context);
+    if (!struct_context->Fields || !struct_context->hasFieldOffsetVector()) {
+        return false;
     }
 
-    if (kind_out) {
-        *kind_out = result->second;
+    auto field_offsets = struct_type->getFieldOffsets();
+    unsigned index = 0;
+    for (auto &field : struct_context->Fields->getFields()) {
+        size_t offset = field_offsets[index];
+        size_t end_offset = index + 1 < struct_context->NumFields ? field_offsets[index + 1] : type.vw_size();
+        size_t field_size = offset <= end_offset ? end_offset - offset : -1;
+        fields.push_back(make_field(type, field, offset, field_size));
+        index += 1;
     }
-    return result->first;
+    return true;
 }
 
-#pragma mark Visiting
+bool collect_enum_cases(const metadata &type, field_vector &fields) {
+    auto context = type.descriptor();
+    if (!context || !::swift::EnumDescriptor::classof(context)) {
+        return false;
+    }
+    auto enum_context = reinterpret_cast<const ::swift::EnumDescriptor *>(context);
+    if (!enum_context->Fields || enum_context->getNumPayloadCases() == 0) {
+        return false;
+    }
+
+    for (auto &field : enum_context->Fields->getFields()) {
+        fields.push_back(make_field(type, field, 0, 0));
+    }
+    return true;
+}
+
+/// Collects the fields declared by the class itself, not those of its superclasses.
+bool collect_class_fields(const metadata &type, field_vector &fields) {
+    auto class_type = reinterpret_cast<const ::swift::ClassMetadata *>(&type);
+    auto context = type.descriptor();
+    if (!context) {
+        return false;
+    }
+    auto class_context = reinterpret_cast<const ::swift::ClassDescriptor *>(context);
+
+    auto field_descriptor = class_context->Fields ? class_context->Fields.get() : nullptr;
+    if (!field_descriptor || !field_descriptor->NumFields) {
+        return true;
+    }
+    if (field_descriptor->NumFields != class_context->NumFields) {
+        return false;
+    }
+
+    auto ivar_offsets = vector<size_t, 16, uint32_t>();
+    const size_t *field_offsets = nullptr;
+    size_t last_end_offset = type.vw_size();
+    if ((class_type->Flags & ::swift::ClassFlags::UsesSwiftRefcounting) == 0) {
+        unsigned int ivar_count;
+        Ivar *ivar_list = class_copyIvarList(reinterpret_cast<const Class>((void *)&type), &ivar_count);
+        if (ivar_list) {
+            if (ivar_count == field_descriptor->NumFields) {
+                for (unsigned int ivar_index = 0; ivar_index < ivar_count; ++ivar_index) {
+                    ivar_offsets.push_back(ivar_getOffset(ivar_list[ivar_index]));
+                }
+            }
+            free(ivar_list);
+        }
+        if (ivar_offsets.size() == 0 || ivar_offsets[0] == 0) {
+            return false;
+        }
+        field_offsets = ivar_offsets.data();
+        last_end_offset = -1;
+    } else {
+        if (!class_context->hasFieldOffsetVector()) {
+            return false;
+        }
+        auto offset = reinterpret_cast<const class_type_descriptor *>(class_context)->field_offset_vector_offset();
+        auto asWords = reinterpret_cast<const size_t *const *>(&type);
+        field_offsets = reinterpret_cast<const size_t *>(asWords + offset);
+    }
+
+    unsigned index = 0;
+    for (auto &field : field_descriptor->getFields()) {
+        size_t offset = field_offsets[index];
+        size_t end_offset = index + 1 < field_descriptor->NumFields ? field_offsets[index + 1] : last_end_offset;
+        size_t field_size = offset <= end_offset ? end_offset - offset : -1;
+        fields.push_back(make_field(type, field, offset, field_size));
+        index += 1;
+    }
+    return true;
+}
+
+/// Collects the captures up to and including the first one whose type can't be resolved, since the offsets of the
+/// later ones depend on it.
+bool collect_captures(const metadata &type, field_vector &fields) {
+    auto local_type = reinterpret_cast<const ::swift::HeapLocalVariableMetadata *>(&type);
+    if (!local_type->CaptureDescription || local_type->CaptureDescription[1] != '\0' ||
+        local_type->OffsetToFirstCapture == 0) {
+        return false;
+    }
+
+    auto descriptor = reinterpret_cast<const ::swift::reflection::CaptureDescriptor *>(local_type->CaptureDescription);
+
+    size_t offset = local_type->OffsetToFirstCapture;
+    for (auto capture_type_record = descriptor->capture_begin(), end = descriptor->capture_end();
+         capture_type_record != end; ++capture_type_record) {
+        const char *mangled_name = nullptr;
+        if (capture_type_record->hasMangledTypeName()) {
+            mangled_name = capture_type_record->getMangledTypeName().data();
+        }
+        metadata::ref_kind kind = metadata::ref_kind::strong;
+        const metadata *element_type = type.mangled_type_name_ref(mangled_name, true, &kind);
+        if (!element_type) {
+            fields.push_back({nullptr, nullptr, offset, size_t(-1), nullptr, kind});
+            break;
+        }
+
+        size_t size = element_type->vw_size();
+        size_t alignment_mask = element_type->getValueWitnesses()->getAlignmentMask();
+        offset = (offset + alignment_mask) & ~alignment_mask;
+        fields.push_back({nullptr, nullptr, offset, size, element_type, kind});
+        offset += size;
+    }
+    return true;
+}
+
+bool collect_fields(const metadata &type, field_vector &fields) {
+    switch (type.getKind()) {
+    case ::swift::MetadataKind::Class:
+        return collect_class_fields(type, fields);
+    case ::swift::MetadataKind::Struct:
+        return collect_struct_fields(type, fields);
+    case ::swift::MetadataKind::Enum:
+    case ::swift::MetadataKind::Optional:
+        return collect_enum_cases(type, fields);
+    case ::swift::MetadataKind::HeapLocalVariable:
+        return collect_captures(type, fields);
+    default:
+        return false;
+    }
+}
+
+/// Field tables of the types visited so far, which can be looked up without taking a lock. Types whose fields can't
+/// be listed are cached as null entries. Tables are collected and copied into a heap owned by the cache without the
+/// lock, which is only taken to publish them. Tables are never freed, including those of threads that lose a race to
+/// publish.
+class FieldTableCache {
+  private:
+    os_unfair_lock _lock;
+    ConcurrentTable<const field_table *> _table;
+    util::ConcurrentHeap _heap;
+
+  public:
+    FieldTableCache() : _lock(OS_UNFAIR_LOCK_INIT), _table(), _heap(0) {};
+
+    static FieldTableCache &shared() {
+        static FieldTableCache *cache = new FieldTableCache();
+        return *cache;
+    };
+
+    const field_table *_Nullable lookup(const metadata *type, bool *found) const { return _table.lookup(type, found); }
+
+    /// Returns the table already cached for `type` if another thread got there first.
+    const field_table *_Nullable insert(const metadata *type, const field_vector *_Nullable fields) {
+        field_table *new_table = nullptr;
+        if (fields) {
+            uint32_t count = fields->size();
+            static_assert(alignof(field_table) <= alignof(uint64_t));
+            size_t words = (field_table::allocation_size(count) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+            new_table = new (_heap.alloc<uint64_t>(words)) field_table(count);
+            std::copy(fields->data(), fields->data() + count, new_table->begin());
+        }
+
+        os_unfair_lock_lock(&_lock);
+
+        bool found = false;
+        auto table = _table.lookup(type, &found);
+        if (!found) {
+            table = new_table;
+            _table.insert(type, table);
+        }
+
+        os_unfair_lock_unlock(&_lock);
+        return table;
+    };
+};
+
+} // namespace
+
+const field_table *_Nullable metadata::fields() const {
+    auto &cache = FieldTableCache::shared();
+
+    bool found = false;
+    auto table = cache.lookup(this, &found);
+    if (found) {
+        return table;
+    }
+
+    auto fields = field_vector();
+    bool known = collect_fields(*this, fields);
+    return cache.insert(this, known ? &fields : nullptr);
+}
 
 bool metadata::visit(metadata_visitor &visitor) const {
     switch (getKind()) {
@@ -488,50 +854,31 @@ bool metadata::visit(metadata_visitor &visitor) const {
         return visitor.visit_class(reinterpret_cast<const any_class_type_metadata &>(*this));
     }
     case ::swift::MetadataKind::Struct: {
-        auto struct_type = reinterpret_cast<const ::swift::StructMetadata *>(this);
-        auto context = descriptor();
-        if (context && ::swift::StructDescriptor::classof(context)) {
-            auto struct_context = reinterpret_cast<const ::swift::StructDescriptor *>(context);
-            if (struct_context->Fields && struct_context->hasFieldOffsetVector()) {
-                auto field_offsets = struct_type->getFieldOffsets();
-                unsigned index = 0;
-                for (auto &field : struct_context->Fields->getFields()) {
-                    size_t offset = field_offsets[index];
-                    size_t end_offset = index + 1 < struct_context->NumFields ? field_offsets[index + 1] : vw_size();
-                    size_t field_size = offset <= end_offset ? end_offset - offset : -1;
-                    if (!visitor.visit_field(*this, field, offset, field_size)) {
-                        return false;
-                    }
-                    index += 1;
-                }
-                return true;
+        auto table = fields();
+        if (!table) {
+            return visitor.unknown_result();
+        }
+        for (auto &field : *table) {
+            if (!visitor.visit_field(*this, field)) {
+                return false;
             }
         }
-        return visitor.unknown_result();
+        return true;
     }
     case ::swift::MetadataKind::Enum:
     case ::swift::MetadataKind::Optional: {
-        auto enum_type = reinterpret_cast<const ::swift::EnumMetadata *>(this);
-        auto context = descriptor();
-        if (context && ::swift::EnumDescriptor::classof(context)) {
-            auto enum_context = reinterpret_cast<const ::swift::EnumDescriptor *>(context);
-            if (enum_context->Fields) {
-                if (enum_context->getNumPayloadCases() != 0) {
-                    if (enum_context->Fields->NumFields == 0) {
-                        return true;
-                    }
-                    unsigned index = 0;
-                    for (auto &field : enum_context->Fields->getFields()) {
-                        if (!visitor.visit_case(*this, field, index)) {
-                            return false;
-                        }
-                        index += 1;
-                    }
-                    return true;
-                }
+        auto table = fields();
+        if (!table) {
+            return visitor.unknown_result();
+        }
+        uint32_t index = 0;
+        for (auto &field : *table) {
+            if (!visitor.visit_case(*this, field, index)) {
+                return false;
             }
+            index += 1;
         }
-        return visitor.unknown_result();
+        return true;
     }
     case ::swift::MetadataKind::Opaque: {
         // Builtin.NativeObject, see https://github.com/swiftlang/swift/blob/main/docs/ABI/Mangling.rst
@@ -627,94 +974,25 @@ bool metadata::visit_heap_class(metadata_visitor &visitor) const {
         }
     }
 
-    if (!class_context->Fields) {
-        return true;
-    }
-
-    auto fields = class_context->Fields.get();
-    if (!fields) {
-        return true;
-    }
-
-    if (!fields->NumFields) {
-        return true;
-    }
-
-    if (fields->NumFields != class_context->NumFields) {
+    auto table = fields();
+    if (!table) {
         return visitor.unknown_result();
     }
-
-    if ((class_type->Flags & ::swift::ClassFlags::UsesSwiftRefcounting) == 0) {
-        size_t *ivar_offsets = nullptr; // TODO: use new
-
-        unsigned int ivar_count;
-        Ivar *ivar_list = class_copyIvarList(reinterpret_cast<const Class>((void *)this), &ivar_count);
-        if (ivar_list) {
-            if (ivar_count == fields->NumFields) {
-                ivar_offsets = (size_t *)calloc(ivar_count, sizeof(size_t)); // or bzero?
-                for (unsigned int ivar_index = 0; ivar_index < ivar_count; ++ivar_index) {
-                    ivar_offsets[ivar_index] = ivar_getOffset(ivar_list[ivar_index]);
-                }
-            }
-            free(ivar_list);
-        }
-
-        if (ivar_offsets && *ivar_offsets != 0) {
-            unsigned index = 0;
-            for (auto &field : fields->getFields()) {
-                size_t offset = ivar_offsets[index];
-                size_t end_offset = index + 1 < fields->NumFields ? ivar_offsets[index + 1] : -1;
-                size_t field_size = offset <= end_offset ? end_offset - offset : -1;
-                if (!visitor.visit_field(*this, field, offset, field_size)) {
-                    if (ivar_offsets) {
-                        free(ivar_offsets);
-                    }
-                    return false;
-                }
-                index += 1;
-            }
-            if (ivar_offsets) {
-                free(ivar_offsets);
-            }
-            return true;
-        }
-
-        if (ivar_offsets) {
-            free(ivar_offsets);
-        }
-        return visitor.unknown_result();
-    } else {
-        if (class_context->hasFieldOffsetVector()) {
-            const size_t *field_offsets = nullptr;
-            auto offset = reinterpret_cast<const class_type_descriptor *>(class_context)->field_offset_vector_offset();
-            auto asWords = reinterpret_cast<const size_t *const *>(this);
-            field_offsets = reinterpret_cast<const size_t *>(asWords + offset);
-
-            unsigned index = 0;
-            for (auto &field : class_context->Fields->getFields()) {
-                size_t offset = field_offsets[index];
-                size_t end_offset = index + 1 < class_context->NumFields ? field_offsets[index + 1] : vw_size();
-                size_t field_size = offset <= end_offset ? end_offset - offset : -1;
-                if (!visitor.visit_field(*this, field, offset, field_size)) {
-                    return false;
-                }
-                index += 1;
-            }
-            return true;
+    for (auto &field : *table) {
+        if (!visitor.visit_field(*this, field)) {
+            return false;
         }
-        return visitor.unknown_result();
     }
-
-    return visitor.unknown_result();
+    return true;
 }
 
 bool metadata::visit_heap_locals(metadata_visitor &visitor) const {
-    auto local_type = reinterpret_cast<const ::swift::HeapLocalVariableMetadata *>(this);
-    if (!local_type->CaptureDescription || local_type->CaptureDescription[1] != '\0' ||
-        local_type->OffsetToFirstCapture == 0) {
+    auto table = fields();
+    if (!table) {
         return visitor.unknown_result();
     }
 
+    auto local_type = reinterpret_cast<const ::swift::HeapLocalVariableMetadata *>(this);
     auto descriptor = reinterpret_cast<const ::swift::reflection::CaptureDescriptor *>(local_type->CaptureDescription);
 
     if (descriptor->NumBindings) {
@@ -730,28 +1008,13 @@ bool metadata::visit_heap_locals(metadata_visitor &visitor) const {
         }
     }
 
-    size_t offset = local_type->OffsetToFirstCapture;
-    for (auto capture_type_record = descriptor->capture_begin(), end = descriptor->capture_end();
-         capture_type_record != end; ++capture_type_record) {
-        const char *mangled_name = nullptr;
-        if (capture_type_record->hasMangledTypeName()) {
-            mangled_name = capture_type_record->getMangledTypeName().data();
-        }
-        metadata::ref_kind kind = metadata::ref_kind::strong;
-        const metadata *element_type = mangled_type_name_ref(mangled_name, true, &kind);
-        if (!element_type) {
+    for (auto &capture : *table) {
+        if (!capture.type) {
             return visitor.unknown_result();
         }
-
-        size_t size = element_type->vw_size();
-        size_t alignment_mask = element_type->getValueWitnesses()->getAlignmentMask();
-        size_t offset = (offset + alignment_mask) & ~alignment_mask;
-
-        if (!visitor.visit_element(*element_type, kind, offset, size)) {
+        if (!visitor.visit_element(*capture.type, capture.kind, capture.offset, capture.size)) {
             return false;
         }
-
-        offset += size;
     }
 
     return true;
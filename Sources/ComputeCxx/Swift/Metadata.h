@@ -13,6 +13,7 @@ using opaque_value = ::swift::OpaqueValue;
 using equatable_witness_table = ::swift::equatable_support::EquatableWitnessTable;
 
 class metadata_visitor;
+class field_table;
 class context_descriptor;
 class type_context_descriptor;
 
@@ -43,8 +44,18 @@ class metadata : public ::swift::Metadata {
     void append_description(CFMutableStringRef description) const;
     const void *signature() const;
 
+    /// Looks up the signatures of `count` types at once. The images of the types that don't have a signature yet are
+    /// located with a single query, rather than one per type.
+    static void signatures(const metadata *const _Nonnull *_Nonnull types, size_t count,
+                           const void *_Nullable *_Nonnull signatures);
+
     const equatable_witness_table *_Nullable equatable() const;
 
+    /// Whether this is an enum whose payloads are stored unchanged at the start of its values, so that they can be
+    /// read without projecting them first. True for enums with at most one payload case, whose tag is kept in extra
+    /// inhabitants or extra tag bytes rather than in spare bits of the payload.
+    bool has_in_place_enum_payloads() const;
+
     // Mutating objects
 
     void copy_on_write_heap_object(void *_Nonnull *_Nonnull object_ref) const;
@@ -62,6 +73,16 @@ class metadata : public ::swift::Metadata {
                                                     ref_kind *_Nullable kind_out) const;
     const metadata *_Nullable mangled_type_name_ref_cached(const char *type_name, ref_kind *_Nullable kind_out) const;
 
+    struct name_cache_stats {
+        uint64_t entry_count;
+        uint64_t hits;
+        uint64_t misses;
+
+        /// Misses that waited for another thread resolving the same name instead of resolving it again.
+        uint64_t shared_misses;
+    };
+    static name_cache_stats mangled_type_name_cache_stats();
+
     // Visiting
 
     enum visit_options {
@@ -72,6 +93,10 @@ class metadata : public ::swift::Metadata {
         heap_class_and_generic_locals = heap_class | heap_generic_locals,
     };
 
+    /// The fields of a struct or class, the cases of an enum or the captures of a heap local variable, built once and
+    /// cached. Null if they can't be listed.
+    const field_table *_Nullable fields() const;
+
     bool visit(metadata_visitor &visitor) const;
     bool visit_heap(metadata_visitor &visitor, visit_options options) const;
     bool visit_heap_class(metadata_visitor &visitor) const;
@@ -0,0 +1,189 @@
+#include "TupleType.h"
+
+#include <os/lock.h>
+#include <string.h>
+
+#include "Containers/ConcurrentTable.h"
+#include "Errors/Errors.h"
+#include "Utilities/ConcurrentHeap.h"
+
+namespace AG {
+namespace swift {
+
+namespace {
+
+opaque_value *opaque(void *value) { return reinterpret_cast<opaque_value *>(value); }
+
+/// Copies a single value of `type`, with a plain memcpy where the value witnesses would do no more than that.
+void copy_value(const metadata &type, void *destination, void *source, size_t size, bool is_pod,
+                bool is_bitwise_takable, tuple_type::copy_options options) {
+    bool initialize = options & tuple_type::initialize;
+    bool take = options & tuple_type::take;
+    if (is_pod || (initialize && take && is_bitwise_takable)) {
+        memcpy(destination, source, size);
+        return;
+    }
+    if (initialize) {
+        if (take) {
+            type.vw_initializeWithTake(opaque(destination), opaque(source));
+        } else {
+            type.vw_initializeWithCopy(opaque(destination), opaque(source));
+        }
+    } else {
+        if (take) {
+            type.vw_assignWithTake(opaque(destination), opaque(source));
+        } else {
+            type.vw_assignWithCopy(opaque(destination), opaque(source));
+        }
+    }
+}
+
+} // namespace
+
+/// Tuple tables of the types seen so far, which can be looked up without taking a lock. Tables are built and copied
+/// into a heap owned by the cache without the lock, which is only taken to publish them. Tables are never freed,
+/// including those of threads that lose a race to publish.
+class TupleTypeCache {
+  private:
+    os_unfair_lock _lock;
+    ConcurrentTable<const tuple_type *> _table;
+    util::ConcurrentHeap _heap;
+
+  public:
+    TupleTypeCache() : _lock(OS_UNFAIR_LOCK_INIT), _table(), _heap(0) {};
+
+    static TupleTypeCache &shared() {
+        static TupleTypeCache *cache = new TupleTypeCache();
+        return *cache;
+    };
+
+    const tuple_type *_Nullable lookup(const metadata &type) const {
+        bool found = false;
+        return _table.lookup(&type, &found);
+    };
+
+    const tuple_type &insert(const metadata &type) {
+        uint32_t count = 1;
+        if (auto tuple_metadata = llvm::dyn_cast<::swift::TupleTypeMetadata>(&type)) {
+            count = tuple_metadata->NumElements;
+        }
+        static_assert(alignof(tuple_type) <= alignof(uint64_t));
+        size_t words = (tuple_type::allocation_size(count) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+        auto new_type = new (_heap.alloc<uint64_t>(words)) tuple_type(type, count);
+
+        os_unfair_lock_lock(&_lock);
+
+        bool found = false;
+        auto result = _table.lookup(&type, &found);
+        if (!found) {
+            result = new_type;
+            _table.insert(&type, result);
+        }
+
+        os_unfair_lock_unlock(&_lock);
+        return *result;
+    };
+};
+
+#pragma mark - Tuple type
+
+tuple_type::tuple_type(const metadata &type, uint32_t count)
+    : _type(&type), _size(type.vw_size()), _stride(type.vw_stride()),
+      _alignment_mask(type.getValueWitnesses()->getAlignmentMask()), _count(count),
+      _is_pod(type.getValueWitnesses()->isPOD()) {
+    auto tuple_metadata = llvm::dyn_cast<::swift::TupleTypeMetadata>(&type);
+    if (!tuple_metadata) {
+        _elements[0] = {&type, 0, _size, _is_pod, type.getValueWitnesses()->isBitwiseTakable()};
+        return;
+    }
+    for (uint32_t index = 0; index < count; index++) {
+        const auto &tuple_element = tuple_metadata->getElement(index);
+        auto element_type = static_cast<const metadata *>(tuple_element.Type);
+        _elements[index] = {element_type, tuple_element.Offset, element_type->vw_size(),
+                            element_type->getValueWitnesses()->isPOD(),
+                            element_type->getValueWitnesses()->isBitwiseTakable()};
+    }
+}
+
+const tuple_type &tuple_type::get(const metadata &type) {
+    auto &cache = TupleTypeCache::shared();
+    if (auto result = cache.lookup(type)) {
+        return *result;
+    }
+    return cache.insert(type);
+}
+
+const metadata &tuple_type::make(size_t count, const metadata *const *elements) {
+    if (count == 1) {
+        return *elements[0];
+    }
+    auto response = ::swift::swift_getTupleTypeMetadata(
+        ::swift::MetadataRequest(::swift::MetadataState::Complete), ::swift::TupleTypeFlags().withNumElements(count),
+        reinterpret_cast<const ::swift::Metadata *const *>(elements), nullptr, nullptr);
+    if (response.State != ::swift::MetadataState::Complete) {
+        precondition_failure("invalid tuple type");
+    }
+    return *static_cast<const metadata *>(response.Value);
+}
+
+const tuple_type::element &tuple_type::element_at(size_t index) const {
+    if (index >= _count) {
+        precondition_failure("index out of range: %zu", index);
+    }
+    return _elements[index];
+}
+
+const tuple_type::element &tuple_type::element_at(size_t index, const metadata &element_type) const {
+    const element &result = element_at(index);
+    if (result.type != &element_type) {
+        precondition_failure("element type mismatch: %zu", index);
+    }
+    return result;
+}
+
+#pragma mark - Copying
+
+void tuple_type::set_element(void *tuple, size_t index, const void *value, const metadata &element_type,
+                             copy_options options) const {
+    const element &element = element_at(index, element_type);
+    copy_value(element_type, (char *)tuple + element.offset, const_cast<void *>(value), element.size, element.is_pod,
+               element.is_bitwise_takable, options);
+}
+
+void tuple_type::get_element(void *tuple, size_t index, void *value, const metadata &element_type,
+                             copy_options options) const {
+    const element &element = element_at(index, element_type);
+    copy_value(element_type, value, (char *)tuple + element.offset, element.size, element.is_pod,
+               element.is_bitwise_takable, options);
+}
+
+void tuple_type::destroy_element(void *tuple, size_t index) const {
+    const element &element = element_at(index);
+    if (!element.is_pod) {
+        element.type->vw_destroy(opaque((char *)tuple + element.offset));
+    }
+}
+
+void tuple_type::copy(void *destination, void *source, size_t count, copy_options options) const {
+    if (_is_pod) {
+        memmove(destination, source, count * _stride);
+        return;
+    }
+    bool is_bitwise_takable = _type->getValueWitnesses()->isBitwiseTakable();
+    for (size_t index = 0; index < count; index++) {
+        copy_value(*_type, (char *)destination + index * _stride, (char *)source + index * _stride, _size, false,
+                   is_bitwise_takable, options);
+    }
+}
+
+void tuple_type::destroy(void *tuples, size_t count) const {
+    if (_is_pod) {
+        return;
+    }
+    for (size_t index = 0; index < count; index++) {
+        _type->vw_destroy(opaque((char *)tuples + index * _stride));
+    }
+}
+
+} // namespace swift
+} // namespace AG
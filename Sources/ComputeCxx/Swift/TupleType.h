@@ -0,0 +1,90 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Metadata.h"
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace AG {
+namespace swift {
+
+/// The elements of a tuple type with their offsets, sizes and value witness flags, read from the tuple metadata once
+/// and cached, so that accessing an element costs an index into a flat array.
+///
+/// A type that isn't a tuple is treated as a tuple of that single element, so a single value can be passed wherever a
+/// tuple is expected.
+class tuple_type {
+  public:
+    enum copy_options : uint32_t {
+        /// The destination is uninitialized, otherwise its old value is replaced.
+        initialize = 1 << 0,
+
+        /// The source is left uninitialized, otherwise it is copied.
+        take = 1 << 1,
+    };
+
+    struct element {
+        const metadata *type;
+        size_t offset;
+        size_t size;
+        bool is_pod;
+        bool is_bitwise_takable;
+    };
+
+  private:
+    const metadata *_type;
+    size_t _size;
+    size_t _stride;
+    size_t _alignment_mask;
+    uint32_t _count;
+    bool _is_pod;
+    element _elements[];
+
+    tuple_type(const metadata &type, uint32_t count);
+
+    static size_t allocation_size(uint32_t count) { return sizeof(tuple_type) + count * sizeof(element); };
+
+    friend class TupleTypeCache;
+
+  public:
+    /// Returns the cached table of `type`. Safe to call from any thread.
+    static const tuple_type &get(const metadata &type);
+
+    /// Returns the metadata of the tuple of `elements`, or the element itself if there is exactly one.
+    static const metadata &make(size_t count, const metadata *_Nonnull const *_Nonnull elements);
+
+    const metadata &type() const { return *_type; };
+    size_t size() const { return _size; };
+    size_t stride() const { return _stride; };
+    size_t alignment_mask() const { return _alignment_mask; };
+    uint32_t count() const { return _count; };
+    bool is_pod() const { return _is_pod; };
+
+    /// Fails a precondition if `index` is out of range.
+    const element &element_at(size_t index) const;
+
+    /// Fails a precondition if `index` is out of range or the element isn't of type `element_type`.
+    const element &element_at(size_t index, const metadata &element_type) const;
+
+    /// Copies between `value`, an element of type `element_type`, and the element at `index` of `tuple`.
+    void set_element(void *tuple, size_t index, const void *value, const metadata &element_type,
+                     copy_options options) const;
+    void get_element(void *tuple, size_t index, void *value, const metadata &element_type,
+                     copy_options options) const;
+
+    void destroy_element(void *tuple, size_t index) const;
+
+    /// Copies `count` consecutive tuples from `source` to `destination`, a single copy for tuples of POD elements.
+    void copy(void *destination, void *source, size_t count, copy_options options) const;
+
+    /// Destroys `count` consecutive tuples. Does nothing for tuples of POD elements.
+    void destroy(void *tuples, size_t count) const;
+};
+
+} // namespace swift
+} // namespace AG
+
+CF_ASSUME_NONNULL_END
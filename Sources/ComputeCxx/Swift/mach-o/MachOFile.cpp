@@ -21,6 +21,23 @@ bool MachOFile::getUuid(uuid_t uuid) const {
     return found;
 }
 
+void MachOFile::forEachSegment(void (^callback)(const char *name, uint64_t vmAddr, uint64_t vmSize,
+                                                bool &stop)) const {
+    forEachLoadCommand(^(const load_command *cmd, bool &stop) {
+      if (cmd->cmd == LC_SEGMENT_64) {
+          const segment_command_64 *seg = (const segment_command_64 *)cmd;
+          if (seg->vmsize != 0 && seg->initprot != 0) { // skips __PAGEZERO
+              callback(seg->segname, seg->vmaddr, seg->vmsize, stop);
+          }
+      } else if (cmd->cmd == LC_SEGMENT) {
+          const segment_command *seg = (const segment_command *)cmd;
+          if (seg->vmsize != 0 && seg->initprot != 0) {
+              callback(seg->segname, seg->vmaddr, seg->vmsize, stop);
+          }
+      }
+    });
+}
+
 bool MachOFile::hasMachOBigEndianMagic() const { return magic == MH_CIGAM || magic == MH_CIGAM_64; };
 
 void MachOFile::forEachLoadCommand(/* Diagnostics& diag, */ void (^callback)(const load_command *cmd, bool &stop)) const {
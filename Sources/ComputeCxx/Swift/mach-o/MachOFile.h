@@ -9,6 +9,9 @@ struct MachOFile : mach_header {
     bool hasMachOMagic() const;
     bool getUuid(uuid_t uuid) const;
 
+    // Calls `callback` with the unslid address range of each segment that occupies memory
+    void forEachSegment(void (^callback)(const char *name, uint64_t vmAddr, uint64_t vmSize, bool &stop)) const;
+
   protected:
     bool hasMachOBigEndianMagic() const;
     void forEachLoadCommand(/* Diagnostics &diag, */ void (^callback)(const load_command *cmd, bool &stop)) const;
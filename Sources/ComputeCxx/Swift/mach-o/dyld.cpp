@@ -1,10 +1,14 @@
 #include "dyld.h"
 
-#include <dlfcn.h>
+#include <algorithm>
+#include <cstring>
+#include <dispatch/dispatch.h>
 #include <mach-o/dyld.h>
 #include <mach-o/dyld_images.h>
+#include <os/lock.h>
 
 #include "MachOFile.h"
+#include "Vector/Vector.h"
 
 bool dyld_get_image_uuid(const mach_header *mh, uuid_t uuid) {
     const MachOFile *mf = (MachOFile *)mh;
@@ -14,16 +18,113 @@ bool dyld_get_image_uuid(const mach_header *mh, uuid_t uuid) {
     return mf->getUuid(uuid);
 }
 
-void dyld_images_for_addresses(unsigned count, const void *addresses[], dyld_image_uuid_offset infos[]) {
-    for (unsigned i = 0; i < count; i++) {
-        const void *addr = addresses[i];
-        bzero(&infos[i], sizeof(dyld_image_uuid_offset));
-
-        Dl_info dl_info;
-        if (dladdr(addr, &dl_info)) {
-            infos[i].image = (mach_header *)dl_info.dli_fbase;
-            infos[i].offsetInImage = (uintptr_t)addr - (uintptr_t)dl_info.dli_fbase;
-            dyld_get_image_uuid((mach_header *)dl_info.dli_fbase, infos[i].uuid);
+namespace {
+
+/// The address ranges of the segments of every loaded image, sorted by address.
+///
+/// Images are added and removed through dyld's image callbacks, so lookups never call into dyld and only take the
+/// index's own lock. Segments rather than whole images are indexed since the segments of an image in the shared cache
+/// aren't contiguous.
+class ImageIndex {
+  private:
+    struct Segment {
+        uintptr_t start;
+        uintptr_t end;
+        const mach_header *image;
+        uuid_t uuid;
+    };
+
+    os_unfair_lock _lock = OS_UNFAIR_LOCK_INIT;
+    AG::vector<Segment, 0, uint32_t> _segments;
+
+    static dispatch_once_t _shared_once;
+    static ImageIndex *_shared;
+
+    static void add_image(const mach_header *mh, intptr_t slide) { _shared->add(mh, slide); };
+    static void remove_image(const mach_header *mh, intptr_t slide) { _shared->remove(mh); };
+
+    void add(const mach_header *mh, intptr_t slide) {
+        const MachOFile *mf = (MachOFile *)mh;
+        if (!mf->hasMachOMagic()) {
+            return;
         }
-    }
+        __block Segment segment = {0, 0, mh, {}};
+        mf->getUuid(segment.uuid);
+
+        // parse the image before taking the lock
+        __block AG::vector<Segment, 8, uint32_t> segments;
+        mf->forEachSegment(^(const char *name, uint64_t vmAddr, uint64_t vmSize, bool &stop) {
+          segment.start = uintptr_t(vmAddr + slide);
+          segment.end = uintptr_t(vmAddr + vmSize + slide);
+          segments.push_back(segment);
+        });
+
+        os_unfair_lock_lock(&_lock);
+        for (auto &new_segment : segments) {
+            _segments.push_back(new_segment);
+            // images are usually added in address order, so this rarely moves anything
+            auto position = std::upper_bound(_segments.begin(), _segments.end() - 1, new_segment.start,
+                                             [](uintptr_t start, const Segment &s) { return start < s.start; });
+            std::rotate(position, _segments.end() - 1, _segments.end());
+        }
+        os_unfair_lock_unlock(&_lock);
+    };
+
+    void remove(const mach_header *mh) {
+        os_unfair_lock_lock(&_lock);
+        auto end = std::remove_if(_segments.begin(), _segments.end(),
+                                  [mh](const Segment &segment) { return segment.image == mh; });
+        _segments.resize(uint32_t(end - _segments.begin()));
+        os_unfair_lock_unlock(&_lock);
+    };
+
+    const Segment *_Nullable find(uintptr_t address) const {
+        auto position = std::upper_bound(_segments.begin(), _segments.end(), address,
+                                         [](uintptr_t address, const Segment &s) { return address < s.start; });
+        if (position == _segments.begin()) {
+            return nullptr;
+        }
+        const Segment *segment = position - 1;
+        return address < segment->end ? segment : nullptr;
+    };
+
+  public:
+    static ImageIndex &shared() {
+        dispatch_once_f(&_shared_once, nullptr, [](void *context) {
+            _shared = new ImageIndex();
+            // calls add_image for every image already loaded
+            _dyld_register_func_for_add_image(add_image);
+            _dyld_register_func_for_remove_image(remove_image);
+        });
+        return *_shared;
+    };
+
+    void lookup(unsigned count, const void *addresses[], dyld_image_uuid_offset infos[]) {
+        os_unfair_lock_lock(&_lock);
+        const Segment *last = nullptr;
+        for (unsigned i = 0; i < count; i++) {
+            uintptr_t address = (uintptr_t)addresses[i];
+            bzero(&infos[i], sizeof(dyld_image_uuid_offset));
+
+            // consecutive addresses are often in the same segment, e.g. the descriptors of a generic type
+            const Segment *segment =
+                last && address >= last->start && address < last->end ? last : find(address);
+            if (segment) {
+                infos[i].image = segment->image;
+                infos[i].offsetInImage = address - (uintptr_t)segment->image;
+                memcpy(infos[i].uuid, segment->uuid, sizeof(uuid_t));
+                last = segment;
+            }
+        }
+        os_unfair_lock_unlock(&_lock);
+    };
+};
+
+dispatch_once_t ImageIndex::_shared_once = 0;
+ImageIndex *ImageIndex::_shared = nullptr;
+
+} // namespace
+
+void dyld_images_for_addresses(unsigned count, const void *addresses[], dyld_image_uuid_offset infos[]) {
+    ImageIndex::shared().lookup(count, addresses, infos);
 }
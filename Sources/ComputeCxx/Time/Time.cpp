@@ -14,7 +14,7 @@ double absolute_time_to_seconds(uint64_t ticks) {
         if (err) {
             return NAN;
         }
-        return (info.numer / info.denom) * 0.000000001;
+        return (double(info.numer) / double(info.denom)) * 0.000000001;
     }();
     return static_cast<double>(ticks) * time_scale;
 }
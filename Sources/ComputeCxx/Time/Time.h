@@ -1,7 +1,14 @@
+#pragma once
+
+#include <mach/mach_time.h>
 #include <stdint.h>
 
 namespace AG {
 
+/// The current time in mach absolute time units, the units of graph deadlines. Inline since updates read it between
+/// every node they evaluate.
+inline uint64_t absolute_time() { return mach_absolute_time(); }
+
 double current_time(void);
 double absolute_time_to_seconds(uint64_t ticks);
 
@@ -0,0 +1,451 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <bit>
+#include <errno.h>
+#include <fcntl.h>
+#include <mach/mach_time.h>
+#include <memory>
+#include <os/lock.h>
+#include <os/log.h>
+#include <os/signpost.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Utilities/HashTable.h"
+#include "Vector/Vector.h"
+
+namespace AG {
+
+std::atomic<bool> Trace::_enabled = false;
+
+uint32_t Trace::ring_capacity() {
+    static uint32_t capacity = []() -> uint32_t {
+        char *result = getenv("AG_TRACE_BUFFER_SIZE");
+        if (result) {
+            return std::bit_ceil(uint32_t(std::clamp(atoi(result), 256, 1 << 20)));
+        }
+        return 4096;
+    }();
+    return capacity;
+}
+
+namespace {
+
+/// The events of one thread, written by that thread and read by the writer thread.
+class Ring {
+  private:
+    std::unique_ptr<Trace::Event[]> _events;
+    uint64_t _mask;
+    std::atomic<uint64_t> _head = 0; // the next event to write
+    std::atomic<uint64_t> _tail = 0; // the next event to read
+    std::atomic<uint64_t> _dropped_count = 0;
+    std::atomic<bool> _is_retired = false;
+
+  public:
+    explicit Ring(uint32_t capacity) : _events(new Trace::Event[capacity]), _mask(capacity - 1){};
+
+    void push(const Trace::Event &event) {
+        uint64_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) > _mask) {
+            _dropped_count.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        _events[head & _mask] = event;
+        _head.store(head + 1, std::memory_order_release);
+    };
+
+    /// Calls `body` with the events written so far, in at most two runs, then frees their slots.
+    template <typename Body> void drain(Body body) {
+        uint64_t tail = _tail.load(std::memory_order_relaxed);
+        uint64_t head = _head.load(std::memory_order_acquire);
+        while (tail < head) {
+            uint64_t run_end = std::min(head, (tail | _mask) + 1);
+            body(&_events[tail & _mask], run_end - tail);
+            tail = run_end;
+        }
+        _tail.store(tail, std::memory_order_release);
+    };
+
+    uint64_t dropped_count() const { return _dropped_count.load(std::memory_order_relaxed); };
+
+    /// Set once the thread exits, after which the writer frees the ring when it has drained it.
+    bool is_retired() const { return _is_retired.load(std::memory_order_acquire); };
+    void retire() { _is_retired.store(true, std::memory_order_release); };
+};
+
+uint64_t string_hash(const char *string) {
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325;
+    for (const char *c = string; *c; c++) {
+        hash = (hash ^ uint8_t(*c)) * 0x100000001b3;
+    }
+    return hash;
+}
+
+bool string_compare(const char *a, const char *b) { return strcmp(a, b) == 0; }
+
+constexpr size_t max_names = UINT16_MAX;
+
+/// The state shared by every thread. Never destroyed, since threads may exit after static destructors ran.
+struct TraceState {
+    os_unfair_lock lock = OS_UNFAIR_LOCK_INIT;
+    vector<Ring *, 0, uint32_t> rings;
+    uint64_t retired_dropped_count = 0;
+
+    os_unfair_lock names_lock = OS_UNFAIR_LOCK_INIT;
+    util::Table<const char *, uintptr_t> name_ids =
+        util::Table<const char *, uintptr_t>(string_hash, string_compare, nullptr, nullptr, nullptr);
+    vector<const char *, 0, uint32_t> names; // ids start at 1
+};
+
+TraceState &shared_state() {
+    static TraceState *state = new TraceState();
+    return *state;
+}
+
+class RingOwner {
+  private:
+    Ring *_Nullable _ring = nullptr;
+
+  public:
+    ~RingOwner() {
+        if (_ring) {
+            _ring->retire();
+        }
+    };
+
+    Ring &get() {
+        if (!_ring) {
+            _ring = new Ring(Trace::ring_capacity());
+            TraceState &state = shared_state();
+            os_unfair_lock_lock(&state.lock);
+            state.rings.push_back(_ring);
+            os_unfair_lock_unlock(&state.lock);
+        }
+        return *_ring;
+    };
+};
+
+thread_local RingOwner current_ring;
+
+#pragma mark - Writing
+
+/// The format of trace files: a header followed by chunks. Names are written in a chunk before the first chunk of
+/// events using them, and the number of dropped events is written last.
+struct FileHeader {
+    char magic[4];
+    uint32_t event_size;
+    uint32_t timebase_numer;
+    uint32_t timebase_denom;
+};
+
+struct ChunkHeader {
+    enum Kind : uint32_t {
+        Names = 1,
+        Events = 2,
+        DroppedCount = 3,
+    };
+    Kind kind;
+    uint32_t size; // of the payload, a multiple of 8 so that events stay aligned
+};
+
+class Writer {
+  public:
+    static constexpr size_t buffer_size = 64 * 1024;
+
+  private:
+    Trace::Sink _sink;
+    int _fd = -1;
+    os_log_t _log = nullptr;
+    std::unique_ptr<unsigned char[]> _buffer;
+    size_t _buffer_length = 0;
+    uint32_t _num_written_names = 0;
+    uint64_t _initial_dropped_count;
+
+    void write_bytes(const void *bytes, size_t length);
+    void flush();
+
+    void write_chunk(ChunkHeader::Kind kind, const void *payload, size_t size);
+    void write_new_names();
+    void write_events(const Trace::Event *events, size_t count);
+
+  public:
+    Writer(Trace::Sink sink, int fd);
+    ~Writer();
+
+    void drain();
+    void finish();
+};
+
+Writer::Writer(Trace::Sink sink, int fd) : _sink(sink), _fd(fd), _initial_dropped_count(Trace::dropped_count()) {
+    if (_sink == Trace::Sink::File) {
+        _buffer.reset(new unsigned char[buffer_size]);
+        struct mach_timebase_info info = {1, 1};
+        mach_timebase_info(&info);
+        FileHeader header = {{'A', 'G', 'T', '1'}, sizeof(Trace::Event), info.numer, info.denom};
+        write_bytes(&header, sizeof(header));
+    } else {
+        _log = os_log_create("dev.incrematic.compute", "trace");
+    }
+}
+
+Writer::~Writer() {
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+void Writer::write_bytes(const void *bytes, size_t length) {
+    if (_buffer_length + length > buffer_size) {
+        flush();
+    }
+    if (length > buffer_size) {
+        const unsigned char *next = (const unsigned char *)bytes;
+        while (length > 0) {
+            ssize_t written = write(_fd, next, length);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return;
+            }
+            next += written;
+            length -= written;
+        }
+        return;
+    }
+    memcpy(&_buffer[_buffer_length], bytes, length);
+    _buffer_length += length;
+}
+
+void Writer::flush() {
+    size_t offset = 0;
+    while (offset < _buffer_length) {
+        ssize_t written = write(_fd, &_buffer[offset], _buffer_length - offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            break; // the trace is truncated rather than blocking the writer
+        }
+        offset += written;
+    }
+    _buffer_length = 0;
+}
+
+void Writer::write_chunk(ChunkHeader::Kind kind, const void *payload, size_t size) {
+    static const uint64_t padding = 0;
+    size_t padded_size = (size + 7) & ~size_t(7);
+    ChunkHeader header = {kind, uint32_t(padded_size)};
+    write_bytes(&header, sizeof(header));
+    write_bytes(payload, size);
+    write_bytes(&padding, padded_size - size);
+}
+
+void Writer::write_new_names() {
+    TraceState &state = shared_state();
+    os_unfair_lock_lock(&state.names_lock);
+    uint32_t num_names = state.names.size();
+    vector<unsigned char, 0, uint32_t> payload;
+    for (uint32_t index = _num_written_names; index < num_names; index++) {
+        // each name is its id and length followed by its characters
+        const char *name = state.names[index];
+        uint16_t entry[2] = {uint16_t(index + 1), uint16_t(std::min(strlen(name), size_t(UINT16_MAX)))};
+        for (size_t i = 0; i < sizeof(entry); i++) {
+            payload.push_back(((unsigned char *)entry)[i]);
+        }
+        for (size_t i = 0; i < entry[1]; i++) {
+            payload.push_back(name[i]);
+        }
+    }
+    os_unfair_lock_unlock(&state.names_lock);
+
+    if (num_names > _num_written_names) {
+        write_chunk(ChunkHeader::Kind::Names, payload.data(), payload.size());
+        _num_written_names = num_names;
+    }
+}
+
+const char *event_name(const Trace::Event &event) {
+    if (event.name != 0) {
+        TraceState &state = shared_state();
+        os_unfair_lock_lock(&state.names_lock);
+        const char *name = event.name <= state.names.size() ? state.names[event.name - 1] : "unknown";
+        os_unfair_lock_unlock(&state.names_lock);
+        return name;
+    }
+    switch (event.kind) {
+    case Trace::EventKind::UpdateBegin:
+        return "update begin";
+    case Trace::EventKind::UpdateEnd:
+        return "update end";
+    case Trace::EventKind::AttributeCreated:
+        return "attribute created";
+    case Trace::EventKind::AttributeInvalidated:
+        return "attribute invalidated";
+    case Trace::EventKind::CompareFailed:
+        return "compare failed";
+    case Trace::EventKind::LayoutBuilt:
+        return "layout built";
+    case Trace::EventKind::Custom:
+        return "custom";
+    }
+    return "unknown";
+}
+
+void Writer::write_events(const Trace::Event *events, size_t count) {
+    if (_sink == Trace::Sink::File) {
+        write_chunk(ChunkHeader::Kind::Events, events, count * sizeof(Trace::Event));
+        return;
+    }
+    for (size_t index = 0; index < count; index++) {
+        const Trace::Event &event = events[index];
+        os_signpost_event_emit(_log, OS_SIGNPOST_ID_EXCLUSIVE, "AGTrace",
+                               "%{public}s attribute=%u context=0x%llx data=0x%llx time=%llu", event_name(event),
+                               event.attribute, event.context, event.data, event.time);
+    }
+}
+
+void Writer::drain() {
+    TraceState &state = shared_state();
+
+    // Rings are only added while the lock is held, and only removed here
+    os_unfair_lock_lock(&state.lock);
+    vector<Ring *, 0, uint32_t> rings = state.rings;
+    os_unfair_lock_unlock(&state.lock);
+
+    if (_sink == Trace::Sink::File) {
+        write_new_names();
+    }
+    for (Ring *ring : rings) {
+        bool is_retired = ring->is_retired();
+        ring->drain([&](const Trace::Event *events, size_t count) { write_events(events, count); });
+        if (is_retired) {
+            os_unfair_lock_lock(&state.lock);
+            state.retired_dropped_count += ring->dropped_count();
+            auto iter = std::find(state.rings.begin(), state.rings.end(), ring);
+            *iter = state.rings.back();
+            state.rings.pop_back();
+            os_unfair_lock_unlock(&state.lock);
+            delete ring;
+        }
+    }
+    if (_sink == Trace::Sink::File) {
+        flush();
+    }
+}
+
+void Writer::finish() {
+    drain();
+    if (_sink == Trace::Sink::File) {
+        uint64_t dropped_count = Trace::dropped_count() - _initial_dropped_count;
+        write_chunk(ChunkHeader::Kind::DroppedCount, &dropped_count, sizeof(dropped_count));
+        flush();
+    }
+}
+
+/// The writer thread drains the rings this often, in microseconds.
+constexpr useconds_t drain_interval = 10000;
+
+os_unfair_lock writer_lock = OS_UNFAIR_LOCK_INIT;
+Writer *_Nullable writer = nullptr;
+pthread_t writer_thread;
+std::atomic<bool> writer_should_stop = false;
+
+void *run_writer(void *context) {
+    Writer *writer = (Writer *)context;
+    while (!writer_should_stop.load(std::memory_order_relaxed)) {
+        usleep(drain_interval);
+        writer->drain();
+    }
+    return nullptr;
+}
+
+} // namespace
+
+#pragma mark - Recording
+
+void Trace::record_slow(EventKind kind, uint16_t name, uint32_t attribute, uint64_t context, uint64_t data) {
+    current_ring.get().push({mach_absolute_time(), kind, name, attribute, context, data});
+}
+
+uint16_t Trace::intern(const char *name) {
+    TraceState &state = shared_state();
+    os_unfair_lock_lock(&state.names_lock);
+    uintptr_t id = state.name_ids.lookup(name, nullptr);
+    if (id == 0 && state.names.size() < max_names) {
+        const char *copy = strdup(name);
+        state.names.push_back(copy);
+        id = state.names.size();
+        state.name_ids.insert(copy, id);
+    }
+    os_unfair_lock_unlock(&state.names_lock);
+    return uint16_t(id);
+}
+
+uint64_t Trace::dropped_count() {
+    TraceState &state = shared_state();
+    os_unfair_lock_lock(&state.lock);
+    uint64_t count = state.retired_dropped_count;
+    for (Ring *ring : state.rings) {
+        count += ring->dropped_count();
+    }
+    os_unfair_lock_unlock(&state.lock);
+    return count;
+}
+
+#pragma mark - Controlling
+
+bool Trace::start(Sink sink, const char *_Nullable path) {
+    os_unfair_lock_lock(&writer_lock);
+    if (writer) {
+        os_unfair_lock_unlock(&writer_lock);
+        return false;
+    }
+
+    int fd = -1;
+    if (sink == Sink::File) {
+        fd = path ? open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : -1;
+        if (fd < 0) {
+            os_unfair_lock_unlock(&writer_lock);
+            return false;
+        }
+    }
+
+    // Events recorded while the last trace was stopping belong to neither trace
+    TraceState &state = shared_state();
+    os_unfair_lock_lock(&state.lock);
+    for (Ring *ring : state.rings) {
+        ring->drain([](const Event *events, size_t count) {});
+    }
+    os_unfair_lock_unlock(&state.lock);
+
+    writer = new Writer(sink, fd);
+    writer_should_stop.store(false, std::memory_order_relaxed);
+    pthread_create(&writer_thread, nullptr, run_writer, writer);
+    _enabled.store(true, std::memory_order_relaxed);
+    os_unfair_lock_unlock(&writer_lock);
+    return true;
+}
+
+void Trace::stop() {
+    os_unfair_lock_lock(&writer_lock);
+    if (!writer) {
+        os_unfair_lock_unlock(&writer_lock);
+        return;
+    }
+
+    _enabled.store(false, std::memory_order_relaxed);
+    writer_should_stop.store(true, std::memory_order_relaxed);
+    pthread_join(writer_thread, nullptr);
+
+    writer->finish();
+    delete writer;
+    writer = nullptr;
+    os_unfair_lock_unlock(&writer_lock);
+}
+
+} // namespace AG
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <atomic>
+#include <stdint.h>
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace AG {
+
+/// Records trace events into a ring buffer per thread while tracing is enabled, and streams them to a file or to
+/// os_signpost from a background thread.
+///
+/// Each ring has a single producer, its thread, and a single consumer, the writer thread, so recording an event is a
+/// few relaxed stores and never blocks. When a ring is full the event is dropped and counted rather than waiting for
+/// the writer. While tracing is disabled recording costs a single branch.
+class Trace {
+  public:
+    enum class EventKind : uint16_t {
+        UpdateBegin = 1,
+        UpdateEnd,
+        AttributeCreated,
+        AttributeInvalidated,
+        CompareFailed,
+        LayoutBuilt,
+        Custom,
+    };
+
+    /// A trace event. Events are fixed-size so that rings are plain arrays and trace files can be mapped and read in
+    /// place.
+    struct Event {
+        uint64_t time; // in mach absolute time units
+        EventKind kind;
+        uint16_t name;      // see `intern`, 0 for the kind's own name
+        uint32_t attribute; // the raw AttributeID the event is about, if any
+        uint64_t context;   // e.g. the graph or the type the event is about
+        uint64_t data;      // depends on the kind, e.g. an inline copy of a custom event's value
+    };
+    static_assert(sizeof(Event) == 32);
+
+    enum class Sink : uint8_t {
+        File,
+        Signpost,
+    };
+
+    /// The number of events each thread's ring holds, see AG_TRACE_BUFFER_SIZE.
+    static uint32_t ring_capacity();
+
+  private:
+    static std::atomic<bool> _enabled;
+
+    static void record_slow(EventKind kind, uint16_t name, uint32_t attribute, uint64_t context, uint64_t data);
+
+  public:
+    static bool is_enabled() { return _enabled.load(std::memory_order_relaxed); };
+
+    /// Starts streaming events to `sink`. `path` is the file to write for `Sink::File`. Returns false if tracing is
+    /// already running or the file can't be created.
+    static bool start(Sink sink, const char *_Nullable path);
+
+    /// Writes the events still in the rings, then stops tracing.
+    static void stop();
+
+    /// Returns a small id for `name`, the same for equal strings. Ids are assigned in order and are listed in a trace
+    /// before the first event that uses them. Returns 0 once all ids are taken.
+    static uint16_t intern(const char *name);
+
+    /// The number of events dropped because a ring was full.
+    static uint64_t dropped_count();
+
+    static void record(EventKind kind, uint16_t name, uint32_t attribute, uint64_t context, uint64_t data) {
+        if (is_enabled()) {
+            record_slow(kind, name, attribute, context, data);
+        }
+    };
+    static void record(EventKind kind, uint32_t attribute, uint64_t context, uint64_t data) {
+        if (is_enabled()) {
+            record_slow(kind, 0, attribute, context, data);
+        }
+    };
+};
+
+} // namespace AG
+
+CF_ASSUME_NONNULL_END
@@ -4,21 +4,44 @@
 #include <concepts>
 #include <iterator>
 #include <memory>
+#include <type_traits>
 
 CF_ASSUME_NONNULL_BEGIN
 
 namespace AG {
 
+/// Describes how a `vector` stores elements of type `T`. Specialize it to let a type use the faster growth path or to
+/// change how quickly vectors of the type grow.
+template <typename T> struct vector_traits {
+    /// Whether an element can be moved to another address by copying its bytes, without calling its move constructor
+    /// and destructor. Vectors of such elements are grown with `realloc`.
+    static constexpr bool trivially_relocatable = std::is_trivially_copyable_v<T>;
+
+    /// The capacity of a full vector is multiplied by `growth_numerator / growth_denominator` when it grows.
+    static constexpr unsigned int growth_numerator = 3;
+    static constexpr unsigned int growth_denominator = 2;
+};
+
+template <typename T, typename Deleter> struct vector_traits<std::unique_ptr<T, Deleter>> : vector_traits<void *> {
+    static constexpr bool trivially_relocatable = vector_traits<Deleter>::trivially_relocatable;
+};
+
 template <typename T, unsigned int _stack_size = 0, typename size_type = std::size_t>
     requires std::unsigned_integral<size_type>
 class vector {
   private:
-    T _stack_buffer[_stack_size];
+    // Elements of the stack buffer are constructed and destroyed by the vector, like those of the heap buffer, so the
+    // buffer mustn't construct or destroy them itself
+    union {
+        T _stack_buffer[_stack_size];
+    };
     T *_Nullable _buffer = nullptr;
     size_type _size = 0;
     size_type _capacity = _stack_size;
 
     void reserve_slow(size_type new_cap);
+    void set_capacity(size_type new_cap);
+    void take_elements(vector &other);
 
   public:
     using value_type = T;
@@ -29,17 +52,23 @@ class vector {
     using reverse_iterator = std::reverse_iterator<iterator>;
     using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
+    vector(){};
+    vector(const vector &other);
+    vector(vector &&other);
     ~vector();
 
+    vector &operator=(const vector &other);
+    vector &operator=(vector &&other);
+
     // Element access
 
     reference operator[](size_type pos) { return data()[pos]; };
     const_reference operator[](size_type pos) const { return data()[pos]; };
 
-    reference front() { return &data()[0]; };
-    const_reference front() const { return *&data()[0]; };
-    reference back() { return *&data()[_size - 1]; };
-    const_reference back() const { return *&data()[_size - 1]; };
+    reference front() { return data()[0]; };
+    const_reference front() const { return data()[0]; };
+    reference back() { return data()[_size - 1]; };
+    const_reference back() const { return data()[_size - 1]; };
 
     T *_Nonnull data() { return _buffer != nullptr ? _buffer : _stack_buffer; };
     const T *_Nonnull data() const { return _buffer != nullptr ? _buffer : _stack_buffer; };
@@ -68,6 +97,7 @@ class vector {
 
     void clear();
 
+    template <typename... Args> reference emplace_back(Args &&...args);
     void push_back(const T &value);
     void push_back(T &&value);
     void pop_back();
@@ -90,6 +120,7 @@ class vector<T, 0, size_type> {
     size_type _capacity = 0;
 
     void reserve_slow(size_type new_cap);
+    void set_capacity(size_type new_cap);
 
   public:
     using value_type = T;
@@ -100,17 +131,23 @@ class vector<T, 0, size_type> {
     using reverse_iterator = std::reverse_iterator<iterator>;
     using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
+    vector(){};
+    vector(const vector &other);
+    vector(vector &&other);
     ~vector();
 
+    vector &operator=(const vector &other);
+    vector &operator=(vector &&other);
+
     // Element access
 
     reference operator[](size_type pos) { return data()[pos]; };
     const_reference operator[](size_type pos) const { return data()[pos]; };
 
-    reference front() { return &data()[0]; };
-    const_reference front() const { return *&data()[0]; };
-    reference back() { return *&data()[_size - 1]; };
-    const_reference back() const { return *&data()[_size - 1]; };
+    reference front() { return data()[0]; };
+    const_reference front() const { return data()[0]; };
+    reference back() { return data()[_size - 1]; };
+    const_reference back() const { return data()[_size - 1]; };
 
     T *_Nonnull data() { return _buffer; };
     const T *_Nonnull data() const { return _buffer; };
@@ -143,6 +180,7 @@ class vector<T, 0, size_type> {
 
     void clear();
 
+    template <typename... Args> reference emplace_back(Args &&...args);
     void push_back(const T &value);
     void push_back(T &&value);
     void pop_back();
@@ -162,6 +200,7 @@ class vector<std::unique_ptr<T>, 0, size_type> {
     size_type _capacity = 0;
 
     void reserve_slow(size_type new_cap);
+    void set_capacity(size_type new_cap);
 
   public:
     using value_type = std::unique_ptr<T>;
@@ -172,17 +211,23 @@ class vector<std::unique_ptr<T>, 0, size_type> {
     using reverse_iterator = std::reverse_iterator<iterator>;
     using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
+    vector(){};
+    vector(const vector &) = delete;
+    vector(vector &&other);
     ~vector();
 
+    vector &operator=(const vector &) = delete;
+    vector &operator=(vector &&other);
+
     // Element access
 
     reference operator[](size_type pos) { return data()[pos]; };
     const_reference operator[](size_type pos) const { return data()[pos]; };
 
-    reference front() { return &data()[0]; };
-    const_reference front() const { return *&data()[0]; };
-    reference back() { return *&data()[_size - 1]; };
-    const_reference back() const { return *&data()[_size - 1]; };
+    reference front() { return data()[0]; };
+    const_reference front() const { return data()[0]; };
+    reference back() { return data()[_size - 1]; };
+    const_reference back() const { return data()[_size - 1]; };
 
     std::unique_ptr<T> *_Nonnull data() { return _buffer; };
     const std::unique_ptr<T> *_Nonnull data() const { return _buffer; };
@@ -215,6 +260,7 @@ class vector<std::unique_ptr<T>, 0, size_type> {
 
     void clear();
 
+    template <typename... Args> reference emplace_back(Args &&...args);
     void push_back(const std::unique_ptr<T> &value) = delete;
     void push_back(std::unique_ptr<T> &&value);
     void pop_back();
@@ -223,6 +269,16 @@ class vector<std::unique_ptr<T>, 0, size_type> {
     void resize(size_type count, const value_type &value);
 };
 
+// MARK: Traits
+
+/// A vector refers to its heap buffer by pointer only, so moving its bytes moves the vector, as long as the elements in
+/// its stack buffer can be moved that way too.
+template <typename T, unsigned int _stack_size, typename size_type>
+    requires std::unsigned_integral<size_type>
+struct vector_traits<vector<T, _stack_size, size_type>> : vector_traits<void *> {
+    static constexpr bool trivially_relocatable = _stack_size == 0 || vector_traits<T>::trivially_relocatable;
+};
+
 } // namespace AG
 
 CF_ASSUME_NONNULL_END
@@ -4,52 +4,109 @@
 #include <malloc/malloc.h>
 #include <memory>
 #include <cassert>
+#include <cstring>
+#include <limits>
 
 #include "Errors/Errors.h"
 
 namespace AG {
 
-#pragma mark - Base implementation
-
 namespace details {
 
-template <typename size_type, unsigned int element_size_bytes>
+/// Moves `count` elements from `source` to uninitialized storage at `destination`, leaving the source storage
+/// uninitialized.
+template <typename T, typename size_type>
+    requires std::unsigned_integral<size_type>
+void relocate_elements(T *destination, T *source, size_type count) {
+    if (count == 0) {
+        return;
+    }
+    if constexpr (vector_traits<T>::trivially_relocatable) {
+        memcpy((void *)destination, (const void *)source, count * sizeof(T));
+    } else {
+        for (size_type i = 0; i < count; i++) {
+            new (&destination[i]) T(std::move(source[i]));
+            source[i].~T();
+        }
+    }
+}
+
+/// Returns the capacity to grow to so that at least `new_cap` elements fit.
+template <typename T, typename size_type>
     requires std::unsigned_integral<size_type>
-void *realloc_vector(void *buffer, void *stack_buffer, size_type stack_size, size_type *size,
-                     size_type preferred_new_size) {
-    // copy data from heap buffer buffer into stack buffer if possible
-    if (preferred_new_size <= stack_size) {
-        if (buffer) {
-            memcpy(stack_buffer, buffer, preferred_new_size * element_size_bytes);
+size_type grown_capacity(size_type capacity, size_type new_cap) {
+    uint64_t grown =
+        uint64_t(capacity) * vector_traits<T>::growth_numerator / vector_traits<T>::growth_denominator;
+    return std::max(size_type(std::min(grown, uint64_t(std::numeric_limits<size_type>::max()))), new_cap);
+}
+
+/// Moves the `size` elements of `buffer` into a heap buffer with room for at least `preferred_new_capacity` elements
+/// and returns it, or returns `nullptr` when `preferred_new_capacity` is zero. `buffer` is freed if it is
+/// `heap_allocated` and isn't returned.
+template <typename T, typename size_type>
+    requires std::unsigned_integral<size_type>
+T *_Nullable reallocate_vector(T *_Nullable buffer, bool heap_allocated, size_type size, size_type *capacity,
+                               size_type preferred_new_capacity) {
+    if (preferred_new_capacity == 0) {
+        if (heap_allocated) {
             free(buffer);
-            *size = stack_size;
         }
+        *capacity = 0;
         return nullptr;
     }
 
-    size_t new_size_bytes = malloc_good_size(preferred_new_size * element_size_bytes);
-    size_type new_size = new_size_bytes / element_size_bytes;
-    if (new_size == *size) {
+    size_t new_size_bytes = malloc_good_size(preferred_new_capacity * sizeof(T));
+    size_type new_capacity = (size_type)(new_size_bytes / sizeof(T));
+    if (heap_allocated && new_capacity == *capacity) {
         // nothing to do
         return buffer;
     }
 
-    void *new_buffer = realloc(buffer, new_size_bytes);
-    if (!new_buffer) {
-        precondition_failure("allocation failure");
-    }
-
-    // copy data from stack buffer into heap buffer
-    if (!buffer) {
-        memcpy(new_buffer, stack_buffer, (*size) * element_size_bytes);
+    T *new_buffer;
+    if constexpr (vector_traits<T>::trivially_relocatable) {
+        // realloc can often extend the buffer in place, and copies the elements otherwise
+        new_buffer = static_cast<T *>(realloc(heap_allocated ? buffer : nullptr, new_size_bytes));
+        if (!new_buffer) {
+            precondition_failure("allocation failure");
+        }
+        if (!heap_allocated) {
+            relocate_elements(new_buffer, buffer, size);
+        }
+    } else {
+        new_buffer = static_cast<T *>(malloc(new_size_bytes));
+        if (!new_buffer) {
+            precondition_failure("allocation failure");
+        }
+        relocate_elements(new_buffer, buffer, size);
+        if (heap_allocated) {
+            free(buffer);
+        }
     }
 
-    *size = new_size;
+    *capacity = new_capacity;
     return new_buffer;
 }
 
 } // namespace details
 
+#pragma mark - Base implementation
+
+template <typename T, unsigned int _stack_size, typename size_type>
+    requires std::unsigned_integral<size_type>
+vector<T, _stack_size, size_type>::vector(const vector &other) {
+    reserve(other._size);
+    for (size_type i = 0; i < other._size; i++) {
+        new (&data()[i]) value_type(other.data()[i]);
+    }
+    _size = other._size;
+}
+
+template <typename T, unsigned int _stack_size, typename size_type>
+    requires std::unsigned_integral<size_type>
+vector<T, _stack_size, size_type>::vector(vector &&other) {
+    take_elements(other);
+}
+
 template <typename T, unsigned int _stack_size, typename size_type>
     requires std::unsigned_integral<size_type>
 vector<T, _stack_size, size_type>::~vector() {
@@ -61,12 +118,73 @@ vector<T, _stack_size, size_type>::~vector() {
     }
 }
 
+template <typename T, unsigned int _stack_size, typename size_type>
+    requires std::unsigned_integral<size_type>
+vector<T, _stack_size, size_type> &vector<T, _stack_size, size_type>::operator=(const vector &other) {
+    if (this != &other) {
+        clear();
+        reserve(other._size);
+        for (size_type i = 0; i < other._size; i++) {
+            new (&data()[i]) value_type(other.data()[i]);
+        }
+        _size = other._size;
+    }
+    return *this;
+}
+
+template <typename T, unsigned int _stack_size, typename size_type>
+    requires std::unsigned_integral<size_type>
+vector<T, _stack_size, size_type> &vector<T, _stack_size, size_type>::operator=(vector &&other) {
+    if (this != &other) {
+        clear();
+        if (_buffer) {
+            free(_buffer);
+            _buffer = nullptr;
+            _capacity = _stack_size;
+        }
+        take_elements(other);
+    }
+    return *this;
+}
+
+/// Takes the elements of `other` into this vector, which must be empty and using its stack buffer.
+template <typename T, unsigned int _stack_size, typename size_type>
+    requires std::unsigned_integral<size_type>
+void vector<T, _stack_size, size_type>::take_elements(vector &other) {
+    if (other._buffer) {
+        // steal the heap buffer
+        _buffer = other._buffer;
+        _capacity = other._capacity;
+        other._buffer = nullptr;
+        other._capacity = _stack_size;
+    } else {
+        details::relocate_elements(_stack_buffer, other._stack_buffer, other._size);
+    }
+    _size = other._size;
+    other._size = 0;
+}
+
+template <typename T, unsigned int _stack_size, typename size_type>
+    requires std::unsigned_integral<size_type>
+void vector<T, _stack_size, size_type>::set_capacity(size_type new_cap) {
+    // move elements from the heap buffer back into the stack buffer if possible
+    if (new_cap <= _stack_size) {
+        if (_buffer) {
+            details::relocate_elements(_stack_buffer, _buffer, _size);
+            free(_buffer);
+            _buffer = nullptr;
+            _capacity = _stack_size;
+        }
+        return;
+    }
+
+    _buffer = details::reallocate_vector<T, size_type>(data(), _buffer != nullptr, _size, &_capacity, new_cap);
+}
+
 template <typename T, unsigned int _stack_size, typename size_type>
     requires std::unsigned_integral<size_type>
 void vector<T, _stack_size, size_type>::reserve_slow(size_type new_cap) {
-    size_type effective_new_cap = std::max(capacity() * 1.5, new_cap * 1.0);
-    _buffer = reinterpret_cast<T *>(details::realloc_vector<size_type, sizeof(T)>(_buffer, _stack_buffer, _stack_size,
-                                                                                  &_capacity, effective_new_cap));
+    set_capacity(details::grown_capacity<T>(capacity(), new_cap));
 }
 
 template <typename T, unsigned int _stack_size, typename size_type>
@@ -82,8 +200,7 @@ template <typename T, unsigned int _stack_size, typename size_type>
     requires std::unsigned_integral<size_type>
 void vector<T, _stack_size, size_type>::shrink_to_fit() {
     if (capacity() > _size) {
-        _buffer = reinterpret_cast<T *>(
-            details::realloc_vector<size_type, sizeof(T)>(_buffer, _stack_buffer, _stack_size, &_capacity, _size));
+        set_capacity(_size);
     }
 }
 
@@ -96,6 +213,16 @@ void vector<T, _stack_size, size_type>::clear() {
     _size = 0;
 }
 
+template <typename T, unsigned int _stack_size, typename size_type>
+    requires std::unsigned_integral<size_type>
+template <typename... Args>
+vector<T, _stack_size, size_type>::reference vector<T, _stack_size, size_type>::emplace_back(Args &&...args) {
+    reserve(_size + 1);
+    T *element = new (&data()[_size]) value_type(std::forward<Args>(args)...);
+    _size += 1;
+    return *element;
+}
+
 template <typename T, unsigned int _stack_size, typename size_type>
     requires std::unsigned_integral<size_type>
 void vector<T, _stack_size, size_type>::push_back(const T &value) {
@@ -130,7 +257,7 @@ void vector<T, _stack_size, size_type>::resize(size_type count) {
         }
     } else if (count > _size) {
         for (auto i = _size; i < count; i++) {
-            new (this[i]) value_type();
+            new (&data()[i]) value_type();
         }
     }
     _size = count;
@@ -146,7 +273,7 @@ void vector<T, _stack_size, size_type>::resize(size_type count, const value_type
         }
     } else if (count > _size) {
         for (auto i = _size; i < count; i++) {
-            new (this[i]) value_type(value);
+            new (&data()[i]) value_type(value);
         }
     }
     _size = count;
@@ -154,33 +281,24 @@ void vector<T, _stack_size, size_type>::resize(size_type count, const value_type
 
 #pragma mark - Specialization for empty stack buffer
 
-namespace details {
-
-template <typename size_type, size_t element_size>
+template <typename T, typename size_type>
     requires std::unsigned_integral<size_type>
-void *realloc_vector(void *buffer, size_type *size, size_type preferred_new_size) {
-    if (preferred_new_size == 0) {
-        *size = 0;
-        free(buffer);
-        return nullptr;
-    }
-
-    size_t new_size_bytes = malloc_good_size(preferred_new_size * element_size);
-    size_type new_size = (size_type)(new_size_bytes / element_size);
-    if (new_size == *size) {
-        // nothing to do
-        return buffer;
+vector<T, 0, size_type>::vector(const vector &other) {
+    reserve(other._size);
+    for (size_type i = 0; i < other._size; i++) {
+        new (&_buffer[i]) value_type(other._buffer[i]);
     }
-
-    void *new_buffer = realloc(buffer, new_size_bytes);
-    if (!new_buffer) {
-        precondition_failure("allocation failure");
-    }
-    *size = new_size;
-    return new_buffer;
+    _size = other._size;
 }
 
-} // namespace details
+template <typename T, typename size_type>
+    requires std::unsigned_integral<size_type>
+vector<T, 0, size_type>::vector(vector &&other)
+    : _buffer(other._buffer), _size(other._size), _capacity(other._capacity) {
+    other._buffer = nullptr;
+    other._size = 0;
+    other._capacity = 0;
+}
 
 template <typename T, typename size_type>
     requires std::unsigned_integral<size_type>
@@ -193,12 +311,48 @@ vector<T, 0, size_type>::~vector() {
     }
 }
 
+template <typename T, typename size_type>
+    requires std::unsigned_integral<size_type>
+vector<T, 0, size_type> &vector<T, 0, size_type>::operator=(const vector &other) {
+    if (this != &other) {
+        clear();
+        reserve(other._size);
+        for (size_type i = 0; i < other._size; i++) {
+            new (&_buffer[i]) value_type(other._buffer[i]);
+        }
+        _size = other._size;
+    }
+    return *this;
+}
+
+template <typename T, typename size_type>
+    requires std::unsigned_integral<size_type>
+vector<T, 0, size_type> &vector<T, 0, size_type>::operator=(vector &&other) {
+    if (this != &other) {
+        clear();
+        if (_buffer) {
+            free(_buffer);
+        }
+        _buffer = other._buffer;
+        _size = other._size;
+        _capacity = other._capacity;
+        other._buffer = nullptr;
+        other._size = 0;
+        other._capacity = 0;
+    }
+    return *this;
+}
+
+template <typename T, typename size_type>
+    requires std::unsigned_integral<size_type>
+void vector<T, 0, size_type>::set_capacity(size_type new_cap) {
+    _buffer = details::reallocate_vector<T, size_type>(_buffer, _buffer != nullptr, _size, &_capacity, new_cap);
+}
+
 template <typename T, typename size_type>
     requires std::unsigned_integral<size_type>
 void vector<T, 0, size_type>::reserve_slow(size_type new_cap) {
-    size_type effective_new_cap = std::max(capacity() * 1.5, new_cap * 1.0);
-    _buffer =
-        reinterpret_cast<T *>(details::realloc_vector<size_type, sizeof(T)>(_buffer, &_capacity, effective_new_cap));
+    set_capacity(details::grown_capacity<T>(capacity(), new_cap));
 }
 
 template <typename T, typename size_type>
@@ -214,8 +368,7 @@ template <typename T, typename size_type>
 requires std::unsigned_integral<size_type>
 void vector<T, 0, size_type>::shrink_to_fit() {
     if (capacity() > size()) {
-        _buffer =
-        reinterpret_cast<T *>(details::realloc_vector<size_type, sizeof(T)>(_buffer, &_capacity, 0));
+        set_capacity(_size);
     }
 }
 
@@ -228,6 +381,16 @@ void vector<T, 0, size_type>::clear() {
     _size = 0;
 }
 
+template <typename T, typename size_type>
+    requires std::unsigned_integral<size_type>
+template <typename... Args>
+vector<T, 0, size_type>::reference vector<T, 0, size_type>::emplace_back(Args &&...args) {
+    reserve(_size + 1);
+    T *element = new (&_buffer[_size]) value_type(std::forward<Args>(args)...);
+    _size += 1;
+    return *element;
+}
+
 template <typename T, typename size_type>
     requires std::unsigned_integral<size_type>
 void vector<T, 0, size_type>::push_back(const T &value) {
@@ -262,7 +425,7 @@ void vector<T, 0, size_type>::resize(size_type count) {
         }
     } else if (count > _size) {
         for (auto i = _size; i < count; i++) {
-            new (this[i]) value_type();
+            new (&data()[i]) value_type();
         }
     }
     _size = count;
@@ -278,7 +441,7 @@ void vector<T, 0, size_type>::resize(size_type count, const value_type &value) {
         }
     } else if (count > _size) {
         for (auto i = _size; i < count; i++) {
-            new (this[i]) value_type(value);
+            new (&data()[i]) value_type(value);
         }
     }
     _size = count;
@@ -286,6 +449,15 @@ void vector<T, 0, size_type>::resize(size_type count, const value_type &value) {
 
 #pragma mark - Specialization for unique_ptr
 
+template <typename T, typename size_type>
+    requires std::unsigned_integral<size_type>
+vector<std::unique_ptr<T>, 0, size_type>::vector(vector &&other)
+    : _buffer(other._buffer), _size(other._size), _capacity(other._capacity) {
+    other._buffer = nullptr;
+    other._size = 0;
+    other._capacity = 0;
+}
+
 template <typename T, typename size_type>
     requires std::unsigned_integral<size_type>
 vector<std::unique_ptr<T>, 0, size_type>::~vector() {
@@ -297,6 +469,59 @@ vector<std::unique_ptr<T>, 0, size_type>::~vector() {
     }
 }
 
+template <typename T, typename size_type>
+    requires std::unsigned_integral<size_type>
+vector<std::unique_ptr<T>, 0, size_type> &vector<std::unique_ptr<T>, 0, size_type>::operator=(vector &&other) {
+    if (this != &other) {
+        for (auto i = 0; i < _size; i++) {
+            _buffer[i].reset();
+        }
+        if (_buffer) {
+            free(_buffer);
+        }
+        _buffer = other._buffer;
+        _size = other._size;
+        _capacity = other._capacity;
+        other._buffer = nullptr;
+        other._size = 0;
+        other._capacity = 0;
+    }
+    return *this;
+}
+
+template <typename T, typename size_type>
+    requires std::unsigned_integral<size_type>
+void vector<std::unique_ptr<T>, 0, size_type>::set_capacity(size_type new_cap) {
+    _buffer = details::reallocate_vector<std::unique_ptr<T>, size_type>(_buffer, _buffer != nullptr, _size,
+                                                                        &_capacity, new_cap);
+}
+
+template <typename T, typename size_type>
+    requires std::unsigned_integral<size_type>
+void vector<std::unique_ptr<T>, 0, size_type>::reserve_slow(size_type new_cap) {
+    set_capacity(details::grown_capacity<std::unique_ptr<T>>(capacity(), new_cap));
+}
+
+template <typename T, typename size_type>
+    requires std::unsigned_integral<size_type>
+void vector<std::unique_ptr<T>, 0, size_type>::reserve(size_type new_cap) {
+    if (new_cap <= capacity()) {
+        return;
+    }
+    reserve_slow(new_cap);
+}
+
+template <typename T, typename size_type>
+    requires std::unsigned_integral<size_type>
+template <typename... Args>
+vector<std::unique_ptr<T>, 0, size_type>::reference
+vector<std::unique_ptr<T>, 0, size_type>::emplace_back(Args &&...args) {
+    reserve(_size + 1);
+    value_type *element = new (&_buffer[_size]) value_type(std::forward<Args>(args)...);
+    _size += 1;
+    return *element;
+}
+
 template <typename T, typename size_type>
     requires std::unsigned_integral<size_type>
 void vector<std::unique_ptr<T>, 0, size_type>::push_back(std::unique_ptr<T> &&value) {
@@ -305,4 +530,12 @@ void vector<std::unique_ptr<T>, 0, size_type>::push_back(std::unique_ptr<T> &&va
     _size += 1;
 }
 
+template <typename T, typename size_type>
+    requires std::unsigned_integral<size_type>
+void vector<std::unique_ptr<T>, 0, size_type>::pop_back() {
+    assert(size() > 0);
+    _buffer[_size - 1].reset();
+    _size -= 1;
+}
+
 } // namespace AG
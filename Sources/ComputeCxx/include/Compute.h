@@ -1,4 +1,7 @@
 #include "Attribute/AGAttribute.h"
 #include "Graph/AGGraph.h"
+#include "Layout/AGComparison.h"
 #include "Subgraph/AGSubgraph.h"
+#include "Subgraph/AGTreeElement.h"
+#include "Swift/AGTuple.h"
 #include "Swift/AGType.h"
@@ -0,0 +1,24 @@
+#include "ComputeTestsSupport.h"
+
+#include "Containers/ConcurrentTable.h"
+
+AGTestProbeStats AGTestConcurrentTableProbeStats(size_t count, size_t alignment) {
+    AG::ConcurrentTable<void *> table;
+    for (size_t index = 1; index <= count; ++index) {
+        table.insert(reinterpret_cast<void *>(index * alignment), reinterpret_cast<void *>(index));
+    }
+
+    size_t max_probe_length = 0;
+    size_t total_probe_length = 0;
+    for (size_t index = 1; index <= count; ++index) {
+        size_t probe_length = table.probe_length(reinterpret_cast<void *>(index * alignment));
+        max_probe_length = probe_length > max_probe_length ? probe_length : max_probe_length;
+        total_probe_length += probe_length;
+    }
+
+    return {
+        .capacity = table.capacity(),
+        .max_probe_length = max_probe_length,
+        .mean_probe_length = count ? double(total_probe_length) / double(count) : 0,
+    };
+}
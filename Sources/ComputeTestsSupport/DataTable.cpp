@@ -0,0 +1,17 @@
+#include "ComputeTestsSupport.h"
+
+#include "Data/Table.h"
+
+struct AGTestDataTableStorage {
+    AG::data::table table;
+};
+
+AGTestDataTableRef AGTestDataTableCreate() { return new AGTestDataTableStorage(); }
+
+uint32_t AGTestDataTableAllocPages(AGTestDataTableRef table, uint32_t count) {
+    return table->table.alloc_pages(count);
+}
+
+void AGTestDataTableDeallocPages(AGTestDataTableRef table, uint32_t index, uint32_t count) {
+    table->table.dealloc_pages(index, count);
+}
@@ -0,0 +1,197 @@
+#include "ComputeTestsSupport.h"
+
+#include "Attribute/AttributeID.h"
+#include "Attribute/AttributeType.h"
+#include "Attribute/Node/Node.h"
+#include "Graph/Graph.h"
+#include "Graph/ParallelUpdate.h"
+#include "Subgraph/Subgraph.h"
+#include "Swift/Metadata.h"
+
+namespace {
+
+/// The layout of an AttributeType, which is otherwise only ever created by Swift.
+struct TestAttributeType {
+    const AG::swift::metadata *self_metadata;
+    const AG::swift::metadata *value_metadata;
+    AG::AttributeType::UpdateFunction update;
+    const void *update_context;
+    AG::AttributeVTable *v_table;
+    uint8_t v_table_flags;
+    uint32_t attribute_offset;
+};
+
+static_assert(sizeof(TestAttributeType) == sizeof(AG::AttributeType));
+
+AG::AttributeVTable empty_v_table = {nullptr};
+
+} // namespace
+
+struct AGTestGraphStorage {
+    AG::Graph graph;
+    TestAttributeType type;
+    uint32_t type_id;
+
+    // Attributes in the order they were updated
+    AG::vector<AGAttribute, 0, uint32_t> updates;
+
+    // The number of updates after which the deadline passes, or UINT32_MAX
+    uint32_t deadline_updates = UINT32_MAX;
+};
+
+namespace {
+
+void update_test_attribute(const void *context, void *body, AGAttribute attribute) {
+    auto graph = static_cast<AGTestGraphStorage *>(const_cast<void *>(context));
+    graph->updates.push_back(attribute);
+    if (graph->type.self_metadata == graph->type.value_metadata) {
+        graph->graph.set_value(AG::AttributeID::from_raw_value(attribute).to_node_ptr(), body);
+    }
+    if (graph->updates.size() == graph->deadline_updates) {
+        graph->graph.set_deadline(0);
+    }
+}
+
+} // namespace
+
+struct AGTestSubgraphStorage {
+    AGTestGraphStorage *graph;
+    AG::Subgraph subgraph;
+
+    explicit AGTestSubgraphStorage(AGTestGraphStorage &graph) : graph(&graph), subgraph(graph.graph) {};
+};
+
+AGTestGraphRef AGTestGraphCreate(AGTypeID body_type, AGTypeID value_type) {
+    AG::data::table::ensure_shared();
+
+    auto self_metadata = reinterpret_cast<const AG::swift::metadata *>(body_type);
+    size_t alignment_mask = self_metadata->vw_alignment() - 1;
+
+    auto graph = new AGTestGraphStorage();
+    graph->type = {self_metadata,
+                   reinterpret_cast<const AG::swift::metadata *>(value_type),
+                   update_test_attribute,
+                   graph,
+                   &empty_v_table,
+                   0,
+                   uint32_t((sizeof(AG::Node) + alignment_mask) & ~alignment_mask)};
+    graph->type_id = graph->graph.add_attribute_type(reinterpret_cast<AG::AttributeType &>(graph->type));
+    return graph;
+}
+
+void AGTestGraphDestroy(AGTestGraphRef graph) { delete graph; }
+
+AGTestSubgraphRef AGTestSubgraphCreate(AGTestGraphRef graph) { return new AGTestSubgraphStorage(*graph); }
+
+void AGTestSubgraphDestroy(AGTestSubgraphRef subgraph) {
+    subgraph->subgraph.destroy_nodes();
+    delete subgraph;
+}
+
+AGAttribute AGTestSubgraphAddAttribute(AGTestSubgraphRef subgraph, const void *body) {
+    AG::data::ptr<AG::Node> node;
+    subgraph->subgraph.add_nodes(subgraph->graph->type_id, body, 0, 1, &node);
+    return AG::AttributeID(node).to_raw_value();
+}
+
+void AGTestSubgraphAddAttributes(AGTestSubgraphRef subgraph, const void *bodies, size_t body_stride, uint32_t count,
+                                 AGAttribute *attributes) {
+    auto nodes = reinterpret_cast<AG::data::ptr<AG::Node> *>(attributes);
+    subgraph->subgraph.add_nodes(subgraph->graph->type_id, bodies, body_stride, count, nodes);
+    for (uint32_t index = 0; index < count; index++) {
+        attributes[index] = AG::AttributeID(nodes[index]).to_raw_value();
+    }
+}
+
+bool AGTestAttributeIsInSubgraph(AGAttribute attribute, AGTestSubgraphRef subgraph) {
+    return AG::AttributeID::from_raw_value(attribute).subgraph() == &subgraph->subgraph;
+}
+
+uint32_t AGTestGraphAddInput(AGTestGraphRef graph, AGAttribute attribute, AGAttribute input) {
+    return graph->graph.add_input(AG::AttributeID::from_raw_value(attribute).to_node_ptr(),
+                                  AG::AttributeID::from_raw_value(input), false);
+}
+
+uint32_t AGTestAttributeInputCount(AGAttribute attribute) {
+    return AG::AttributeID::from_raw_value(attribute).to_node_ptr()->inputs().size();
+}
+
+AGAttribute AGTestAttributeInput(AGAttribute attribute, uint32_t index) {
+    return AG::AttributeID::from_raw_value(attribute).to_node_ptr()->inputs()[index].attribute_value();
+}
+
+uint32_t AGTestAttributeOutputCount(AGAttribute attribute) {
+    return AG::AttributeID::from_raw_value(attribute).to_node_ptr()->outputs().size();
+}
+
+void AGTestGraphMarkDirty(AGTestGraphRef graph, AGAttribute attribute) {
+    graph->graph.mark_dirty(AG::AttributeID::from_raw_value(attribute).to_node_ptr());
+}
+
+bool AGTestGraphUpdate(AGTestGraphRef graph) {
+    return graph->graph.update_dirty_nodes() == AG::UpdateStack::Status::Complete;
+}
+
+void AGTestGraphSetDeadlineAfterUpdates(AGTestGraphRef graph, uint32_t count) {
+    graph->deadline_updates = count == UINT32_MAX ? UINT32_MAX : graph->updates.size() + count;
+    graph->graph.set_deadline(UINT64_MAX);
+}
+
+uint32_t AGTestGraphUpdateCount(AGTestGraphRef graph) { return graph->updates.size(); }
+
+AGAttribute AGTestGraphUpdatedAttribute(AGTestGraphRef graph, uint32_t index) { return graph->updates[index]; }
+
+bool AGTestAttributeIsDirty(AGAttribute attribute) {
+    return AG::AttributeID::from_raw_value(attribute).to_node_ptr()->is_dirty();
+}
+
+const void *AGTestAttributeValue(AGAttribute attribute) {
+    auto node = AG::AttributeID::from_raw_value(attribute).to_node_ptr();
+    return node->has_value() ? node->direct_value().get() : nullptr;
+}
+
+uint32_t AGTestGraphPartitionCount(AGTestGraphRef graph, const AGAttribute *attributes, uint32_t count) {
+    AG::vector<AG::data::ptr<AG::Node>, 0, uint32_t> batch;
+    for (uint32_t index = 0; index < count; index++) {
+        batch.push_back(AG::AttributeID::from_raw_value(attributes[index]).to_node_ptr());
+    }
+    return AG::ParallelUpdate(graph->graph, batch).num_partitions();
+}
+
+uint32_t AGTestPageSize() { return AG::data::page_size; }
+
+uint32_t AGTestSubgraphAllocBytes(AGTestSubgraphRef subgraph, uint32_t size) {
+    return subgraph->subgraph.alloc_bytes(size, 7).offset();
+}
+
+uint32_t AGTestSubgraphAllocBytesRecycle(AGTestSubgraphRef subgraph, uint32_t size) {
+    return subgraph->subgraph.alloc_bytes_recycle(size, 7).offset();
+}
+
+uint32_t AGTestSubgraphReallocBytes(AGTestSubgraphRef subgraph, uint32_t offset, uint32_t size, uint32_t new_size) {
+    auto buffer = AG::data::ptr<void>(offset);
+    subgraph->subgraph.realloc_bytes(&buffer, size, new_size, 7);
+    return buffer.offset();
+}
+
+uint64_t AGTestSubgraphCompact(AGTestSubgraphRef subgraph, uint32_t max_fragments) {
+    return subgraph->subgraph.compact(max_fragments);
+}
+
+uint32_t AGTestSubgraphPageCount(AGTestSubgraphRef subgraph) {
+    return subgraph->subgraph.stats().num_pages.load(std::memory_order_relaxed);
+}
+
+uint32_t AGTestSubgraphFreeFragmentCount(AGTestSubgraphRef subgraph) {
+    return subgraph->subgraph.stats().num_free_fragments.load(std::memory_order_relaxed);
+}
+
+void AGTestSubgraphBeginScratchAllocations(AGTestSubgraphRef subgraph) {
+    subgraph->subgraph.begin_scratch_allocations();
+}
+
+void AGTestSubgraphEndScratchAllocations(AGTestSubgraphRef subgraph) { subgraph->subgraph.end_scratch_allocations(); }
+
+uint32_t AGTestSubgraphZoneID(AGTestSubgraphRef subgraph) { return subgraph->subgraph.info().zone_id(); }
+
+bool AGTestZoneIDIsLive(uint32_t zone_id) { return AG::data::table::shared().is_zone_id_live(zone_id); }
@@ -0,0 +1,69 @@
+#include "ComputeTestsSupport.h"
+
+#include <string>
+
+#include "Errors/Errors.h"
+#include "Layout/Compare.h"
+#include "Layout/LayoutDescriptor.h"
+#include "Layout/Program.h"
+#include "Swift/Metadata.h"
+
+namespace {
+
+/// Mode 2 compares fields of non-trivial types with their equatable conformances and existentials by their dynamic
+/// types, so that layouts hold more than data. Trivial fields are still compared as data.
+const AG::LayoutDescriptor::ComparisonOptions test_comparison_options =
+    AG::LayoutDescriptor::ComparisonOptions(2 | AG::LayoutDescriptor::ComparisonOptions::FetchLayoutsSynchronously);
+
+/// The program of the layout of `type` if it covers the whole value, otherwise `nullptr`.
+const AG::LayoutDescriptor::Program *_Nullable layout_program(const AG::swift::metadata &type,
+                                                              AG::ValueLayout *layout) {
+    *layout = AG::LayoutDescriptor::fetch(type, test_comparison_options, 0);
+    if (!*layout || *layout == AG::ValueLayoutEmpty) {
+        return nullptr;
+    }
+    auto program = AG::LayoutDescriptor::program(*layout);
+    return program && program->extent() <= type.vw_size() ? program : nullptr;
+}
+
+} // namespace
+
+bool AGTestCompareBytes(const void *lhs, const void *rhs, size_t size, size_t *failure_location) {
+    return AG::LayoutDescriptor::compare_bytes(static_cast<const unsigned char *>(lhs),
+                                               static_cast<const unsigned char *>(rhs), size, failure_location);
+}
+
+bool AGTestLayoutHasProgram(AGTypeID type) {
+    AG::ValueLayout layout = nullptr;
+    return layout_program(*reinterpret_cast<const AG::swift::metadata *>(type), &layout) != nullptr;
+}
+
+CFStringRef AGTestLayoutDescription(AGTypeID type) {
+    auto layout = AG::LayoutDescriptor::fetch(*reinterpret_cast<const AG::swift::metadata *>(type),
+                                              test_comparison_options, 0);
+    std::string description;
+    if (layout && layout != AG::ValueLayoutEmpty) {
+        AG::LayoutDescriptor::print(description, layout);
+    }
+
+    CFStringRef result = CFStringCreateWithCString(kCFAllocatorDefault, description.c_str(), kCFStringEncodingUTF8);
+    CFAutorelease(result);
+    return result;
+}
+
+bool AGTestCompareLayout(AGTypeID type, const void *lhs, const void *rhs, bool compiled) {
+    auto &metadata = *reinterpret_cast<const AG::swift::metadata *>(type);
+    AG::ValueLayout layout = nullptr;
+    auto program = layout_program(metadata, &layout);
+    if (!program) {
+        AG::precondition_failure("no layout program for type");
+    }
+
+    auto lhs_bytes = static_cast<const unsigned char *>(lhs);
+    auto rhs_bytes = static_cast<const unsigned char *>(rhs);
+    if (compiled) {
+        return program->compare(lhs_bytes, rhs_bytes, test_comparison_options);
+    }
+    auto compare_object = AG::LayoutDescriptor::Compare();
+    return compare_object(layout, lhs_bytes, rhs_bytes, 0, metadata.vw_size(), test_comparison_options);
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <CoreFoundation/CFString.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Attribute/AGAttribute.h"
+#include "Swift/AGType.h"
+
+CF_ASSUME_NONNULL_BEGIN
+CF_IMPLICIT_BRIDGING_ENABLED
+
+CF_EXTERN_C_BEGIN
+
+// Access to ComputeCxx internals for ComputeTests, which can't reach the C++ classes themselves.
+
+// Graphs
+
+typedef struct AGTestGraphStorage *AGTestGraphRef;
+typedef struct AGTestSubgraphStorage *AGTestSubgraphRef;
+
+/// Creates a graph with a single attribute type, whose body and value are of the types given. Updating an attribute
+/// records it, see `AGTestGraphUpdatedAttribute`, and sets its value to a copy of its body if the two types are the
+/// same.
+AGTestGraphRef AGTestGraphCreate(AGTypeID body_type, AGTypeID value_type);
+void AGTestGraphDestroy(AGTestGraphRef graph);
+
+AGTestSubgraphRef AGTestSubgraphCreate(AGTestGraphRef graph);
+
+/// Destroys the subgraph's nodes, see `Subgraph::destroy_nodes`, then the subgraph itself.
+void AGTestSubgraphDestroy(AGTestSubgraphRef subgraph);
+
+/// Creates an attribute of the graph's attribute type with the body at `body`.
+AGAttribute AGTestSubgraphAddAttribute(AGTestSubgraphRef subgraph, const void *body);
+
+/// Creates `count` attributes at once, see `Subgraph::add_nodes`.
+void AGTestSubgraphAddAttributes(AGTestSubgraphRef subgraph, const void *_Nullable bodies, size_t body_stride,
+                                 uint32_t count, AGAttribute *_Nullable attributes);
+
+/// Whether the page holding `attribute` belongs to `subgraph`.
+bool AGTestAttributeIsInSubgraph(AGAttribute attribute, AGTestSubgraphRef subgraph);
+
+/// Adds `input` to the inputs of `attribute`, see `Graph::add_input`.
+uint32_t AGTestGraphAddInput(AGTestGraphRef graph, AGAttribute attribute, AGAttribute input);
+
+uint32_t AGTestAttributeInputCount(AGAttribute attribute);
+AGAttribute AGTestAttributeInput(AGAttribute attribute, uint32_t index);
+uint32_t AGTestAttributeOutputCount(AGAttribute attribute);
+
+// Updates
+
+/// Marks `attribute` dirty, see `Graph::mark_dirty`.
+void AGTestGraphMarkDirty(AGTestGraphRef graph, AGAttribute attribute);
+
+/// Updates the attributes marked dirty, see `Graph::update_dirty_nodes`. Returns false if the deadline passed first.
+bool AGTestGraphUpdate(AGTestGraphRef graph);
+
+/// Clears the graph's deadline, then lets it pass once `count` more attributes have been updated. A `count` of
+/// `UINT32_MAX` leaves it clear.
+void AGTestGraphSetDeadlineAfterUpdates(AGTestGraphRef graph, uint32_t count);
+
+/// The number of attributes updated since the graph was created, counting each time an attribute is updated.
+uint32_t AGTestGraphUpdateCount(AGTestGraphRef graph);
+AGAttribute AGTestGraphUpdatedAttribute(AGTestGraphRef graph, uint32_t index);
+
+bool AGTestAttributeIsDirty(AGAttribute attribute);
+
+/// The value of `attribute`, or `NULL` if it hasn't been allocated or is stored indirectly.
+const void *_Nullable AGTestAttributeValue(AGAttribute attribute);
+
+/// The number of partitions a parallel update would split the batch `attributes` into, see `ParallelUpdate`.
+uint32_t AGTestGraphPartitionCount(AGTestGraphRef graph, const AGAttribute *attributes, uint32_t count);
+
+// Zones
+
+/// The size of a data page, see AG_PAGE_SIZE.
+uint32_t AGTestPageSize(void);
+
+/// Allocates `size` bytes, 8-byte aligned, in the subgraph's zone and returns their offset, see `zone::alloc_bytes`.
+uint32_t AGTestSubgraphAllocBytes(AGTestSubgraphRef subgraph, uint32_t size);
+
+/// Allocates `size` bytes, 8-byte aligned, from a free fragment of the subgraph's zone if one of a suitable size
+/// class fits, and otherwise like `AGTestSubgraphAllocBytes`, see `zone::alloc_bytes_recycle`.
+uint32_t AGTestSubgraphAllocBytesRecycle(AGTestSubgraphRef subgraph, uint32_t size);
+
+/// Grows the allocation at `offset` to `new_size` bytes and returns its new offset. An allocation that has to move
+/// leaves its old bytes as a free fragment, see `zone::realloc_bytes`.
+uint32_t AGTestSubgraphReallocBytes(AGTestSubgraphRef subgraph, uint32_t offset, uint32_t size, uint32_t new_size);
+
+/// Compacts the subgraph's zone, see `Subgraph::compact`.
+uint64_t AGTestSubgraphCompact(AGTestSubgraphRef subgraph, uint32_t max_fragments);
+
+uint32_t AGTestSubgraphPageCount(AGTestSubgraphRef subgraph);
+uint32_t AGTestSubgraphFreeFragmentCount(AGTestSubgraphRef subgraph);
+
+/// Opens and closes a scope whose allocations are released when it ends, see `Subgraph::begin_scratch_allocations`.
+void AGTestSubgraphBeginScratchAllocations(AGTestSubgraphRef subgraph);
+void AGTestSubgraphEndScratchAllocations(AGTestSubgraphRef subgraph);
+
+/// The id of the subgraph's zone, which weak references made now record, see `WeakAttributeID`.
+uint32_t AGTestSubgraphZoneID(AGTestSubgraphRef subgraph);
+
+/// Whether weak references that recorded `zone_id` are still live, see `table::is_zone_id_live`.
+bool AGTestZoneIDIsLive(uint32_t zone_id);
+
+// Layouts
+
+/// Compares `size` bytes at `lhs` and `rhs`, see `LayoutDescriptor::compare_bytes`. If they differ, stores the offset
+/// of the first byte that differs in `failure_location`.
+bool AGTestCompareBytes(const void *lhs, const void *rhs, size_t size, size_t *_Nullable failure_location);
+
+/// Whether the layout of `type` was compiled into a program that covers the whole value, see
+/// `LayoutDescriptor::program`. Layouts are built for comparison mode 2, where fields of non-trivial types are compared
+/// with their equatable conformances.
+bool AGTestLayoutHasProgram(AGTypeID type);
+
+/// The layout of `type` printed one item per line, with runs of data and skipped bytes as `(read n)` and `(skip n)`,
+/// see `LayoutDescriptor::print`. Empty if values of the type are compared as plain data.
+CFStringRef AGTestLayoutDescription(AGTypeID type);
+
+/// Compares two values of `type` with its layout, either by running the layout's program or by interpreting the
+/// layout itself. The type must have a program, see `AGTestLayoutHasProgram`.
+bool AGTestCompareLayout(AGTypeID type, const void *lhs, const void *rhs, bool compiled);
+
+// Data tables
+
+typedef struct AGTestDataTableStorage *AGTestDataTableRef;
+
+/// Creates a data table separate from the shared one, so that the pages it hands out depend only on the calls made to
+/// it. Tables are never destroyed, so this is only for tests.
+AGTestDataTableRef AGTestDataTableCreate(void);
+
+/// Allocates `count` consecutive pages and returns the index of the first, see `table::alloc_pages`.
+uint32_t AGTestDataTableAllocPages(AGTestDataTableRef table, uint32_t count);
+void AGTestDataTableDeallocPages(AGTestDataTableRef table, uint32_t index, uint32_t count);
+
+// Concurrent tables
+
+typedef struct AGTestProbeStats {
+    size_t capacity;
+    size_t max_probe_length;
+    double mean_probe_length;
+} AGTestProbeStats;
+
+/// Inserts `count` keys spaced `alignment` bytes apart into an empty `ConcurrentTable`, then measures how many slots
+/// looking up each of them visits.
+AGTestProbeStats AGTestConcurrentTableProbeStats(size_t count, size_t alignment);
+
+CF_EXTERN_C_END
+
+CF_IMPLICIT_BRIDGING_DISABLED
+CF_ASSUME_NONNULL_END
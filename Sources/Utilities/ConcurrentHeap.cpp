@@ -0,0 +1,102 @@
+#include "Utilities/ConcurrentHeap.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "Utilities/Heap.h"
+
+namespace util {
+
+namespace {
+
+constexpr size_t default_increment = 0x2000;
+
+// Never zero, so that an empty cache entry doesn't match any heap
+std::atomic<uint64_t> next_heap_id = 1;
+
+struct ThreadChunk {
+    uint64_t heap_id;
+    char *_Nullable free_start;
+    size_t capacity;
+};
+
+constexpr size_t thread_chunk_count = 16;
+thread_local ThreadChunk thread_chunks[thread_chunk_count] = {};
+
+} // namespace
+
+std::shared_ptr<ConcurrentHeap> ConcurrentHeap::make_shared(size_t increment) {
+    return std::make_shared<ConcurrentHeap>(increment);
+}
+
+ConcurrentHeap::ConcurrentHeap(size_t increment) {
+    // enforce minimum but treat 0 as the default
+    _increment = increment > 0 ? std::max(increment, Heap::minimum_increment) : default_increment;
+    _id = next_heap_id.fetch_add(1, std::memory_order_relaxed);
+    _node = nullptr;
+}
+
+ConcurrentHeap::~ConcurrentHeap() { reset(); }
+
+void *ConcurrentHeap::allocate_node(size_t size) {
+    Node *node = static_cast<Node *>(malloc(sizeof(Node) + size));
+    if (!node) {
+        return nullptr;
+    }
+
+    node->next = _node.load(std::memory_order_relaxed);
+    while (!_node.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    return node + 1;
+}
+
+void *ConcurrentHeap::alloc_(size_t size, size_t alignment) {
+    uint64_t id = _id.load(std::memory_order_relaxed);
+    ThreadChunk &chunk = thread_chunks[id % thread_chunk_count];
+
+    uintptr_t start = (uintptr_t(chunk.free_start) + alignment - 1) & ~uintptr_t(alignment - 1);
+    size_t padding = start - uintptr_t(chunk.free_start);
+    if (chunk.heap_id != id || chunk.capacity < size + padding) {
+        // Large allocations, and any that might not fit in a new chunk once aligned, get a node of their own rather
+        // than replacing the current chunk
+        if (size > Heap::minimum_increment || size + alignment - 1 > _increment) {
+            return allocate_node(size);
+        }
+
+        char *buffer = static_cast<char *>(allocate_node(_increment));
+        if (!buffer) {
+            return nullptr;
+        }
+        chunk.heap_id = id;
+        chunk.free_start = buffer;
+        chunk.capacity = _increment;
+
+        start = (uintptr_t(buffer) + alignment - 1) & ~uintptr_t(alignment - 1);
+        padding = start - uintptr_t(buffer);
+    }
+
+    chunk.free_start = reinterpret_cast<char *>(start + size);
+    chunk.capacity -= size + padding;
+    return reinterpret_cast<void *>(start);
+}
+
+void ConcurrentHeap::reset() {
+    _id.store(next_heap_id.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+
+    Node *node = _node.exchange(nullptr, std::memory_order_acquire);
+    while (node) {
+        Node *next = node->next;
+        free(node);
+        node = next;
+    }
+}
+
+size_t ConcurrentHeap::num_nodes() const {
+    size_t count = 0;
+    for (Node *node = _node.load(std::memory_order_acquire); node != nullptr; node = node->next) {
+        count += 1;
+    }
+    return count;
+}
+
+} // namespace util
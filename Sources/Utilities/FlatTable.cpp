@@ -0,0 +1,315 @@
+#include "Utilities/FlatTable.h"
+
+#include <bit>
+#include <cstring>
+#include <memory>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "Utilities/HashTable.h"
+
+namespace util {
+
+namespace {
+
+// Full slots have a control byte between 0 and 127, the low seven bits of the hash of their key
+constexpr int8_t control_empty = -128;
+constexpr int8_t control_deleted = -2;
+
+constexpr UntypedFlatTable::size_type initial_capacity = 16;
+
+/// The control bytes of consecutive slots, compared all at once. Matches are returned as a mask in which the slot at
+/// index `i` of the group corresponds to bit `i << shift`.
+#if defined(__SSE2__)
+struct Group {
+    static constexpr size_t width = 16;
+    static constexpr unsigned shift = 0;
+
+    __m128i control;
+
+    explicit Group(const int8_t *position) : control(_mm_loadu_si128(reinterpret_cast<const __m128i *>(position))) {}
+
+    uint64_t match(int8_t value) const {
+        return uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(value), control)));
+    }
+    uint64_t match_empty() const { return match(control_empty); }
+    uint64_t match_empty_or_deleted() const { return uint16_t(_mm_movemask_epi8(control)); }
+};
+#elif defined(__ARM_NEON)
+struct Group {
+    static constexpr size_t width = 8;
+    static constexpr unsigned shift = 3;
+    static constexpr uint64_t msbs = 0x8080808080808080;
+
+    int8x8_t control;
+
+    explicit Group(const int8_t *position) : control(vld1_s8(position)) {}
+
+    uint64_t match(int8_t value) const {
+        return vget_lane_u64(vreinterpret_u64_u8(vceq_s8(control, vdup_n_s8(value))), 0) & msbs;
+    }
+    uint64_t match_empty() const { return match(control_empty); }
+    uint64_t match_empty_or_deleted() const { return vget_lane_u64(vreinterpret_u64_s8(control), 0) & msbs; }
+};
+#else
+struct Group {
+    static constexpr size_t width = 8;
+    static constexpr unsigned shift = 3;
+    static constexpr uint64_t lsbs = 0x0101010101010101;
+    static constexpr uint64_t msbs = 0x8080808080808080;
+
+    uint64_t control;
+
+    explicit Group(const int8_t *position) { memcpy(&control, position, sizeof(control)); }
+
+    // May report a byte following a real match, which is harmless since keys are compared after matching
+    uint64_t match(int8_t value) const {
+        uint64_t x = control ^ (lsbs * uint8_t(value));
+        return (x - lsbs) & ~x & msbs;
+    }
+    // Empty is the only control byte with the high bit set and bit 1 clear
+    uint64_t match_empty() const { return control & ~(control << 6) & msbs; }
+    uint64_t match_empty_or_deleted() const { return control & msbs; }
+};
+#endif
+
+/// Visits groups in a triangular sequence, which reaches every group once the capacity is a power of two.
+struct Probe {
+    UntypedFlatTable::size_type mask;
+    UntypedFlatTable::size_type offset;
+    UntypedFlatTable::size_type step = 0;
+
+    Probe(uint64_t hash_value, UntypedFlatTable::size_type capacity)
+        : mask(capacity - 1), offset((hash_value >> 7) & mask) {}
+
+    UntypedFlatTable::size_type index(uint64_t match) const {
+        return (offset + (std::countr_zero(match) >> Group::shift)) & mask;
+    }
+    void next() {
+        step += Group::width;
+        offset = (offset + step) & mask;
+    }
+};
+
+int8_t control_for_hash(uint64_t hash_value) { return int8_t(hash_value & 0x7f); }
+
+// At most seven eighths of the slots are used, so that probes end quickly at an empty slot
+UntypedFlatTable::size_type max_load(UntypedFlatTable::size_type capacity) { return capacity - capacity / 8; }
+
+} // namespace
+
+std::shared_ptr<UntypedFlatTable> UntypedFlatTable::make_shared() { return std::make_shared<UntypedFlatTable>(); }
+
+UntypedFlatTable::UntypedFlatTable() {
+    _hash = pointer_hash;
+    _compare = pointer_compare;
+    _did_remove_key = nullptr;
+    _did_remove_value = nullptr;
+    _slots = nullptr;
+    _control = nullptr;
+    _capacity = 0;
+    _count = 0;
+    _growth_left = 0;
+    _compare_by_pointer = true;
+}
+
+UntypedFlatTable::UntypedFlatTable(hasher custom_hash, key_equal custom_compare, key_callback did_remove_key,
+                                   value_callback did_remove_value) {
+    _hash = custom_hash != nullptr ? custom_hash : pointer_hash;
+    _compare = custom_compare != nullptr ? custom_compare : pointer_compare;
+    _did_remove_key = did_remove_key;
+    _did_remove_value = did_remove_value;
+    _slots = nullptr;
+    _control = nullptr;
+    _capacity = 0;
+    _count = 0;
+    _growth_left = 0;
+    _compare_by_pointer = custom_compare == nullptr || custom_compare == pointer_compare;
+}
+
+UntypedFlatTable::~UntypedFlatTable() {
+    if ((_did_remove_key || _did_remove_value) && _count) {
+        for (size_type index = 0; index < _capacity; ++index) {
+            if (_control[index] >= 0) {
+                if (_did_remove_key) {
+                    _did_remove_key(_slots[index].key);
+                }
+                if (_did_remove_value) {
+                    _did_remove_value(_slots[index].value);
+                }
+            }
+        }
+    }
+    delete[] reinterpret_cast<char *>(_slots);
+}
+
+#pragma mark - Managing slots
+
+// Slots and control bytes share one allocation. The control bytes of the first group are repeated after the last
+// slot's, so that a group can be loaded starting at any slot without wrapping around.
+
+void UntypedFlatTable::resize(size_type capacity) {
+    Slot *old_slots = _slots;
+    int8_t *old_control = _control;
+    size_type old_capacity = _capacity;
+
+    char *buffer = new char[capacity * sizeof(Slot) + capacity + Group::width];
+    _slots = reinterpret_cast<Slot *>(buffer);
+    _control = reinterpret_cast<int8_t *>(buffer + capacity * sizeof(Slot));
+    std::memset(_control, control_empty, capacity + Group::width);
+    _capacity = capacity;
+    _growth_left = max_load(capacity) - _count;
+
+    for (size_type old_index = 0; old_index < old_capacity; ++old_index) {
+        if (old_control[old_index] >= 0) {
+            uint64_t hash_value = _hash(old_slots[old_index].key);
+            size_type index = find_insert_index(hash_value);
+            set_control(index, control_for_hash(hash_value));
+            _slots[index] = old_slots[old_index];
+        }
+    }
+
+    delete[] reinterpret_cast<char *>(old_slots);
+}
+
+void UntypedFlatTable::set_control(size_type index, int8_t control) {
+    _control[index] = control;
+    if (index < Group::width) {
+        _control[_capacity + index] = control;
+    }
+}
+
+UntypedFlatTable::size_type UntypedFlatTable::find_index(key_type key, uint64_t hash_value,
+                                                         bool compare_by_pointer) const {
+    int8_t control = control_for_hash(hash_value);
+    for (Probe probe = Probe(hash_value, _capacity);; probe.next()) {
+        Group group = Group(_control + probe.offset);
+        for (uint64_t match = group.match(control); match; match &= match - 1) {
+            size_type index = probe.index(match);
+            if (compare_by_pointer ? _slots[index].key == key : _compare(_slots[index].key, key)) {
+                return index;
+            }
+        }
+        if (group.match_empty()) {
+            return _capacity;
+        }
+    }
+}
+
+UntypedFlatTable::size_type UntypedFlatTable::find_insert_index(uint64_t hash_value) const {
+    for (Probe probe = Probe(hash_value, _capacity);; probe.next()) {
+        if (uint64_t match = Group(_control + probe.offset).match_empty_or_deleted()) {
+            return probe.index(match);
+        }
+    }
+}
+
+void UntypedFlatTable::erase(size_type index) {
+    if (_did_remove_key) {
+        _did_remove_key(_slots[index].key);
+    }
+    if (_did_remove_value) {
+        _did_remove_value(_slots[index].value);
+    }
+
+    // Probes for other keys may have passed through this slot, so it can't become empty again
+    set_control(index, control_deleted);
+    _count -= 1;
+}
+
+#pragma mark - Lookup
+
+UntypedFlatTable::value_type UntypedFlatTable::lookup(key_type key, nullable_key_type *found_key_out) const noexcept {
+    if (_count) {
+        size_type index = find_index(key, _hash(key), _compare_by_pointer);
+        if (index != _capacity) {
+            if (found_key_out) {
+                *found_key_out = _slots[index].key;
+            }
+            return _slots[index].value;
+        }
+    }
+    if (found_key_out) {
+        *found_key_out = nullptr;
+    }
+    return nullptr;
+}
+
+void UntypedFlatTable::for_each(entry_callback body, void *context) const {
+    for (size_type index = 0; _count && index < _capacity; ++index) {
+        if (_control[index] >= 0) {
+            body(_slots[index].key, _slots[index].value, context);
+        }
+    }
+}
+
+#pragma mark - Modifying entries
+
+bool UntypedFlatTable::insert(key_type key, value_type value) {
+    uint64_t hash_value = _hash(key);
+
+    if (_capacity == 0) {
+        resize(initial_capacity);
+    } else {
+        // replace existing if match
+        size_type index = find_index(key, hash_value, _compare_by_pointer);
+        if (index != _capacity) {
+            if (_did_remove_key) {
+                _did_remove_key(_slots[index].key);
+            }
+            if (_did_remove_value) {
+                _did_remove_value(_slots[index].value);
+            }
+            _slots[index] = {key, value};
+            return false;
+        }
+    }
+
+    // insert new
+    size_type index = find_insert_index(hash_value);
+    if (_growth_left == 0 && _control[index] != control_deleted) {
+        // Deleted slots count as used, so if most of them are deleted the table is rebuilt at the same size instead
+        // of growing
+        resize(_count * 2 < max_load(_capacity) ? _capacity : _capacity * 2);
+        index = find_insert_index(hash_value);
+    }
+    if (_control[index] == control_empty) {
+        _growth_left -= 1;
+    }
+
+    set_control(index, control_for_hash(hash_value));
+    _slots[index] = {key, value};
+    _count += 1;
+
+    return true;
+}
+
+bool UntypedFlatTable::remove(key_type key) {
+    if (_count == 0) {
+        return false;
+    }
+    size_type index = find_index(key, _hash(key), _compare_by_pointer);
+    if (index == _capacity) {
+        return false;
+    }
+    erase(index);
+    return true;
+}
+
+bool UntypedFlatTable::remove_ptr(key_type key) {
+    if (_count == 0) {
+        return false;
+    }
+    size_type index = find_index(key, _hash(key), true);
+    if (index == _capacity) {
+        return false;
+    }
+    erase(index);
+    return true;
+}
+
+} // namespace util
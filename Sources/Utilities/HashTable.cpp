@@ -1,5 +1,7 @@
 #include "Utilities/HashTable.h"
 
+#include <cstdlib>
+#include <cstring>
 #include <memory>
 
 #include "Utilities/Heap.h"
@@ -28,6 +30,11 @@ uint64_t string_hash(char const *str) {
 
 constexpr uint32_t initial_bucket_mask_width = 4;
 
+// The number of old buckets moved on each insertion or removal while growing incrementally. Growing doubles the
+// number of buckets when the table holds four entries per bucket, so every old bucket has been moved long before the
+// table needs to grow again.
+constexpr uint64_t old_buckets_moved_per_change = 8;
+
 std::shared_ptr<UntypedTable> UntypedTable::make_shared() { return std::make_shared<UntypedTable>(); }
 
 UntypedTable::UntypedTable() {
@@ -43,6 +50,11 @@ UntypedTable::UntypedTable() {
     _bucket_mask_width = 0;
     _is_heap_owner = true;
     _compare_by_pointer = true;
+    _grows_incrementally = false;
+    _old_buckets = nullptr;
+    _old_bucket_mask = 0;
+    _old_bucket_mask_width = 0;
+    _next_old_bucket = 0;
 }
 
 UntypedTable::UntypedTable(hasher custom_hash, key_equal custom_compare, key_callback did_remove_key,
@@ -59,23 +71,37 @@ UntypedTable::UntypedTable(hasher custom_hash, key_equal custom_compare, key_cal
     _bucket_mask_width = 0;
     _is_heap_owner = heap == nullptr;
     _compare_by_pointer = custom_compare == nullptr || custom_compare == pointer_compare;
+    _grows_incrementally = false;
+    _old_buckets = nullptr;
+    _old_bucket_mask = 0;
+    _old_bucket_mask_width = 0;
+    _next_old_bucket = 0;
 }
 
 UntypedTable::~UntypedTable() {
     if ((_did_remove_key || _did_remove_value) && _count) {
-        for (uint32_t bucket = 0; !(bucket >> _bucket_mask_width); bucket++) {
-            for (HashNode *node = _buckets[bucket]; node != nullptr; node = node->next) {
-                if (_did_remove_key) {
-                    _did_remove_key(node->key);
+        struct Context {
+            key_callback _Nullable did_remove_key;
+            value_callback _Nullable did_remove_value;
+        };
+        Context context = {_did_remove_key, _did_remove_value};
+        for_each(
+            [](const key_type key, const value_type value, void *context_pointer) {
+                auto context = static_cast<Context *>(context_pointer);
+                if (context->did_remove_key) {
+                    context->did_remove_key(key);
                 }
-                if (_did_remove_value) {
-                    _did_remove_value(node->value);
+                if (context->did_remove_value) {
+                    context->did_remove_value(value);
                 }
-            }
-        }
+            },
+            &context);
     }
-    if (_bucket_mask_width > initial_bucket_mask_width) {
-        free(_buckets);
+    if (_old_buckets) {
+        free_buckets(_old_buckets, _old_bucket_mask_width);
+    }
+    if (_buckets) {
+        free_buckets(_buckets, _bucket_mask_width);
     }
     if (_is_heap_owner && _heap) {
         delete _heap;
@@ -85,7 +111,28 @@ UntypedTable::~UntypedTable() {
 #pragma mark - Managing buckets
 
 // Buckets are initially allocated by the util::Heap instance,
-// until they grow past initial_bucket_mask_width where they are allocated using new.ˆ
+// until they grow past initial_bucket_mask_width where they are allocated using calloc, which can hand out large
+// arrays as pages that are already zeroed.
+
+UntypedTable::Bucket *UntypedTable::allocate_buckets(uint32_t mask_width) {
+    size_t num_buckets = size_t(1) << mask_width;
+    if (mask_width > initial_bucket_mask_width) {
+        return static_cast<Bucket *>(calloc(num_buckets, sizeof(Bucket)));
+    }
+
+    if (_heap == nullptr) {
+        _heap = new Heap(nullptr, 0, Heap::minimum_increment);
+    }
+    Bucket *buckets = _heap->alloc<Bucket>(num_buckets);
+    std::memset(buckets, 0, sizeof(Bucket) * num_buckets);
+    return buckets;
+}
+
+void UntypedTable::free_buckets(Bucket *buckets, uint32_t mask_width) {
+    if (mask_width > initial_bucket_mask_width) {
+        free(buckets);
+    }
+}
 
 void UntypedTable::create_buckets() {
     if (_buckets != nullptr) {
@@ -94,53 +141,78 @@ void UntypedTable::create_buckets() {
 
     _bucket_mask_width = initial_bucket_mask_width;
     _bucket_mask = (1 << initial_bucket_mask_width) - 1;
-
-    if (_heap == nullptr) {
-        _heap = new Heap(nullptr, 0, Heap::minimum_increment);
-    }
-
-    size_t num_buckets = (1 << initial_bucket_mask_width);
-    _buckets = _heap->alloc<Bucket>(num_buckets);
-    std::memset(_buckets, 0, sizeof(Bucket) * num_buckets);
+    _buckets = allocate_buckets(initial_bucket_mask_width);
 }
 
 void UntypedTable::grow_buckets() {
     if (_bucket_mask_width > 30) {
         return;
     }
+    resize_buckets(_bucket_mask_width + 1, _grows_incrementally);
+}
 
-    uint32_t old_width = _bucket_mask_width;
-    _bucket_mask_width = old_width + 1;
+void UntypedTable::resize_buckets(uint32_t mask_width, bool incrementally) {
+    // A previous incremental grow must finish before the next one starts
+    if (_old_buckets) {
+        move_old_buckets(UINT64_MAX);
+    }
 
-    Bucket *old_buckets = _buckets;
-    Bucket *new_buckets = nullptr;
+    Bucket *new_buckets = allocate_buckets(mask_width);
+    if (!new_buckets) {
+        return;
+    }
 
-    size_t num_buckets = 1 << _bucket_mask_width;
-    if (_bucket_mask_width > initial_bucket_mask_width) {
-        new_buckets = new Bucket[num_buckets];
-    } else {
-        if (_heap == nullptr) {
-            _heap = new Heap(nullptr, 0, Heap::minimum_increment);
-        }
-        new_buckets = _heap->alloc<Bucket>(num_buckets);
-    }
-    std::memset(new_buckets, 0, sizeof(Bucket) * num_buckets);
-
-    // redistribute old buckets into new
-    if (new_buckets) {
-        _bucket_mask = num_buckets - 1;
-        for (uint32_t i = 0; !(i >> old_width); i++) {
-            for (UntypedTable::HashNode *node = old_buckets[i]; node != nullptr; node = node->next) {
-                uint64_t new_bucket = _bucket_mask & node->hash_value;
-                node->next = new_buckets[new_bucket];
-                new_buckets[new_bucket] = node;
-            }
-        }
-        _buckets = new_buckets;
+    _old_buckets = _buckets;
+    _old_bucket_mask = _bucket_mask;
+    _old_bucket_mask_width = _bucket_mask_width;
+    _next_old_bucket = 0;
+
+    _buckets = new_buckets;
+    _bucket_mask_width = mask_width;
+    _bucket_mask = (uint64_t(1) << _bucket_mask_width) - 1;
+
+    if (!incrementally) {
+        move_old_buckets(UINT64_MAX);
+    }
+}
 
-        if (old_width > initial_bucket_mask_width) {
-            delete old_buckets;
+void UntypedTable::reserve(size_type count) {
+    uint32_t mask_width = _buckets ? _bucket_mask_width : initial_bucket_mask_width;
+    while (mask_width <= 30 && count > size_type(4) << mask_width) {
+        mask_width += 1;
+    }
+
+    if (_buckets == nullptr) {
+        _bucket_mask_width = mask_width;
+        _bucket_mask = (uint64_t(1) << mask_width) - 1;
+        _buckets = allocate_buckets(mask_width);
+    } else if (mask_width > _bucket_mask_width) {
+        resize_buckets(mask_width, false);
+    }
+}
+
+/// Redistributes up to `count` old buckets into the new bucket array, releasing the old array once it is empty.
+void UntypedTable::move_old_buckets(uint64_t count) {
+    uint64_t num_old_buckets = _old_bucket_mask + 1;
+    uint64_t end = count < num_old_buckets - _next_old_bucket ? _next_old_bucket + count : num_old_buckets;
+    for (uint64_t i = _next_old_bucket; i < end; i++) {
+        UntypedTable::HashNode *next = nullptr;
+        for (UntypedTable::HashNode *node = _old_buckets[i]; node != nullptr; node = next) {
+            next = node->next;
+            uint64_t new_bucket = _bucket_mask & node->hash_value;
+            node->next = _buckets[new_bucket];
+            _buckets[new_bucket] = node;
         }
+        _old_buckets[i] = nullptr;
+    }
+    _next_old_bucket = end;
+
+    if (_next_old_bucket == num_old_buckets) {
+        free_buckets(_old_buckets, _old_bucket_mask_width);
+        _old_buckets = nullptr;
+        _old_bucket_mask = 0;
+        _old_bucket_mask_width = 0;
+        _next_old_bucket = 0;
     }
 }
 
@@ -148,26 +220,45 @@ void UntypedTable::grow_buckets() {
 
 UntypedTable::value_type UntypedTable::lookup(key_type key, nullable_key_type *found_key_out) const noexcept {
     if (_count) {
-        uint64_t hash_value = _hash(key);
+        return lookup_prehashed(key, _hash(key), found_key_out);
+    }
+    if (found_key_out) {
+        *found_key_out = nullptr;
+    }
+    return nullptr;
+}
+
+UntypedTable::value_type UntypedTable::lookup_prehashed(key_type key, uint64_t hash_value,
+                                                        nullable_key_type *found_key_out) const noexcept {
+    if (_count) {
         HashNode *node = _buckets[_bucket_mask & hash_value];
-        if (_compare_by_pointer) {
-            for (; node != nullptr; node = node->next) {
-                if (node->key == key) {
-                    if (found_key_out) {
-                        *found_key_out = node->key;
+        bool checked_old_bucket = _old_buckets == nullptr;
+        while (true) {
+            if (_compare_by_pointer) {
+                for (; node != nullptr; node = node->next) {
+                    if (node->key == key) {
+                        if (found_key_out) {
+                            *found_key_out = node->key;
+                        }
+                        return node->value;
                     }
-                    return node->value;
                 }
-            }
-        } else if (node) {
-            for (; node != nullptr; node = node->next) {
-                if (node->hash_value == hash_value && _compare(node->key, key)) {
-                    if (found_key_out) {
-                        *found_key_out = node->key;
+            } else if (node) {
+                for (; node != nullptr; node = node->next) {
+                    if (node->hash_value == hash_value && _compare(node->key, key)) {
+                        if (found_key_out) {
+                            *found_key_out = node->key;
+                        }
+                        return node->value;
                     }
-                    return node->value;
                 }
             }
+            if (checked_old_bucket) {
+                break;
+            }
+            // Old buckets that have been moved are empty
+            node = _old_buckets[_old_bucket_mask & hash_value];
+            checked_old_bucket = true;
         }
     }
     if (found_key_out) {
@@ -176,35 +267,61 @@ UntypedTable::value_type UntypedTable::lookup(key_type key, nullable_key_type *f
     return nullptr;
 }
 
+void UntypedTable::for_each(entry_callback body, void *context) const {
+    if (_count) {
+        for (uint32_t i = 0; !(i >> _bucket_mask_width); i++) {
+            for (UntypedTable::HashNode *node = _buckets[i]; node != nullptr; node = node->next) {
+                body(node->key, node->value, context);
+            }
+        }
+        if (_old_buckets) {
+            for (uint64_t i = _next_old_bucket; i <= _old_bucket_mask; i++) {
+                for (UntypedTable::HashNode *node = _old_buckets[i]; node != nullptr; node = node->next) {
+                    body(node->key, node->value, context);
+                }
+            }
+        }
+    }
+}
+
 #pragma mark - Modifying entries
 
-bool UntypedTable::insert(key_type key, value_type value) {
+bool UntypedTable::insert(key_type key, value_type value) { return insert_prehashed(key, value, _hash(key)); }
+
+bool UntypedTable::insert_prehashed(key_type key, value_type value, uint64_t hash_value) {
     if (_buckets == nullptr) {
         this->create_buckets();
     }
-
-    void *result;
-
-    uint64_t hash_value = _hash(key);
-    HashNode *node = _buckets[hash_value & _bucket_mask];
+    if (_old_buckets) {
+        move_old_buckets(old_buckets_moved_per_change);
+    }
 
     // replace existing if match
-    for (; node != nullptr; node = node->next) {
-        if (node->hash_value == hash_value && _compare(node->key, key)) {
-            if (_did_remove_key) {
-                _did_remove_key(node->key);
-            }
-            if (_did_remove_value) {
-                _did_remove_value(node->value);
+    HashNode *node = _buckets[hash_value & _bucket_mask];
+    bool checked_old_bucket = _old_buckets == nullptr;
+    while (true) {
+        for (; node != nullptr; node = node->next) {
+            if (node->hash_value == hash_value && _compare(node->key, key)) {
+                if (_did_remove_key) {
+                    _did_remove_key(node->key);
+                }
+                if (_did_remove_value) {
+                    _did_remove_value(node->value);
+                }
+                node->key = key;
+                node->value = value;
+                return false;
             }
-            node->key = key;
-            node->value = value;
-            return false;
         }
+        if (checked_old_bucket) {
+            break;
+        }
+        node = _old_buckets[hash_value & _old_bucket_mask];
+        checked_old_bucket = true;
     }
 
     // insert new
-    if (_count + 1 > 4 << _bucket_mask_width) {
+    if (_count + 1 > size_type(4) << _bucket_mask_width) {
         this->grow_buckets();
     }
     if (!_heap) {
@@ -231,6 +348,18 @@ bool UntypedTable::insert(key_type key, value_type value) {
     return true;
 }
 
+UntypedTable::size_type UntypedTable::insert_bulk(const key_type *keys, const value_type *values, size_type count) {
+    reserve(_count + count);
+
+    size_type inserted = 0;
+    for (size_type i = 0; i < count; i++) {
+        if (insert_prehashed(keys[i], values[i], _hash(keys[i]))) {
+            inserted += 1;
+        }
+    }
+    return inserted;
+}
+
 bool UntypedTable::remove(key_type key) {
     if (_count == 0) {
         return false;
@@ -238,24 +367,35 @@ bool UntypedTable::remove(key_type key) {
     if (_compare_by_pointer) {
         return this->remove_ptr(key);
     }
-    uint64_t hash_value = _hash(key);
-    HashNode *node = _buckets[_bucket_mask & hash_value];
+    if (_old_buckets) {
+        move_old_buckets(old_buckets_moved_per_change);
+    }
 
-    for (HashNode *candidate = node; candidate != nullptr; candidate = candidate->next) {
-        if (candidate->hash_value == hash_value && _compare(candidate->key, key)) {
-            node->next = candidate->next;
-            if (_did_remove_key) {
-                _did_remove_key(candidate->key);
-            }
-            if (_did_remove_value) {
-                _did_remove_value(candidate->value);
+    uint64_t hash_value = _hash(key);
+    HashNode **previous_next = &_buckets[_bucket_mask & hash_value];
+    bool checked_old_bucket = _old_buckets == nullptr;
+    while (true) {
+        for (HashNode *candidate = *previous_next; candidate != nullptr; candidate = candidate->next) {
+            if (candidate->hash_value == hash_value && _compare(candidate->key, key)) {
+                *previous_next = candidate->next;
+                if (_did_remove_key) {
+                    _did_remove_key(candidate->key);
+                }
+                if (_did_remove_value) {
+                    _did_remove_value(candidate->value);
+                }
+                candidate->next = _spare_node;
+                _spare_node = candidate;
+                _count -= 1;
+                return true;
             }
-            candidate->next = _spare_node;
-            _spare_node = candidate;
-            _count -= 1;
-            return true;
+            previous_next = &candidate->next;
         }
-        node = candidate;
+        if (checked_old_bucket) {
+            break;
+        }
+        previous_next = &_old_buckets[_old_bucket_mask & hash_value];
+        checked_old_bucket = true;
     }
 
     return false;
@@ -265,35 +405,37 @@ bool UntypedTable::remove_ptr(key_type key) {
     if (_count == 0) {
         return false;
     }
-
-    HashNode *node = _buckets[_bucket_mask & _hash(key)];
-    for (HashNode *candidate = node; candidate != nullptr; candidate = candidate->next) {
-        if (candidate->key == key) {
-            node->next = candidate->next;
-            if (_did_remove_key) {
-                _did_remove_key(candidate->key);
-            }
-            if (_did_remove_value) {
-                _did_remove_value(candidate->value);
-            }
-            candidate->next = _spare_node;
-            _spare_node = candidate;
-            _count -= 1;
-            return true;
-        }
-        node = candidate;
+    if (_old_buckets) {
+        move_old_buckets(old_buckets_moved_per_change);
     }
-    return false;
-}
 
-void UntypedTable::for_each(entry_callback body, void *context) const {
-    if (_count) {
-        for (uint32_t i = 0; !(i >> _bucket_mask_width); i++) {
-            for (UntypedTable::HashNode *node = _buckets[i]; node != nullptr; node = node->next) {
-                body(node->key, node->value, context);
+    uint64_t hash_value = _hash(key);
+    HashNode **previous_next = &_buckets[_bucket_mask & hash_value];
+    bool checked_old_bucket = _old_buckets == nullptr;
+    while (true) {
+        for (HashNode *candidate = *previous_next; candidate != nullptr; candidate = candidate->next) {
+            if (candidate->key == key) {
+                *previous_next = candidate->next;
+                if (_did_remove_key) {
+                    _did_remove_key(candidate->key);
+                }
+                if (_did_remove_value) {
+                    _did_remove_value(candidate->value);
+                }
+                candidate->next = _spare_node;
+                _spare_node = candidate;
+                _count -= 1;
+                return true;
             }
+            previous_next = &candidate->next;
+        }
+        if (checked_old_bucket) {
+            break;
         }
+        previous_next = &_old_buckets[_old_bucket_mask & hash_value];
+        checked_old_bucket = true;
     }
+    return false;
 }
 
 } // namespace util
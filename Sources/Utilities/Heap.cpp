@@ -15,26 +15,57 @@ Heap::Heap(char *start, size_t capacity, size_t increment) {
     size_t effective_increment = increment > 0 ? std::max(increment, minimum_increment) : default_increment;
 
     _increment = effective_increment;
+    _maximum_increment = std::max(effective_increment, default_maximum_increment);
     _node = nullptr;
     reset(start, capacity);
 };
 
 util::Heap::~Heap() { reset(nullptr, 0); }
 
-void *util::Heap::alloc_(size_t size) {
-    if (_capacity >= size) {
-        char *result = _free_start;
-        _free_start += size;
-        _capacity -= size;
+/// Keeps the larger of the spare space and the space left at `start`, and counts the other one as wasted.
+void util::Heap::retire(char *start, size_t capacity) {
+    if (capacity > _spare_capacity) {
+        _bytes_wasted += _spare_capacity;
+        _spare_start = start;
+        _spare_capacity = capacity;
+    } else {
+        _bytes_wasted += capacity;
+    }
+}
+
+/// Carves an allocation out of the space at `start`, or returns null if it doesn't fit once aligned.
+void *_Nullable util::Heap::alloc_from(char *_Nullable &start, size_t &capacity, size_t size, size_t alignment) {
+    size_t padding = (alignment - (uintptr_t(start) & (alignment - 1))) & (alignment - 1);
+    if (capacity < size + padding) {
+        return nullptr;
+    }
+    char *result = start + padding;
+    start = result + size;
+    capacity -= size + padding;
+    _bytes_allocated += size;
+    _bytes_wasted += padding;
+    return result;
+}
+
+void *util::Heap::alloc_(size_t size, size_t alignment) {
+    if (void *result = alloc_from(_free_start, _capacity, size, alignment)) {
         return result;
     }
 
-    if (size <= minimum_increment) {
-        int64_t increment = _increment;
+    if (void *result = alloc_from(_spare_start, _spare_capacity, size, alignment)) {
+        return result;
+    }
+
+    // A new chunk starts with its node, so only allocations that fit in the rest of it are made from chunks
+    if (size <= std::min(minimum_increment, _next_increment - sizeof(Node))) {
+        size_t increment = _next_increment;
         char *buffer = static_cast<char *>(malloc(increment));
 
+        retire(_free_start, _capacity);
         _free_start = buffer;
         _capacity = increment;
+        _bytes_reserved += increment;
+        _next_increment = std::min(increment * 2, _maximum_increment);
 
         Node *node = alloc<Node>();
 
@@ -42,20 +73,20 @@ void *util::Heap::alloc_(size_t size) {
         node->buffer = buffer;
         _node = node;
 
-        char *result = _free_start;
-        _free_start += size;
-        _capacity -= size;
-        return result;
+        return alloc_from(_free_start, _capacity, size, alignment);
     }
 
-    Node *node = alloc<Node>();
-    void *result = malloc(size);
-    if (result) {
-        node->next = _node;
-        node->buffer = result;
-        _node = node;
+    // Large allocations share a single malloc with their node, and leave the current chunk as it is
+    Node *node = static_cast<Node *>(malloc(sizeof(Node) + size));
+    if (!node) {
+        return nullptr;
     }
-    return result;
+    node->next = _node;
+    node->buffer = node;
+    _node = node;
+    _bytes_reserved += sizeof(Node) + size;
+    _bytes_allocated += sizeof(Node) + size;
+    return node + 1;
 }
 
 void util::Heap::reset(char *_Nullable start, size_t capacity) {
@@ -71,6 +102,13 @@ void util::Heap::reset(char *_Nullable start, size_t capacity) {
     bool prealigned = ((uintptr_t)start & alignment_mask) == 0;
     _free_start = prealigned ? start : aligned_start;
     _capacity = capacity + (start - aligned_start);
+
+    _next_increment = _increment;
+    _spare_start = nullptr;
+    _spare_capacity = 0;
+    _bytes_reserved = 0;
+    _bytes_allocated = 0;
+    _bytes_wasted = 0;
 }
 
 size_t util::Heap::num_nodes() const {
@@ -81,6 +119,15 @@ size_t util::Heap::num_nodes() const {
     return count;
 }
 
+util::Heap::statistics util::Heap::stats() const {
+    return {
+        num_nodes(),
+        _bytes_reserved,
+        _bytes_allocated,
+        _bytes_wasted,
+    };
+}
+
 void util::Heap::print() const {
     fprintf(stdout, "Nodes\n");
     for (Node *node = _node; node != nullptr; node = node->next) {
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <swift/bridging>
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace util {
+
+/// A bump allocator like `Heap` that can be allocated from by several threads at once.
+///
+/// Each thread allocates from a chunk of its own, so allocating only synchronizes with other threads when a chunk is
+/// full and a new one is added to the heap's list of chunks. Nothing is freed until the heap is reset or destroyed.
+/// A thread keeps one chunk per heap in a small direct mapped cache. When two heaps map to the same cache entry,
+/// whatever is left of an evicted chunk goes unused.
+class ConcurrentHeap {
+  private:
+    // Aligned so that the allocation following a node is aligned like malloc's
+    struct alignas(alignof(std::max_align_t)) Node {
+        Node *_Nullable next;
+    };
+
+    size_t _increment;
+
+    // Identifies the heap to the chunks cached by threads, changed on reset so that those chunks are no longer used
+    std::atomic<uint64_t> _id;
+
+    std::atomic<Node *> _node;
+
+    void *alloc_(size_t size, size_t alignment);
+    void *allocate_node(size_t size);
+
+  public:
+    static std::shared_ptr<ConcurrentHeap> make_shared(size_t increment);
+
+    ConcurrentHeap(size_t increment);
+    ~ConcurrentHeap();
+
+    // non-copyable
+    ConcurrentHeap(const ConcurrentHeap &) = delete;
+    ConcurrentHeap &operator=(const ConcurrentHeap &) = delete;
+
+    // non-movable
+    ConcurrentHeap(ConcurrentHeap &&) = delete;
+    ConcurrentHeap &operator=(ConcurrentHeap &&) = delete;
+
+    template <typename T> inline T *_Nonnull alloc(size_t count = 1) {
+        static_assert(alignof(T) <= alignof(std::max_align_t), "large allocations are only aligned like a node");
+        return static_cast<T *>(alloc_(sizeof(T) * count, alignof(T)));
+    };
+
+    /// Frees every allocation. Must not be called while other threads are allocating from the heap.
+    void reset();
+
+    // Debugging
+
+    size_t num_nodes() const;
+    size_t increment() const { return _increment; }
+
+#ifdef SWIFT_TESTING
+    uint64_t *alloc_uint64_t(size_t count = 1) { return alloc<uint64_t>(count); }
+#endif
+
+} SWIFT_UNSAFE_REFERENCE;
+
+} // namespace util
+
+CF_ASSUME_NONNULL_END
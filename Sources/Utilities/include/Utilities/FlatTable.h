@@ -0,0 +1,125 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <memory>
+#include <stdint.h>
+#include <swift/bridging>
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace util {
+
+/// An open addressing hash table with the same interface as `UntypedTable`.
+///
+/// Entries are stored inline in a single array, alongside one control byte per entry holding either seven bits of the
+/// entry's hash or a marker for an empty or deleted entry. A lookup compares the control bytes of a whole group of
+/// entries at once using SIMD instructions, and only compares the keys whose hash bits match, so it usually touches a
+/// single group of control bytes and a single entry.
+///
+/// Unlike `UntypedTable`, hashes aren't stored, so growing the table hashes every key again.
+class UntypedFlatTable {
+  public:
+    using key_type = const void *_Nonnull;
+    using nullable_key_type = const void *_Nullable;
+    using value_type = const void *_Nullable;
+    using size_type = uint64_t;
+    using hasher = uint64_t (*)(void const *);
+    using key_equal = bool (*)(void const *, void const *);
+    using key_callback = void (*)(const key_type);
+    using value_callback = void (*)(const value_type);
+    using entry_callback = void (*)(const key_type, const value_type, void *context);
+
+  private:
+    struct Slot {
+        nullable_key_type key;
+        value_type value;
+    };
+
+    hasher _hash;
+    key_equal _compare;
+    key_callback _did_remove_key;
+    value_callback _did_remove_value;
+    Slot *_Nullable _slots;
+    int8_t *_Nullable _control;
+    size_type _capacity;
+    size_type _count;
+    size_type _growth_left;
+    bool _compare_by_pointer;
+
+    // Managing slots
+    void resize(size_type capacity);
+    void set_control(size_type index, int8_t control);
+    size_type find_index(key_type key, uint64_t hash_value, bool compare_by_pointer) const;
+    size_type find_insert_index(uint64_t hash_value) const;
+    void erase(size_type index);
+
+  public:
+    static std::shared_ptr<UntypedFlatTable> make_shared();
+
+    UntypedFlatTable();
+    UntypedFlatTable(hasher _Nullable custom_hasher, key_equal _Nullable custom_compare,
+                     key_callback _Nullable did_remove_key, value_callback _Nullable did_remove_value);
+    ~UntypedFlatTable();
+
+    // non-copyable
+    UntypedFlatTable(const UntypedFlatTable &) = delete;
+    UntypedFlatTable &operator=(const UntypedFlatTable &) = delete;
+
+    // non-movable
+    UntypedFlatTable(UntypedFlatTable &&) = delete;
+    UntypedFlatTable &operator=(UntypedFlatTable &&) = delete;
+
+    // Lookup
+    bool empty() const noexcept { return _count == 0; };
+    size_type count() const noexcept { return _count; };
+    value_type lookup(key_type key, nullable_key_type *_Nullable found_key) const noexcept;
+    void for_each(entry_callback body, void *context) const;
+
+    // Modifiers
+    bool insert(const key_type key, const value_type value);
+    bool remove(const key_type key);
+    bool remove_ptr(const key_type key);
+} SWIFT_UNSAFE_REFERENCE;
+
+template <typename Key, typename Value> class FlatTable : public UntypedFlatTable {
+  public:
+    using key_type = Key;
+    using value_type = Value;
+    using hasher = uint64_t (*)(const key_type);
+    using key_equal = bool (*)(const key_type, const key_type);
+    using key_callback = void (*)(const key_type);
+    using value_callback = void (*)(const value_type);
+    using entry_callback = void (*)(const key_type, const value_type, void *context);
+
+    FlatTable() : UntypedFlatTable() {};
+    FlatTable(hasher _Nullable custom_hasher, key_equal _Nullable custom_compare,
+              key_callback _Nullable did_remove_key, value_callback _Nullable did_remove_value)
+        : UntypedFlatTable(reinterpret_cast<UntypedFlatTable::hasher>(custom_hasher),
+                           reinterpret_cast<UntypedFlatTable::key_equal>(custom_compare),
+                           reinterpret_cast<UntypedFlatTable::key_callback>(did_remove_key),
+                           reinterpret_cast<UntypedFlatTable::value_callback>(did_remove_value)) {};
+
+    // Lookup
+
+    value_type lookup(const key_type key, key_type *_Nullable found_key) const noexcept {
+        auto result = UntypedFlatTable::lookup(
+            *(void **)&key, reinterpret_cast<UntypedFlatTable::nullable_key_type *_Nullable>(found_key));
+        return *(value_type *)&result;
+    };
+
+    void for_each(entry_callback _Nonnull body, void *_Nullable context) const {
+        UntypedFlatTable::for_each((UntypedFlatTable::entry_callback)body, context);
+    };
+
+    // Modifying entries
+
+    bool insert(const key_type key, const value_type value) {
+        return UntypedFlatTable::insert(*(void **)&key, *(void **)&value);
+    };
+    bool remove(const key_type key) { return UntypedFlatTable::remove(*(void **)&key); };
+    bool remove_ptr(const key_type key) { return UntypedFlatTable::remove_ptr(key); };
+};
+
+} // namespace util
+
+CF_ASSUME_NONNULL_END
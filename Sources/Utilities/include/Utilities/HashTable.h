@@ -10,6 +10,8 @@ namespace util {
 
 class Heap;
 
+uint64_t pointer_hash(void const *pointer);
+bool pointer_compare(void const *a, void const *b);
 uint64_t string_hash(char const *str);
 
 class UntypedTable {
@@ -45,10 +47,21 @@ class UntypedTable {
     uint32_t _bucket_mask_width;
     bool _is_heap_owner;
     bool _compare_by_pointer;
+    bool _grows_incrementally;
+
+    // While growing incrementally, the buckets not yet moved to the new bucket array
+    Bucket *_Nullable _old_buckets;
+    uint64_t _old_bucket_mask;
+    uint32_t _old_bucket_mask_width;
+    uint64_t _next_old_bucket;
 
     // Managing buckets
     void create_buckets();
     void grow_buckets();
+    void resize_buckets(uint32_t mask_width, bool incrementally);
+    Bucket *allocate_buckets(uint32_t mask_width);
+    void free_buckets(Bucket *buckets, uint32_t mask_width);
+    void move_old_buckets(uint64_t count);
 
   public:
     static std::shared_ptr<UntypedTable> make_shared();
@@ -67,16 +80,38 @@ class UntypedTable {
     UntypedTable(UntypedTable &&) = delete;
     UntypedTable &operator=(UntypedTable &&) = delete;
 
+    /// When set, growing the table moves a few buckets to the new bucket array on each insertion or removal rather
+    /// than all of them at once, so that insertions into large tables don't pause for a full rehash. Lookups check
+    /// both bucket arrays until every bucket has been moved.
+    void set_grows_incrementally(bool grows_incrementally) { _grows_incrementally = grows_incrementally; };
+    bool grows_incrementally() const noexcept { return _grows_incrementally; };
+
     // Lookup
     bool empty() const noexcept { return _count == 0; };
     size_type count() const noexcept { return _count; };
     value_type lookup(key_type key, nullable_key_type *_Nullable found_key) const noexcept;
     void for_each(entry_callback body, void *context) const;
 
+    /// Looks up a key whose hash is already known. `hash_value` must be the value the table's hasher returns for
+    /// `key`.
+    value_type lookup_prehashed(key_type key, uint64_t hash_value,
+                                nullable_key_type *_Nullable found_key) const noexcept;
+
     // Modifiers
     bool insert(const key_type key, const value_type value);
     bool remove(const key_type key);
     bool remove_ptr(const key_type key);
+
+    /// Inserts a key whose hash is already known. `hash_value` must be the value the table's hasher returns for
+    /// `key`.
+    bool insert_prehashed(const key_type key, const value_type value, uint64_t hash_value);
+
+    /// Inserts `count` entries, growing the buckets at most once beforehand. Returns the number of keys that weren't
+    /// in the table yet.
+    size_type insert_bulk(const key_type *keys, const value_type *values, size_type count);
+
+    /// Grows the buckets so that `count` entries fit without growing again.
+    void reserve(size_type count);
 } SWIFT_UNSAFE_REFERENCE;
 
 template <typename Key, typename Value> class Table : public UntypedTable {
@@ -105,6 +140,12 @@ template <typename Key, typename Value> class Table : public UntypedTable {
         return *(value_type *)&result;
     };
 
+    value_type lookup_prehashed(const key_type key, uint64_t hash_value, key_type *_Nullable found_key) const noexcept {
+        auto result = UntypedTable::lookup_prehashed(
+            *(void **)&key, hash_value, reinterpret_cast<UntypedTable::nullable_key_type *_Nullable>(found_key));
+        return *(value_type *)&result;
+    };
+
     void for_each(entry_callback _Nonnull body, void *_Nullable context) const {
         UntypedTable::for_each((UntypedTable::entry_callback)body, context);
     };
@@ -116,6 +157,16 @@ template <typename Key, typename Value> class Table : public UntypedTable {
     };
     bool remove(const key_type key) { return UntypedTable::remove(*(void **)&key); };
     bool remove_ptr(const key_type key) { return UntypedTable::remove_ptr(key); };
+
+    bool insert_prehashed(const key_type key, const value_type value, uint64_t hash_value) {
+        return UntypedTable::insert_prehashed(*(void **)&key, *(void **)&value, hash_value);
+    };
+    size_type insert_bulk(const key_type *keys, const value_type *values, size_type count) {
+        static_assert(sizeof(key_type) == sizeof(UntypedTable::key_type) &&
+                      sizeof(value_type) == sizeof(UntypedTable::value_type));
+        return UntypedTable::insert_bulk(reinterpret_cast<const UntypedTable::key_type *>(keys),
+                                         reinterpret_cast<const UntypedTable::value_type *>(values), count);
+    };
 };
 
 } // namespace util
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <CoreFoundation/CFBase.h>
+#include <algorithm>
+#include <cstddef>
 #include <memory>
 #include <swift/bridging>
 
@@ -16,14 +18,40 @@ class Heap {
     } Node;
 
     size_t _increment;
+    size_t _next_increment;
+    size_t _maximum_increment;
     Node *_node;
     char *_free_start;
     size_t _capacity;
 
-    void *alloc_(size_t arg1);
+    // The largest space left at the end of an earlier chunk, for allocations that don't fit in the current one
+    char *_spare_start;
+    size_t _spare_capacity;
+
+    size_t _bytes_reserved;
+    size_t _bytes_allocated;
+    size_t _bytes_wasted;
+
+    void *alloc_(size_t size, size_t alignment);
+    void *_Nullable alloc_from(char *_Nullable &start, size_t &capacity, size_t size, size_t alignment);
+    void retire(char *start, size_t capacity);
 
   public:
     static constexpr size_t minimum_increment = 0x400;
+    static constexpr size_t default_maximum_increment = 0x40000;
+
+    struct statistics {
+        size_t num_nodes;
+
+        /// The memory allocated by the heap itself, not counting any initial buffer.
+        size_t bytes_reserved;
+
+        /// The memory handed out by `alloc`, including the heap's own bookkeeping.
+        size_t bytes_allocated;
+
+        /// The memory left at the ends of chunks that will never be handed out.
+        size_t bytes_wasted;
+    };
 
     static std::shared_ptr<Heap> make_shared(char *_Nullable start, size_t capacity, size_t increment);
 
@@ -38,20 +66,32 @@ class Heap {
     Heap(Heap &&) = delete;
     Heap &operator=(Heap &&) = delete;
 
+    /// Allocations are aligned for `T`, with any padding counted as wasted.
     template <typename T> inline T *_Nonnull alloc(size_t count = 1) {
-        return static_cast<T *>(alloc_(sizeof(T) * count));
+        static_assert(alignof(T) <= alignof(std::max_align_t), "large allocations are only aligned by malloc");
+        return static_cast<T *>(alloc_(sizeof(T) * count, alignof(T)));
     };
     void reset(char *_Nullable start, size_t capacity);
 
+    /// Each new chunk is twice the size of the previous one, starting from `increment()`, until it reaches the
+    /// maximum increment.
+    void set_maximum_increment(size_t maximum_increment) {
+        _maximum_increment = std::max(maximum_increment, _increment);
+        _next_increment = std::min(_next_increment, _maximum_increment);
+    };
+    size_t maximum_increment() const { return _maximum_increment; }
+
     // Debugging
 
     size_t num_nodes() const;
     size_t increment() const { return _increment; }
     size_t capacity() const { return _capacity; }
+    statistics stats() const;
 
     void print() const;
 
 #ifdef SWIFT_TESTING
+    uint8_t *alloc_uint8_t(size_t count = 1) { return alloc<uint8_t>(count); }
     uint64_t *alloc_uint64_t(size_t count = 1) { return alloc<uint64_t>(count); }
 #endif
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <CoreFoundation/CFBase.h>
+#include <cassert>
 #include <swift/bridging>
 
 #include "Utilities/Heap.h"
@@ -59,9 +60,12 @@ template <typename T> class ForwardList {
 };
 
 template <typename T>
-ForwardList<T>::ForwardList() : _heap(new Heap(nullptr, 0, util::Heap::minimum_increment)), _is_heap_owner(true){};
+ForwardList<T>::ForwardList()
+    : _heap(new Heap(nullptr, 0, util::Heap::minimum_increment)), _front(nullptr), _spare(nullptr),
+      _is_heap_owner(true){};
 
-template <typename T> ForwardList<T>::ForwardList(util::Heap *heap) : _heap(heap), _is_heap_owner(false){};
+template <typename T> ForwardList<T>::ForwardList(util::Heap *heap)
+    : _heap(heap), _front(nullptr), _spare(nullptr), _is_heap_owner(false){};
 
 template <typename T> ForwardList<T>::~ForwardList() {
     if (_is_heap_owner && _heap) {
@@ -96,7 +100,7 @@ template <typename T> void ForwardList<T>::push_front(T &&value) {
     Node *new_node;
     if (_spare != nullptr) {
         new_node = _spare;
-        _spare = _spare->previous;
+        _spare = _spare->next;
     } else {
         new_node = _heap->alloc<Node>();
     }
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <CoreFoundation/CFBase.h>
+#include <atomic>
+#include <memory>
+#include <swift/bridging>
+
+#include "Utilities/ConcurrentHeap.h"
+
+CF_ASSUME_NONNULL_BEGIN
+
+namespace util {
+
+/// MPSCQueue is a lock-free queue that any number of threads can push to, and one thread drains. Like ForwardList it
+/// links values through nodes of its own, allocated from a heap and reused once they have been drained.
+///
+/// Pushing adds a node to the front of a list, and draining takes the whole list at once and visits it in reverse, so
+/// values are drained in the order they were pushed.
+template <typename T> class MPSCQueue {
+  private:
+    struct Node {
+        Node *_Nullable next;
+        T value;
+    };
+
+    util::ConcurrentHeap *_heap;
+    std::atomic<Node *> _front;
+    std::atomic<Node *> _spare;
+    bool _is_heap_owner;
+
+    Node *_Nonnull make_node();
+    bool push_node(Node *node);
+    void push_spare(Node *first, Node *last);
+
+  public:
+    MPSCQueue();
+    MPSCQueue(util::ConcurrentHeap *heap);
+    ~MPSCQueue();
+
+    // non-copyable
+    MPSCQueue(const MPSCQueue &) = delete;
+    MPSCQueue &operator=(const MPSCQueue &) = delete;
+
+    // non-movable
+    MPSCQueue(MPSCQueue &&) = delete;
+    MPSCQueue &operator=(MPSCQueue &&) = delete;
+
+    // MARK: Capacity
+
+    bool empty() const noexcept { return _front.load(std::memory_order_relaxed) == nullptr; }
+
+    // MARK: Modifiers
+
+    /// Adds a value to the back of the queue. Can be called from any thread.
+    ///
+    /// Returns true if the queue was empty, so that the producer that made it non-empty can notify the consumer.
+    bool push(const T &value);
+    bool push(T &&value);
+    template <class... Args> bool emplace(Args &&...args);
+
+    /// Removes every value from the queue, passing each one to `body` in the order they were pushed, and returns how
+    /// many there were. Must only be called from one thread at a time.
+    template <typename Body> size_t drain(Body body);
+};
+
+template <typename T>
+MPSCQueue<T>::MPSCQueue()
+    : _heap(new ConcurrentHeap(0)), _front(nullptr), _spare(nullptr), _is_heap_owner(true){};
+
+template <typename T>
+MPSCQueue<T>::MPSCQueue(util::ConcurrentHeap *heap)
+    : _heap(heap), _front(nullptr), _spare(nullptr), _is_heap_owner(false){};
+
+template <typename T> MPSCQueue<T>::~MPSCQueue() {
+    drain([](T &value) {});
+    if (_is_heap_owner && _heap) {
+        delete _heap;
+    }
+};
+
+template <typename T> MPSCQueue<T>::Node *MPSCQueue<T>::make_node() {
+    // Nodes can't be popped from the spare list one at a time without risking ABA, so the whole list is taken and
+    // whatever isn't needed is put back
+    Node *node = _spare.exchange(nullptr, std::memory_order_acquire);
+    if (node == nullptr) {
+        return _heap->alloc<Node>();
+    }
+
+    if (Node *rest = node->next) {
+        Node *expected = nullptr;
+        if (!_spare.compare_exchange_strong(expected, rest, std::memory_order_release, std::memory_order_relaxed)) {
+            // other nodes were returned in the meantime
+            Node *last = rest;
+            while (last->next) {
+                last = last->next;
+            }
+            push_spare(rest, last);
+        }
+    }
+    return node;
+}
+
+template <typename T> bool MPSCQueue<T>::push_node(Node *node) {
+    // The node belongs to the consumer as soon as it's published, so the previous front is kept aside
+    Node *front = _front.load(std::memory_order_relaxed);
+    do {
+        node->next = front;
+    } while (!_front.compare_exchange_weak(front, node, std::memory_order_release, std::memory_order_relaxed));
+    return front == nullptr;
+}
+
+template <typename T> void MPSCQueue<T>::push_spare(Node *first, Node *last) {
+    last->next = _spare.load(std::memory_order_relaxed);
+    while (!_spare.compare_exchange_weak(last->next, first, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+}
+
+template <typename T> bool MPSCQueue<T>::push(const T &value) {
+    Node *node = make_node();
+    new (&node->value) T(value);
+    return push_node(node);
+}
+
+template <typename T> bool MPSCQueue<T>::push(T &&value) {
+    Node *node = make_node();
+    new (&node->value) T(std::move(value));
+    return push_node(node);
+}
+
+template <typename T> template <class... Args> bool MPSCQueue<T>::emplace(Args &&...args) {
+    Node *node = make_node();
+    new (&node->value) T(std::forward<Args>(args)...);
+    return push_node(node);
+}
+
+template <typename T> template <typename Body> size_t MPSCQueue<T>::drain(Body body) {
+    Node *node = _front.exchange(nullptr, std::memory_order_acquire);
+    if (node == nullptr) {
+        return 0;
+    }
+
+    // reverse the list into the order the values were pushed
+    Node *first = nullptr;
+    Node *last = node;
+    size_t count = 0;
+    while (node) {
+        Node *next = node->next;
+        node->next = first;
+        first = node;
+        node = next;
+        count += 1;
+    }
+
+    for (node = first; node != nullptr; node = node->next) {
+        body(node->value);
+        node->value.~T();
+    }
+
+    push_spare(first, last);
+    return count;
+}
+
+#ifdef SWIFT_TESTING
+
+class UInt64MPSCQueue : public MPSCQueue<uint64_t> {
+  public:
+    static std::shared_ptr<UInt64MPSCQueue> make_shared() { return std::make_shared<UInt64MPSCQueue>(); }
+
+    bool empty() const noexcept { return MPSCQueue<uint64_t>::empty(); }
+
+    bool push(uint64_t element) { return MPSCQueue<uint64_t>::push(element); }
+
+    /// Drains the queue into `elements`, which must have room for every element in the queue.
+    size_t drain(uint64_t *elements) {
+        return MPSCQueue<uint64_t>::drain([&elements](uint64_t &element) { *elements++ = element; });
+    }
+
+} SWIFT_UNSAFE_REFERENCE;
+
+#endif
+
+} // namespace util
+
+CF_ASSUME_NONNULL_END
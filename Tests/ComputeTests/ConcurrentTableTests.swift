@@ -0,0 +1,19 @@
+import ComputeTestsSupport
+import Testing
+
+@Suite("ConcurrentTable tests")
+struct ConcurrentTableTests {
+
+    @Test(
+        "Aligned keys spread across the table",
+        arguments: [8, 16, 64, 4096]
+    )
+    func alignedKeys(alignment: Int) {
+        let stats = AGTestConcurrentTableProbeStats(1000, alignment)
+
+        #expect(stats.capacity == 2048)
+        #expect(stats.max_probe_length <= 8)
+        #expect(stats.mean_probe_length < 2)
+    }
+
+}
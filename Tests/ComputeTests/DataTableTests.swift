@@ -0,0 +1,45 @@
+import Compute
+import ComputeTestsSupport
+import Testing
+
+@Suite("Data table tests")
+struct DataTableTests {
+
+    // The number of pages in each page map
+    let pagesPerMap: UInt32 = 64
+
+    @Test("Allocating pages reuses the first free run that fits")
+    func reuseFreedRun() {
+        let table = AGTestDataTableCreate()
+
+        #expect(AGTestDataTableAllocPages(table, 2) == 0)
+        #expect(AGTestDataTableAllocPages(table, 2) == 2)
+        #expect(AGTestDataTableAllocPages(table, 2) == 4)
+
+        AGTestDataTableDeallocPages(table, 2, 2)
+
+        // too long for the gap, so it goes after the last run
+        #expect(AGTestDataTableAllocPages(table, 3) == 6)
+        #expect(AGTestDataTableAllocPages(table, 2) == 2)
+    }
+
+    @Test("Allocating pages finds runs that span page maps")
+    func crossMapRun() {
+        let table = AGTestDataTableCreate()
+
+        // a run that crosses into a new map at the end of the table
+        #expect(AGTestDataTableAllocPages(table, pagesPerMap - 4) == 0)
+        #expect(AGTestDataTableAllocPages(table, pagesPerMap + 4) == pagesPerMap - 4)
+        #expect(AGTestDataTableAllocPages(table, 2) == 2 * pagesPerMap)
+
+        // frees the top of the first map and the whole of the second
+        AGTestDataTableDeallocPages(table, pagesPerMap - 4, pagesPerMap + 4)
+
+        // longer than any run within a map, so it starts at the top of the first map and continues into the second
+        #expect(AGTestDataTableAllocPages(table, pagesPerMap + 2) == pagesPerMap - 4)
+
+        // the two pages left at the top of the second map can't continue into the third, whose first pages are used
+        #expect(AGTestDataTableAllocPages(table, 3) == 2 * pagesPerMap + 2)
+    }
+
+}
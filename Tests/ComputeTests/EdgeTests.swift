@@ -0,0 +1,64 @@
+import Compute
+import ComputeTestsSupport
+import Testing
+
+@Suite("Edge tests")
+struct EdgeTests {
+
+    @Test("Destroying a subgraph removes its edges from the subgraphs that survive it")
+    func destroySubgraphWithDependents() {
+        let graph = AGTestGraphCreate(Metadata(Int.self), Metadata(Int.self))
+        defer { AGTestGraphDestroy(graph) }
+
+        var body = 0
+        let survivor = AGTestSubgraphCreate(graph)
+        defer { AGTestSubgraphDestroy(survivor) }
+        let source = AGTestSubgraphAddAttribute(survivor, &body)
+        let dependent = AGTestSubgraphAddAttribute(survivor, &body)
+        let unrelated = AGTestSubgraphAddAttribute(survivor, &body)
+
+        let destroyed = AGTestSubgraphCreate(graph)
+        let input = AGTestSubgraphAddAttribute(destroyed, &body)
+        let output = AGTestSubgraphAddAttribute(destroyed, &body)
+        let offset = __AGGraphCreateOffsetAttribute(input, 0, 8)
+
+        // edges in both directions across the subgraphs, and one within each of them
+        _ = AGTestGraphAddInput(graph, output, source)
+        _ = AGTestGraphAddInput(graph, output, input)
+        _ = AGTestGraphAddInput(graph, dependent, input)
+        _ = AGTestGraphAddInput(graph, dependent, unrelated)
+        _ = AGTestGraphAddInput(graph, dependent, offset)
+        #expect(AGTestAttributeOutputCount(source) == 1)
+        #expect(AGTestAttributeInputCount(dependent) == 3)
+
+        AGTestSubgraphDestroy(destroyed)
+
+        #expect(AGTestAttributeOutputCount(source) == 0)
+        #expect(AGTestAttributeInputCount(dependent) == 1)
+        #expect(AGTestAttributeInput(dependent, 0) == unrelated)
+        #expect(AGTestAttributeOutputCount(unrelated) == 1)
+    }
+
+    @Test("Destroying a subgraph that depends on another leaves no outputs behind")
+    func destroyDependentSubgraph() {
+        let graph = AGTestGraphCreate(Metadata(Int.self), Metadata(Int.self))
+        defer { AGTestGraphDestroy(graph) }
+
+        var body = 0
+        let survivor = AGTestSubgraphCreate(graph)
+        defer { AGTestSubgraphDestroy(survivor) }
+        let source = AGTestSubgraphAddAttribute(survivor, &body)
+
+        let destroyed = AGTestSubgraphCreate(graph)
+        for _ in 0..<3 {
+            let dependent = AGTestSubgraphAddAttribute(destroyed, &body)
+            _ = AGTestGraphAddInput(graph, dependent, source)
+        }
+        #expect(AGTestAttributeOutputCount(source) == 3)
+
+        AGTestSubgraphDestroy(destroyed)
+
+        #expect(AGTestAttributeOutputCount(source) == 0)
+    }
+
+}
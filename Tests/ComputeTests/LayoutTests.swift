@@ -0,0 +1,169 @@
+import ComputeTestsSupport
+import Foundation
+import Testing
+
+private struct Point {
+    var x: Double
+    var y: Double
+}
+
+private final class Box {
+    var value = 0
+}
+
+private struct Mixed {
+    var id: Int
+    var name: String
+    var origin: Point
+    var flags: UInt8
+    var box: Box
+    var tags: [String]
+}
+
+private enum Shape {
+    case empty
+    case point(Point)
+    case named(String, Point)
+    case nested(Mixed)
+}
+
+private struct Pair {
+    var first: Int
+    var second: Int
+}
+
+private struct Coalesced {
+    var value: Any
+    var id: Int
+    var pair: Pair
+    var width: Int32
+    var height: Int32
+}
+
+private struct Block {
+    var a, b, c, d, e, f, g, h: Int
+}
+
+private struct Blocks {
+    var first, second, third, fourth: Block
+}
+
+private struct LongRun {
+    var value: Any
+    var blocks: (Blocks, Blocks, Blocks, Blocks)
+}
+
+private struct Padded {
+    var value: Any
+    var flag: UInt8
+    var count: Int
+}
+
+@Suite("Layout tests")
+struct LayoutTests {
+
+    /// Compares the first `size` bytes of `lhs` and `rhs`, returning the offset of the first mismatch if there is one.
+    func compareBytes(_ lhs: [UInt8], _ rhs: [UInt8], size: Int) -> Int? {
+        var failureLocation = 0
+        let equal = lhs.withUnsafeBytes { lhs in
+            rhs.withUnsafeBytes { rhs in
+                AGTestCompareBytes(lhs.baseAddress!, rhs.baseAddress!, size, &failureLocation)
+            }
+        }
+        return equal ? nil : failureLocation
+    }
+
+    @Test(
+        "Comparing bytes reports the first mismatch, including one found by the overlapping final block",
+        arguments: [1, 7, 8, 9, 15, 16, 17, 24, 31, 32, 33, 40, 63, 64, 65, 100]
+    )
+    func compareBytesMismatch(size: Int) {
+        // the bytes after `size` differ, so that comparing beyond the end would be noticed
+        let lhs = [UInt8](repeating: 0x5a, count: size) + [0x00]
+        let equalRHS = [UInt8](repeating: 0x5a, count: size) + [0xff]
+        #expect(compareBytes(lhs, equalRHS, size: size) == nil)
+
+        for position in 0..<size {
+            // a second mismatch at the end must not be reported instead of the first
+            var rhs = equalRHS
+            rhs[position] = 0xa5
+            rhs[size - 1] = 0xa5
+            #expect(compareBytes(lhs, rhs, size: size) == position)
+        }
+    }
+
+    /// Compares `lhs` and `rhs` by running the compiled layout program and by interpreting the layout, expecting both
+    /// to agree. Returns their result.
+    func compareLayout<Value>(_ lhs: Value, _ rhs: Value) throws -> Bool {
+        let type = Metadata(Value.self)
+        try #require(AGTestLayoutHasProgram(type))
+        return withUnsafePointer(to: lhs) { lhs in
+            withUnsafePointer(to: rhs) { rhs in
+                let compiled = AGTestCompareLayout(type, lhs, rhs, true)
+                let interpreted = AGTestCompareLayout(type, lhs, rhs, false)
+                #expect(compiled == interpreted)
+                return compiled
+            }
+        }
+    }
+
+    @Test("Compiled layout programs agree with the interpreter on structs")
+    func compiledStruct() throws {
+        // built at runtime, so that equal names and tags are in different buffers
+        func mixed(name: String = "name", x: Double = 1, flags: UInt8 = 3, box: Box, tags: Int = 2) -> Mixed {
+            return Mixed(
+                id: 1, name: String(repeating: name, count: 10), origin: Point(x: x, y: 2), flags: flags, box: box,
+                tags: (0..<tags).map { String($0) })
+        }
+
+        let box = Box()
+        let value = mixed(box: box)
+        #expect(try compareLayout(value, mixed(box: box)))
+        #expect(try !compareLayout(value, mixed(name: "other", box: box)))
+        #expect(try !compareLayout(value, mixed(x: 3, box: box)))
+        #expect(try !compareLayout(value, mixed(flags: 4, box: box)))
+        #expect(try !compareLayout(value, mixed(box: box, tags: 3)))
+
+        // whether distinct boxes compare equal depends on the heap mode, the two only have to agree
+        _ = try compareLayout(value, mixed(box: Box()))
+    }
+
+    @Test("Compiled layout programs agree with the interpreter on enums")
+    func compiledEnum() throws {
+        let name = String(repeating: "name", count: 10)
+        let mixed = Mixed(id: 1, name: name, origin: Point(x: 1, y: 2), flags: 3, box: Box(), tags: ["one"])
+
+        #expect(try compareLayout(Shape.empty, Shape.empty))
+        #expect(try compareLayout(Shape.point(Point(x: 1, y: 2)), Shape.point(Point(x: 1, y: 2))))
+        #expect(try !compareLayout(Shape.point(Point(x: 1, y: 2)), Shape.point(Point(x: 1, y: 3))))
+        #expect(try !compareLayout(Shape.empty, Shape.point(Point(x: 0, y: 0))))
+        #expect(try compareLayout(Shape.named(name, Point(x: 1, y: 2)), Shape.named(name + "", Point(x: 1, y: 2))))
+        #expect(try !compareLayout(Shape.named(name, Point(x: 1, y: 2)), Shape.point(Point(x: 1, y: 2))))
+        #expect(try compareLayout(Shape.nested(mixed), Shape.nested(mixed)))
+    }
+
+    /// The runs of data and skipped bytes in the layout of `Value`, in order.
+    func layoutRuns<Value>(_ type: Value.Type) -> [String] {
+        let description = AGTestLayoutDescription(Metadata(type)) as String
+        return description.components(separatedBy: "\n").map { $0.trimmingCharacters(in: .whitespaces) }.filter {
+            $0.hasPrefix("(read ") || $0.hasPrefix("(skip ")
+        }
+    }
+
+    @Test("Adjacent trivial fields are read as a single run, across nested structs")
+    func coalesceData() {
+        // the existential comes first so that the layout holds more than data
+        #expect(layoutRuns(Coalesced.self) == ["(read 32)"])
+    }
+
+    @Test("Long runs are read in one step rather than in chunks")
+    func coalesceLongRun() {
+        #expect(layoutRuns(LongRun.self) == ["(read 1024)"])
+    }
+
+    @Test("Padding between fields is skipped")
+    func skipPadding() {
+        #expect(layoutRuns(Padded.self) == ["(read 1)", "(skip 7)", "(read 8)"])
+    }
+
+}
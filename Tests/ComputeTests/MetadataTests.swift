@@ -237,6 +237,24 @@ struct MetadataTests {
                 #expect(result == false)
             }
         }
+
+        class T4: T1 {
+            var c = ""
+        }
+
+        @Test
+        func forEachFieldRepeatedly() throws {
+            // Later passes read the field tables cached by the first one
+            for _ in 0..<2 {
+                var names: [String] = []
+                let result = Metadata(T4.self).forEachField(options: .heapClasses) { name, _, _ in
+                    names.append(String(cString: name))
+                    return true
+                }
+                #expect(result == true)
+                #expect(names == ["a", "b", "c"])
+            }
+        }
     }
 
 }
@@ -0,0 +1,35 @@
+import Compute
+import ComputeTestsSupport
+import Testing
+
+@Suite("Subgraph tests")
+struct SubgraphTests {
+
+    @Test("Attributes created together can span several pages")
+    func addAttributesAcrossPages() {
+        let graph = AGTestGraphCreate(Metadata(Int.self), Metadata(Int.self))
+        defer { AGTestGraphDestroy(graph) }
+
+        let subgraph = AGTestSubgraphCreate(graph)
+        defer { AGTestSubgraphDestroy(subgraph) }
+
+        // more nodes than fit in a single page of any supported size
+        let bodies = Array(0..<1000)
+        var attributes = [AnyAttribute](repeating: AnyAttribute(rawValue: 0), count: bodies.count)
+        bodies.withUnsafeBufferPointer { bodies in
+            attributes.withUnsafeMutableBufferPointer { attributes in
+                AGTestSubgraphAddAttributes(
+                    subgraph,
+                    bodies.baseAddress,
+                    MemoryLayout<Int>.stride,
+                    UInt32(bodies.count),
+                    attributes.baseAddress
+                )
+            }
+        }
+
+        #expect(Set(attributes).count == bodies.count)
+        #expect(attributes.allSatisfy { AGTestAttributeIsInSubgraph($0, subgraph) })
+    }
+
+}
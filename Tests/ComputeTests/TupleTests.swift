@@ -0,0 +1,76 @@
+import Compute
+import Testing
+
+@Suite("Tuple tests")
+struct TupleTests {
+
+    typealias CustomTuple = (String, Int, Double)
+
+    @Test("Tuple type from element types")
+    func initFromElements() {
+        let tupleType = TupleType([String.self, Int.self, Double.self])
+
+        #expect(tupleType.type == CustomTuple.self)
+        #expect(tupleType.count == 3)
+        #expect(tupleType.indices == 0..<3)
+        #expect(tupleType.type(at: 1) == Int.self)
+        #expect(tupleType.offset(at: 0, as: String.self) == 0)
+        #expect(tupleType.offset(at: 1, as: Int.self) == MemoryLayout<CustomTuple>.offset(of: \.1))
+        #expect(tupleType.offset(at: 2, as: Double.self) == MemoryLayout<CustomTuple>.offset(of: \.2))
+    }
+
+    @Test("Non-tuple type is a tuple of one element")
+    func singleElement() {
+        let tupleType = TupleType(Int.self)
+
+        #expect(tupleType.count == 1)
+        #expect(tupleType.type(at: 0) == Int.self)
+        #expect(tupleType.offset(at: 0, as: Int.self) == 0)
+        #expect(TupleType([Int.self]).type == Int.self)
+    }
+
+    @Test("Empty tuple type")
+    func empty() {
+        let tupleType = TupleType([])
+
+        #expect(tupleType.isEmpty)
+        #expect(tupleType.type == Void.self)
+    }
+
+    @Test("Get and set elements")
+    func getAndSetElements() {
+        let tuple = UnsafeMutableTuple(with: TupleType(CustomTuple.self))
+        defer { tuple.deallocate(initialized: true) }
+
+        tuple.initialize(at: 0, to: "first")
+        tuple.initialize(at: 1, to: 1)
+        tuple.initialize(at: 2, to: 2.5)
+        #expect(tuple[0] == "first")
+        #expect(tuple[1] == 1)
+        #expect(tuple[2] == 2.5)
+
+        var string = "second"
+        tuple.type.setElement(in: tuple.value, at: 0, from: &string, options: [])
+        var result = ""
+        tuple.type.getElement(in: tuple.value, at: 0, to: &result, options: [])
+        #expect(result == "second")
+
+        let whole: CustomTuple = tuple[]
+        #expect(whole == ("second", 1, 2.5))
+    }
+
+    @Test("Temporary tuple buffers")
+    func withBuffer() {
+        var called = false
+        withUnsafeTuple(of: TupleType(CustomTuple.self), count: 4) { tuple in
+            tuple.initialize(at: 0, to: "value")
+            tuple.initialize(at: 1, to: 3)
+            tuple.initialize(at: 2, to: 0.5)
+            #expect(tuple[1] == 3)
+            tuple.deinitialize()
+            called = true
+        }
+        #expect(called)
+    }
+
+}
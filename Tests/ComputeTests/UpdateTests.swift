@@ -0,0 +1,130 @@
+import Compute
+import ComputeTestsSupport
+import Testing
+
+@Suite("Update tests")
+struct UpdateTests {
+
+    func updates(_ graph: AGTestGraphRef) -> [AnyAttribute] {
+        return (0..<AGTestGraphUpdateCount(graph)).map { AGTestGraphUpdatedAttribute(graph, $0) }
+    }
+
+    func value(_ attribute: AnyAttribute) -> Int? {
+        return AGTestAttributeValue(attribute)?.load(as: Int.self)
+    }
+
+    @Test("Dirty inputs are updated before the attributes that read them")
+    func updateInputsFirst() {
+        let graph = AGTestGraphCreate(Metadata(Int.self), Metadata(Int.self))
+        defer { AGTestGraphDestroy(graph) }
+
+        let subgraph = AGTestSubgraphCreate(graph)
+        defer { AGTestSubgraphDestroy(subgraph) }
+
+        var bodies = [1, 2, 3]
+        let first = AGTestSubgraphAddAttribute(subgraph, &bodies[0])
+        let second = AGTestSubgraphAddAttribute(subgraph, &bodies[1])
+        let third = AGTestSubgraphAddAttribute(subgraph, &bodies[2])
+        _ = AGTestGraphAddInput(graph, second, first)
+        _ = AGTestGraphAddInput(graph, third, second)
+
+        for attribute in [third, second, first] {
+            AGTestGraphMarkDirty(graph, attribute)
+        }
+        #expect(AGTestGraphUpdate(graph))
+
+        // the first attribute in the batch pulls in its inputs, which are up to date by the time they are reached
+        #expect(updates(graph) == [first, second, third])
+        #expect([first, second, third].allSatisfy { !AGTestAttributeIsDirty($0) })
+        #expect([first, second, third].map(value) == [1, 2, 3])
+    }
+
+    @Test("Inputs already on the update stack are reported as a cycle rather than updated again")
+    func updateCycle() {
+        let graph = AGTestGraphCreate(Metadata(Int.self), Metadata(Int.self))
+        defer { AGTestGraphDestroy(graph) }
+
+        let subgraph = AGTestSubgraphCreate(graph)
+        defer { AGTestSubgraphDestroy(subgraph) }
+
+        var body = 0
+        let first = AGTestSubgraphAddAttribute(subgraph, &body)
+        let second = AGTestSubgraphAddAttribute(subgraph, &body)
+        _ = AGTestGraphAddInput(graph, first, second)
+        _ = AGTestGraphAddInput(graph, second, first)
+
+        AGTestGraphMarkDirty(graph, first)
+        AGTestGraphMarkDirty(graph, second)
+        #expect(AGTestGraphUpdate(graph))
+
+        #expect(updates(graph) == [second, first])
+        #expect(!AGTestAttributeIsDirty(first))
+        #expect(!AGTestAttributeIsDirty(second))
+    }
+
+    @Test("An update cut short by the deadline leaves the rest dirty and resumes from there")
+    func updateUntilDeadline() {
+        let graph = AGTestGraphCreate(Metadata(Int.self), Metadata(Int.self))
+        defer { AGTestGraphDestroy(graph) }
+
+        let subgraph = AGTestSubgraphCreate(graph)
+        defer { AGTestSubgraphDestroy(subgraph) }
+
+        var body = 0
+        let first = AGTestSubgraphAddAttribute(subgraph, &body)
+        let second = AGTestSubgraphAddAttribute(subgraph, &body)
+        let third = AGTestSubgraphAddAttribute(subgraph, &body)
+        _ = AGTestGraphAddInput(graph, second, first)
+        _ = AGTestGraphAddInput(graph, third, second)
+
+        for attribute in [third, second, first] {
+            AGTestGraphMarkDirty(graph, attribute)
+        }
+
+        // the deadline passes with the second and third attributes still on the update stack
+        AGTestGraphSetDeadlineAfterUpdates(graph, 1)
+        #expect(!AGTestGraphUpdate(graph))
+        #expect(updates(graph) == [first])
+        #expect(!AGTestAttributeIsDirty(first))
+        #expect(AGTestAttributeIsDirty(second))
+        #expect(AGTestAttributeIsDirty(third))
+
+        AGTestGraphSetDeadlineAfterUpdates(graph, UInt32.max)
+        #expect(AGTestGraphUpdate(graph))
+        #expect(updates(graph) == [first, second, third])
+        #expect(!AGTestAttributeIsDirty(third))
+    }
+
+
+    @Test("Subgraphs are updated in separate partitions until a dirty dependency joins them")
+    func partitionBySubgraph() {
+        let graph = AGTestGraphCreate(Metadata(Int.self), Metadata(Int.self))
+        defer { AGTestGraphDestroy(graph) }
+
+        var body = 0
+        let subgraphs = (0..<3).map { _ in AGTestSubgraphCreate(graph) }
+        defer { subgraphs.forEach(AGTestSubgraphDestroy) }
+
+        // two attributes in each subgraph, the second reading the first
+        var batch: [AnyAttribute] = []
+        for subgraph in subgraphs {
+            let input = AGTestSubgraphAddAttribute(subgraph, &body)
+            let output = AGTestSubgraphAddAttribute(subgraph, &body)
+            _ = AGTestGraphAddInput(graph, output, input)
+            batch += [output, input]
+        }
+        batch.forEach { AGTestGraphMarkDirty(graph, $0) }
+        #expect(AGTestGraphPartitionCount(graph, batch, UInt32(batch.count)) == 3)
+
+        // the first subgraph now reads a dirty attribute of the last one
+        _ = AGTestGraphAddInput(graph, batch[0], batch[5])
+        #expect(AGTestGraphPartitionCount(graph, batch, UInt32(batch.count)) == 2)
+
+        // once the input is up to date, the subgraphs are independent again
+        #expect(AGTestGraphUpdate(graph))
+        AGTestGraphMarkDirty(graph, batch[0])
+        AGTestGraphMarkDirty(graph, batch[4])
+        #expect(AGTestGraphPartitionCount(graph, [batch[0], batch[4]], 2) == 2)
+    }
+
+}
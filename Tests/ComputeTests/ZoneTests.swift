@@ -0,0 +1,162 @@
+import Compute
+import ComputeTestsSupport
+import Testing
+
+@Suite("Zone tests")
+struct ZoneTests {
+
+    /// Leaves the first page of `subgraph` holding nothing but free fragments, behind a current page and a large page
+    /// for each block moved out of it.
+    func freeFirstPage(_ subgraph: AGTestSubgraphRef) {
+        let pageSize = AGTestPageSize()
+        let blockSize = pageSize / 4
+
+        // three blocks fill the first page up to its last quarter
+        let blocks = (0..<3).map { _ in AGTestSubgraphAllocBytes(subgraph, blockSize) }
+
+        // doesn't fit behind them, so the rest of the first page becomes a fragment and a second page is started
+        _ = AGTestSubgraphAllocBytes(subgraph, pageSize / 2)
+
+        // more than half a page, so each block moves to a large page of its own and leaves a fragment behind
+        for block in blocks {
+            _ = AGTestSubgraphReallocBytes(subgraph, block, blockSize, pageSize / 2 + 8)
+        }
+    }
+
+    /// Leaves a free fragment of `size` bytes in the current page of `subgraph` and returns its offset.
+    func freeFragment(_ subgraph: AGTestSubgraphRef, size: UInt32) -> UInt32 {
+        let block = AGTestSubgraphAllocBytes(subgraph, size)
+
+        // keeps the block from growing in place, so growing it moves it and leaves a fragment behind
+        _ = AGTestSubgraphAllocBytes(subgraph, 8)
+        _ = AGTestSubgraphReallocBytes(subgraph, block, size, size + 8)
+
+        return block
+    }
+
+    @Test("Recycling takes a fragment of a suitable size class and keeps what is left of it")
+    func recycleFragment() {
+        let graph = AGTestGraphCreate(Metadata(Int.self), Metadata(Int.self))
+        defer { AGTestGraphDestroy(graph) }
+
+        let subgraph = AGTestSubgraphCreate(graph)
+        defer { AGTestSubgraphDestroy(subgraph) }
+
+        let fragment = freeFragment(subgraph, size: 48)
+        #expect(AGTestSubgraphFreeFragmentCount(subgraph) == 1)
+
+        #expect(AGTestSubgraphAllocBytesRecycle(subgraph, 16) == fragment)
+        #expect(AGTestSubgraphFreeFragmentCount(subgraph) == 1)
+
+        #expect(AGTestSubgraphAllocBytesRecycle(subgraph, 32) == fragment + 16)
+        #expect(AGTestSubgraphFreeFragmentCount(subgraph) == 0)
+    }
+
+    @Test("Recycling keeps small requests away from large fragments")
+    func recycleLargeFragment() {
+        let graph = AGTestGraphCreate(Metadata(Int.self), Metadata(Int.self))
+        defer { AGTestGraphDestroy(graph) }
+
+        let subgraph = AGTestSubgraphCreate(graph)
+        defer { AGTestSubgraphDestroy(subgraph) }
+
+        let fragment = freeFragment(subgraph, size: 200)
+        #expect(AGTestSubgraphFreeFragmentCount(subgraph) == 1)
+
+        // 16 and 32 byte requests only take fragments of up to 64 and 128 bytes
+        #expect(AGTestSubgraphAllocBytesRecycle(subgraph, 16) != fragment)
+        #expect(AGTestSubgraphAllocBytesRecycle(subgraph, 32) != fragment)
+        #expect(AGTestSubgraphFreeFragmentCount(subgraph) == 1)
+
+        #expect(AGTestSubgraphAllocBytesRecycle(subgraph, 64) == fragment)
+    }
+
+    @Test("Compaction releases a page that holds nothing but free fragments")
+    func compactFreePage() {
+        let graph = AGTestGraphCreate(Metadata(Int.self), Metadata(Int.self))
+        defer { AGTestGraphDestroy(graph) }
+
+        let subgraph = AGTestSubgraphCreate(graph)
+        defer { AGTestSubgraphDestroy(subgraph) }
+
+        freeFirstPage(subgraph)
+        #expect(AGTestSubgraphPageCount(subgraph) == 5)
+
+        #expect(AGTestSubgraphCompact(subgraph, UInt32.max) == UInt64(AGTestPageSize()))
+        #expect(AGTestSubgraphPageCount(subgraph) == 4)
+
+        // the pages left all hold something
+        #expect(AGTestSubgraphCompact(subgraph, UInt32.max) == 0)
+    }
+
+    @Test("Compaction with a small budget continues from the page where the last call stopped")
+    func compactInSteps() {
+        let graph = AGTestGraphCreate(Metadata(Int.self), Metadata(Int.self))
+        defer { AGTestGraphDestroy(graph) }
+
+        let subgraph = AGTestSubgraphCreate(graph)
+        defer { AGTestSubgraphDestroy(subgraph) }
+
+        freeFirstPage(subgraph)
+
+        // large pages go in right behind the current page, putting four more in front of the free one
+        for _ in 0..<4 {
+            _ = AGTestSubgraphAllocBytes(subgraph, AGTestPageSize() / 2 + 8)
+        }
+        #expect(AGTestSubgraphPageCount(subgraph) == 9)
+
+        // a budget of five takes all five fragments, but the first call only gets through five of the seven large
+        // pages in front of the free one
+        #expect(AGTestSubgraphCompact(subgraph, 5) == 0)
+        #expect(AGTestSubgraphCompact(subgraph, 5) == UInt64(AGTestPageSize()))
+        #expect(AGTestSubgraphPageCount(subgraph) == 8)
+    }
+
+    @Test("Ending scratch allocations releases everything allocated in the scope")
+    func scratchAllocations() {
+        let graph = AGTestGraphCreate(Metadata(Int.self), Metadata(Int.self))
+        defer { AGTestGraphDestroy(graph) }
+
+        let subgraph = AGTestSubgraphCreate(graph)
+        defer { AGTestSubgraphDestroy(subgraph) }
+
+        _ = AGTestSubgraphAllocBytes(subgraph, 8)
+        #expect(AGTestSubgraphPageCount(subgraph) == 1)
+
+        AGTestSubgraphBeginScratchAllocations(subgraph)
+        let scratch = AGTestSubgraphAllocBytes(subgraph, 8)
+        for _ in 0..<4 {
+            _ = AGTestSubgraphAllocBytes(subgraph, AGTestPageSize() / 2)
+        }
+        _ = AGTestSubgraphAllocBytes(subgraph, AGTestPageSize())
+        #expect(AGTestSubgraphPageCount(subgraph) > 1)
+        AGTestSubgraphEndScratchAllocations(subgraph)
+
+        // the pages are released and the bytes used in the first page are available again
+        #expect(AGTestSubgraphPageCount(subgraph) == 1)
+        #expect(AGTestSubgraphAllocBytes(subgraph, 8) == scratch)
+    }
+
+    @Test("Weak references made in a scratch scope expire when it ends")
+    func scratchAllocationsZoneID() {
+        let graph = AGTestGraphCreate(Metadata(Int.self), Metadata(Int.self))
+        defer { AGTestGraphDestroy(graph) }
+
+        let subgraph = AGTestSubgraphCreate(graph)
+        defer { AGTestSubgraphDestroy(subgraph) }
+
+        let zoneID = AGTestSubgraphZoneID(subgraph)
+
+        AGTestSubgraphBeginScratchAllocations(subgraph)
+        let scratchZoneID = AGTestSubgraphZoneID(subgraph)
+        #expect(scratchZoneID != zoneID)
+        #expect(AGTestZoneIDIsLive(scratchZoneID))
+        #expect(AGTestZoneIDIsLive(zoneID))
+        AGTestSubgraphEndScratchAllocations(subgraph)
+
+        #expect(!AGTestZoneIDIsLive(scratchZoneID))
+        #expect(AGTestZoneIDIsLive(zoneID))
+        #expect(AGTestSubgraphZoneID(subgraph) == zoneID)
+    }
+
+}
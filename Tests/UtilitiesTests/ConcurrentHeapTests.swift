@@ -0,0 +1,47 @@
+import Testing
+import Utilities
+
+@Suite("ConcurrentHeap tests")
+struct ConcurrentHeapTests {
+
+    @Test("Allocating small objects shares a node")
+    func allocateSmallObjects() {
+        let heapPointer = util.ConcurrentHeap.make_shared(0)
+        let heap = heapPointer.pointee
+
+        let first = heap.__alloc_uint64_tUnsafe()
+        let second = heap.__alloc_uint64_tUnsafe()
+
+        #expect(heap.num_nodes() == 1)
+        #expect(second == first + 1)
+    }
+
+    @Test("Allocating large object creates new node")
+    func allocateLargeObject() {
+        let heapPointer = util.ConcurrentHeap.make_shared(0)
+        let heap = heapPointer.pointee
+
+        let _ = heap.__alloc_uint64_tUnsafe()
+        let _ = heap.__alloc_uint64_tUnsafe(500)
+        let _ = heap.__alloc_uint64_tUnsafe()
+
+        // the small objects still share the first node
+        #expect(heap.num_nodes() == 2)
+    }
+
+    @Test("Reset frees all nodes")
+    func reset() {
+        let heapPointer = util.ConcurrentHeap.make_shared(0)
+        let heap = heapPointer.pointee
+
+        let _ = heap.__alloc_uint64_tUnsafe(500)
+        let _ = heap.__alloc_uint64_tUnsafe()
+        heap.reset()
+
+        #expect(heap.num_nodes() == 0)
+
+        let _ = heap.__alloc_uint64_tUnsafe()
+        #expect(heap.num_nodes() == 1)
+    }
+
+}
@@ -0,0 +1,60 @@
+import Testing
+import Utilities
+
+@Suite("FlatTable tests")
+struct FlatTableTests {
+
+    @Test("Initialize empty table")
+    func initEmpty() {
+        let tablePointer = util.UntypedFlatTable.make_shared()
+        let table = tablePointer.pointee
+
+        #expect(table.empty())
+        #expect(table.count() == 0)
+    }
+
+    @Test("Insert and replace entry")
+    func insertEntry() {
+        let tablePointer = util.UntypedFlatTable.make_shared()
+        let table = tablePointer.pointee
+
+        let keys = UnsafeMutablePointer<Int>.allocate(capacity: 2)
+        defer { keys.deallocate() }
+        keys.initialize(repeating: 0, count: 2)
+
+        #expect(table.insert(keys, keys) == true)
+        #expect(table.insert(keys, keys + 1) == false)
+        #expect(table.count() == 1)
+        #expect(table.__lookupUnsafe(keys, nil) == UnsafeRawPointer(keys + 1))
+    }
+
+    @Test("Insert, remove and reinsert many entries")
+    func manyEntries() {
+        let tablePointer = util.UntypedFlatTable.make_shared()
+        let table = tablePointer.pointee
+
+        let count = 10_000
+        let keys = UnsafeMutablePointer<Int>.allocate(capacity: count)
+        defer { keys.deallocate() }
+        keys.initialize(repeating: 0, count: count)
+
+        for i in 0..<count {
+            try! #require(table.insert(keys + i, keys + i))
+        }
+        for i in stride(from: 0, to: count, by: 2) {
+            try! #require(table.remove(keys + i))
+        }
+        #expect(table.count() == count / 2)
+
+        for i in 0..<count {
+            let expected = i % 2 == 0 ? nil : UnsafeRawPointer(keys + i)
+            #expect(table.__lookupUnsafe(keys + i, nil) == expected)
+        }
+
+        for i in stride(from: 0, to: count, by: 2) {
+            try! #require(table.insert(keys + i, keys + i))
+        }
+        #expect(table.count() == count)
+    }
+
+}
@@ -72,4 +72,79 @@ struct HashTableTests {
         }
     }
 
+    @Test("Remove entry while others remain")
+    func removeEntryWhileOthersRemain() {
+        let tablePointer = util.UntypedTable.make_shared()
+        let table = tablePointer.pointee
+
+        let keys = UnsafeMutablePointer<Int>.allocate(capacity: 2)
+        defer { keys.deallocate() }
+        keys.initialize(repeating: 0, count: 2)
+
+        try! #require(table.insert(keys, keys))
+        try! #require(table.insert(keys + 1, keys + 1))
+
+        let removed = table.remove(keys)
+
+        #expect(removed == true)
+        #expect(table.count() == 1)
+        #expect(table.__lookupUnsafe(keys, nil) == nil)
+        #expect(table.__lookupUnsafe(keys + 1, nil) == UnsafeRawPointer(keys + 1))
+    }
+
+    @Test("Grow incrementally")
+    func growIncrementally() {
+        let tablePointer = util.UntypedTable.make_shared()
+        let table = tablePointer.pointee
+        table.set_grows_incrementally(true)
+
+        let count = 10_000
+        let keys = UnsafeMutablePointer<Int>.allocate(capacity: count)
+        defer { keys.deallocate() }
+        keys.initialize(repeating: 0, count: count)
+
+        for i in 0..<count {
+            try! #require(table.insert(keys + i, keys + i))
+
+            // Entries inserted before the last grow may still be in the old buckets
+            #expect(table.__lookupUnsafe(keys + i / 2, nil) == UnsafeRawPointer(keys + i / 2))
+        }
+        for i in stride(from: 0, to: count, by: 2) {
+            try! #require(table.remove(keys + i))
+        }
+
+        #expect(table.count() == count / 2)
+        for i in 0..<count {
+            let expected = i % 2 == 0 ? nil : UnsafeRawPointer(keys + i)
+            #expect(table.__lookupUnsafe(keys + i, nil) == expected)
+        }
+    }
+
+    @Test("Insert entries in bulk")
+    func insertBulk() {
+        let tablePointer = util.UntypedTable.make_shared()
+        let table = tablePointer.pointee
+
+        let count = 1_000
+        let storage = UnsafeMutablePointer<Int>.allocate(capacity: count)
+        defer { storage.deallocate() }
+        storage.initialize(repeating: 0, count: count)
+
+        let keys = (0..<count).map { UnsafeRawPointer(storage + $0) }
+        let values: [UnsafeRawPointer?] = keys
+        table.reserve(UInt64(count))
+
+        let inserted = keys.withUnsafeBufferPointer { keys in
+            values.withUnsafeBufferPointer { values in
+                table.insert_bulk(keys.baseAddress!, values.baseAddress!, UInt64(count))
+            }
+        }
+
+        #expect(inserted == UInt64(count))
+        #expect(table.count() == UInt64(count))
+        for key in keys {
+            #expect(table.__lookup_prehashedUnsafe(key, util.pointer_hash(key), nil) == key)
+        }
+    }
+
 }
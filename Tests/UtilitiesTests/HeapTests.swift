@@ -42,9 +42,74 @@ struct HeapTests {
         // larger than minimum increment
         let _ = heap.__alloc_uint64_tUnsafe(500)
 
-        // data is allocated from second node
+        // data is allocated with its own node, without creating a chunk
+        #expect(heap.num_nodes() == 1)
+        #expect(heap.capacity() == 0)
+    }
+
+    @Test("Allocations that don't fit in a chunk after its node get their own node")
+    func allocateMinimumIncrement() {
+        let heapPointer = util.Heap.make_shared(nil, 0, 0x400)
+        let heap = heapPointer.pointee
+
+        // fits in a 0x400 byte chunk, but not once the chunk's node is allocated from it
+        let pointer = heap.__alloc_uint8_tUnsafe(1020)
+
+        pointer.initialize(repeating: 0xFF, count: 1020)
+        #expect(pointer[1019] == 0xFF)
+        #expect(heap.num_nodes() == 1)
+        #expect(heap.capacity() == 0)
+        #expect(heap.stats().bytes_allocated == 1020 + nodeSize)
+    }
+
+    @Test("Chunks grow geometrically up to the maximum increment")
+    func chunkGrowth() {
+        let heapPointer = util.Heap.make_shared(nil, 0, 0x400)
+        let heap = heapPointer.pointee
+        heap.set_maximum_increment(0x1000)
+
+        // 1000 bytes each, filling chunks of 0x400, 0x800, 0x1000 and 0x1000 bytes with 1, 2, 4 and 1 allocations
+        for _ in 0..<8 {
+            let _ = heap.__alloc_uint64_tUnsafe(125)
+        }
+
+        let stats = heap.stats()
+        #expect(stats.num_nodes == 4)
+        #expect(stats.bytes_reserved == 0x400 + 0x800 + 2 * 0x1000)
+        #expect(stats.bytes_allocated == 8 * 1000 + 4 * nodeSize)
+    }
+
+    @Test("Space left in an earlier chunk is reused")
+    func spareSpaceReuse() {
+        let heapPointer = util.Heap.make_shared(nil, 0, 0x400)
+        let heap = heapPointer.pointee
+
+        // leaves 208 bytes in the first chunk
+        let _ = heap.__alloc_uint64_tUnsafe(100)
+
+        // don't fit in the first chunk, and leave 32 bytes in the second
+        let _ = heap.__alloc_uint64_tUnsafe(125)
+        let _ = heap.__alloc_uint64_tUnsafe(125)
+        #expect(heap.num_nodes() == 2)
+
+        // fits in the rest of the first chunk
+        let _ = heap.__alloc_uint64_tUnsafe(25)
         #expect(heap.num_nodes() == 2)
-        #expect(heap.capacity() == 0x2000 - 2 * nodeSize)
+        #expect(heap.capacity() == 32)
+        #expect(heap.stats().bytes_wasted == 0)
+    }
+
+    @Test("Allocations are aligned for their type")
+    func alignment() {
+        let heapPointer = util.Heap.make_shared(nil, 0, 0)
+        let heap = heapPointer.pointee
+
+        let _ = heap.__alloc_uint8_tUnsafe(3)
+        let pointer = heap.__alloc_uint64_tUnsafe()
+
+        #expect(Int(bitPattern: pointer) % 8 == 0)
+        #expect(heap.capacity() == 0x2000 - nodeSize - 16)
+        #expect(heap.stats().bytes_wasted == 5)
     }
 
 }
@@ -0,0 +1,58 @@
+import Testing
+import Utilities
+
+@Suite("MPSCQueue tests")
+struct MPSCQueueTests {
+
+    @Test("Initialize empty queue")
+    func initEmpty() {
+        let queuePointer = util.UInt64MPSCQueue.make_shared()
+        let queue = queuePointer.pointee
+
+        #expect(queue.empty())
+    }
+
+    @Test("Drain in push order")
+    func drainInOrder() {
+        let queuePointer = util.UInt64MPSCQueue.make_shared()
+        let queue = queuePointer.pointee
+
+        #expect(queue.push(1) == true)
+        #expect(queue.push(2) == false)
+        #expect(queue.push(3) == false)
+
+        let elements = UnsafeMutablePointer<UInt64>.allocate(capacity: 3)
+        defer { elements.deallocate() }
+
+        #expect(queue.drain(elements) == 3)
+        #expect(elements[0] == 1)
+        #expect(elements[1] == 2)
+        #expect(elements[2] == 3)
+        #expect(queue.empty())
+    }
+
+    @Test("Push from several threads")
+    func pushConcurrently() async {
+        let queuePointer = util.UInt64MPSCQueue.make_shared()
+        let queue = queuePointer.pointee
+
+        let producers = 4
+        let count = 1000
+        await withTaskGroup(of: Void.self) { group in
+            for producer in 0..<producers {
+                group.addTask {
+                    for i in 0..<count {
+                        queue.push(UInt64(producer * count + i))
+                    }
+                }
+            }
+        }
+
+        let elements = UnsafeMutablePointer<UInt64>.allocate(capacity: producers * count)
+        defer { elements.deallocate() }
+
+        #expect(queue.drain(elements) == producers * count)
+        #expect(Set(UnsafeBufferPointer(start: elements, count: producers * count)).count == producers * count)
+    }
+
+}